@@ -106,6 +106,10 @@ typedef FLONG ID;
 #define MSG_GROUP_END					0xf0000002
 #define MSG_INTEGER_VALUE				0xf0000003
 
+// set in request id (ID_FRID) by client which wants to send next requests through same connection,
+// without it connection is closed after answer as before
+#define MSG_FRID_KEEP_ALIVE				0x8000000000000000UL
+
 #define FC_QUERY_DEFAULT				0x000f0000
 #define FC_QUERY_SERVICES				(FC_QUERY_DEFAULT)
 #define FC_QUERY_GEOLOC					(FC_QUERY_DEFAULT+1)
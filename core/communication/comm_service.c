@@ -101,7 +101,8 @@ CommService *CommServiceNew( int port, int secured, void *sb, int maxev, int buf
 		service->s_SB = sb;
 		
 		pthread_mutex_init( &service->s_Mutex, NULL );
-		pthread_cond_init( &service->s_DataReceivedCond, NULL );
+		pthread_mutex_init( &service->s_RequestsMutex, NULL );
+		service->s_RequestsNextID = 1;
 	}
 	else
 	{
@@ -125,20 +126,7 @@ void CommServiceDelete( CommService *s )
 	{
 		s->s_Cam.cam_Quit = TRUE;
 		
-		pthread_mutex_lock( &s->s_Mutex );
-
-		CommRequest *cr = s->s_Requests;
-		while( cr != NULL )
-		{
-			cr->cr_Bs = NULL;
-			cr->cr_Time = 0;
-			
-			cr = (CommRequest *) cr->node.mln_Succ;
-		}
-		
-		pthread_cond_broadcast( &s->s_DataReceivedCond );
-		
-		pthread_mutex_unlock( &s->s_Mutex );
+		CommServiceRequestsCancel( s );
 		
 		DEBUG2("[COMMSERV] : Quit set to TRUE, sending signal\n");
 		
@@ -197,7 +185,7 @@ void CommServiceDelete( CommService *s )
 		DEBUG2("[COMMSERV] : pipes closed\n");
 		
 		pthread_mutex_destroy( &s->s_Mutex );
-		pthread_cond_destroy( &s->s_DataReceivedCond );
+		pthread_mutex_destroy( &s->s_RequestsMutex );
 		
 		if( s->s_Buffer )
 		{
@@ -532,12 +520,6 @@ int CommServiceThreadServer( FThread *ptr )
 				
 				if( eventCount == 0 )
 				{
-					if( pthread_mutex_lock( &service->s_Mutex ) == 0 )
-					{
-						pthread_cond_broadcast( &service->s_DataReceivedCond );
-						
-						pthread_mutex_unlock( &service->s_Mutex );
-					}
 					continue;
 				}
 				
@@ -735,21 +717,11 @@ int CommServiceThreadServer( FThread *ptr )
 								{
 									DEBUG("[COMMSERV] Response received!\n");
 									
-									pthread_mutex_lock( &service->s_Mutex );
-									CommRequest *cr = service->s_Requests;
-									while( cr != NULL )
+									// nobody wait for response anymore (timeout), message is dropped
+									if( CommServiceRequestComplete( service, df->df_Size, bs ) != 0 )
 									{
-										DEBUG("[COMMSERV] Going through requests %ld find %ld\n", df->df_Size, cr->cr_RequestID );
-										if( cr->cr_RequestID == df->df_Size )
-										{
-											cr->cr_Bs = bs;
-											DEBUG("[COMMSERV] Message found by id\n");
-											pthread_cond_broadcast( &service->s_DataReceivedCond );
-											break;
-										}
-										cr = (CommRequest *) cr->node.mln_Succ;
+										BufStringDelete( bs );
 									}
-									pthread_mutex_unlock( &service->s_Mutex );
 								}
 								/*
 								else if( df->df_ID == ID_QUER  )
@@ -765,7 +737,11 @@ int CommServiceThreadServer( FThread *ptr )
 										commsg->fccm_Service = service;
 										commsg->fccm_Socket = sock;
 										
-										WorkerManagerRun( lsb->sl_WorkerManager, &ParseCallThread, commsg, NULL );
+										if( WorkerManagerTryRun( lsb->sl_WorkerManager, &ParseCallThread, commsg, NULL ) != 0 )
+										{
+											BufStringDelete( bs );
+											FFree( commsg );
+										}
 									}
 								}*/
 								else if( df->df_ID == ID_FCON )
@@ -85,6 +85,9 @@ enum {
 #define SERVER_NAME_SPLIT_SIGN	'@'
 #define SERVER_PORT_SPLIT_SIGN ':'
 
+#define COMM_REQUEST_TABLE_SIZE	64		// pending requests hash table size
+#define COMM_REQUEST_TIMEOUT	10		// seconds to wait for response
+
 //
 // Message structure
 //
@@ -105,7 +108,10 @@ typedef struct CommRequest
 	BufString						*cr_Bs;
 	time_t 							cr_Time;
 	FULONG							cr_RequestID;
-	MinNode 						node;
+	FQUAD							cr_StartTime;		// ms, used to measure round trip
+	pthread_cond_t					cr_Cond;			// signalled when response arrive or request is cancelled
+	FBOOL							cr_Cancelled;
+	MinNode 						node;				// next request in table slot
 }CommRequest;
 
 //
@@ -213,8 +219,15 @@ typedef struct CommService
 	int 										s_NumberConnections;
 	pthread_mutex_t					s_Mutex;
 	
-	CommRequest						*s_Requests;
-	pthread_cond_t 					s_DataReceivedCond;
+	pthread_mutex_t					s_RequestsMutex;
+	CommRequest						*s_Requests[ COMM_REQUEST_TABLE_SIZE ];	///< pending requests by request id
+	FULONG									s_RequestsNextID;
+	int										s_RequestsInFlight;
+	FULONG									s_RequestsCompleted;
+	FULONG									s_RequestsTimeouts;
+	FULONG									s_RequestsLate;		///< responses received after timeout
+	FQUAD									s_RequestsTimeTotal;	///< round trip time in ms
+	FQUAD									s_RequestsTimeMax;
 	FBOOL									s_Started;			//if thread is started
 }CommService;
 
@@ -309,6 +322,24 @@ int CommServiceThreadServerSelect( FThread *ptr );
 
 BufString *SendMessageAndWait( CommFCConnection *con, DataForm *df );
 
+//
+// pass response to request which wait for it
+//
+
+int CommServiceRequestComplete( CommService *s, FULONG reqid, BufString *bs );
+
+//
+// wake up all requests which wait for response
+//
+
+void CommServiceRequestsCancel( CommService *s );
+
+//
+// get requests statistics
+//
+
+int CommServiceGetStatistics( CommService *s, char *buffer, int size );
+
 //
 //
 //
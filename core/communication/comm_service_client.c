@@ -61,6 +61,124 @@ extern pthread_mutex_t InitMutex;
 
 extern SystemBase *SLIB;
 
+/**
+ * Get current time in milliseconds
+ *
+ * @return time in ms
+ */
+
+static inline FQUAD RequestGetTime( void )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return ( (FQUAD)tv.tv_sec * 1000 ) + ( tv.tv_usec / 1000 );
+}
+
+/**
+ * Remove request from table of pending requests. Function must be called when s_RequestsMutex is locked.
+ *
+ * @param s pointer to CommService
+ * @param reqid request id
+ * @return pointer to removed CommRequest or NULL when request was not found
+ */
+
+static CommRequest *RequestRemove( CommService *s, FULONG reqid )
+{
+	CommRequest **cr = &(s->s_Requests[ reqid % COMM_REQUEST_TABLE_SIZE ]);
+	while( *cr != NULL )
+	{
+		if( (*cr)->cr_RequestID == reqid )
+		{
+			CommRequest *found = *cr;
+			*cr = (CommRequest *)found->node.mln_Succ;
+			found->node.mln_Succ = NULL;
+			s->s_RequestsInFlight--;
+			return found;
+		}
+		cr = (CommRequest **)&((*cr)->node.mln_Succ);
+	}
+	return NULL;
+}
+
+/**
+ * Pass response to request which wait for it
+ *
+ * @param s pointer to CommService
+ * @param reqid request id taken from response
+ * @param bs response, it is released by waiting thread
+ * @return 0 when success, otherwise error number (request was not found, caller must release response)
+ */
+
+int CommServiceRequestComplete( CommService *s, FULONG reqid, BufString *bs )
+{
+	if( pthread_mutex_lock( &s->s_RequestsMutex ) == 0 )
+	{
+		CommRequest *cr = RequestRemove( s, reqid );
+		if( cr != NULL )
+		{
+			DEBUG("[COMMSERV] Message found by id %lu\n", reqid );
+			cr->cr_Bs = bs;
+			pthread_cond_signal( &cr->cr_Cond );
+		}
+		else
+		{
+			DEBUG("[COMMSERV] Response %lu received after timeout\n", reqid );
+			s->s_RequestsLate++;
+		}
+		pthread_mutex_unlock( &s->s_RequestsMutex );
+		
+		return cr != NULL ? 0 : 1;
+	}
+	return 2;
+}
+
+/**
+ * Wake up all requests which wait for response, they return NULL
+ *
+ * @param s pointer to CommService
+ */
+
+void CommServiceRequestsCancel( CommService *s )
+{
+	if( pthread_mutex_lock( &s->s_RequestsMutex ) == 0 )
+	{
+		int i;
+		for( i = 0; i < COMM_REQUEST_TABLE_SIZE; i++ )
+		{
+			CommRequest *cr;
+			while( ( cr = s->s_Requests[ i ] ) != NULL )
+			{
+				RequestRemove( s, cr->cr_RequestID );
+				cr->cr_Cancelled = TRUE;
+				pthread_cond_signal( &cr->cr_Cond );
+			}
+		}
+		pthread_mutex_unlock( &s->s_RequestsMutex );
+	}
+}
+
+/**
+ * Get requests statistics
+ *
+ * @param s pointer to CommService
+ * @param buffer pointer to buffer where statistics in JSON format will be stored
+ * @param size size of buffer
+ * @return length of string stored in buffer
+ */
+
+int CommServiceGetStatistics( CommService *s, char *buffer, int size )
+{
+	int len = 0;
+	if( pthread_mutex_lock( &s->s_RequestsMutex ) == 0 )
+	{
+		len = snprintf( buffer, size, "{\"inflight\":%d,\"completed\":%lu,\"timeouts\":%lu,\"late\":%lu,\"avgtime\":%lld,\"maxtime\":%lld}",
+			s->s_RequestsInFlight, s->s_RequestsCompleted, s->s_RequestsTimeouts, s->s_RequestsLate,
+			s->s_RequestsCompleted > 0 ? s->s_RequestsTimeTotal / (FQUAD)s->s_RequestsCompleted : 0LL, s->s_RequestsTimeMax );
+		pthread_mutex_unlock( &s->s_RequestsMutex );
+	}
+	return len;
+}
+
 /**
  * Send message via CommunicationService and wait+read response
  *
@@ -81,146 +199,112 @@ BufString *SendMessageAndWait( CommFCConnection *con, DataForm *df )
 	}
 	DEBUG("[SendMessageAndWait] SendMessageAndWait alloc memory\n");
 	CommRequest *cr = FCalloc( 1, sizeof( CommRequest ) );
-	if( cr != NULL )
-	{
-		cr->cr_Time = time( NULL );
-		cr->cr_RequestID = (FULONG)cr;
-		cr->cr_Df = df;
-		
-		char *ridbytes = (char *) df;// (DataForm *)(((char *)df) + (6*sizeof(FULONG)) + df[ 1 ].df_Size);
-		ridbytes += COMM_MSG_HEADER_SIZE;
-		DataForm *rid = (DataForm *)ridbytes;
-		if( rid->df_ID == ID_FCID )
-		{
-			DEBUG("[SendMessageAndWait]  found fcid, tag size %lu\n", rid->df_Size );
-			int size = COMM_MSG_HEADER_SIZE + FRIEND_CORE_MANAGER_ID_SIZE;
-			ridbytes += size;
-		}
-		rid = (DataForm *)ridbytes;
-		rid->df_Size = (FULONG)cr;		// pointer is our request id
-		DEBUG2("[SendMessageAndWait] Request ID set to %lu base %lu\n", rid->df_Size, cr->cr_RequestID );
-	}
-	else
+	if( cr == NULL )
 	{
 		FERROR("Cannot allocate memory for request!\n");
 		return NULL;
 	}
 	
-	DEBUG("[SendMessageAndWait] SendMessageAndWait before lock\n");
-	if( pthread_mutex_lock( &serv->s_Mutex ) == 0 )
+	cr->cr_Time = time( NULL );
+	cr->cr_StartTime = RequestGetTime();
+	cr->cr_Df = df;
+	pthread_cond_init( &cr->cr_Cond, NULL );
+	
+	// register request before message is sent, response can arrive before we start to wait
+	if( pthread_mutex_lock( &serv->s_RequestsMutex ) == 0 )
 	{
-		DEBUG("[SendMessageAndWait] SendMessageAndWait add entry to list\n");
-		if( serv->s_Requests == NULL )
+		cr->cr_RequestID = serv->s_RequestsNextID++;
+		if( cr->cr_RequestID == 0 )
 		{
-			serv->s_Requests = cr;
+			cr->cr_RequestID = serv->s_RequestsNextID++;
 		}
-		else
-		{
-			DEBUG("[SendMessageAndWait] Pointer %p\n", serv->s_Requests );
-			serv->s_Requests->node.mln_Pred = (MinNode *)cr;
-			cr->node.mln_Succ = (MinNode *)serv->s_Requests;
-			serv->s_Requests = cr;
-		}
-		pthread_mutex_unlock( &serv->s_Mutex );
+		
+		CommRequest **slot = &(serv->s_Requests[ cr->cr_RequestID % COMM_REQUEST_TABLE_SIZE ]);
+		cr->node.mln_Succ = (MinNode *)*slot;
+		*slot = cr;
+		serv->s_RequestsInFlight++;
+		pthread_mutex_unlock( &serv->s_RequestsMutex );
 	}
 	else
 	{
 		FERROR("Cannot lock mutex!\n");
+		pthread_cond_destroy( &cr->cr_Cond );
 		FFree( cr ); 
 		return NULL;
 	}
 	
+	char *ridbytes = (char *) df;// (DataForm *)(((char *)df) + (6*sizeof(FULONG)) + df[ 1 ].df_Size);
+	ridbytes += COMM_MSG_HEADER_SIZE;
+	DataForm *rid = (DataForm *)ridbytes;
+	if( rid->df_ID == ID_FCID )
+	{
+		DEBUG("[SendMessageAndWait]  found fcid, tag size %lu\n", rid->df_Size );
+		int size = COMM_MSG_HEADER_SIZE + FRIEND_CORE_MANAGER_ID_SIZE;
+		ridbytes += size;
+	}
+	rid = (DataForm *)ridbytes;
+	rid->df_Size = cr->cr_RequestID;
+	DEBUG2("[SendMessageAndWait] Request ID set to %lu\n", rid->df_Size );
+	
 	DEBUG("[SendMessageAndWait] Before sending message lock\n");
 	
+	int size = -1;
 	if( pthread_mutex_lock( &con->cfcc_Mutex ) == 0 )
 	{
 		DEBUG("[SendMessageAndWait] mutex locked\n");
 		SocketSetBlocking( con->cfcc_Socket, TRUE );
 	
 		// send request
-		int size = SocketWrite( con->cfcc_Socket, (char *)df, (FQUAD)df->df_Size );
+		size = SocketWrite( con->cfcc_Socket, (char *)df, (FQUAD)df->df_Size );
 		pthread_mutex_unlock( &con->cfcc_Mutex );
 	}
-	else
-	{
-		FFree( cr ); 
-		return NULL;
-	}
 	
 	// wait for answer
 	
-	FBOOL quit = FALSE;
-	while( quit != TRUE )
+	struct timespec deadline;
+	clock_gettime( CLOCK_REALTIME, &deadline );
+	deadline.tv_sec += COMM_REQUEST_TIMEOUT;
+	
+	if( pthread_mutex_lock( &serv->s_RequestsMutex ) == 0 )
 	{
 		DEBUG("[SendMessageAndWait] SendMessageAndWait waiting for condition\n");
-		if( pthread_mutex_lock( &serv->s_Mutex ) == 0 )
+		while( size > 0 && cr->cr_Bs == NULL && cr->cr_Cancelled == FALSE )
 		{
-			DEBUG("[SendMessageAndWait] SendMessageAndWait Setup condition\n");
-			pthread_cond_wait( &serv->s_DataReceivedCond, &serv->s_Mutex );
-			pthread_mutex_unlock( &serv->s_Mutex );
+			if( pthread_cond_timedwait( &cr->cr_Cond, &serv->s_RequestsMutex, &deadline ) == ETIMEDOUT )
+			{
+				break;
+			}
 		}
-		else break;
-
-		DEBUG( "[SendMessageAndWait] Condition met, now going on\n!" );
-		time_t acttime = time( NULL );
-		if( ( acttime - cr->cr_Time ) > 10 || cr->cr_Bs != NULL )
+		
+		bs = cr->cr_Bs;
+		
+		// response did not arrive, late one will be dropped by receiver
+		if( bs == NULL )
 		{
-		/*
-			FERROR("Message was not received, timeout!\n");
-			break;
+			RequestRemove( serv, cr->cr_RequestID );
+			if( size > 0 && cr->cr_Cancelled == FALSE )
+			{
+				FERROR("[SendMessageAndWait] Message was not received, timeout!\n");
+				serv->s_RequestsTimeouts++;
+			}
 		}
 		else
 		{
-			*/
-			// remove entry from list
-			DEBUG("[SendMessageAndWait] SendMessageAndWait message : time %lu  cr_bs ptr %p\n", (unsigned long)( acttime - cr->cr_Time ), cr->cr_Bs );
-			bs = cr->cr_Bs;
-			quit = TRUE;
-
-			if( pthread_mutex_lock( &serv->s_Mutex ) == 0 )
+			FQUAD rtt = RequestGetTime() - cr->cr_StartTime;
+			serv->s_RequestsCompleted++;
+			serv->s_RequestsTimeTotal += rtt;
+			if( rtt > serv->s_RequestsTimeMax )
 			{
-				DEBUG("[SendMessageAndWait] Remove Socket entry from list\n");
-				if( cr == serv->s_Requests )
-				{
-					CommRequest *next = (CommRequest *)serv->s_Requests->node.mln_Succ;
-					if( next != NULL )
-					{
-						next->node.mln_Pred = (MinNode *)NULL;
-						serv->s_Requests = next;
-					}
-					else
-					{
-						serv->s_Requests = NULL;
-					}
-				}
-				else
-				{
-					CommRequest *next = (CommRequest *)cr->node.mln_Succ;
-					CommRequest *prev = (CommRequest *)cr->node.mln_Pred;
-					if( next != NULL )
-					{
-						prev->node.mln_Pred = (MinNode *)prev;
-						prev->node.mln_Succ = (MinNode *)next;
-					}
-					else
-					{
-						if( prev != NULL )
-						{
-							prev->node.mln_Succ = (MinNode *)NULL;
-						}
-					}
-				}
-				if( cr != NULL )
-				{
-					FFree( cr );
-					cr = NULL;
-				}
-				pthread_mutex_unlock( &serv->s_Mutex );
+				serv->s_RequestsTimeMax = rtt;
 			}
-			break;
+			DEBUG("[SendMessageAndWait] SendMessageAndWait message : time %lld ms  cr_bs ptr %p\n", rtt, cr->cr_Bs );
 		}
+		pthread_mutex_unlock( &serv->s_RequestsMutex );
 	}
 	
+	pthread_cond_destroy( &cr->cr_Cond );
+	FFree( cr );
+	
 	DEBUG( "[SendMessageAndWait] SendMessageAndWait Done with sending, returning\n" );
 	
 	return bs;
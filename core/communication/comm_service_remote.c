@@ -56,6 +56,7 @@
 
 #define FLAGS S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH
 #define MAX_MSG 50
+#define CSR_MAX_MESSAGES_PER_EVENT 16	// messages read from one connection before other events are handled
 
 /**
  * Create remote communication service
@@ -909,115 +910,152 @@ int CommServiceRemoteThreadServer( FThread *ptr )
 					}
 					else
 					{
-						// Remove event // not persistent connection
-						epoll_ctl( service->csr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
-						
 						FBYTE *tempBuffer = NULL;
 						int tempSize = 0;
 						DEBUG("[CommServiceRemote] Wait for message on socket\n");
 						
-						//SocketSetBlocking( sock, TRUE );
+						// connection stay open while client asks for it and messages are answered with size in header,
+						// streamed answer, error or request without keep alive flag ends connection
+						FBOOL keepConnection = TRUE;
 						
-						BufString *bs = NULL;
-						if( sock != NULL )
+						// edge triggered event can be delivered for message which was already processed
+						// together with previous one
+						if( sock != NULL && SocketHasData( sock ) == FALSE )
 						{
-							//bs = SocketReadPackage( sock );
-							bs = SocketReadTillEnd( sock, 0, 15 );
+							continue;
 						}
-						else
-						{
-							FERROR("Sock == NULL!\n");
-						}
-						if( bs != NULL )
+						
+						// client can send next requests without waiting for answers, they are processed here,
+						// but not more than CSR_MAX_MESSAGES_PER_EVENT, so one client cannot hold the thread
+						int processed = 0;
+						do
 						{
-							count = (int)bs->bs_Size;
+							keepConnection = FALSE;
+							BufString *bs = NULL;
+							if( sock != NULL )
+							{
+								bs = SocketReadDataForm( sock, 15, NULL );
+							}
+							else
+							{
+								FERROR("Sock == NULL!\n");
+							}
+							if( bs != NULL )
+							{
+								count = (int)bs->bs_Size;
 							
-							DEBUG2("[CommServiceRemote] PROCESSING RECEIVED CALL, DATA READED %d\n", (int)count );
-							int dcount = count;
-							DataForm *df = (DataForm *)bs->bs_Buffer;
+								DEBUG2("[CommServiceRemote] PROCESSING RECEIVED CALL, DATA READED %d\n", (int)count );
+								int dcount = count;
+								DataForm *df = (DataForm *)bs->bs_Buffer;
 							
-							// checking if its FRIEND message
+								// checking if its FRIEND message
 							
-							int j = 0;
-							if( df->df_ID == ID_FCRE && count > 24 )
-							{
-								char *id = (char *)&(df[ 2 ].df_ID);
+								int j = 0;
+								if( df->df_ID == ID_FCRE && count > 24 )
+								{
+									char *id = (char *)&(df[ 2 ].df_ID);
 
-								//DEBUG2("[CommServiceRemote] ID POS 2 %lu ID_RESP %lu ID_QUERY %lu   ID %c %c %c %c\n", df[ 2 ].df_ID, ID_RESP, ID_QUER, id[0], id[1], id[2], id[3] );
+									//DEBUG2("[CommServiceRemote] ID POS 2 %lu ID_RESP %lu ID_QUERY %lu   ID %c %c %c %c\n", df[ 2 ].df_ID, ID_RESP, ID_QUER, id[0], id[1], id[2], id[3] );
 								
-								if( df[ 2 ].df_ID == ID_QUER )
-								{
-									// checking if its a request or response
-									//if( count >= (ssize_t)df->df_Size )
+									if( df[ 2 ].df_ID == ID_QUER )
+									{
+										// checking if its a request or response
+										//if( count >= (ssize_t)df->df_Size )
 									
-									// we received whole data
-									// Process data
-									DataForm *recvDataForm = NULL;
-									FBOOL isStream = FALSE;
+										// we received whole data
+										// Process data
+										DataForm *recvDataForm = NULL;
+										FBOOL isStream = FALSE;
 									
-									DEBUG("[CommServiceRemote] All data received, processing bytes %d-------------------------------------------PROCESSING ANSWER\n", dcount );
+										DEBUG("[CommServiceRemote] All data received, processing bytes %d-------------------------------------------PROCESSING ANSWER\n", dcount );
 									
-									recvDataForm = ParseMessageCSR( service, sock, (FBYTE *)bs->bs_Buffer, (int *)&dcount, &isStream );
+										recvDataForm = ParseMessageCSR( service, sock, (FBYTE *)bs->bs_Buffer, (int *)&dcount, &isStream );
 									
-									DEBUG2("[CommServiceRemote] Data processed-----------------------------------------\n");
+										DEBUG2("[CommServiceRemote] Data processed-----------------------------------------\n");
 									
-									// return information
-									if( recvDataForm != NULL )
-									{
-										DEBUG2("[CommServiceRemote] Data received-----------------------------------------%lu\n", recvDataForm->df_Size);
-
-										int wrote = 0;
+										// old clients read answer till end of connection, so it stays open only when client asked for it
+										FBOOL clientKeepAlive = ( count >= (int)(3*COMM_MSG_HEADER_SIZE) && df[ 1 ].df_ID == ID_FRID && ( df[ 1 ].df_Size & MSG_FRID_KEEP_ALIVE ) );
 										
-										if( isStream == FALSE )
+										// return information
+										if( recvDataForm != NULL )
 										{
-											wrote = SocketWrite( sock, (char *)recvDataForm, (FQUAD)recvDataForm->df_Size );
-										}
-										DEBUG2("[CommServiceRemote] Wrote bytes %d\n", wrote );
+											DEBUG2("[CommServiceRemote] Data received-----------------------------------------%lu\n", recvDataForm->df_Size);
+
+											int wrote = 0;
 										
-										// remove data form
-										DataFormDelete( recvDataForm );
-										BufStringDelete( bs );
-									}
-									else
-									{
-										// prepare asnwer
-										// everything goes well - no response
+											if( isStream == FALSE )
+											{
+												wrote = SocketWrite( sock, (char *)recvDataForm, (FQUAD)recvDataForm->df_Size );
+												keepConnection = ( clientKeepAlive && wrote == (int)recvDataForm->df_Size );
+											}
+											DEBUG2("[CommServiceRemote] Wrote bytes %d\n", wrote );
+										
+											// remove data form
+											DataFormDelete( recvDataForm );
+											BufStringDelete( bs );
+										}
+										else
+										{
+											// prepare asnwer
+											// everything goes well - no response
 										
-										DataForm *tmpfrm = DataFormNew( NULL );
+											DataForm *tmpfrm = DataFormNew( NULL );
 										
-										FBYTE tdata[ 20 ];
-										FULONG *tdatau = (FULONG *)tdata;
-										tdatau[ 0 ] = ID_RPOK;
-										tdatau[ 1 ] = 20;
-										strcpy( (char *)&tdata[ 8 ], "No response" );
-										DataFormAdd( &tmpfrm, tdata, 20 );
+											FBYTE tdata[ 20 ];
+											FULONG *tdatau = (FULONG *)tdata;
+											tdatau[ 0 ] = ID_RPOK;
+											tdatau[ 1 ] = 20;
+											strcpy( (char *)&tdata[ 8 ], "No response" );
+											DataFormAdd( &tmpfrm, tdata, 20 );
 										
-										DEBUG2("[CommServiceRemote] Service, send message to socket, size %lu\n", tmpfrm->df_Size );
+											DEBUG2("[CommServiceRemote] Service, send message to socket, size %lu\n", tmpfrm->df_Size );
 										
-										SocketWrite( sock, (char *)tmpfrm, (FQUAD)tmpfrm->df_Size );
+											int wrote = SocketWrite( sock, (char *)tmpfrm, (FQUAD)tmpfrm->df_Size );
+											keepConnection = ( clientKeepAlive && wrote == (int)tmpfrm->df_Size );
 										
-										DataFormDelete( tmpfrm );
+											DataFormDelete( tmpfrm );
+											BufStringDelete( bs );
+										}
+									}
+									else if( df[ 2 ].df_ID == ID_FCON )
+									{
+										INFO("[CommServiceRemote] New connection was set\n");
+										BufStringDelete( bs );
+									}
+									else
+									{
+										FERROR("[CommServiceRemote] Message uknown!\n");
+										BufStringDelete( bs );
+									}
+
+									if( tempBuffer != NULL )
+									{
+										FFree( tempBuffer );
+										tempBuffer = NULL;
 									}
-								}
-								else if( df[ 2 ].df_ID == ID_FCON )
-								{
-									INFO("[CommServiceRemote] New connection was set\n");
-									BufStringDelete( bs );
 								}
 								else
 								{
-									FERROR("[CommServiceRemote] Message uknown!\n");
 									BufStringDelete( bs );
 								}
-
-								if( tempBuffer != NULL )
-								{
-									FFree( tempBuffer );
-									tempBuffer = NULL;
-								}
 							}
 						}
-						SocketClose( sock );
+						while( keepConnection == TRUE && ++processed < CSR_MAX_MESSAGES_PER_EVENT && SocketHasData( sock ) == TRUE );
+						
+						if( keepConnection == FALSE )
+						{
+							epoll_ctl( service->csr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+							SocketClose( sock );
+						}
+						else if( processed >= CSR_MAX_MESSAGES_PER_EVENT && SocketHasData( sock ) == TRUE )
+						{
+							// edge triggered event will not come again for data which is already waiting,
+							// modification puts connection back into ready list after other events
+							struct epoll_event event;
+							event.data.ptr = (void *) sock;
+							event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+							epoll_ctl( service->csr_Epollfd, EPOLL_CTL_MOD, sock->fd, &event );
+						}
 					}
 				}//end for through events
 			} //end while
@@ -181,21 +181,10 @@ int CommServiceThreadConnection( FThread *ptr )
 					{
 						DEBUG("[COMMSERV-s] Response received!\n");
 						
-						pthread_mutex_lock( &service->s_Mutex );
-						CommRequest *cr = service->s_Requests;
-						while( cr != NULL )
+						if( CommServiceRequestComplete( service, df[ 1 ].df_Size, bs ) != 0 )
 						{
-							DEBUG("[COMMSERV-s] Going through requests %ld find %ld\n", df[ 1 ].df_Size, cr->cr_RequestID );
-							if( cr->cr_RequestID == df[ 1 ].df_Size )
-							{
-								cr->cr_Bs = bs;
-								DEBUG("[COMMSERV-s] Message found by id\n");
-								pthread_cond_broadcast( &service->s_DataReceivedCond );
-								break;
-							}
-							cr = (CommRequest *) cr->node.mln_Succ;
+							BufStringDelete( bs );
 						}
-						pthread_mutex_unlock( &service->s_Mutex );
 					}
 					else if( df[ 2 ].df_ID == ID_QUER )
 					{
@@ -79,17 +79,19 @@ typedef struct Event
 
 typedef struct CoreEvent
 {
-	struct MinNode	node;
-	time_t					ce_Time;
-	time_t					ce_TimeDelta;
+	struct CoreEvent		*ce_WheelNext;		// next event in timer wheel slot
+	struct CoreEvent		**ce_WheelPrev;		// pointer to field which points to this event, NULL when event is not in wheel
+	FQUAD					ce_Time;			// when event will be called (milliseconds, monotonic clock)
+	FQUAD					ce_TimeDelta;		// repeat interval (milliseconds)
 	int 					ce_RepeatTime;		// -1 repeat everytime, 0 - last repeat, n - number of repeats
 	FUQUAD 					ce_ID;
 	
-	pthread_t				ce_Thread;
-	FBOOL					ce_Quit;
+	FBOOL					ce_Quit;			// event was cancelled while it was running
 	FBOOL					ce_Launched;
 	int						(*ce_Function)( void *sb );
 	void					*ce_Data;
+	void					*ce_Manager;		// EventManager which owns event
+	struct CoreEvent		*ce_RunNext;		// next event on list of events passed to workers
 }CoreEvent;
 
 
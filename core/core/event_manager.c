@@ -25,7 +25,8 @@
  *
  *  Events are the counterpart of workers. They provide a mechanism to send
  *  delayed or repeated messages to Friend Code elements.
- *  This system is not used in the current version of Friend Core.
+ *  Events are kept in hierarchical timer wheel with millisecond resolution,
+ *  event thread sleeps until next deadline and passes due events to workers.
  *
  *  @author PS (Pawel Stefanski)
  *  @date first pushed on 10/02/2015
@@ -39,11 +40,230 @@
 #include <core/thread.h>
 #include <time.h>
 #include <unistd.h>
+#include <system/systembase.h>
 
 void *EventManagerLoopThread( FThread *ptr );
 
+//
+// longest sleep of event thread when there are no events (milliseconds)
+//
+
+#define EVENT_SLEEP_MAX		60000
+
+/**
+ * Get current time from monotonic clock
+ *
+ * @return time in milliseconds
+ */
+static inline FQUAD EventNow( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( (FQUAD)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+/**
+ * Put event into timer wheel slot, slot is selected by distance between event time and current wheel time.
+ * Must be called with em_Mutex locked.
+ *
+ * @param em pointer to the EventManager structure
+ * @param ev pointer to event
+ */
+static void WheelInsert( EventManager *em, CoreEvent *ev )
+{
+	FQUAD expires = ev->ce_Time;
+	int level = 0;
+	
+	if( expires < em->em_WheelTime )
+	{
+		expires = em->em_WheelTime;
+	}
+	
+	while( level < EVENT_WHEEL_LEVELS-1 && ( expires - em->em_WheelTime ) >= ( (FQUAD)1 << ( EVENT_WHEEL_BITS * ( level + 1 ) ) ) )
+	{
+		level++;
+	}
+	
+	// event is too far, it will be inserted again when it leaves wheel
+	if( ( expires - em->em_WheelTime ) >= ( (FQUAD)1 << ( EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS ) ) )
+	{
+		expires = em->em_WheelTime + ( (FQUAD)1 << ( EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS ) ) - 1;
+	}
+	
+	CoreEvent **slot = &(em->em_Wheel[ level ][ ( expires >> ( EVENT_WHEEL_BITS * level ) ) & EVENT_WHEEL_MASK ]);
+	
+	ev->ce_WheelNext = *slot;
+	if( *slot != NULL )
+	{
+		(*slot)->ce_WheelPrev = &(ev->ce_WheelNext);
+	}
+	ev->ce_WheelPrev = slot;
+	*slot = ev;
+}
+
+/**
+ * Remove event from timer wheel. Must be called with em_Mutex locked.
+ *
+ * @param ev pointer to event
+ */
+static void WheelRemove( CoreEvent *ev )
+{
+	if( ev->ce_WheelPrev != NULL )
+	{
+		*(ev->ce_WheelPrev) = ev->ce_WheelNext;
+		if( ev->ce_WheelNext != NULL )
+		{
+			ev->ce_WheelNext->ce_WheelPrev = ev->ce_WheelPrev;
+		}
+		ev->ce_WheelNext = NULL;
+		ev->ce_WheelPrev = NULL;
+	}
+}
 
-static int threadsNo = 0;
+/**
+ * Move events from slot of higher level to lower levels. Must be called with em_Mutex locked.
+ *
+ * @param em pointer to the EventManager structure
+ * @param level wheel level
+ * @param index slot index
+ * @return slot index
+ */
+static int WheelCascade( EventManager *em, int level, int index )
+{
+	CoreEvent *ev = em->em_Wheel[ level ][ index ];
+	em->em_Wheel[ level ][ index ] = NULL;
+	
+	while( ev != NULL )
+	{
+		CoreEvent *next = ev->ce_WheelNext;
+		ev->ce_WheelPrev = NULL;
+		WheelInsert( em, ev );
+		ev = next;
+	}
+	return index;
+}
+
+/**
+ * Find first tick when wheel has something to do (call event or move events from higher level).
+ * Must be called with em_Mutex locked.
+ *
+ * @param em pointer to the EventManager structure
+ * @return tick in milliseconds
+ */
+static FQUAD WheelNext( EventManager *em )
+{
+	FQUAD next = em->em_WheelTime + EVENT_SLEEP_MAX;
+	int i, level;
+	
+	for( i=0 ; i < EVENT_WHEEL_SLOTS ; i++ )
+	{
+		if( em->em_Wheel[ 0 ][ ( em->em_WheelTime + i ) & EVENT_WHEEL_MASK ] != NULL )
+		{
+			next = em->em_WheelTime + i;
+			break;
+		}
+	}
+	
+	for( level=1 ; level < EVENT_WHEEL_LEVELS ; level++ )
+	{
+		FQUAD base = em->em_WheelTime >> ( EVENT_WHEEL_BITS * level );
+		
+		// slot of current block is moved down at next tick when wheel time is at block start, otherwise after full turn
+		i = ( em->em_WheelTime & ( ( (FQUAD)1 << ( EVENT_WHEEL_BITS * level ) ) - 1 ) ) == 0 ? 0 : 1;
+		for( ; i <= EVENT_WHEEL_SLOTS ; i++ )
+		{
+			if( em->em_Wheel[ level ][ ( base + i ) & EVENT_WHEEL_MASK ] != NULL )
+			{
+				FQUAD cascade = ( base + i ) << ( EVENT_WHEEL_BITS * level );
+				if( cascade < next )
+				{
+					next = cascade;
+				}
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+/**
+ * Process one wheel tick. Due events are put on run list, repeated events are inserted again.
+ * Must be called with em_Mutex locked.
+ *
+ * @param em pointer to the EventManager structure
+ * @param now current time in milliseconds
+ * @param run pointer to list of events which must be called
+ */
+static void WheelTick( EventManager *em, FQUAD now, CoreEvent **run )
+{
+	FQUAD tick = em->em_WheelTime;
+	int index = tick & EVENT_WHEEL_MASK;
+	
+	if( index == 0 )
+	{
+		int level = 1;
+		while( level < EVENT_WHEEL_LEVELS && WheelCascade( em, level, ( tick >> ( EVENT_WHEEL_BITS * level ) ) & EVENT_WHEEL_MASK ) == 0 )
+		{
+			level++;
+		}
+	}
+	
+	CoreEvent *ev = em->em_Wheel[ 0 ][ index ];
+	em->em_Wheel[ 0 ][ index ] = NULL;
+	em->em_WheelTime = tick + 1;
+	
+	while( ev != NULL )
+	{
+		CoreEvent *next = ev->ce_WheelNext;
+		ev->ce_WheelNext = NULL;
+		ev->ce_WheelPrev = NULL;
+		
+		if( ev->ce_Time > tick )	// event was too far for wheel
+		{
+			WheelInsert( em, ev );
+			ev = next;
+			continue;
+		}
+		
+		FBOOL repeat = TRUE;
+		if( ev->ce_RepeatTime == 0 || ev->ce_TimeDelta <= 0 )	// last call
+		{
+			repeat = FALSE;
+		}
+		else if( ev->ce_RepeatTime > 0 )
+		{
+			ev->ce_RepeatTime--;
+		}
+		
+		if( ev->ce_Launched == FALSE )
+		{
+			ev->ce_Launched = TRUE;
+			em->em_Running++;
+			ev->ce_RunNext = *run;
+			*run = ev;
+		}
+		else
+		{
+			DEBUG("[EventManager] Event %llu is still running, call skipped\n", ev->ce_ID );
+			if( repeat == FALSE )
+			{
+				ev->ce_Quit = TRUE;		// will be released when current call ends
+			}
+		}
+		
+		if( repeat == TRUE )
+		{
+			ev->ce_Time += ev->ce_TimeDelta;
+			if( ev->ce_Time <= now )	// calls which were missed are not repeated
+			{
+				ev->ce_Time = now + ev->ce_TimeDelta;
+			}
+			WheelInsert( em, ev );
+		}
+		
+		ev = next;
+	}
+}
 
 /**
  * Creates a new Event Manager structure and launches its thread
@@ -56,8 +276,20 @@ EventManager *EventManagerNew( void *sb )
 	DEBUG("[EventManager] start\n");
 	if( em != NULL )
 	{
+		pthread_condattr_t attr;
+		
 		em->lastID = 0xf;
 		em->em_SB = sb;
+		
+		pthread_mutex_init( &(em->em_Mutex), NULL );
+		pthread_condattr_init( &attr );
+		pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+		pthread_cond_init( &(em->em_Cond), &attr );
+		pthread_condattr_destroy( &attr );
+		
+		em->em_WheelTime = EventNow();
+		em->em_WakeTime = em->em_WheelTime;
+		
 		em->em_EventThread = ThreadNew( EventManagerLoopThread, em, TRUE, NULL );
 	}
 	else
@@ -79,18 +311,22 @@ void EventManagerDelete( EventManager *em )
 	// remove long time events
 	if( em != NULL )
 	{
-		em->em_EventThread->t_Quit = TRUE;
-		while( TRUE )
+		if( em->em_EventThread != NULL )
 		{
-			if( em->em_EventThread->t_Launched == FALSE )
+			em->em_EventThread->t_Quit = TRUE;
+			pthread_mutex_lock( &(em->em_Mutex) );
+			pthread_cond_signal( &(em->em_Cond) );
+			pthread_mutex_unlock( &(em->em_Mutex) );
+			
+			while( TRUE )
 			{
-				break;
+				if( em->em_EventThread->t_Launched == FALSE )
+				{
+					break;
+				}
+				usleep( 5000 );
 			}
-			usleep( 5000 );
-		}
-		
-		if( em->em_EventThread != NULL )
-		{
+			
 			DEBUG("[EventManager] Delete thread\n");
 			ThreadDelete( em->em_EventThread );
 		}
@@ -100,23 +336,37 @@ void EventManagerDelete( EventManager *em )
 		
 		while( TRUE )
 		{
-			if( threadsNo <= 0 )
+			pthread_mutex_lock( &(em->em_Mutex) );
+			int running = em->em_Running;
+			pthread_mutex_unlock( &(em->em_Mutex) );
+			
+			if( running <= 0 )
 			{
 				break;
 			}
-			DEBUG("[EventManager] Not all threads were closed properly, waiting. ThreadsNo: %d\n", threadsNo );
+			DEBUG("[EventManager] Not all events were finished, waiting. Running: %d\n", running );
 			usleep( 500 );
 		}
 		
-		CoreEvent *locnce = em->em_EventList;
-		while( locnce != NULL )
+		int level, index;
+		for( level=0 ; level < EVENT_WHEEL_LEVELS ; level++ )
 		{
-			CoreEvent *rem = locnce;
-			locnce = (CoreEvent *)locnce->node.mln_Succ;
+			for( index=0 ; index < EVENT_WHEEL_SLOTS ; index++ )
+			{
+				CoreEvent *locnce = em->em_Wheel[ level ][ index ];
+				while( locnce != NULL )
+				{
+					CoreEvent *rem = locnce;
+					locnce = locnce->ce_WheelNext;
 
-			FFree( rem );
+					FFree( rem );
+				}
+			}
 		}
 		
+		pthread_cond_destroy( &(em->em_Cond) );
+		pthread_mutex_destroy( &(em->em_Mutex) );
+		
 		FFree( em );
 	}
 	DEBUG("[EventManager] Delete end\n");
@@ -135,117 +385,151 @@ FUQUAD EventGetNewID( EventManager *em )
 }
 
 /**
- * Launches a new event
+ * Call event function, called by worker
  *
- * @param ptr pointer to the FThread structure of the Friend thread to send the event to
+ * @param data pointer to CoreEvent
  */
-void EventLaunch( CoreEvent *ptr )
+static void EventLaunch( void *data )
 {
-	pthread_detach( pthread_self() );
-	ptr->ce_Launched = TRUE;
-	threadsNo++;
+	CoreEvent *ev = (CoreEvent *)data;
+	EventManager *em = (EventManager *)ev->ce_Manager;
 	
-	if( ptr->ce_Function != NULL )
+	if( ev->ce_Function != NULL )
 	{
-		ptr->ce_Function( ptr->ce_Data );
+		ev->ce_Function( ev->ce_Data );
 	}
 	
-	threadsNo--;
-	ptr->ce_Launched = FALSE;
+	pthread_mutex_lock( &(em->em_Mutex) );
+	ev->ce_Launched = FALSE;
+	em->em_Running--;
 	
-	pthread_exit( 0 );
+	// event is not in wheel when it was called last time or it was cancelled
+	if( ev->ce_Quit == TRUE || ev->ce_WheelPrev == NULL )
+	{
+		WheelRemove( ev );
+		FFree( ev );
+	}
+	pthread_mutex_unlock( &(em->em_Mutex) );
 }
 
-//
-// wait thread
-//
-
-#define WAIT_SECOND 1						 //< Maximum wait time
-#define WAIT_SECOND_1m 1000000 //< one million!
-
 /**
- * Event Manager thread entry function
+ * Event Manager thread entry function. Thread sleeps until next deadline,
+ * due events are passed to workers.
  *
  * @param ptr pointer to the FThread structure of the event manager
- * @todo This function waits a maximum of 10 seconds for each event to be completed. FL>PS !!!
  */
 void *EventManagerLoopThread( FThread *ptr )
 {
-	EventManager *ce = (EventManager *)ptr->t_Data;
-	//const unsigned long long nano = 1000000000;
-	//unsigned long long t1, t2, lasttime;
-	//struct timespec tm;
+	EventManager *em = (EventManager *)ptr->t_Data;
+	SystemBase *sb = (SystemBase *)em->em_SB;
 	
-	time_t stime = time( NULL );
-	time_t etime = stime;
-
-	do
+	pthread_mutex_lock( &(em->em_Mutex) );
+	
+	while( ptr->t_Quit != TRUE )
 	{
-		time_t dtime = etime - stime;
+		CoreEvent *run = NULL;
+		FQUAD now = EventNow();
 		
-		CoreEvent *locnce = ce->em_EventList;
-		while( locnce != NULL )
+		while( em->em_WheelTime <= now )
 		{
-			EventCheck( ce, locnce, stime );
+			FQUAD next = WheelNext( em );
+			if( next > now )
+			{
+				// nothing to do before now, empty ticks are skipped
+				em->em_WheelTime = now + 1;
+				break;
+			}
+			em->em_WheelTime = next;
+			WheelTick( em, now, &run );
+		}
+		
+		if( run != NULL )
+		{
+			pthread_mutex_unlock( &(em->em_Mutex) );
 			
-			locnce = (CoreEvent *) locnce->node.mln_Succ;
+			while( run != NULL )
+			{
+				CoreEvent *ev = run;
+				run = ev->ce_RunNext;
+				ev->ce_RunNext = NULL;
+				
+				DEBUG("[EventManager] Run event %llu function %p\n", ev->ce_ID, ev->ce_Function );
+				
+				if( sb == NULL || WorkerManagerTryRun( sb->sl_WorkerManager, EventLaunch, ev, NULL ) != 0 )
+				{
+					EventLaunch( ev );
+				}
+			}
+			
+			pthread_mutex_lock( &(em->em_Mutex) );
+			continue;
+		}
+		
+		if( ptr->t_Quit == TRUE )
+		{
+			break;
 		}
 		
-		time_t end_time = WAIT_SECOND_1m - dtime;
-		usleep( end_time );
-		//printf("waiting..... %d\n", end_time );
+		// sleep until next deadline or until new event is added
+		em->em_WakeTime = WheelNext( em );
 		
-		stime = etime;
-		etime = time( NULL );
+		struct timespec ts;
+		ts.tv_sec = em->em_WakeTime / 1000;
+		ts.tv_nsec = ( em->em_WakeTime % 1000 ) * 1000000;
+		pthread_cond_timedwait( &(em->em_Cond), &(em->em_Mutex), &ts );
 	}
-	while( ptr->t_Quit != TRUE );
+	
+	pthread_mutex_unlock( &(em->em_Mutex) );
 	
 	ptr->t_Launched = FALSE;
 	
-	//pthread_exit( 0 );
-	/*
-	clock_t time = clock();
+	return NULL;
+}
 
-	while( ptr->t_Quit != TRUE )
+/**
+ * Add a new event to the timer wheel
+ *
+ * @param em pointer to the event manager structure
+ * @param function function which will be called
+ * @param data parameter passed to function
+ * @param delay time after which event will be called (milliseconds)
+ * @param interval time between next calls (milliseconds)
+ * @param repeat number of repetitions, -1 when event is repeated until it is cancelled
+ * @return pointer to event which can be used by EventCancel or NULL when error appear
+ */
+CoreEvent *EventAddMs( EventManager *em, void *function, void *data, FQUAD delay, FQUAD interval, int repeat )
+{
+	CoreEvent *nce = FCalloc( sizeof( CoreEvent ), 1 );
+	if( nce != NULL )
 	{
-		clock_t dtime = clock() - time;
-		
-		CoreEvent *locnce = em->em_EventList;
-		while( locnce != NULL )
-		{
-//			if( locnce->ce_Time.
-			
-			locnce = (CoreEvent *) locnce->node.mln_Succ;
-		}
+		nce->ce_Function = function;
+		nce->ce_RepeatTime = repeat;
+		nce->ce_TimeDelta = interval;
+		nce->ce_Data = data;
+		nce->ce_Manager = em;
 		
-		clock_t end_time = (WAIT_SECOND * CLOCKS_PER_SEC  ) - dtime;
-		usleep( end_time );
-		//printf("witing..... %d\n", end_time );
+		pthread_mutex_lock( &(em->em_Mutex) );
 		
-		time = clock();
-	}*/
+		nce->ce_ID = ++em->em_IDGenerator;
+		nce->ce_Time = EventNow() + ( delay > 0 ? delay : 0 );
+		WheelInsert( em, nce );
 		
-		/*
-	{
-		//clock_gettime( CLOCK_REALTIME, &tm );
-		t1 = tm.tv_nsec + tm.tv_sec * nano;
-
-		long long tmp = lasttime+20000-now;
-		if( tmp > 0 )
+		// event thread sleeps longer then new event wants, wake it up
+		if( nce->ce_Time < em->em_WakeTime )
 		{
-			usleep( tmp );
+			pthread_cond_signal( &(em->em_Cond) );
 		}
-
-		//clock_gettime( CLOCK_REALTIME, &tm );
-		t2 = tm.tv_nsec + tm.tv_sec * nano;
 		
-		clock_t start_time = clock();
-	clock_t end_time = sec * 1000 + start_time;
+		pthread_mutex_unlock( &(em->em_Mutex) );
 
-		printf( "delay: %ld\n", ( t2 - t1 ) / 1000 );
+		DEBUG("[EventManager] Add new event, ID: %llu\n", nce->ce_ID );
+	}
+	else
+	{
+		Log( FLOG_ERROR, "Cannot allocate memory for new Event\n");
+	}
 
-	}*/
-	return NULL;
+	return nce;
 }
 
 //
@@ -255,116 +539,49 @@ void *EventManagerLoopThread( FThread *ptr )
  * Add a new event to the list of events to handle
  *
  * @param em pointer to the event manager structure
- * @param id ID of the event returned by EventGetNewID
- * @param thread pointer to the thread to send the message to
- * @param nextCall delay before sending the message
+ * @param function function which will be called
+ * @param data parameter passed to function
+ * @param nextCall time when event will be called first time
+ * @param deltaTime time between next calls (seconds)
  * @param repeat number of repetitions
  * @return 0 when success, otherwise error number
  */
 int EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat )
 {
-	CoreEvent *nce = FCalloc( sizeof( CoreEvent ), 1 );
-	if( nce != NULL )
-	{
-		//FThread *nth = ThreadNew( function, em->em_SB, FALSE );
-		//CoreEvent *retEv = NULL;
-		//nce->ce_Thread = thread;
-		nce->ce_Function = function;
-		nce->ce_ID = ++em->em_IDGenerator;
-		nce->ce_Time = nextCall;
-		nce->ce_RepeatTime = repeat;
-		nce->ce_TimeDelta = deltaTime;
-		nce->ce_Data = data;
-
-		DEBUG("[EventManager] Add new event, ID: %llu\n", nce->ce_ID );
-
-		nce->node.mln_Succ = (MinNode *) em->em_EventList;
-		em->em_EventList = nce;
-	}
-	else
+	time_t delay = nextCall - time( NULL );
+	
+	if( EventAddMs( em, function, data, (FQUAD)delay * 1000, (FQUAD)deltaTime * 1000, repeat ) == NULL )
 	{
-		Log( FLOG_ERROR, "Cannot allocate memory for new Event\n");
 		return -1;
 	}
-
 	return 0;
 }
 
 /**
- * Force call an event
+ * Cancel event. Event is released now or when its current call ends.
+ * Pointer to event which is not repeated anymore is not valid after its last call.
  *
  * @param em pointer to the event manager structure
- * @param id ID of the event to call
- * @return NULL
+ * @param ev pointer to event returned by EventAddMs
  */
-CoreEvent *EventCheck( EventManager *em, CoreEvent *ev, time_t ti )
+void EventCancel( EventManager *em, CoreEvent *ev )
 {
-	FBOOL removeEvent = FALSE;
-	
-	//DEBUG("Check event: time %lu eventTime %lu\n", ti, ev->ce_Time );
-	
-	if( ti >= ev->ce_Time  )
+	if( em == NULL || ev == NULL )
 	{
-		ev->ce_Time += ev->ce_TimeDelta;		//we increse time amount after which call will be done
-		
-		if( ev->ce_RepeatTime == -1 )		// never ending loop
-		{
-			//ev->ce_Thread->t_Launched = FALSE;
-		}
-		else if( ev->ce_RepeatTime == 0 )	// last call, must be removed
-		{
-			removeEvent = TRUE;
-		}
-		else
-		{
-			//ev->ce_Thread->t_Launched = FALSE;
-			ev->ce_RepeatTime--;
-		}
-		
-		DEBUG("[EventManager] Start thread %p  SB ptr %p\n", ev->ce_Function, em->em_SB );
-		//ThreadStart( ev->ce_Thread );
-		//ev->ce_Data = em->em_SB;
-		//ev->ce_Thread = ThreadNew( EventLaunch, ev, TRUE, NULL );
-		pthread_create( &(ev->ce_Thread), NULL, EventLaunch, ev );
-		//ThreadStart( ev->ce_Thread );
-		DEBUG("[EventManager] Thread started\n");
+		return;
 	}
 	
-	if( removeEvent == TRUE )
-	{
-		
-	}
+	pthread_mutex_lock( &(em->em_Mutex) );
 	
-	/*
-	List *tmp = em->eventTList;
-	CoreEvent *retEv = NULL;
-
-	while( tmp != NULL )
+	WheelRemove( ev );
+	if( ev->ce_Launched == TRUE )
 	{
-		CoreEvent *locce = (CoreEvent *) tmp->data;
-		if( locce != NULL && locce->eventId == id )
-		{
-			// we found interested position for us
-			retEv = locce;
-
-			break;
-		}
-
-		tmp = tmp->next;
+		ev->ce_Quit = TRUE;
 	}
-
-	if( retEv != NULL )
+	else
 	{
-		while( retEv != NULL )
-		{
-			// we call function with interesting arguments for us
-			retEv->hook.h_Function( retEv->hook.h_Entry, retEv->hook.h_SubEntry, retEv->hook.h_Data );
-
-			retEv = (CoreEvent *)retEv->node.mln_Succ;
-		}
+		FFree( ev );
 	}
-	*/
-	//return retEv;
-	return NULL;
+	
+	pthread_mutex_unlock( &(em->em_Mutex) );
 }
-
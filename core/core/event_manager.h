@@ -36,6 +36,16 @@
 #include <core/event.h>
 #include <util/list.h>
 
+//
+// Timer wheel: EVENT_WHEEL_LEVELS levels of EVENT_WHEEL_SLOTS slots, one tick is one millisecond
+// level 0 keeps events which will be called in next 64 ms, level 1 in next 4 s, ... level 5 in next 2 years
+//
+
+#define EVENT_WHEEL_BITS		6
+#define EVENT_WHEEL_SLOTS		( 1 << EVENT_WHEEL_BITS )
+#define EVENT_WHEEL_MASK		( EVENT_WHEEL_SLOTS - 1 )
+#define EVENT_WHEEL_LEVELS		6
+
 //
 // EventManager structure
 //
@@ -43,12 +53,17 @@
 typedef struct EventManager
 {
 	FUQUAD lastID;							///< last available event ID
-	//struct List 			*eventTList;	// list of events , by types
-	CoreEvent				*em_EventList;		///< pointer to the list of events
 	FThread 				*em_EventThread;	///< pointer to the list of associated Friend threads
 	FUQUAD				em_IDGenerator;		// ID generator
 	void						*em_SB;
 	void						*em_Function;
+	
+	pthread_mutex_t			em_Mutex;
+	pthread_cond_t			em_Cond;			// signalled when event thread should recalculate sleep time
+	CoreEvent				*em_Wheel[ EVENT_WHEEL_LEVELS ][ EVENT_WHEEL_SLOTS ];
+	FQUAD					em_WheelTime;		// next tick which will be processed (milliseconds, monotonic clock)
+	FQUAD					em_WakeTime;		// tick when event thread wakes up
+	int						em_Running;			// number of events called now by workers
 }EventManager;
 
 //
@@ -77,10 +92,16 @@ FUQUAD EventGetNewID( EventManager *em );
 int EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat );
 
 //
-// check event
+// add new event with millisecond resolution, returned event can be cancelled
+//
+
+CoreEvent *EventAddMs( EventManager *em, void *function, void *data, FQUAD delay, FQUAD interval, int repeat );
+
+//
+// cancel event
 //
 
-CoreEvent *EventCheck( EventManager *em, CoreEvent *ev, time_t ti );
+void EventCancel( EventManager *em, CoreEvent *ev );
 
 
 
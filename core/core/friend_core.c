@@ -38,6 +38,8 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <strings.h>
 #include <errno.h>
 #ifdef USE_SELECT
 
@@ -188,6 +190,7 @@ FriendCoreInstance *FriendCoreNew( void *sb, FBOOL ssl, int port, int maxp, int
 	
 	// Init listen mutex
 	pthread_mutex_init( &fc->fci_ListenMutex, NULL );
+	pthread_mutex_init( &fc->fci_IdleMutex, NULL );
 	
 	LOG( FLOG_INFO,"[FriendCore] WorkerManager started\n");
 	
@@ -226,6 +229,7 @@ void FriendCoreShutdown( FriendCoreInstance* fc )
 		pthread_mutex_unlock( &fc->fci_ListenMutex );
 		pthread_mutex_destroy( &fc->fci_ListenMutex );
 	}
+	pthread_mutex_destroy( &fc->fci_IdleMutex );
 	
 	FFree( fc );
 	
@@ -457,7 +461,19 @@ void FriendCoreAcceptPhase1( void *d )
 #else
 #ifdef USE_WORKERS
 					SystemBase *locsb = (SystemBase *)idata->fc->fci_SB;
-					WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreAccept, idata, NULL );
+					// we are running on worker, waiting for free slot here could block all workers
+					int runError = WorkerManagerTryRun( locsb->sl_WorkerManager,  FriendCoreAccept, idata, NULL );
+					if( runError == WORKER_MANAGER_QUEUE_FULL )
+					{
+						FriendCoreAccept( idata );
+					}
+					else if( runError != 0 )
+					{
+						FFree( idata );
+						shutdown( p->fd, SHUT_RDWR );
+						close( p->fd );
+						FFree( p );
+					}
 #else
 					int pid = fork();
 				
@@ -595,7 +611,7 @@ void *FriendCoreProcess__httponthefly( void *fcv )
 							//char *content = HttpGetHeader( request, "content-length", 0 );
 							//char *content = HttpGetHeaderFromTable( request, HTTP_HEADER_CONTENT_LENGTH );
 							
-							if( request->h_ContentLength > 0 )
+							if( request->h_ContentLength > 0 && request->h_ContentLength < INT_MAX )
 							{
 								//char *divider = strstr( content, dividerStr );
 								char *divider = strstr( resultString->ht_Buffer, dividerStr );
@@ -733,6 +749,330 @@ void *FriendCoreProcess__httponthefly( void *fcv )
 
 
 
+/**
+ * Removes socket from list of idle keep-alive connections. fci_IdleMutex must be locked
+ *
+ * @param fc pointer to Friend Core instance
+ * @param sock pointer to socket
+ */
+
+static inline void FriendCoreIdleUnlink( FriendCoreInstance *fc, Socket *sock )
+{
+	if( sock->s_Idle == FALSE )
+	{
+		return;
+	}
+	
+	if( sock->s_IdlePrev != NULL )
+	{
+		sock->s_IdlePrev->s_IdleNext = sock->s_IdleNext;
+	}
+	else
+	{
+		fc->fci_IdleHead = sock->s_IdleNext;
+	}
+	
+	if( sock->s_IdleNext != NULL )
+	{
+		sock->s_IdleNext->s_IdlePrev = sock->s_IdlePrev;
+	}
+	else
+	{
+		fc->fci_IdleTail = sock->s_IdlePrev;
+	}
+	
+	sock->s_IdlePrev = sock->s_IdleNext = NULL;
+	sock->s_Idle = FALSE;
+}
+
+/**
+ * Removes socket from list of idle keep-alive connections
+ *
+ * @param fc pointer to Friend Core instance
+ * @param sock pointer to socket
+ */
+
+static inline void FriendCoreIdleRemove( FriendCoreInstance *fc, Socket *sock )
+{
+	if( pthread_mutex_lock( &fc->fci_IdleMutex ) == 0 )
+	{
+		FriendCoreIdleUnlink( fc, sock );
+		pthread_mutex_unlock( &fc->fci_IdleMutex );
+	}
+}
+
+/**
+ * Puts connection back to epoll, it will wait there for next request
+ *
+ * Socket cannot be used by caller after this call, it can be already processed by another worker
+ *
+ * @param fc pointer to Friend Core instance
+ * @param sock pointer to socket
+ * @return 0 when success, otherwise error number
+ */
+
+static int FriendCoreKeepAlive( FriendCoreInstance *fc, Socket *sock )
+{
+	int error = -1;
+	
+	if( pthread_mutex_lock( &fc->fci_IdleMutex ) == 0 )
+	{
+		sock->s_LastActivity = time( NULL );
+		sock->s_Idle = TRUE;
+		sock->s_IdleNext = NULL;
+		sock->s_IdlePrev = fc->fci_IdleTail;
+		if( fc->fci_IdleTail != NULL )
+		{
+			fc->fci_IdleTail->s_IdleNext = sock;
+		}
+		else
+		{
+			fc->fci_IdleHead = sock;
+		}
+		fc->fci_IdleTail = sock;
+		
+		pthread_mutex_lock( &sock->mutex );
+		struct epoll_event event;
+		event.data.ptr = sock;
+		event.events = EPOLLIN | EPOLLET;
+		error = epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_ADD, sock->fd, &event );
+		pthread_mutex_unlock( &sock->mutex );
+		
+		if( error != 0 )
+		{
+			FriendCoreIdleUnlink( fc, sock );
+		}
+		pthread_mutex_unlock( &fc->fci_IdleMutex );
+	}
+	return error;
+}
+
+/**
+ * Closes keep-alive connections which were idle for too long
+ *
+ * Called only from epoll thread
+ *
+ * @param fc pointer to Friend Core instance
+ * @param timeout idle time in seconds after which connection is closed, -1 closes all idle connections
+ */
+
+static void FriendCoreIdleSweep( FriendCoreInstance *fc, int timeout )
+{
+	Socket *expired = NULL;
+	time_t now = time( NULL );
+	
+	if( pthread_mutex_lock( &fc->fci_IdleMutex ) == 0 )
+	{
+		// Oldest connections are first on list
+		while( fc->fci_IdleHead != NULL && ( timeout < 0 || fc->fci_IdleHead->s_LastActivity + timeout <= now ) )
+		{
+			Socket *sock = fc->fci_IdleHead;
+			FriendCoreIdleUnlink( fc, sock );
+			epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+			
+			sock->s_IdleNext = expired;
+			expired = sock;
+		}
+		pthread_mutex_unlock( &fc->fci_IdleMutex );
+	}
+	
+	while( expired != NULL )
+	{
+		Socket *sock = expired;
+		expired = sock->s_IdleNext;
+		sock->s_IdleNext = NULL;
+		
+		DEBUG("[FriendCoreIdleSweep] Closing idle connection %d\n", sock->fd );
+		SocketClose( sock );
+	}
+}
+
+/**
+ * Checks if connection can be reused after response to request is sent
+ *
+ * @param fc pointer to Friend Core instance
+ * @param sock pointer to socket
+ * @param request http request
+ * @return TRUE when client allows to keep connection open, otherwise FALSE
+ */
+
+static FBOOL FriendCoreKeepAliveAllowed( FriendCoreInstance *fc, Socket *sock, Http *request )
+{
+	SystemBase *locsb = (SystemBase *)fc->fci_SB;
+	
+	if( fc->fci_Shutdown == TRUE || locsb->sl_KeepAliveTimeout <= 0 || sock->s_Requests >= locsb->sl_KeepAliveMaxRequests )
+	{
+		return FALSE;
+	}
+	
+	// We do not know where chunked body ends, upgraded connection is not http anymore
+	if( HttpHeaderContains( request, "transfer-encoding", "chunked", FALSE ) == TRUE || HttpHeaderContains( request, "connection", "upgrade", FALSE ) == TRUE )
+	{
+		return FALSE;
+	}
+	
+	// HTTP/1.1 keeps connection by default, HTTP/1.0 must ask for it
+	if( request->versionMajor > 1 || ( request->versionMajor == 1 && request->versionMinor >= 1 ) )
+	{
+		return !HttpHeaderContains( request, "connection", "close", FALSE );
+	}
+	return HttpHeaderContains( request, "connection", "keep-alive", FALSE );
+}
+
+/**
+ * Finds field in raw http header
+ *
+ * @param header pointer to http header
+ * @param length length of header
+ * @param name field name with colon, lowercase
+ * @return pointer to field value (leading whitespace skipped) or NULL when header do not have it
+ */
+
+static const char *FriendCoreFindHeader( const char *header, int length, const char *name )
+{
+	const char *ptr = header, *end = header + length;
+	int nlen = strlen( name );
+	
+	while( ptr < end )
+	{
+		const char *eol = memchr( ptr, '\n', end - ptr );
+		if( eol == NULL )
+		{
+			break;
+		}
+		
+		if( ( eol - ptr ) > nlen && strncasecmp( ptr, name, nlen ) == 0 )
+		{
+			ptr += nlen;
+			while( *ptr == ' ' || *ptr == '\t' )
+			{
+				ptr++;
+			}
+			return ptr;
+		}
+		ptr = eol + 1;
+	}
+	return NULL;
+}
+
+/**
+ * Reads one complete http request (header and body) from socket
+ *
+ * Data which came together with previous request (pipelining) is already in resultString
+ * and it is used before anything new is read from socket.
+ *
+ * @param th pointer to thread instance of Friend Core
+ * @param resultString buffer where request is collected
+ * @param locBuffer pointer to read buffer, it can be reallocated
+ * @param bufferSize pointer to size of read buffer
+ * @param complete set to FALSE when only part of body was received
+ * @param stream set to TRUE when body is too big and it will be read by handler
+ * @return length of request in bytes or 0 when request cannot be received
+ */
+
+static int FriendCoreReadRequest( struct fcThreadInstance *th, BufString *resultString, char **locBuffer, int *bufferSize, FBOOL *complete, FBOOL *stream )
+{
+	Socket *sock = th->sock;
+	SystemBase *locsb = (SystemBase *)th->fc->fci_SB;
+	int headerLength = 0, res = 0;
+	FQUAD contentLength = 0;
+	unsigned int scanned = 0;
+	const char *value = NULL;
+	
+	*complete = TRUE;
+	*stream = FALSE;
+	
+	// Header first
+	while( headerLength == 0 )
+	{
+		if( resultString->bs_Size > 0 )
+		{
+			char *divider = strstr( resultString->bs_Buffer + scanned, dividerStr );
+			if( divider != NULL )
+			{
+				headerLength = divider - resultString->bs_Buffer + 4;
+				break;
+			}
+			// Divider can be split between two reads
+			scanned = resultString->bs_Size > 3 ? resultString->bs_Size - 3 : 0;
+			
+			if( resultString->bs_Size > HTTP_HEADER_MAX_SIZE )
+			{
+				FERROR("[FriendCoreReadRequest] Header is too long\n");
+				return 0;
+			}
+		}
+		
+		if( ( res = SocketRead( sock, *locBuffer, *bufferSize, 0 ) ) <= 0 )
+		{
+			return 0;
+		}
+		BufStringAddSize( resultString, *locBuffer, res );
+	}
+	
+	if( ( value = FriendCoreFindHeader( resultString->bs_Buffer, headerLength, "content-length:" ) ) != NULL )
+	{
+		if( ( contentLength = HttpParseContentLength( value ) ) < 0 )
+		{
+			FERROR("[FriendCoreReadRequest] Invalid Content-Length\n");
+			return 0;
+		}
+	}
+	
+	// Big uploads are not stored in memory, handler reads body from socket
+	if( contentLength > locsb->sl_MaxBufferedBody && (FQUAD)resultString->bs_Size < headerLength + contentLength )
+	{
+		if( ( value = FriendCoreFindHeader( resultString->bs_Buffer, headerLength, "content-type:" ) ) != NULL && strncasecmp( value, "multipart/form-data", 19 ) == 0 )
+		{
+			*stream = TRUE;
+			return resultString->bs_Size;
+		}
+	}
+	
+	// Everything else is kept in memory
+	if( contentLength > INT_MAX - 1 - headerLength )
+	{
+		FERROR("[FriendCoreReadRequest] Content-Length %lld is too big\n", contentLength );
+		return 0;
+	}
+	int requestLength = headerLength + (int)contentLength;
+	
+	// Then body
+	while( (int)resultString->bs_Size < requestLength )
+	{
+		// Increase the buffer for files!
+		if( requestLength - (int)resultString->bs_Size > *bufferSize && *bufferSize == HTTP_READ_BUFFER_DATA_SIZE )
+		{
+			*bufferSize = 1048576; // Bit faster, bit greedier
+			FFree( *locBuffer ); 
+			if( ( *locBuffer = FCalloc( *bufferSize + 32, sizeof( char ) ) ) == NULL )
+			{
+				FERROR("[FriendCoreReadRequest] Cannot allocate memory for read buffer\n");
+				return 0;
+			}
+		}
+		
+		if( ( res = SocketRead( sock, *locBuffer, *bufferSize, 1 ) ) <= 0 )
+		{
+			// Body is not complete, request is processed with what we have, connection will be closed
+			DEBUG("[FriendCoreReadRequest] Body is not complete %d/%d\n", resultString->bs_Size, requestLength );
+			requestLength = resultString->bs_Size;
+			*complete = FALSE;
+			break;
+		}
+		BufStringAddSize( resultString, *locBuffer, res );
+	}
+	return requestLength;
+}
+
+/**
+ * Processes http requests which came on connection
+ *
+ * Connection is kept open when client allows it (keep-alive), pipelined requests are processed in order
+ *
+ * @param fcv pointer to thread instance of Friend Core
+ */
+
 void FriendCoreProcess( void *fcv )
 {
 #ifdef USE_PTHREAD
@@ -765,12 +1105,8 @@ void FriendCoreProcess( void *fcv )
 	
 	// Let's go!
 	
-	// First pass header, second, data
-	int pass = 0, bodyLength = 0, prevBufSize = 0, preroll = 0, stopReading = 0;
-
-	// Often used
-	int partialDivider = 0, foundDivider = 0, y = 0;
-	char findDivider[ 5 ];
+	Socket *sock = th->sock;
+	FBOOL keepAlive = FALSE;
 	
 	int bufferSize = HTTP_READ_BUFFER_DATA_SIZE;
 	int bufferSizeAlloc = HTTP_READ_BUFFER_DATA_SIZE_ALLOC;
@@ -779,198 +1115,112 @@ void FriendCoreProcess( void *fcv )
 	if( locBuffer != NULL )
 	{
 		BufString *resultString = BufStringNewSize( bufferSizeAlloc << 1 );
-
-		for( ; pass < 2; pass++ )
+		
+		while( resultString != NULL )
 		{
-			// No bodylength? Fuck it
-			if( pass == 1 && ( !bodyLength || stopReading ) )
+			FBOOL complete = TRUE, stream = FALSE;
+			keepAlive = FALSE;
+			
+			int requestLength = FriendCoreReadRequest( th, resultString, &locBuffer, &bufferSize, &complete, &stream );
+			if( requestLength <= 0 )
 			{
-				//FERROR( "We have Bodylength: %s, Stopreading: %s\n", !bodyLength ? "no body" : "have body", stopReading ? "stop" : "continue" );
+				DEBUG( "[FriendCoreProcess] No buffer to write!\n" );
 				break;
 			}
-
-			int count = preroll, res = 0, joints = 0, methodGet = 0;
-
-			// We must find divider!
-			// TODO: before there was table of pointers and sign was placed there
-			memset( findDivider, 0, 5 );
-
-			char *stdBufChr = NULL;
-			partialDivider = 0, foundDivider = 0, y = res - 1;
-
-			for( ; ; )
+			
+			// Data behind this request belongs to next pipelined request
+			BufString *nextString = NULL;
+			if( (int)resultString->bs_Size > requestLength )
 			{
-				// Increase the buffer for files!
-				if( count != 0 && bufferSize == HTTP_READ_BUFFER_DATA_SIZE )
+				int pos = requestLength;
+				
+				// Some clients send CRLF after body
+				while( pos < (int)resultString->bs_Size && ( resultString->bs_Buffer[ pos ] == '\r' || resultString->bs_Buffer[ pos ] == '\n' ) )
 				{
-					bufferSize = 1048576; // Bit faster, bit greedier
-					bufferSizeAlloc = 1048608; // buffersize + 32
-					FFree( locBuffer ); locBuffer = FCalloc( bufferSizeAlloc, sizeof( char ) );
+					pos++;
 				}
 				
-				if( ( res = SocketRead( th->sock, locBuffer, bufferSize, pass ) ) > 0 )
+				if( pos < (int)resultString->bs_Size )
 				{
-					BufStringAddSize( resultString, locBuffer, res );
-
-					if( pass == 0 && partialDivider != 0 )
+					if( ( nextString = BufStringNewSize( bufferSizeAlloc << 1 ) ) != NULL )
 					{
-						stdBufChr = strstr( "\r", locBuffer );
-						if( stdBufChr == NULL ) stdBufChr = strstr( "\n", locBuffer );
-						if( stdBufChr != NULL )
-						{
-							findDivider[ partialDivider++ ] = stdBufChr[0];
-							if( partialDivider > 3 )
-							{
-								findDivider[ 4 ] = '\0';
-							}
-						}
-						else partialDivider = 0;
-					}
-
-					// How much data did we read?
-					count += res;
-					joints++;
-
-					// Break get posts after header
-					if( pass == 0 )
-					{
-						stdBufChr = locBuffer + res - 1;
-
-						// If we found a divider!
-						if( partialDivider >= 4 || strstr( locBuffer, dividerStr ) )
-						{
-							// We have a divider! Great!
-							break;
-						}
-						// Does it end with this? Perhaps it's a partial divider
-						else if( stdBufChr[0] == '\r' ||  stdBufChr[0] == '\n' )
-						{
-							memcpy( findDivider, locBuffer + res - 5, 5 );
-							partialDivider = 5;
-						}
-					}
-					// Or in second pass, body length
-					else if( pass == 1 && count >= bodyLength )
-					{
-						// remove preroll to get correct read bytes
-						count -= preroll;
-						DEBUG( "[FriendCoreProcess] Fixing preroll %d\n", preroll );
-						break;
+						BufStringAddSize( nextString, resultString->bs_Buffer + pos, resultString->bs_Size - pos );
 					}
 				}
-				// No data?
-				else break;
+				resultString->bs_Size = requestLength;
+				resultString->bs_Buffer[ requestLength ] = 0;
 			}
-
-			if( count > 0 )
+			
+			sock->s_Requests++;
+			
+			// Already now parse header, request will be continued by ProtocolHttp
+			Http *request = ( Http *)sock->data;
+			if( request == NULL )
 			{
-				// Already now parse header to receive other data
-				if( pass == 0 )
-				{
-					Http *request = ( Http *)th->sock->data;
-					int result = 0;
-					char *content = NULL;
-					{
-						if( request == NULL )
-						{
-							request = HttpNew( );
-							request->timestamp = time( NULL );
-							th->sock->data = ( void* )request;
-						}
-						
-						request->h_ShutdownPtr = &(th->fc->fci_Shutdown);
-
-						request->h_Socket = th->sock;
-						result = HttpParseHeader( request, resultString->bs_Buffer, resultString->bs_Size + 1 );
-						request->gotHeader = TRUE;
-						
-						content = HttpGetHeaderFromTable( request, HTTP_HEADER_CONTENT_LENGTH );
-					}
-
-					// If we have content, then parse it
-					if( request->h_ContentLength > 0 )
-					{
-						//rchar *divider = strstr( resultString->bs_Buffer, dividerStr );
-						char *divider = strstr( content, dividerStr );
-						
-						// No divider?
-						if( !divider )
-						{
-							prevBufSize += count;
-							break;
-						}
-
-						bodyLength = request->h_ContentLength;//atoi( content );
-						
-						// We have enough data and are ready for reading the body
-						int headerLength = divider - resultString->bs_Buffer + 4;
-						if( count > headerLength )
-						{
-							prevBufSize += count;
-							preroll = count - headerLength;
-							stopReading = count >= ( headerLength + bodyLength );
-							continue;
-						}
-					}
-					// Need only one pass
-					else
-					{
-						// No content length
-						prevBufSize += count;
-						break;
-					}
-					// Determine if we need pass 2
-				}
-				// For next pass
-				prevBufSize += count;
+				request = HttpNew( );
+				request->timestamp = time( NULL );
+				sock->data = ( void* )request;
 			}
-		}	// for pass 0 < 2
-	
-		//DEBUG( "[FriendCoreProcess] Exited headers loop. Now freeing up.\n" );
+			request->h_ShutdownPtr = &(th->fc->fci_Shutdown);
+			request->h_Socket = sock;
+			HttpParseHeader( request, resultString->bs_Buffer, resultString->bs_Size + 1 );
+			request->gotHeader = TRUE;
+			request->h_BodyStream = stream;
+			
+			sock->s_KeepAlive = FALSE;
+			sock->s_KeepAliveAllowed = ( complete == TRUE && FriendCoreKeepAliveAllowed( th->fc, sock, request ) );
+			
+			// Process data
+			//LOG( FLOG_DEBUG, "We received this (%d bytes): >>%s<<\n", resultString->bs_Size, resultString->bs_Buffer);
+			Http *resp = ProtocolHttp( sock, resultString->bs_Buffer, resultString->bs_Size );
 
-		// Free up
-		if( resultString != NULL )
-		{
-			if( resultString->bs_Buffer != NULL )
+			if( resp != NULL )
 			{
-				if( resultString->bs_Size > 0 )
+				if( resp->h_WriteType == FREE_ONLY )
 				{
-					// Process data
-					//LOG( FLOG_DEBUG, "We received this (%d bytes): >>%s<<\n", resultString->bs_Size, resultString->bs_Buffer);
-					Http *resp = ProtocolHttp( th->sock, resultString->bs_Buffer, resultString->bs_Size );
-
-					if( resp != NULL )
-					{
-						if( resp->h_WriteType == FREE_ONLY )
-						{
-							HttpFree( resp );
-						}
-						else
-						{
-							HttpWriteAndFree( resp, th->sock );
-						}
-					}
+					HttpFree( resp );
 				}
-				// No data, just free
 				else
 				{
-					// Ask for more info
-					DEBUG( "[FriendCoreProcess] No buffer to write, so just free!\n" );
+					HttpWriteAndFree( resp, sock );
 				}
 			}
+			
 			BufStringDelete( resultString );
+			resultString = nextString;
+			
+			// Connection can be reused only when response was sent with keep-alive and request was fully processed
+			keepAlive = ( sock->s_KeepAlive == TRUE && sock->data == NULL && th->fc->fci_Shutdown == FALSE );
+			sock->s_KeepAliveAllowed = sock->s_KeepAlive = FALSE;
+			if( keepAlive == FALSE )
+			{
+				break;
+			}
+			
+			// SSL can hold already decrypted data, epoll will not report it
+			if( resultString == NULL && sock->s_SSLEnabled == TRUE && sock->s_Ssl != NULL && SSL_pending( sock->s_Ssl ) > 0 )
+			{
+				resultString = BufStringNewSize( bufferSizeAlloc << 1 );
+			}
 		}
-		else
+		
+		if( resultString != NULL )
 		{
-			// Ask for more info
-			DEBUG( "[FriendCoreProcess] No buffer to write!\n" );
+			BufStringDelete( resultString );
 		}
 
 		// Free up buffers
-		FFree( locBuffer );
+		if( locBuffer != NULL )
+		{
+			FFree( locBuffer );
+		}
 	}
 
-	SocketClose( th->sock );
+	// Wait for next request or close
+	if( keepAlive == FALSE || FriendCoreKeepAlive( th->fc, sock ) != 0 )
+	{
+		SocketClose( sock );
+	}
 	
 	// Free the pair
 	if( th != NULL )
@@ -1227,13 +1477,18 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 	sigaction( SIGINT, &setup_action, NULL );
 	sigprocmask( SIG_SETMASK, NULL, &curmask );
 	fci = fc;
+	
+	// Idle keep-alive connections are checked once per second
+	SystemBase *epollsb = (SystemBase *)fc->fci_SB;
+	int keepAliveTimeout = epollsb->sl_KeepAliveTimeout;
+	time_t lastSweep = time( NULL );
 
 	// All incoming network events go through here
 	while( !fc->fci_Shutdown )
 	{
 		// Wait for something to happen on any of the sockets we're listening on
 		
-		eventCount = epoll_pwait( fc->fci_Epollfd, events, fc->fci_MaxPoll, -1, &curmask );
+		eventCount = epoll_pwait( fc->fci_Epollfd, events, fc->fci_MaxPoll, keepAliveTimeout > 0 ? 1000 : -1, &curmask );
 
 		for( i = 0; i < eventCount; i++ )
 		{
@@ -1261,6 +1516,7 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				{
 					DEBUG("[FriendCoreEpoll] FD %d\n", sock->fd );
 					epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+					FriendCoreIdleRemove( fc, sock );
 					SocketClose( sock );
 				}
 			}
@@ -1312,8 +1568,10 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 #else
 #ifdef USE_WORKERS
 					SystemBase *locsb = (SystemBase *)fc->fci_SB;
-					WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreAcceptPhase1, pre, NULL );
-					//WorkerManagerRun( fc->fci_WorkerManager,  FriendCoreAcceptPhase1, pre );
+					if( WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreAcceptPhase1, pre, NULL ) != 0 )
+					{
+						FFree( pre );
+					}
 #else
 					int pid;
 					pid = fork();
@@ -1341,6 +1599,9 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
 				pthread_mutex_unlock( &sock->mutex );
 				
+				// Keep-alive connection got next request
+				FriendCoreIdleRemove( fc, sock );
+				
 				// Process
 
 				if( !fc->fci_Shutdown )
@@ -1364,8 +1625,12 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 #else
 #ifdef USE_WORKERS
 						SystemBase *locsb = (SystemBase *)fc->fci_SB;
-						WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreProcess, pre, NULL );
-						//WorkerManagerRun( fc->fci_WorkerManager,  FriendCoreProcess, pre );
+						// Ready socket goes to workers run queue, we are blocked here when queue is full
+						if( WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreProcess, pre, NULL ) != 0 )
+						{
+							FFree( pre );
+							SocketClose( sock );
+						}
 #else
 						int pid = fork();
 						if( pid < 0 )
@@ -1385,6 +1650,12 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				}
 			}
 		}
+		
+		if( keepAliveTimeout > 0 && time( NULL ) != lastSweep )
+		{
+			lastSweep = time( NULL );
+			FriendCoreIdleSweep( fc, keepAliveTimeout );
+		}
 	}
 	
 	usleep( 1 );
@@ -1401,6 +1672,9 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 		DEBUG("[FriendCoreEpoll] Number of threads %d, waiting .....\n", nothreads );
 	}
 	
+	// Workers are done, nobody will put connections on idle list anymore
+	FriendCoreIdleSweep( fc, -1 );
+	
 	// Free epoll events
 	FFree( events );
 	
@@ -84,6 +84,10 @@ typedef struct FriendCoreInstance
 	FThread					*fci_Thread;		/// FC instance internal thread
 	pthread_mutex_t			fci_ListenMutex;
 	
+	Socket					*fci_IdleHead;		/// keep-alive connections waiting for next request, oldest first
+	Socket					*fci_IdleTail;
+	pthread_mutex_t			fci_IdleMutex;
+	
 	void 					*fci_SB;							//pointer to systembase
 	
 } FriendCoreInstance;
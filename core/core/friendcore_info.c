@@ -204,12 +204,17 @@ BufString *FriendCoreInfoGet( FriendcoreInfo *fci )
 				sprintf( temp, ", { \"ID\":\"%32s\" ,\"Port\":\"%d\",\"Workers\":", fc->fci_CoreID, fc->fci_Port );
 			}
 			BufStringAdd( bs, temp );
-		
-			strcpy( temp, "\"0\"" );
-			BufStringAdd( bs, temp );
 			
 			if( sb->sl_WorkerManager != NULL )
 			{
+				WorkerManager *wm = sb->sl_WorkerManager;
+				FULONG dequeued = wm->wm_StatDequeued;
+				
+				sprintf( temp, "{\"Number\":\"%d\",\"QueueSize\":\"%lu\",\"QueueDepth\":\"%lu\",\"QueueMaxDepth\":\"%lu\",\"Enqueued\":\"%lu\",\"Dequeued\":\"%lu\",\"AvgWaitMicros\":\"%lld\",\"MaxWaitMicros\":\"%lld\",\"Blocked\":\"%lu\",\"BlockedMicros\":\"%lld\",\"Rejected\":\"%lu\"}", 
+					wm->wm_MaxWorkers, wm->wm_QueueSize, WorkerManagerQueueDepth( wm ), wm->wm_StatMaxDepth, wm->wm_StatEnqueued, dequeued,
+					dequeued > 0 ? wm->wm_StatWaitMicros / (FQUAD)dequeued : 0, wm->wm_StatMaxWaitMicros, wm->wm_StatBlocked, wm->wm_StatBlockedMicros, wm->wm_StatRejected );
+				BufStringAdd( bs, temp );
+				
 				if( sb->sl_WorkerManager->wm_MaxWorkers == 0 )
 				{
 				
@@ -231,6 +236,10 @@ BufString *FriendCoreInfoGet( FriendcoreInfo *fci )
 					}*/
 				}
 			}
+			else
+			{
+				BufStringAdd( bs, "\"0\"" );
+			}
 		
 			BufStringAdd( bs, "}" );
 		
@@ -31,7 +31,9 @@
 #define _POSIX_SOURCE
 #endif
 
+#ifndef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 600
+#endif
 
 #ifndef __USE_POSIX
 #define __USE_POSIX
@@ -64,7 +66,9 @@ int usleep (__useconds_t __useconds);
 
 struct hostent *gethostbyname2 (const char *__name, int __af);
 
+#ifndef __USE_GNU
 void pthread_yield();
+#endif
 //void usleep( long );
 
 //void pclose( FILE *f );
@@ -29,19 +29,23 @@
  *  @date created 02/2015
  */
 
+#define _GNU_SOURCE
+
 #include "worker.h"
 #include "worker_manager.h"
 #include <util/log/log.h>
 #include <sys/time.h>
 #include <time.h>
+#include <sched.h>
 
 /**
  * Create new worker
  *
  * @param nr id of new worker
+ * @param wm pointer to WorkerManager which will feed worker with tasks
  * @return pointer to new Worker structure when success, otherwise NULL
  */
-Worker *WorkerNew( int nr )
+Worker *WorkerNew( int nr, void *wm )
 {
 	Worker *wrk = ( Worker *)FCalloc( 1, sizeof( Worker ) );
 	
@@ -51,9 +55,8 @@ Worker *WorkerNew( int nr )
 		
 		wrk->w_State = W_STATE_CREATED;
 		wrk->w_Nr = nr;
-		
-		pthread_mutex_init( &(wrk->w_Mut), NULL );
-		pthread_cond_init( &(wrk->w_Cond), NULL );
+		wrk->w_Manager = wm;
+		wrk->w_CPU = -1;
 	}
 	else
 	{
@@ -65,10 +68,11 @@ Worker *WorkerNew( int nr )
 }
 
 /**
- * Create new worker
+ * Delete worker
  *
- * @param nr id of new worker
- * @return pointer to new Worker structure when success, otherwise NULL
+ * Worker must be woken up by WorkerManager before this call
+ *
+ * @param w pointer to Worker which will be deleted
  */
 void WorkerDelete( Worker *w )
 {
@@ -78,28 +82,11 @@ void WorkerDelete( Worker *w )
 		{
 			w->w_Quit = TRUE;
 
-			while( w->w_State != W_STATE_TO_REMOVE )
-			{
-				if( pthread_mutex_lock( &(w->w_Mut) ) == 0 )
-				{
-					pthread_cond_signal( &(w->w_Cond) ); // <- wake up!!
-					pthread_mutex_unlock( &(w->w_Mut) );
-				}
-				
-				DEBUG("[WorkerThread] State %d quit %d WRKID %d\n", w->w_State, w->w_Quit, w->w_Nr );
-				usleep( 100000 );
-			}
 			ThreadDelete( w->w_Thread );
+			w->w_Thread = NULL;
 		}
 		
-		// Free up the mutex elements
-		if( w->w_State )
-		{
-			pthread_cond_destroy( &(w->w_Cond) );
-			pthread_mutex_destroy( &(w->w_Mut) );
-		}
-		
-		DEBUG("[WorkerThread] Worker deleted: %d\n", w->w_Nr );
+		DEBUG("[WorkerThread] Worker deleted: %d tasks done %lu\n", w->w_Nr, w->w_TasksDone );
 		FFree( w );
 	}
 }
@@ -113,10 +100,11 @@ void WorkerThread( void *w );
 /**
  * Run Worker
  *
- * @param nr id of worker which will be launched
+ * @param wrk pointer to worker which will be launched
+ * @param cpu number of cpu to which worker will be pinned, -1 if worker should not be pinned
  * @return 0 when success, otherwise error number
  */
-int WorkerRun( Worker *wrk )
+int WorkerRun( Worker *wrk, int cpu )
 {
 	if( wrk == NULL )
 	{
@@ -134,6 +122,8 @@ int WorkerRun( Worker *wrk )
 	pthread_attr_setstacksize( &attr, stacksize );
 
 	wrk->w_Thread = ThreadNew( WorkerThread, wrk, TRUE, &attr );
+	pthread_attr_destroy( &attr );
+	
 	if( wrk->w_Thread == NULL )
 	{
 		FERROR("[WorkerRun] Cannot create thread!\n");
@@ -141,6 +131,22 @@ int WorkerRun( Worker *wrk )
 		return -1;
 	}
 	
+	if( cpu >= 0 )
+	{
+		cpu_set_t cpuset;
+		CPU_ZERO( &cpuset );
+		CPU_SET( cpu, &cpuset );
+		
+		if( pthread_setaffinity_np( wrk->w_Thread->t_Thread, sizeof( cpu_set_t ), &cpuset ) == 0 )
+		{
+			wrk->w_CPU = cpu;
+		}
+		else
+		{
+			FERROR("[WorkerRun] Cannot pin worker %d to cpu %d\n", wrk->w_Nr, cpu );
+		}
+	}
+	
 	end = clock();
     wrk->w_WorkMicros = end - start;
     wrk->w_WorkSeconds = wrk->w_WorkMicros / 1000000;
@@ -151,60 +157,48 @@ int WorkerRun( Worker *wrk )
 /**
  * Worker thread
  *
+ * Takes tasks from WorkerManager run queue until quit
+ *
  * @param w pointer to Worker FThread
  */
 void WorkerThread( void *w )
 {
 	FThread *thread = (FThread *)w;
 	Worker *wrk = (Worker *)thread->t_Data;
+	WorkerManager *wm = (WorkerManager *)wrk->w_Manager;
+	WorkerTask task;
+	
 	wrk->w_State = W_STATE_RUNNING;
 
 	// Run until quit
 	while( TRUE )
 	{
-		if( wrk->w_Quit == TRUE )
+		if( ( wrk->w_Quit == TRUE || wm->wm_Quit == TRUE ) && WorkerManagerQueueDepth( wm ) == 0 )
 		{
 			break;
 		}
-
-		if( pthread_mutex_lock( &(wrk->w_Mut) ) == 0 )
-		{
-			wrk->w_State = W_STATE_WAITING;
-
-			pthread_cond_wait( &(wrk->w_Cond), &(wrk->w_Mut) );
-
-			wrk->w_State = W_STATE_COMMAND_CALLED;
-			pthread_mutex_unlock( &(wrk->w_Mut) );
-			
-			if( wrk->w_Function != NULL && wrk->w_Data != NULL )
-			{
-				wrk->w_Function( wrk->w_Data );
-
-				if( pthread_mutex_lock( &(wrk->w_Mut) ) == 0 )
-				{
-					wrk->w_Data = NULL;
-					wrk->w_Function = NULL;
-					
-					pthread_mutex_unlock( &(wrk->w_Mut) );				
-				}
-			}
-			else
-			{
-				//FERROR("Function is not set\n");
-			}
-		}
-		else
+		
+		wrk->w_State = W_STATE_WAITING;
+		
+		if( WorkerManagerQueuePop( wm, &task ) != 0 )
 		{
-			FERROR("[WorkerThread] Cannot lock!\n");
+			continue;
 		}
-
-		if( wrk->w_Quit == TRUE ) 
+		
+		wrk->w_State = W_STATE_COMMAND_CALLED;
+		wrk->w_Function = task.wt_Function;
+		wrk->w_Data = task.wt_Data;
+		wrk->w_Request = task.wt_Request;
+		
+		if( wrk->w_Function != NULL && wrk->w_Data != NULL )
 		{
-			break;
+			wrk->w_Function( wrk->w_Data );
 		}
-
-		// Let others come to..
-		usleep( 100 );
+		
+		wrk->w_TasksDone++;
+		wrk->w_Data = NULL;
+		wrk->w_Function = NULL;
+		wrk->w_Request = NULL;
 	}
 	
 	wrk->w_Function = NULL;
@@ -212,4 +206,3 @@ void WorkerThread( void *w )
 	wrk->w_State = W_STATE_TO_REMOVE;
 	thread->t_Launched = FALSE;
 }
-
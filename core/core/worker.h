@@ -61,19 +61,20 @@ typedef struct Worker
 	FBOOL                    w_Quit;                             ///< if worker should quit
 	int                     w_Nr;                               ///< number of worker
 	FThread                 *w_Thread;                          ///< worker thread
-	pthread_cond_t          w_Cond;                             ///< condition
-	pthread_mutex_t         w_Mut;                              ///< mutex
+	void                    *w_Manager;                         ///< WorkerManager which feeds this worker
+	int                     w_CPU;                              ///< CPU to which worker is pinned, -1 when not pinned
 	
 	double 					w_WorkMicros;						///< frequency microseconds
 	float					w_WorkSeconds;						///< frequency seconds
 	void					*w_Request;						// pointer to http request (used to debug)
+	FULONG					w_TasksDone;						///< number of tasks processed by worker
 } Worker;
 
 //
 // Create worker
 //
 
-Worker *WorkerNew( );
+Worker *WorkerNew( int nr, void *wm );
 
 //
 // Start worker
@@ -88,15 +89,9 @@ void WorkerStart( Worker *w );
 void WorkerDelete( Worker *w );
 
 //
-//
-//
-
-int WorkerRun( Worker *w );
-
-//
-// Run function in thread
+// Launch worker thread, pin it to cpu when cpu >= 0
 //
 
-int WorkerRunCommand( Worker *wrk, void (*foo)( void *), void *d );
+int WorkerRun( Worker *w, int cpu );
 
 #endif // __CORE_THREAD_H__
@@ -33,17 +33,35 @@
 
 #include "worker_manager.h"
 #include <system/systembase.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * Get monotonic time in microseconds
+ *
+ * @return current time in microseconds
+ */
+static inline FQUAD GetMicros( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( (FQUAD)ts.tv_sec * 1000000 ) + ( ts.tv_nsec / 1000 );
+}
 
 /**
  * Creates a new Worker-Manager
  *
  * This function does all the initialization and launches the workers.
+ * Workers are long living threads which take tasks from bounded run queue.
  *
  * @param number maximum number of t workers handled byt the Worker-Manager
+ * @param queueSize number of slots in run queue (rounded up to power of 2)
+ * @param pin set to TRUE if workers should be pinned to cores
  * @return pointer to the Friend Worker-Manager structure
  * @return NULL in case of errors
  */
-WorkerManager *WorkerManagerNew( int number )
+WorkerManager *WorkerManagerNew( int number, int queueSize, FBOOL pin )
 {
 	WorkerManager *wm = NULL;
 	
@@ -55,18 +73,64 @@ WorkerManager *WorkerManagerNew( int number )
 		
 		wm->wm_LastWorker = 0;
 		wm->wm_MaxWorkers = number;
+		wm->wm_PinWorkers = pin;
+		
+		// queue size must be power of 2, otherwise mask will not work
+		
+		wm->wm_QueueSize = 2;
+		if( queueSize <= 0 )
+		{
+			queueSize = WORKERS_QUEUE_SIZE_DEFAULT;
+		}
+		while( wm->wm_QueueSize < (FULONG)queueSize )
+		{
+			wm->wm_QueueSize <<= 1;
+		}
+		wm->wm_QueueMask = wm->wm_QueueSize - 1;
+		
+		if( ( wm->wm_Queue = FCalloc( wm->wm_QueueSize, sizeof(WorkerTask) ) ) == NULL )
+		{
+			FERROR( "[WorkerManager] Cannot allocate memory for run queue\n" );
+			FFree( wm );
+			return NULL;
+		}
+		
+		FULONG j;
+		for( j = 0 ; j < wm->wm_QueueSize ; j++ )
+		{
+			wm->wm_Queue[ j ].wt_Sequence = j;
+		}
+		
+		sem_init( &(wm->wm_QueueItems), 0, 0 );
+		sem_init( &(wm->wm_QueueSlots), 0, wm->wm_QueueSize );
 		
 		if( ( wm->wm_Workers = FCalloc( wm->wm_MaxWorkers, sizeof(Worker *) ) ) != NULL )
 		{
+			int cpus = (int)sysconf( _SC_NPROCESSORS_ONLN );
+			if( cpus < 1 )
+			{
+				cpus = 1;
+			}
+			
 			for( ; i < wm->wm_MaxWorkers; i++ )
 			{
-				wm->wm_Workers[ i ] = WorkerNew( i ); 
-				WorkerRun( wm->wm_Workers[ i ]  ); 
+				wm->wm_Workers[ i ] = WorkerNew( i, wm );
+				if( wm->wm_Workers[ i ] != NULL )
+				{
+					if( WorkerRun( wm->wm_Workers[ i ], wm->wm_PinWorkers == TRUE ? ( i % cpus ) : -1 ) != 0 )
+					{
+						// WorkerRun releases worker on error
+						wm->wm_Workers[ i ] = NULL;
+					}
+				}
 			}
 		}
 		else
 		{
  			FERROR( "[WorkerManager] Cannot allocate memory for workers\n" );
+			sem_destroy( &(wm->wm_QueueItems) );
+			sem_destroy( &(wm->wm_QueueSlots) );
+			FFree( wm->wm_Queue );
 			FFree( wm );
 			return NULL;
 		}
@@ -77,7 +141,7 @@ WorkerManager *WorkerManagerNew( int number )
 		return NULL;
 	}
 	
-	Log( FLOG_INFO, "[WorkerManager] started %d threads\n", wm->wm_MaxWorkers );
+	Log( FLOG_INFO, "[WorkerManager] started %d threads, queue size %lu, pinned %d\n", wm->wm_MaxWorkers, wm->wm_QueueSize, wm->wm_PinWorkers );
 	
 	return wm;
 }
@@ -93,154 +157,287 @@ void WorkerManagerDelete( WorkerManager *wm )
 	{
 		int i = 0;
 		
+		wm->wm_Quit = TRUE;
+		
 		if( wm->wm_Workers )
 		{
-			for( ; i < wm->wm_MaxWorkers ; i++ )
+			for( i = 0 ; i < wm->wm_MaxWorkers ; i++ )
+			{
+				if( wm->wm_Workers[ i ] != NULL )
+				{
+					wm->wm_Workers[ i ]->w_Quit = TRUE;
+				}
+			}
+			
+			// wake up all workers, they will notice quit flag
+			for( i = 0 ; i < wm->wm_MaxWorkers ; i++ )
+			{
+				sem_post( &(wm->wm_QueueItems) );
+			}
+			
+			// wake up producers which wait for free slot
+			sem_post( &(wm->wm_QueueSlots) );
+			
+			for( i = 0 ; i < wm->wm_MaxWorkers ; i++ )
 			{
 				WorkerDelete( wm->wm_Workers[ i ] );
 			}
 			FFree( wm->wm_Workers );
 		}
+		
+		DEBUG( "[WorkerManager] Deleted, tasks enqueued %lu dequeued %lu\n", wm->wm_StatEnqueued, wm->wm_StatDequeued );
+		
+		sem_destroy( &(wm->wm_QueueItems) );
+		sem_destroy( &(wm->wm_QueueSlots) );
+		FFree( wm->wm_Queue );
 		FFree( wm );
 	}
 }
 
-
-
-//
-// Start worker
-//
-
-inline int WorkerRunCommand( Worker *w, void (*foo)( void *), void *d )
+/**
+ * Put task into run queue
+ *
+ * Lock-free bounded MPMC queue (sequence number per slot).
+ * Caller must own free slot (wm_QueueSlots).
+ *
+ * @param wm pointer to WorkerManager
+ * @param foo pointer to function which will be called by worker
+ * @param d pointer to data passed to function
+ * @param wrkinfo pointer to http request (used to debug)
+ */
+static inline void QueuePush( WorkerManager *wm, void (*foo)( void *), void *d, void *wrkinfo )
 {
-
-	if( w != NULL )
+	WorkerTask *task;
+	FULONG pos = __atomic_load_n( &(wm->wm_QueueHead), __ATOMIC_RELAXED );
+	
+	while( TRUE )
 	{
-		if( w->w_Thread != NULL )
+		task = &(wm->wm_Queue[ pos & wm->wm_QueueMask ]);
+		FULONG seq = __atomic_load_n( &(task->wt_Sequence), __ATOMIC_ACQUIRE );
+		FLONG diff = (FLONG)seq - (FLONG)pos;
+		
+		if( diff == 0 )
 		{
+			if( __atomic_compare_exchange_n( &(wm->wm_QueueHead), &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
 			{
-				w->w_Function = foo;
-				w->w_Data = d;
-				pthread_cond_signal( &(w->w_Cond) );
-				
-				int wait = 0;
-				
-				while( TRUE )
-				{
-					if( w->w_State == W_STATE_WAITING || w->w_State == W_STATE_COMMAND_CALLED )
-					{
-						break;
-					}
-					DEBUG("[WorkerRunCommand] --------waiting for running state: %d\n", wait++ );
-					usleep( 10 );
-				}
+				break;
 			}
 		}
+		else if( diff < 0 )
+		{
+			// slot is not released yet by consumer, it will be soon
+			sched_yield();
+			pos = __atomic_load_n( &(wm->wm_QueueHead), __ATOMIC_RELAXED );
+		}
 		else
 		{
-			//pthread_mutex_unlock( &(w->w_Mut) );
-			FERROR("[WorkerRunCommand] Thread not initalized\n");
-			return 1;
+			pos = __atomic_load_n( &(wm->wm_QueueHead), __ATOMIC_RELAXED );
 		}
 	}
+	
+	task->wt_Function = foo;
+	task->wt_Data = d;
+	task->wt_Request = wrkinfo;
+	task->wt_EnqueueTime = GetMicros();
+	
+	__atomic_store_n( &(task->wt_Sequence), pos + 1, __ATOMIC_RELEASE );
+}
 
+/**
+ * Take next task from run queue
+ *
+ * Function blocks until task is available or manager is going down.
+ *
+ * @param wm pointer to WorkerManager
+ * @param dst pointer to place where task will be copied
+ * @return 0 when success, otherwise error number
+ */
+int WorkerManagerQueuePop( WorkerManager *wm, WorkerTask *dst )
+{
+	while( sem_wait( &(wm->wm_QueueItems) ) != 0 )
+	{
+		if( errno != EINTR )
+		{
+			return 1;
+		}
+	}
+	
+	if( wm->wm_Quit == TRUE && WorkerManagerQueueDepth( wm ) == 0 )
+	{
+		return 2;
+	}
+	
+	WorkerTask *task;
+	FULONG pos = __atomic_load_n( &(wm->wm_QueueTail), __ATOMIC_RELAXED );
+	
+	while( TRUE )
+	{
+		task = &(wm->wm_Queue[ pos & wm->wm_QueueMask ]);
+		FULONG seq = __atomic_load_n( &(task->wt_Sequence), __ATOMIC_ACQUIRE );
+		FLONG diff = (FLONG)seq - (FLONG)( pos + 1 );
+		
+		if( diff == 0 )
+		{
+			if( __atomic_compare_exchange_n( &(wm->wm_QueueTail), &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				break;
+			}
+		}
+		else if( diff < 0 )
+		{
+			// producer reserved slot but did not publish it yet
+			sched_yield();
+			pos = __atomic_load_n( &(wm->wm_QueueTail), __ATOMIC_RELAXED );
+		}
+		else
+		{
+			pos = __atomic_load_n( &(wm->wm_QueueTail), __ATOMIC_RELAXED );
+		}
+	}
+	
+	dst->wt_Function = task->wt_Function;
+	dst->wt_Data = task->wt_Data;
+	dst->wt_Request = task->wt_Request;
+	dst->wt_EnqueueTime = task->wt_EnqueueTime;
+	
+	__atomic_store_n( &(task->wt_Sequence), pos + wm->wm_QueueMask + 1, __ATOMIC_RELEASE );
+	sem_post( &(wm->wm_QueueSlots) );
+	
+	// update statistics
+	
+	FQUAD wait = GetMicros() - dst->wt_EnqueueTime;
+	__atomic_add_fetch( &(wm->wm_StatDequeued), 1, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &(wm->wm_StatWaitMicros), wait, __ATOMIC_RELAXED );
+	
+	FQUAD maxWait = __atomic_load_n( &(wm->wm_StatMaxWaitMicros), __ATOMIC_RELAXED );
+	while( wait > maxWait && !__atomic_compare_exchange_n( &(wm->wm_StatMaxWaitMicros), &maxWait, wait, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ){}
+	
 	return 0;
 }
 
+/**
+ * Get number of tasks which wait in run queue
+ *
+ * @param wm pointer to WorkerManager
+ * @return number of waiting tasks
+ */
+FULONG WorkerManagerQueueDepth( WorkerManager *wm )
+{
+	FULONG head = __atomic_load_n( &(wm->wm_QueueHead), __ATOMIC_RELAXED );
+	FULONG tail = __atomic_load_n( &(wm->wm_QueueTail), __ATOMIC_RELAXED );
+	return head > tail ? head - tail : 0;
+}
 
+//
+// put task into queue, slot must be reserved already
+//
 
-static int testquit = 0;
+static inline int QueueRunReserved( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo )
+{
+	QueuePush( wm, foo, d, wrkinfo );
+	
+	FULONG depth = WorkerManagerQueueDepth( wm );
+	__atomic_add_fetch( &(wm->wm_StatEnqueued), 1, __ATOMIC_RELAXED );
+	
+	FULONG maxDepth = __atomic_load_n( &(wm->wm_StatMaxDepth), __ATOMIC_RELAXED );
+	while( depth > maxDepth && !__atomic_compare_exchange_n( &(wm->wm_StatMaxDepth), &maxDepth, depth, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ){}
+	
+	sem_post( &(wm->wm_QueueItems) );
+	
+	return 0;
+}
 
 /**
- * Adds a new worker to the list of workers and sends a first initial call
+ * Adds a new task to the run queue of Worker-Manager
  *
- * If the average workers-manager w_AverageWorkSeconds filed is not defined,
- * the new worker will be added with its own frequency.
- * This function waits for all the workers in the list to be completed
- * or exits after a 25*1500 milliseconds.
+ * Task will be taken by first idle worker. When run queue is full
+ * caller is blocked until one of workers take task from queue (backpressure).
+ * Only threads which are not needed to drain the queue (main epoll loop) may use it,
+ * workers and other service threads must use WorkerManagerTryRun.
  *
  * @param wm pointer to the Worker-Manager structure
  * @param foo pointer to the message-handler
  * @param d pointer to the data associated with the call
- * @return 0
- * @todo FL>PS debug code still present here, exits Friend Core if some workers
- * 		are stuck!
+ * @param wrkinfo pointer to http request (used to debug)
+ * @return 0 when success, otherwise error number
  */
 int WorkerManagerRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo )
 {
-	int i = 0;
-	int max = 0;
-	Worker *wrk = NULL;
-	
 	if( wm == NULL )
 	{
 		FERROR("Work manager is NULL!\n");
+		return 1;
 	}
 	
-	while( TRUE )
+	if( wm->wm_Quit == TRUE )
 	{
-		wrk = NULL;
-
-		max++; wm->wm_LastWorker++;
-		if( wm->wm_LastWorker >= wm->wm_MaxWorkers )
-		{ 
-			wm->wm_LastWorker = 0; 
-		}
-
-		// Safely test the state of the worker
-		//if( pthread_mutex_trylock( &wm->wm_Workers[ wm->wm_LastWorker ]->w_Mut ) == 0 )
-		{
-			if( wm->wm_Workers[ wm->wm_LastWorker ]->w_State == W_STATE_WAITING )
-			{
-				wrk = wm->wm_Workers[ wm->wm_LastWorker ];
-			
-				// Register worker index..
-				//struct SocketThreadData *td = ( struct SocketThreadData *)d;
-				//td->workerIndex = wm->wm_LastWorker;
-			}
-			//pthread_mutex_unlock( &wm->wm_Workers[ wm->wm_LastWorker ]->w_Mut );
-		}
+		return 2;
+	}
+	
+	// reserve slot, block when queue is full
 	
-		if( wrk != NULL )
+	if( sem_trywait( &(wm->wm_QueueSlots) ) != 0 )
+	{
+		FQUAD start = GetMicros();
+		
+		__atomic_add_fetch( &(wm->wm_StatBlocked), 1, __ATOMIC_RELAXED );
+		DEBUG( "[WorkManagerRun] Run queue is full, waiting\n");
+		
+		while( sem_wait( &(wm->wm_QueueSlots) ) != 0 )
 		{
-			if( wm->w_AverageWorkSeconds == 0 )
-			{
-				wm->w_AverageWorkSeconds = wrk->w_WorkSeconds;
-			}
-			else
+			if( errno != EINTR )
 			{
-				wm->w_AverageWorkSeconds += wrk->w_WorkSeconds;
-				wm->w_AverageWorkSeconds /= 2;
+				return 3;
 			}
-			wrk->w_Request = wrkinfo;
-			WorkerRunCommand( wrk, foo, d );
-			testquit = 0;
-			
-			break;
-		}
-		else
-		{
-			Log( FLOG_INFO, "[WorkManagerRun] Worker is busy, waiting\n");
-			usleep( 100 );
 		}
 		
-		if( max > wm->wm_MaxWorkers )
+		__atomic_add_fetch( &(wm->wm_StatBlockedMicros), GetMicros() - start, __ATOMIC_RELAXED );
+		
+		if( wm->wm_Quit == TRUE )
 		{
-			//Log( FLOG_INFO, "[WorkManagerRun] All workers are busy, waiting\n");
-			testquit++;
-			if( testquit > 25 )
-			{
-				//
-				FERROR("Worker testquit > 25 \n");
-				//exit( 0 ); // <- die! only for debug
-				testquit = 0;
-				usleep( 15000 );
-			}
-			max = 0;
+			// let other producers know too
+			sem_post( &(wm->wm_QueueSlots) );
+			return 2;
 		}
 	}
 	
-	return 0;
+	return QueueRunReserved( wm, foo, d, wrkinfo );
+}
+
+/**
+ * Adds a new task to the run queue of Worker-Manager without waiting
+ *
+ * Used by workers, websocket, communication and event threads. When queue is full
+ * function returns WORKER_MANAGER_QUEUE_FULL at once and caller must run task itself
+ * or drop it and release its data.
+ *
+ * @param wm pointer to the Worker-Manager structure
+ * @param foo pointer to the message-handler
+ * @param d pointer to the data associated with the call
+ * @param wrkinfo pointer to http request (used to debug)
+ * @return 0 when success, otherwise error number
+ */
+int WorkerManagerTryRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo )
+{
+	if( wm == NULL )
+	{
+		FERROR("Work manager is NULL!\n");
+		return 1;
+	}
+	
+	if( wm->wm_Quit == TRUE )
+	{
+		return 2;
+	}
+	
+	if( sem_trywait( &(wm->wm_QueueSlots) ) != 0 )
+	{
+		__atomic_add_fetch( &(wm->wm_StatRejected), 1, __ATOMIC_RELAXED );
+		DEBUG( "[WorkManagerTryRun] Run queue is full\n");
+		return WORKER_MANAGER_QUEUE_FULL;
+	}
+	
+	return QueueRunReserved( wm, foo, d, wrkinfo );
 }
 
 /**
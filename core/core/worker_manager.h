@@ -25,6 +25,32 @@
 
 #include "worker.h"
 #include "network/socket.h"
+#include <semaphore.h>
+
+//
+// Default size of run queue, must be power of 2
+//
+
+#define WORKERS_QUEUE_SIZE_DEFAULT	1024
+
+//
+// WorkerManagerTryRun result when there is no free slot in run queue
+//
+
+#define WORKER_MANAGER_QUEUE_FULL	4
+
+//
+// Single task waiting in run queue
+//
+
+typedef struct WorkerTask
+{
+	volatile FULONG					wt_Sequence;			// slot sequence number, used by lock-free queue
+	void							(*wt_Function)( void *data );
+	void							*wt_Data;
+	void							*wt_Request;			// pointer to http request (used to debug)
+	FQUAD							wt_EnqueueTime;			// time when task was put into queue (microseconds)
+} WorkerTask;
 
 typedef struct WorkerManager
 {
@@ -32,6 +58,29 @@ typedef struct WorkerManager
 	Worker							**wm_Workers;			// array of  workers
 	int 								wm_MaxWorkers;
 	int 								wm_LastWorker;
+	FBOOL								wm_Quit;				// set when manager is going down
+	FBOOL								wm_PinWorkers;			// pin workers to cores
+	
+	// bounded MPMC run queue
+	
+	WorkerTask						*wm_Queue;				// ring of tasks
+	FULONG							wm_QueueSize;			// number of slots (power of 2)
+	FULONG							wm_QueueMask;			// wm_QueueSize - 1
+	volatile FULONG					wm_QueueHead;			// next slot to fill
+	volatile FULONG					wm_QueueTail;			// next slot to take
+	sem_t							wm_QueueItems;			// number of tasks ready to take
+	sem_t							wm_QueueSlots;			// number of free slots, producers block here when queue is full
+	
+	// statistics
+	
+	volatile FULONG					wm_StatEnqueued;		// tasks put into queue
+	volatile FULONG					wm_StatDequeued;		// tasks taken by workers
+	volatile FULONG					wm_StatMaxDepth;		// highest queue depth seen
+	volatile FULONG					wm_StatBlocked;			// how many times producer waited for free slot
+	volatile FQUAD					wm_StatBlockedMicros;	// time producers spent waiting for free slot
+	volatile FULONG					wm_StatRejected;		// tasks not queued by WorkerManagerTryRun because queue was full
+	volatile FQUAD					wm_StatWaitMicros;		// time tasks spent in queue
+	volatile FQUAD					wm_StatMaxWaitMicros;	// longest time task spent in queue
 	
 	float								w_AverageWorkSeconds;
 } WorkerManager;
@@ -40,7 +89,7 @@ typedef struct WorkerManager
 // Create worker manager
 //
 
-WorkerManager *WorkerManagerNew( int nr );
+WorkerManager *WorkerManagerNew( int nr, int queueSize, FBOOL pin );
 
 //
 // Delete worker manager
@@ -54,6 +103,24 @@ void WorkerManagerDelete( WorkerManager *wm );
 
 int WorkerManagerRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo );
 
+//
+// add worker to list, do not wait when queue is full
+//
+
+int WorkerManagerTryRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo );
+
+//
+// take next task from queue (called by workers)
+//
+
+int WorkerManagerQueuePop( WorkerManager *wm, WorkerTask *task );
+
+//
+// number of tasks waiting in queue
+//
+
+FULONG WorkerManagerQueueDepth( WorkerManager *wm );
+
 //
 //
 //
@@ -51,7 +51,7 @@ typedef struct SQLConnection
 
 	void			*sql_Con;
 	//MYSQL 			*sql_Con;			// sql connection
-	void			*sql_SpecialData;
+	void			*sql_SpecialData;	// prepared statements cache
 	FBOOL			sql_Recconect;	// should I reconnect
 }SQLConnection;
 
@@ -90,6 +90,10 @@ typedef struct SQLLibrary
 	void 					(*Delete)( struct SQLLibrary *l, const FULONG *descr, void *data );
 	void					(*DeleteWhere)( struct SQLLibrary *l, const FULONG *descr, char *where );
 	void 					*(*Query)( struct SQLLibrary *l, const char *sel );
+	void 					*(*QueryPrepared)( struct SQLLibrary *l, const char *query, const char **params, int paramsNumber );
+	void					*(*LoadIteratorNew)( struct SQLLibrary *l, const FULONG *descr, char *where );		// rows are streamed, connection cannot be used until iterator is deleted
+	void					*(*LoadIteratorNext)( struct SQLLibrary *l, void *it );
+	void					(*LoadIteratorDelete)( struct SQLLibrary *l, void *it );
 	int 					(*NumberOfRecords)( struct SQLLibrary *l, const FULONG *descr, char *where );
 	int 					(*NumberOfRecordsCustomQuery)( struct SQLLibrary *l, const char *query );
 	char 					**(*FetchRow)( struct SQLLibrary *l, void *res );
@@ -101,6 +105,7 @@ typedef struct SQLLibrary
 	int						(*GetStatus)( struct Library *l );
 
 	SQLConnection con;
+	void					*l_PoolSlot;		// SQLConPool entry, set by SystemBase
 	
 } SQLLibrary;
 
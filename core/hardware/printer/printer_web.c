@@ -136,8 +136,9 @@ Http* PrinterManagerWebRequest( void *lb, char **urlpath, Http* request, UserSes
 
 			INFO("Printer JSON INFO: %s\n", bs->bs_Buffer);
 
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 
 			BufStringDelete(bs);
 		}
@@ -121,8 +121,9 @@ Http* USBManagerWebRequest( void *lb, char **urlpath, Http* request, UserSession
 
 			INFO("USBPORTS JSON INFO: %s\n", bs->bs_Buffer);
 
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 
 			BufStringDelete(bs);
 		}
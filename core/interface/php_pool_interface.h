@@ -0,0 +1,53 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ * 
+ *  PHP pool Interface definition
+ *
+ *  @date pushed 2017
+ */
+#ifndef __INTERFACE_PHP_POOL_INTERFACE_H__
+#define __INTERFACE_PHP_POOL_INTERFACE_H__
+
+#include <system/php/php_pool.h>
+
+typedef struct PHPPoolInterface
+{
+	PHPPoolRequest				*(*PHPPoolOpen)( PHPPool *pp, const char *script, const char **args, int argsNumber );
+	int							(*PHPPoolRead)( PHPPoolRequest *pr, char *buffer, int size );
+	void						(*PHPPoolClose)( PHPPoolRequest *pr );
+	ListString					*(*PHPPoolRun)( PHPPool *pp, const char *script, const char **args, int argsNumber );
+}PHPPoolInterface;
+
+//
+// init function
+//
+
+inline void PHPPoolInterfaceInit( PHPPoolInterface *si )
+{
+	si->PHPPoolOpen = PHPPoolOpen;
+	si->PHPPoolRead = PHPPoolRead;
+	si->PHPPoolClose = PHPPoolClose;
+	si->PHPPoolRun = PHPPoolRun;
+}
+
+#endif
@@ -43,6 +43,8 @@ typedef struct SocketInterface
 	int						(*SocketRead)( Socket* sock, char* data, unsigned int length, unsigned int pass );
 	int						(*SocketWaitRead)( Socket* sock, char* data, unsigned int length, unsigned int pass, int sec );
 	BufString*				(*SocketReadTillEnd)( Socket* sock, unsigned int pass, int sec );
+	BufString*				(*SocketReadDataForm)( Socket* sock, int sec, FBOOL *closed );
+	FBOOL					(*SocketIsAlive)( Socket* sock );
 	int						(*SocketWrite)( Socket* s, char* data, FQUAD length );
 	void					(*SocketClose)( Socket* s );
 	void					(*SocketFree)( Socket *s );
@@ -72,6 +74,8 @@ inline void SocketInterfaceInit( SocketInterface *si )
 	si->SocketRead = SocketRead;
 	si->SocketWaitRead = SocketWaitRead;
 	si->SocketReadTillEnd = SocketReadTillEnd;
+	si->SocketReadDataForm = SocketReadDataForm;
+	si->SocketIsAlive = SocketIsAlive;
 	si->SocketWrite = SocketWrite;
 	si->SocketClose = SocketClose;
 	si->SocketFree = SocketFree;
@@ -34,6 +34,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include "network/http.h"
 #include "util/string.h"
 #include <util/log/log.h>
@@ -363,6 +365,51 @@ int HttpParseInt( char* str )
 	}
 }
 
+/**
+ * parse Content-Length value
+ *
+ * @param str pointer to header value, it ends with end of line or end of string
+ * @return content length or -1 when value is not a valid non-negative number
+ */
+
+FQUAD HttpParseContentLength( const char *str )
+{
+	if( str == NULL )
+	{
+		return -1;
+	}
+	
+	while( *str == ' ' || *str == '\t' )
+	{
+		str++;
+	}
+	
+	// strtoll would accept sign, value must start with digit
+	if( *str < '0' || *str > '9' )
+	{
+		return -1;
+	}
+	
+	char *end = NULL;
+	errno = 0;
+	long long v = strtoll( str, &end, 10 );
+	if( errno == ERANGE || v < 0 )
+	{
+		return -1;
+	}
+	
+	while( *end == ' ' || *end == '\t' )
+	{
+		end++;
+	}
+	if( *end != 0 && *end != '\r' && *end != '\n' )
+	{
+		return -1;
+	}
+	
+	return (FQUAD)v;
+}
+
 /**
  * Parse Http header
  *
@@ -614,11 +661,13 @@ int HttpParseHeader( Http* http, const char* request, unsigned int length )
 						{
 							http->h_RespHeaders[ HTTP_HEADER_CONTENT_LENGTH ] = lineStartPtr+16;
 							
-							char *val = StringDuplicateEOL( lineStartPtr+16 );
-							if( val != NULL )
+							http->h_ContentLength = HttpParseContentLength( lineStartPtr+16 );
+							if( http->h_ContentLength < 0 )
 							{
-								http->h_ContentLength = atoi( val );
-								FFree( val );
+								FERROR("[HttpParseHeader] Invalid Content-Length\n");
+								http->h_ContentLength = 0;
+								FFree( currentToken );
+								return 400;
 							}
 
 							copyValue = FALSE;
@@ -699,8 +748,8 @@ int HttpParseHeader( Http* http, const char* request, unsigned int length )
 					char* value = StringDuplicateN( fieldValuePtr, valLength );
 					List* list = CreateList();
 
-					// Do not split Set-Cookie field
-					if( strcmp( currentToken, "set-cookie" ) == 0 )
+					// Do not split Set-Cookie field and dates
+					if( strcmp( currentToken, "set-cookie" ) == 0 || strcmp( currentToken, "if-modified-since" ) == 0 )
 					{
 						AddToList( list, value );
 					}
@@ -993,6 +1042,293 @@ Content-Type: application/octet-stream
 	return 0;
 }
 
+/**
+ * Move streamed body data from socket to body buffer
+ *
+ * @param http pointer to Http request
+ * @return number of new bytes in buffer, 0 when buffer is full or whole body was read, -1 when error appear
+ */
+
+static int HttpBodyFill( Http *http )
+{
+	// Consumed data is not needed anymore
+	if( http->h_BodyBufferPos > 0 )
+	{
+		memmove( http->h_BodyBuffer, http->h_BodyBuffer + http->h_BodyBufferPos, http->h_BodyBufferLen - http->h_BodyBufferPos );
+		http->h_BodyBufferLen -= http->h_BodyBufferPos;
+		http->h_BodyBufferPos = 0;
+	}
+	
+	FQUAD space = http->h_BodyBufferSize - http->h_BodyBufferLen;
+	if( space > http->h_BodyRemaining )
+	{
+		space = http->h_BodyRemaining;
+	}
+	
+	if( space <= 0 )
+	{
+		return 0;
+	}
+	
+	int res = SocketRead( http->h_Socket, http->h_BodyBuffer + http->h_BodyBufferLen, (unsigned int)space, 1 );
+	if( res <= 0 )
+	{
+		FERROR("[HttpBodyFill] Cannot read body, %lld bytes are missing\n", http->h_BodyRemaining );
+		return -1;
+	}
+	
+	http->h_BodyBufferLen += res;
+	http->h_BodyRemaining -= res;
+	http->h_BodyBuffer[ http->h_BodyBufferLen ] = 0;
+	
+	return res;
+}
+
+/**
+ * Find data in streamed body, body buffer is filled until data is found
+ *
+ * @param http pointer to Http request
+ * @param str data which will be searched
+ * @param len length of data
+ * @return position of data counted from first not consumed byte, -1 when data was not found
+ */
+
+static int HttpBodyFind( Http *http, char *str, int len )
+{
+	int checked = 0;
+	
+	while( TRUE )
+	{
+		int avail = http->h_BodyBufferLen - http->h_BodyBufferPos;
+		if( avail - checked >= len )
+		{
+			FQUAD pos = FindInBinaryPOS( str, len, http->h_BodyBuffer + http->h_BodyBufferPos + checked, avail - checked );
+			if( pos >= 0 )
+			{
+				return checked + (int)pos;
+			}
+			checked = avail - len + 1;
+		}
+		
+		if( HttpBodyFill( http ) <= 0 )
+		{
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Read and drop rest of streamed body
+ *
+ * @param http pointer to Http request
+ */
+
+static void HttpBodyDrain( Http *http )
+{
+	do
+	{
+		http->h_BodyBufferPos = http->h_BodyBufferLen;
+	}
+	while( HttpBodyFill( http ) > 0 );
+}
+
+/**
+ * Parse streamed multipart body until file data or end of body is reached
+ *
+ * Parameters are stored in parsedPostContent. Found file is added to h_FileList and
+ * its data can be read by HttpFileRead.
+ *
+ * @param http pointer to Http request
+ * @return 0 when success, otherwise error number
+ */
+
+static int ParseMultipartStream( Http* http )
+{
+	char delimiter[ 260 ];
+	int dlen = snprintf( delimiter, sizeof( delimiter ), "\r\n%s", http->h_PartDivider );
+	
+	while( TRUE )
+	{
+		// Divider is followed by "--" at the end of body or by "\r\n" before next part
+		while( http->h_BodyBufferLen - http->h_BodyBufferPos < 2 )
+		{
+			if( HttpBodyFill( http ) <= 0 )
+			{
+				FERROR("[ParseMultipartStream] Unexpected end of body\n");
+				return -1;
+			}
+		}
+		
+		char *ptr = http->h_BodyBuffer + http->h_BodyBufferPos;
+		if( ptr[ 0 ] == '-' && ptr[ 1 ] == '-' )
+		{
+			HttpBodyDrain( http );
+			return 0;
+		}
+		http->h_BodyBufferPos += 2;
+		
+		int hlen = HttpBodyFind( http, "\r\n\r\n", 4 );
+		if( hlen < 0 )
+		{
+			FERROR("[ParseMultipartStream] Part header is too long or body is not complete\n");
+			return -2;
+		}
+		
+		char *header = http->h_BodyBuffer + http->h_BodyBufferPos;
+		header[ hlen ] = 0;
+		http->h_BodyBufferPos += hlen + 4;
+		
+		char *key = NULL;
+		char *nameStart = strstr( header, "Content-Disposition: form-data; name=\"" );
+		if( nameStart != NULL )
+		{
+			char *nameEnd = strchr( nameStart + 38, '"' );
+			if( nameEnd != NULL )
+			{
+				key = StringDuplicateN( nameStart + 38, (int)(nameEnd - ( nameStart + 38 ) ) );
+			}
+		}
+		
+		//
+		// file, its data will be read by handler
+		//
+		
+		char *fname = strstr( header, "filename=\"" );
+		if( fname != NULL )
+		{
+			fname += 10;
+			char *fnameend = strchr( fname, '"' );
+			
+			if( key != NULL )
+			{
+				FFree( key );
+			}
+			
+			HttpFile *newFile = FCalloc( 1, sizeof( HttpFile ) );
+			if( newFile == NULL || fnameend == NULL )
+			{
+				FERROR("[ParseMultipartStream] Cannot create file entry\n");
+				if( newFile != NULL )
+				{
+					FFree( newFile );
+				}
+				return -3;
+			}
+			
+			int fnamesize = (int)(fnameend - fname);
+			if( fnamesize > (int)sizeof( newFile->hf_FileName ) - 1 )
+			{
+				fnamesize = sizeof( newFile->hf_FileName ) - 1;
+			}
+			strncpy( newFile->hf_FileName, fname, fnamesize );
+			newFile->hf_Stream = TRUE;
+			
+			// Streamed files are kept in body order
+			if( http->h_FileList == NULL )
+			{
+				http->h_FileList = newFile;
+			}
+			else
+			{
+				HttpFile *last = http->h_FileList;
+				while( last->node.mln_Succ != NULL )
+				{
+					last = (HttpFile *)last->node.mln_Succ;
+				}
+				last->node.mln_Succ = (MinNode *)newFile;
+			}
+			http->h_StreamFile = newFile;
+			
+			INFO("[ParseMultipartStream] Streamed file %s\n", newFile->hf_FileName );
+			return 0;
+		}
+		
+		//
+		// its not file its parameter
+		//
+		
+		int vlen = HttpBodyFind( http, delimiter, dlen );
+		if( vlen < 0 )
+		{
+			FERROR("[ParseMultipartStream] Parameter is too long or body is not complete\n");
+			if( key != NULL )
+			{
+				FFree( key );
+			}
+			return -4;
+		}
+		
+		if( key != NULL )
+		{
+			char *value = StringDuplicateN( http->h_BodyBuffer + http->h_BodyBufferPos, vlen );
+			
+			HashmapPut( http->parsedPostContent, key, value );
+			
+			DEBUG("[ParseMultipartStream] Parse multipart KEY: %s\n", key );
+		}
+		http->h_BodyBufferPos += vlen + dlen;
+	}
+	return 0;
+}
+
+/**
+ * Start reading of streamed multipart body
+ *
+ * @param http pointer to Http request
+ * @param data part of body which was already received
+ * @param length length of received data
+ * @return 0 when success, otherwise error number
+ */
+
+static int HttpBodyStreamStart( Http* http, char *data, int length )
+{
+	if( length < 0 )
+	{
+		length = 0;
+	}
+	
+	http->h_BodyBufferSize = length > HTTP_BODY_STREAM_BUFFER_SIZE ? length : HTTP_BODY_STREAM_BUFFER_SIZE;
+	if( ( http->h_BodyBuffer = FMalloc( http->h_BodyBufferSize + 1 ) ) == NULL )
+	{
+		FERROR("[HttpBodyStreamStart] Cannot allocate memory for body buffer\n");
+		return -1;
+	}
+	
+	if( length > 0 )
+	{
+		memcpy( http->h_BodyBuffer, data, length );
+	}
+	http->h_BodyBuffer[ length ] = 0;
+	http->h_BodyBufferLen = length;
+	http->h_BodyBufferPos = 0;
+	http->h_BodyRemaining = http->h_ContentLength - length;
+	
+	if( http->parsedPostContent != NULL )
+	{
+		HashmapFree( http->parsedPostContent );
+	}
+	if( ( http->parsedPostContent = HashmapNew() ) == NULL )
+	{
+		return -2;
+	}
+	
+	// First line is divider
+	int dl = HttpBodyFind( http, "\r\n", 2 );
+	if( dl <= 0 || dl >= (int)sizeof( http->h_PartDivider ) )
+	{
+		FERROR("[HttpBodyStreamStart] Cannot find multipart divider\n");
+		return -3;
+	}
+	memset( http->h_PartDivider, 0, sizeof( http->h_PartDivider ) );
+	strncpy( http->h_PartDivider, http->h_BodyBuffer + http->h_BodyBufferPos, dl );
+	http->h_BodyBufferPos += dl;
+	
+	DEBUG("[HttpBodyStreamStart] Streaming body, size %lld divider %s\n", http->h_ContentLength, http->h_PartDivider );
+	
+	return ParseMultipartStream( http );
+}
+
 /**
  * Parse first part of the request
  *
@@ -1036,11 +1372,28 @@ inline int HttpParsePartialRequest( Http* http, char* data, unsigned int length
 				HttpParseHeader( http, data, length );
 			}
 			
+			// Big multipart body stays in socket, handler reads files with HttpFileRead
+			if( http->h_BodyStream == TRUE && http->h_ContentLength > 0 )
+			{
+				int dataOffset = ( found - data + 4 );
+				if( HttpBodyStreamStart( http, found + 4, length - dataOffset ) != 0 )
+				{
+					return -1;
+				}
+				return 1;
+			}
+			
 			//if( (content = HttpGetHeaderFromTable( http, HTTP_HEADER_CONTENT_LENGTH ) ) )
 			//if( ( content = HttpGetHeader( http, "content-length", 0 ) ) )
 			if( http->h_ContentLength > 0 )
 			{
-				size = http->h_ContentLength;
+				// body is kept in memory
+				if( http->h_ContentLength > INT_MAX - 1 )
+				{
+					FERROR("[HttpParsePartialRequest] Content-Length %lld is too big\n", http->h_ContentLength );
+					return -1;
+				}
+				size = (int)http->h_ContentLength;
 
 				if( size > 0 )
 				{
@@ -1217,6 +1570,165 @@ char* HttpGetHeaderFromTable( Http* http, int pos )
 	return http->h_RespHeaders[ pos ];
 }
 
+/**
+ * Build strong entity tag. Tag is changed when file is modified or its size change.
+ *
+ * @param dst pointer to buffer where tag will be stored (with quotes)
+ * @param size size of buffer
+ * @param id file identifier (for example path hash)
+ * @param modified file modification time
+ * @param length file size
+ * @param suffix additional text added to tag (for example content encoding), can be NULL
+ */
+
+void HttpETagBuild( char *dst, unsigned int size, FUQUAD id, FQUAD modified, FQUAD length, const char *suffix )
+{
+	if( suffix != NULL )
+	{
+		snprintf( dst, size, "\"%llx-%llx-%llx-%s\"", (unsigned long long)id, (unsigned long long)modified, (unsigned long long)length, suffix );
+	}
+	else
+	{
+		snprintf( dst, size, "\"%llx-%llx-%llx\"", (unsigned long long)id, (unsigned long long)modified, (unsigned long long)length );
+	}
+}
+
+/**
+ * Format date in format used by http headers, for example "Sun, 06 Nov 1994 08:49:37 GMT"
+ *
+ * @param dst pointer to buffer where date will be stored
+ * @param size size of buffer
+ * @param t time
+ */
+
+void HttpDateFormat( char *dst, unsigned int size, time_t t )
+{
+	static const char *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	struct tm tm;
+	
+	// names are not taken from locale
+	gmtime_r( &t, &tm );
+	snprintf( dst, size, "%s, %02d %s %04d %02d:%02d:%02d GMT", days[ tm.tm_wday ], tm.tm_mday, months[ tm.tm_mon ], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec );
+}
+
+/**
+ * Parse date in format used by http headers
+ *
+ * @param date date as string
+ * @return time or 0 when date cannot be parsed
+ */
+
+static time_t HttpDateParse( const char *date )
+{
+	static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	char month[ 4 ];
+	int day, year, hour, min, sec;
+	
+	// skip day name
+	const char *ptr = strchr( date, ',' );
+	ptr = ( ptr != NULL ) ? ptr + 1 : date;
+	
+	if( sscanf( ptr, "%d %3s %d %d:%d:%d", &day, month, &year, &hour, &min, &sec ) != 6 )
+	{
+		return 0;
+	}
+	
+	const char *m = strstr( months, month );
+	if( m == NULL || strlen( month ) != 3 )
+	{
+		return 0;
+	}
+	int mon = ( m - months ) / 3 + 1;
+	
+	// days since 1970-01-01 in proleptic gregorian calendar (timegm is not available in c99)
+	int y = year - ( mon <= 2 );
+	int era = ( y >= 0 ? y : y - 399 ) / 400;
+	int yoe = y - era * 400;
+	int doy = ( 153 * ( mon + ( mon > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	FQUAD days = (FQUAD)era * 146097 + doe - 719468;
+	
+	return (time_t)( days * 86400 + hour * 3600 + min * 60 + sec );
+}
+
+/**
+ * Compare entity tags, weak comparison is used as required for If-None-Match
+ *
+ * @param a first tag
+ * @param b second tag
+ * @return TRUE when tags are equal, otherwise FALSE
+ */
+
+static FBOOL HttpETagMatch( const char *a, const char *b )
+{
+	int alen, blen;
+	
+	while( *a == ' ' || *a == '\t' ){ a++; }
+	while( *b == ' ' || *b == '\t' ){ b++; }
+	if( strncmp( a, "W/", 2 ) == 0 ){ a += 2; }
+	if( strncmp( b, "W/", 2 ) == 0 ){ b += 2; }
+	if( *a == '"' ){ a++; }
+	if( *b == '"' ){ b++; }
+	
+	for( alen = 0; a[ alen ] != 0 && a[ alen ] != '"' && a[ alen ] != ' ' && a[ alen ] != '\r'; alen++ ){}
+	for( blen = 0; b[ blen ] != 0 && b[ blen ] != '"' && b[ blen ] != ' ' && b[ blen ] != '\r'; blen++ ){}
+	
+	return ( alen == blen && strncmp( a, b, alen ) == 0 ) ? TRUE : FALSE;
+}
+
+/**
+ * Check conditional request headers. If-None-Match has priority over If-Modified-Since.
+ *
+ * @param request http request
+ * @param etag current entity tag of resource, can be NULL
+ * @param modified current modification time of resource, 0 when not known
+ * @return TRUE when client copy is up to date and 304 should be returned, otherwise FALSE
+ */
+
+FBOOL HttpIsNotModified( Http* request, const char *etag, time_t modified )
+{
+	if( request == NULL || request->headers == NULL )
+	{
+		return FALSE;
+	}
+	
+	HashmapElement *e = HashmapGet( request->headers, "if-none-match" );
+	if( e != NULL )
+	{
+		if( etag == NULL )
+		{
+			return FALSE;
+		}
+		
+		List *l = (List *)e->data;
+		while( l != NULL )
+		{
+			char *tag = (char *)l->data;
+			if( tag != NULL && ( strcmp( tag, "*" ) == 0 || HttpETagMatch( tag, etag ) == TRUE ) )
+			{
+				return TRUE;
+			}
+			l = l->next;
+		}
+		return FALSE;
+	}
+	
+	if( modified > 0 )
+	{
+		char *since = HttpGetHeader( request, "if-modified-since", 0 );
+		if( since != NULL )
+		{
+			time_t t = HttpDateParse( since );
+			if( t > 0 && modified <= t )
+			{
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
+
 /**
  * Get the number of values this header contains
  *
@@ -1355,6 +1867,11 @@ void HttpFree( Http* http )
 		HttpFileDelete( remFile );
 	}
 	//DEBUG("Free http\n");
+	
+	if( http->h_BodyBuffer != NULL )
+	{
+		FFree( http->h_BodyBuffer );
+	}
 
 	FFree( http );
 }
@@ -1444,6 +1961,19 @@ void HttpFreeRequest( Http* http )
 		HttpFileDelete( remFile );
 	}
 	//DEBUG("Free http\n");
+	
+	if( http->h_BodyBuffer != NULL )
+	{
+		FFree( http->h_BodyBuffer );
+		http->h_BodyBuffer = NULL;
+	}
+	
+	// Part of streamed body is still in socket, connection cannot be used for next request
+	if( http->h_BodyStream == TRUE && http->h_BodyRemaining > 0 && http->h_Socket != NULL )
+	{
+		http->h_Socket->s_KeepAliveAllowed = FALSE;
+		http->h_Socket->s_KeepAlive = FALSE;
+	}
 
 	// Suicide
 	FFree( http );
@@ -1639,7 +2169,22 @@ void HttpAddTextContent( Http* http, char* content )
 
 #define HTTP_MAX_ELEMENTS 512
 
+static char *HttpBuildMessage( Http* http, FBOOL withContent );
+
 char *HttpBuild( Http* http )
+{
+	return HttpBuildMessage( http, TRUE );
+}
+
+/**
+ * build Http response string, content is added only when withContent is set
+ *
+ * @param http http request
+ * @param withContent set to FALSE when content will be sent separately
+ * @return response as string
+ */
+
+static char *HttpBuildMessage( Http* http, FBOOL withContent )
 {
 	char *strings[ HTTP_MAX_ELEMENTS ];
 	int stringsSize[ HTTP_MAX_ELEMENTS ];
@@ -1716,7 +2261,12 @@ char *HttpBuild( Http* http )
 	// Find the total size of the response
 	int size = 0;
 	
-	if( http->h_Stream == FALSE )
+	if( http->h_Stream == TRUE )
+	{
+		withContent = FALSE;
+	}
+	
+	if( withContent == TRUE )
 	{
 		size += http->sizeOfContent ? http->sizeOfContent : 0 ;
 	}
@@ -1739,7 +2289,7 @@ char *HttpBuild( Http* http )
 		FFree( strings[ i ] );
 	}
 
-	if( http->h_Stream == FALSE && http->content )
+	if( withContent == TRUE && http->content )
 	{
 		memcpy( response + ( size - http->sizeOfContent ), http->content, http->sizeOfContent );
 	}
@@ -1850,6 +2400,145 @@ char *HttpBuildHeader( Http* http )
 	return response;
 }
 
+/**
+ * Decide if connection can be reused after response is sent
+ *
+ * Connection is kept only when client allowed it and response length is known,
+ * otherwise client would not know where response ends
+ *
+ * @param http http response
+ * @param sock pointer to socket on which response will be sent
+ */
+
+static inline void HttpSetConnection( Http* http, Socket *sock )
+{
+	FBOOL keep = ( sock->s_KeepAliveAllowed == TRUE && http->h_Stream == FALSE && http->h_WriteOnlyContent == FALSE && http->h_RespHeaders[ HTTP_HEADER_CONTENT_LENGTH ] != NULL );
+	
+	// only one response per request can be sent with keep-alive
+	sock->s_KeepAliveAllowed = FALSE;
+	sock->s_KeepAlive = keep;
+	
+	if( keep == TRUE )
+	{
+		HttpAddHeader( http, HTTP_HEADER_CONNECTION, StringDuplicateN( "keep-alive", 10 ) );
+	}
+}
+
+/**
+ * write headers built by HttpBuildMessage and content to socket, content is not copied
+ *
+ * @param http http response
+ * @param sock pointer to socket
+ */
+
+static inline void HttpWriteResponse( Http* http, Socket *sock )
+{
+	struct iovec iov[ 2 ];
+	int cnt = 1;
+	
+	iov[ 0 ].iov_base = http->response;
+	iov[ 0 ].iov_len = http->responseLength;
+	
+	if( http->h_Stream == FALSE && http->content != NULL && http->sizeOfContent > 0 )
+	{
+		iov[ 1 ].iov_base = http->content;
+		iov[ 1 ].iov_len = http->sizeOfContent;
+		cnt++;
+	}
+	
+	SocketWriteV( sock, iov, cnt );
+}
+
+/**
+ * build status line and headers for static response which will be sent by HttpWriteStatic.
+ * Connection header and empty line are added when response is sent, so header can be stored and reused.
+ *
+ * @param http http response with all headers set (Content-Length must be provided)
+ * @param length pointer to place where header length will be stored
+ * @return header as string, must be released by caller
+ */
+
+char *HttpBuildStaticHeader( Http* http, FULONG *length )
+{
+	BufString *bs = BufStringNewSize( 512 );
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	
+	// same header as HttpBuild add
+	HttpAddHeader( http, HTTP_HEADER_CONTROL_ALLOW_ORIGIN, StringDuplicateN( "*", 1 ) ); 
+	
+	BufStringAddFormat( bs, "HTTP/%u.%u %u %s\r\n", http->versionMajor, http->versionMinor, http->responseCode, http->responseReason );
+	
+	int i;
+	for( i = 0; i < HTTP_HEADER_END; i++ )
+	{
+		if( http->h_RespHeaders[ i ] != NULL && i != HTTP_HEADER_CONNECTION )
+		{
+			BufStringAddFormat( bs, "%s: %s\r\n", HEADERS[ i ], http->h_RespHeaders[ i ] );
+		}
+	}
+	
+	int size = 0;
+	char *header = BufStringDetach( bs, &size );
+	*length = size;
+	BufStringDelete( bs );
+	
+	return header;
+}
+
+/**
+ * write static response (header prepared by HttpBuildStaticHeader and content) to socket.
+ * Nothing is copied, buffers are passed directly to socket.
+ *
+ * @param sock pointer to socket
+ * @param header header created by HttpBuildStaticHeader
+ * @param headerLength header length
+ * @param content pointer to content
+ * @param length content length
+ * @return number of bytes writen to socket
+ */
+
+FQUAD HttpWriteStatic( Socket *sock, char *header, FULONG headerLength, char *content, FQUAD length )
+{
+	if( sock == NULL || header == NULL )
+	{
+		FERROR("[HttpWriteStatic] socket or header is NULL\n");
+		return -1;
+	}
+	
+	// Content-Length is always part of static header
+	FBOOL keep = ( sock->s_KeepAliveAllowed == TRUE );
+	sock->s_KeepAliveAllowed = FALSE;
+	sock->s_KeepAlive = keep;
+	
+	struct iovec iov[ 3 ];
+	int cnt = 2;
+	
+	iov[ 0 ].iov_base = header;
+	iov[ 0 ].iov_len = headerLength;
+	if( keep == TRUE )
+	{
+		iov[ 1 ].iov_base = "connection: keep-alive\r\n\r\n";
+		iov[ 1 ].iov_len = sizeof("connection: keep-alive\r\n\r\n") - 1;
+	}
+	else
+	{
+		iov[ 1 ].iov_base = "connection: close\r\n\r\n";
+		iov[ 1 ].iov_len = sizeof("connection: close\r\n\r\n") - 1;
+	}
+	
+	if( content != NULL && length > 0 )
+	{
+		iov[ 2 ].iov_base = content;
+		iov[ 2 ].iov_len = length;
+		cnt++;
+	}
+	
+	return SocketWriteV( sock, iov, cnt );
+}
+
 /**
  * write Http request to socket and release it
  *
@@ -1874,6 +2563,8 @@ void HttpWriteAndFree( Http* http, Socket *sock )
 	
 	//DEBUG("HTTP AND FREE\n");
 	
+	HttpSetConnection( http, sock );
+	
 	if( http->h_WriteOnlyContent == TRUE )
 	{
 		SocketWrite( sock, http->content, http->sizeOfContent );
@@ -1882,10 +2573,10 @@ void HttpWriteAndFree( Http* http, Socket *sock )
 	{
 		if( http->h_Stream == FALSE )
 		{
-			if( HttpBuild( http ) != NULL )
+			if( HttpBuildMessage( http, FALSE ) != NULL )
 			{
 				// Write to the socket!
-				SocketWrite( sock, http->response, http->responseLength );
+				HttpWriteResponse( http, sock );
 			}
 			else
 			{
@@ -1930,7 +2621,8 @@ void HttpWrite( Http* http, Socket *sock )
 	}
 	else
 	{
-		HttpBuild( http );
+		HttpSetConnection( http, sock );
+		HttpBuildMessage( http, FALSE );
 		
 		if( http->h_WriteOnlyContent == TRUE )
 		{
@@ -1938,7 +2630,7 @@ void HttpWrite( Http* http, Socket *sock )
 		}
 		else
 		{
-			SocketWrite( sock, http->response, http->responseLength );
+			HttpWriteResponse( http, sock );
 		}
 	}
 }
@@ -2198,6 +2890,124 @@ void HttpFileDelete( HttpFile *f )
 	}
 }
 
+/**
+ * Read uploaded file data
+ *
+ * Streamed files are read directly from request body, so memory used by upload does not depend on file size.
+ * When file ends, next parts of body are parsed and next file (if any) is added after this one to h_FileList.
+ *
+ * @param http pointer to Http request
+ * @param file pointer to HttpFile
+ * @param data pointer to buffer where data will be stored
+ * @param size size of buffer
+ * @return number of bytes read, 0 when there is no more data, -1 when error appear
+ */
+
+int HttpFileRead( Http *http, HttpFile *file, char *data, int size )
+{
+	if( http == NULL || file == NULL || data == NULL || size <= 0 )
+	{
+		return -1;
+	}
+	
+	if( file->hf_Stream == FALSE )
+	{
+		FQUAD left = file->hf_FileSize - file->hf_ReadPos;
+		if( left <= 0 || file->hf_Data == NULL )
+		{
+			return 0;
+		}
+		if( left < size )
+		{
+			size = (int)left;
+		}
+		memcpy( data, file->hf_Data + file->hf_ReadPos, size );
+		file->hf_ReadPos += size;
+		return size;
+	}
+	
+	if( file->hf_Complete == TRUE || http->h_StreamFile != file )
+	{
+		return 0;
+	}
+	
+	char delimiter[ 260 ];
+	int dlen = snprintf( delimiter, sizeof( delimiter ), "\r\n%s", http->h_PartDivider );
+	
+	while( TRUE )
+	{
+		int avail = http->h_BodyBufferLen - http->h_BodyBufferPos;
+		char *ptr = http->h_BodyBuffer + http->h_BodyBufferPos;
+		int len = 0;
+		
+		if( avail >= dlen )
+		{
+			FQUAD pos = FindInBinaryPOS( delimiter, dlen, ptr, avail );
+			if( pos == 0 )
+			{
+				// End of file, parse what comes after it
+				http->h_BodyBufferPos += dlen;
+				file->hf_Complete = TRUE;
+				http->h_StreamFile = NULL;
+				
+				if( ParseMultipartStream( http ) != 0 )
+				{
+					FERROR("[HttpFileRead] Cannot parse rest of body\n");
+				}
+				return 0;
+			}
+			// Data before divider can be returned. Without divider, tail can be beginning of it
+			len = pos > 0 ? (int)pos : avail - dlen + 1;
+		}
+		
+		if( len > 0 )
+		{
+			if( len > size )
+			{
+				len = size;
+			}
+			memcpy( data, ptr, len );
+			http->h_BodyBufferPos += len;
+			file->hf_ReadPos += len;
+			file->hf_FileSize = file->hf_ReadPos;
+			return len;
+		}
+		
+		if( HttpBodyFill( http ) <= 0 )
+		{
+			FERROR("[HttpFileRead] File %s is not complete\n", file->hf_FileName );
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Skip rest of uploaded file, used when file will not be stored
+ *
+ * @param http pointer to Http request
+ * @param file pointer to HttpFile
+ */
+
+void HttpFileSkip( Http *http, HttpFile *file )
+{
+	if( http == NULL || file == NULL )
+	{
+		return;
+	}
+	
+	if( file->hf_Stream == FALSE )
+	{
+		file->hf_ReadPos = file->hf_FileSize;
+		return;
+	}
+	
+	char buffer[ 4096 ];
+	while( HttpFileRead( http, file, buffer, sizeof( buffer ) ) > 0 )
+	{
+	}
+}
+
 /**
  * Get POST parameter
  *
@@ -45,6 +45,12 @@
 
 #define DEFAULT_CONTENT_TYPE "text/html; charset=utf-8"
 
+#define HTTP_KEEPALIVE_TIMEOUT_DEFAULT 5		// seconds
+#define HTTP_KEEPALIVE_MAX_REQUESTS_DEFAULT 100
+
+#define HTTP_BODY_BUFFERED_MAX_DEFAULT 1048576	// bigger multipart bodies are streamed
+#define HTTP_BODY_STREAM_BUFFER_SIZE 65536	// buffer used to read streamed body, multipart parameter must fit into it
+
 #ifndef DOXYGEN
 #define HTTP_READ_BUFFER_DATA_SIZE 32768
 #define HTTP_READ_BUFFER_DATA_SIZE_ALLOC 32768+32
@@ -77,6 +83,10 @@ enum {
 	HTTP_HEADER_REFERER,
 	HTTP_HEADER_ACCEPT_LANGUAGE,
 	HTTP_HEADER_ACCEPT_ENCODING,
+	HTTP_HEADER_CONTENT_ENCODING,
+	HTTP_HEADER_VARY,
+	HTTP_HEADER_ETAG,
+	HTTP_HEADER_LAST_MODIFIED,
 	HTTP_HEADER_END
 };
 
@@ -102,7 +112,11 @@ static const char *HEADERS[] = {
 	"method",
 	"referer",
 	"accept-language",
-	"accept-encoding"
+	"accept-encoding",
+	"content-encoding",
+	"vary",
+	"etag",
+	"last-modified"
 };
 
 //
@@ -223,6 +237,9 @@ typedef struct HttpFile
 	char 		*hf_Data;
 	FQUAD		hf_FileSize;		// file size
 	FILE			*hf_FP;			// when file is stored on server disk
+	FQUAD		hf_ReadPos;		// position of HttpFileRead in hf_Data
+	FBOOL		hf_Stream;		// file data is not in memory, it is read from request body on demand
+	FBOOL		hf_Complete;		// streamed file was read to the end
 	struct MinNode node;
 }HttpFile;
 
@@ -323,9 +340,17 @@ typedef struct Http
 	
 	char               h_PartDivider[ 256 ];
 	FBOOL           h_ContentType;
-	int                  h_ContentLength;
+	FQUAD           h_ContentLength;
 	HttpFile         *h_FileList;
 	
+	FBOOL           h_BodyStream;		// body is not in memory, files are read from socket by HttpFileRead
+	FQUAD           h_BodyRemaining;	// body bytes which are still waiting in socket
+	char               *h_BodyBuffer;		// fixed size buffer for streamed body
+	int                  h_BodyBufferPos;	// first not consumed byte in h_BodyBuffer
+	int                  h_BodyBufferLen;	// number of bytes in h_BodyBuffer
+	int                  h_BodyBufferSize;	// size of h_BodyBuffer
+	HttpFile         *h_StreamFile;		// multipart file which data is streamed now
+	
 	FBOOL           h_Stream;			// stream
 	void                *h_WSocket;				// websocket context, if provided data should be delivered here
 	Socket            *h_Socket;		// socket,  if != NULL  data should be delivered here
@@ -352,6 +377,12 @@ typedef struct Http
 
 int HttpParseHeader( Http* http, const char* request, unsigned int length );
 
+//
+// Parse Content-Length header value
+//
+
+FQUAD HttpParseContentLength( const char *str );
+
 //
 // Create a generic HttpObject
 //
@@ -425,6 +456,24 @@ char* HttpGetHeader( Http* http, const char* name, unsigned int index );
 
 char* HttpGetHeaderFromTable( Http* http, int pos );
 
+//
+// Build strong entity tag (with quotes) from file identifier, modification time and size
+//
+
+void HttpETagBuild( char *dst, unsigned int size, FUQUAD id, FQUAD modified, FQUAD length, const char *suffix );
+
+//
+// Format date in http format (RFC 7231 IMF-fixdate)
+//
+
+void HttpDateFormat( char *dst, unsigned int size, time_t t );
+
+//
+// Check If-None-Match / If-Modified-Since request headers, TRUE when client copy is valid and 304 can be sent
+//
+
+FBOOL HttpIsNotModified( Http* request, const char *etag, time_t modified );
+
 //
 // TODO: Get a single header field value from the list, or NULL if there no values, or NULL is there is more than 1 value
 // (Useful for failing when only 1 value is expected)
@@ -464,6 +513,18 @@ void HttpSetContent( Http*, char* data, unsigned int length );
 
 char* HttpBuild( Http* http );
 
+//
+// Build reusable header for static response (without Connection header and empty line)
+//
+
+char *HttpBuildStaticHeader( Http* http, FULONG *length );
+
+//
+// Write static response, header and content are not copied
+//
+
+FQUAD HttpWriteStatic( Socket *sock, char *header, FULONG headerLength, char *content, FQUAD length );
+
 //
 // Frees a generic HttpObject (Caller is responsible for freeing other fields before calling this)
 //
@@ -506,4 +567,16 @@ HttpFile *HttpFileNew( char *filename, int fnamesize, char *data, FQUAD size );
 
 void HttpFileDelete( HttpFile *f );
 
+//
+// read uploaded file data, streamed files are read directly from request body
+//
+
+int HttpFileRead( Http *http, HttpFile *file, char *data, int size );
+
+//
+// skip rest of uploaded file
+//
+
+void HttpFileSkip( Http *http, HttpFile *file );
+
 #endif // __NETWORK_HTTP_H__
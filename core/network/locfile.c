@@ -301,6 +301,22 @@ void LocFileDelete( LocFile* file )
 		FFree( file->lf_Buffer );
 		file->lf_Buffer = NULL;
 	}
+	if( file->lf_Header )
+	{
+		FFree( file->lf_Header );
+		file->lf_Header = NULL;
+	}
+	for( int i = 0; i < LOCFILE_VARIANT_MAX ; i++ )
+	{
+		if( file->lf_Variants[ i ].lfv_Buffer != NULL )
+		{
+			FFree( file->lf_Variants[ i ].lfv_Buffer );
+		}
+		if( file->lf_Variants[ i ].lfv_Header != NULL )
+		{
+			FFree( file->lf_Variants[ i ].lfv_Header );
+		}
+	}
 
 	FFree( file );	
 }
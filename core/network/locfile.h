@@ -39,6 +39,35 @@
 #define FILE_READ_NOW  0x00000002
 #define FILE_EXISTS    0x00000004
 
+//
+// precompressed file variants
+//
+
+enum {
+	LOCFILE_VARIANT_GZIP = 0,
+	LOCFILE_VARIANT_BROTLI,
+	LOCFILE_VARIANT_MAX
+};
+
+//
+// state of compressed variants preparation
+//
+
+enum {
+	LOCFILE_COMPRESS_NONE = 0,		// file is not compressed
+	LOCFILE_COMPRESS_PENDING,		// variants should be prepared, identity is sent until then
+	LOCFILE_COMPRESS_RUNNING,		// variants are prepared by worker
+	LOCFILE_COMPRESS_DONE
+};
+
+typedef struct LocFileVariant
+{
+	char			*lfv_Buffer;	// compressed file content, NULL when variant is not available
+	FULONG			lfv_Size;
+	char			*lfv_Header;	// prebuilt http response header with content-encoding
+	FULONG			lfv_HeaderLength;
+} LocFileVariant;
+
 //
 //
 //
@@ -62,6 +91,20 @@ typedef struct LocFile
 	FUQUAD          lf_FileUsed;
 	struct MinNode  node;
 	uint64_t		hash[ 2 ];
+	
+	int             lf_References;	// number of references, CacheManager holds one while file is cached
+	FBOOL           lf_Cached;		// TRUE while file is stored in CacheManager
+	FBOOL           lf_Accessed;	// set on cache hit, gives file second chance before eviction
+	FULONG          lf_CacheSize;	// size accounted in CacheManager
+	struct LocFile  *lf_LRUPrev;	// CacheManager LRU list, head is most recently used
+	struct LocFile  *lf_LRUNext;
+	
+	char            *lf_Header;		// prebuilt http response header (see HttpBuildStaticHeader)
+	FULONG          lf_HeaderLength;
+	
+	LocFileVariant  lf_Variants[ LOCFILE_VARIANT_MAX ];	// compressed content, published by worker after file is put to cache
+	int             lf_CompressState;	// LOCFILE_COMPRESS_*
+	char            lf_ETag[ 64 ];	// entity tag used by conditional requests, filled before file is put to cache
 } LocFile;
 
 //
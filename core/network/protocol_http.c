@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include "core/friend_core.h"
 #include "core/library.h"
@@ -59,6 +60,10 @@
 #define HTTP_REQUEST_TIMEOUT 2 * 60
 #define SHARING_BUFFER_SIZE 262144
 
+// compression used for static resources, variants are prepared on the fly so fastest reasonable settings are used
+#define RESOURCE_GZIP_LEVEL 6
+#define RESOURCE_BROTLI_QUALITY 5
+
 extern SystemBase *SLIB;
 
 // 
@@ -66,43 +71,431 @@ extern SystemBase *SLIB;
 //It is to help us with fallback PHP support
 //
 /**
- * Function runs php script via PHP
+ * Function runs php script via PHP worker pool
  *
- * @param command pointer to php command provided as string
+ * @param script path to php script
+ * @param arg script argument
  * @return new ListString structure or NULL when problem appear
  */
-inline ListString *RunPHPScript( const char *command )
+inline ListString *RunPHPScript( const char *script, const char *arg )
 {
-	FILE *pipe = popen( command, "r" );
-	if( !pipe )
+	ListString *data = PHPPoolRun( SLIB->sl_PHPPool, script, &arg, 1 );
+	if( data == NULL )
+	{
+		Log( FLOG_ERROR,"Cannot run php script %s\n", script );
+	}
+	return data;
+}
+
+/**
+ * Check if content with provided mime type is worth compressing
+ *
+ * @param mime mime type
+ * @return TRUE when content should be compressed, otherwise FALSE
+ */
+static inline FBOOL MimeCompressible( const char *mime )
+{
+	if( mime == NULL )
+	{
+		return FALSE;
+	}
+	if( strncmp( mime, "text/", 5 ) == 0 || strstr( mime, "javascript" ) != NULL || strstr( mime, "json" ) != NULL || strstr( mime, "xml" ) != NULL )
+	{
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Mark static resource file for compression. Variants are prepared later by ResourceFileCompressStart,
+ * identity content is sent until they are ready.
+ *
+ * @param file pointer to LocFile
+ * @param mime file mime type
+ */
+static void ResourceFileCompressPrepare( LocFile *file, const char *mime )
+{
+	if( SLIB->sl_CompressFiles == FALSE || file->lf_Buffer == NULL || file->lf_FileSize < (FULONG)SLIB->sl_CompressMinSize || MimeCompressible( mime ) == FALSE )
+	{
+		return;
+	}
+	file->lf_CompressState = LOCFILE_COMPRESS_PENDING;
+}
+
+/**
+ * Prepare compressed variants of cached static resource file, runs on worker
+ *
+ * @param data pointer to LocFile, reference taken by ResourceFileCompressStart is released here
+ */
+static void ResourceFileCompressTask( void *data )
+{
+	static const int types[ LOCFILE_VARIANT_MAX ] = { ZLIB_COMPRESS_GZIP, ZLIB_COMPRESS_BROTLI };
+	static const int levels[ LOCFILE_VARIANT_MAX ] = { RESOURCE_GZIP_LEVEL, RESOURCE_BROTLI_QUALITY };
+	
+	LocFile *file = (LocFile *)data;
+	FULONG added = 0;
+	
+	ZLibrary *zlib = SLIB->LibraryZGet( SLIB );
+	if( zlib != NULL && zlib->Compress != NULL )
+	{
+		int i;
+		for( i = 0; i < LOCFILE_VARIANT_MAX ; i++ )
+		{
+			char *dst = NULL;
+			FULONG dstLen = 0;
+			
+			if( zlib->Compress( zlib, types[ i ], levels[ i ], file->lf_Buffer, file->lf_FileSize, &dst, &dstLen ) == 0 )
+			{
+				// variant is used only when it really saves bandwidth
+				if( dstLen < file->lf_FileSize )
+				{
+					// readers can see buffer only when its size is already set
+					file->lf_Variants[ i ].lfv_Size = dstLen;
+					__atomic_store_n( &(file->lf_Variants[ i ].lfv_Buffer), dst, __ATOMIC_RELEASE );
+					added += dstLen;
+				}
+				else
+				{
+					FFree( dst );
+				}
+			}
+		}
+	}
+	if( zlib != NULL )
+	{
+		SLIB->LibraryZDrop( SLIB, zlib );
+	}
+	
+	if( added > 0 )
+	{
+		CacheManagerFileGrow( SLIB->cm, file, added );
+	}
+	__atomic_store_n( &(file->lf_CompressState), LOCFILE_COMPRESS_DONE, __ATOMIC_RELEASE );
+	
+	CacheManagerFileRelease( SLIB->cm, file );
+}
+
+/**
+ * Start compression of cached static resource file if it was not started yet.
+ * Only one compression of file runs at a time and it never runs on request path.
+ *
+ * @param file pointer to LocFile stored in CacheManager
+ */
+static void ResourceFileCompressStart( LocFile *file )
+{
+	int state = LOCFILE_COMPRESS_PENDING;
+	
+	if( __atomic_compare_exchange_n( &(file->lf_CompressState), &state, LOCFILE_COMPRESS_RUNNING, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) == FALSE )
+	{
+		return;
+	}
+	
+	// task holds own reference, file can be evicted while it is compressed
+	__sync_add_and_fetch( &(file->lf_References), 1 );
+	
+	if( WorkerManagerTryRun( SLIB->sl_WorkerManager, ResourceFileCompressTask, file, NULL ) != 0 )
+	{
+		// workers are busy, one of next requests will try again
+		__atomic_store_n( &(file->lf_CompressState), LOCFILE_COMPRESS_PENDING, __ATOMIC_RELEASE );
+		CacheManagerFileRelease( SLIB->cm, file );
+	}
+}
+
+/**
+ * Set entity tag of static resource file. Tag is build from path hash, modification time and size,
+ * files without modification time (joined resources) use content hash instead.
+ *
+ * @param file pointer to LocFile
+ */
+static void ResourceFileETag( LocFile *file )
+{
+	FUQUAD id = file->hash[ 0 ];
+	
+	if( file->lf_Info.st_mtime == 0 && file->lf_Buffer != NULL )
+	{
+		uint64_t hash[ 2 ];
+		MURMURHASH3( file->lf_Buffer, file->lf_FileSize, hash );
+		id = hash[ 0 ];
+	}
+	HttpETagBuild( file->lf_ETag, sizeof( file->lf_ETag ), id, file->lf_Info.st_mtime, file->lf_FileSize, NULL );
+}
+
+/**
+ * Select compressed file variant accepted by client (Accept-Encoding). Brotli is preferred over gzip.
+ *
+ * @param request http request
+ * @param file pointer to LocFile
+ * @return variant index or -1 when file should be sent without compression
+ */
+static int ResourceFileSelectVariant( Http *request, LocFile *file )
+{
+	if( request == NULL || __atomic_load_n( &(file->lf_CompressState), __ATOMIC_ACQUIRE ) != LOCFILE_COMPRESS_DONE )
+	{
+		return -1;
+	}
+	
+	HashmapElement *e = HashmapGet( request->headers, "accept-encoding" );
+	if( e == NULL )
+	{
+		return -1;
+	}
+	
+	// -1 - not mentioned, 0 - refused (q=0), 1 - accepted
+	int accepted[ LOCFILE_VARIANT_MAX ] = { -1, -1 };
+	int wildcard = -1;
+	
+	List *l = (List *)e->data;
+	while( l != NULL )
+	{
+		char *coding = (char *)l->data;
+		if( coding != NULL )
+		{
+			int len = 0;
+			while( coding[ len ] != 0 && coding[ len ] != ';' && coding[ len ] != ' ' && coding[ len ] != '\t' )
+			{
+				len++;
+			}
+			
+			int accept = 1;
+			char *q = strstr( coding + len, "q=" );
+			if( q != NULL && atof( q + 2 ) <= 0.0 )
+			{
+				accept = 0;
+			}
+			
+			if( len == 2 && strncasecmp( coding, "br", 2 ) == 0 )
+			{
+				accepted[ LOCFILE_VARIANT_BROTLI ] = accept;
+			}
+			else if( ( len == 4 && strncasecmp( coding, "gzip", 4 ) == 0 ) || ( len == 6 && strncasecmp( coding, "x-gzip", 6 ) == 0 ) )
+			{
+				accepted[ LOCFILE_VARIANT_GZIP ] = accept;
+			}
+			else if( len == 1 && coding[ 0 ] == '*' )
+			{
+				wildcard = accept;
+			}
+		}
+		l = l->next;
+	}
+	
+	int order[] = { LOCFILE_VARIANT_BROTLI, LOCFILE_VARIANT_GZIP };
+	int i;
+	for( i = 0; i < LOCFILE_VARIANT_MAX ; i++ )
+	{
+		int v = order[ i ];
+		int accept = accepted[ v ] >= 0 ? accepted[ v ] : wildcard;
+		if( accept == 1 && file->lf_Variants[ v ].lfv_Buffer != NULL )
+		{
+			return v;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Get static resource file, from cache when caching is enabled
+ *
+ * Cached files are never modified, changed files are removed from cache by CacheManager watcher
+ * so there is no global lock and no stat call on this path.
+ *
+ * @param decoded decoded path to file
+ * @param mime file mime type, used to decide if compressed variants should be prepared, can be NULL
+ * @param freeFile pointer to place where information if file must be deleted by caller is stored
+ * @return pointer to LocFile when success, otherwise NULL
+ */
+static LocFile *ResourceFileGet( char *decoded, const char *mime, FBOOL *freeFile )
+{
+	LocFile *file = NULL;
+	
+	*freeFile = FALSE;
+	
+	// Don't allow directory traversal
+	if( strstr( decoded, ".." ) )
 	{
-		Log( FLOG_ERROR,"Cannot open pipe\n");
 		return NULL;
 	}
 	
-	FULONG size = 0;
-	ListString *data = ListStringNew();
+	if( SLIB->sl_CacheFiles == 1 )
+	{
+		file = CacheManagerFileGet( SLIB->cm, decoded, FALSE );
+		if( file == NULL )
+		{
+			file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
+			if( file != NULL )
+			{
+				ResourceFileETag( file );
+				ResourceFileCompressPrepare( file, mime );
+				
+				if( CacheManagerFilePut( SLIB->cm, file ) != 0 )
+				{
+					file->lf_CompressState = LOCFILE_COMPRESS_NONE;
+					*freeFile = TRUE;
+				}
+			}
+		}
+		
+		if( file != NULL && *freeFile == FALSE && file->lf_CompressState == LOCFILE_COMPRESS_PENDING )
+		{
+			ResourceFileCompressStart( file );
+		}
+	}
+	else
+	{
+		file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
+		if( file != NULL )
+		{
+			ResourceFileETag( file );
+		}
+		*freeFile = TRUE;
+	}
+	return file;
+}
+
+/**
+ * Release static resource file taken by ResourceFileGet
+ *
+ * @param file pointer to LocFile
+ * @param freeFile TRUE when file is not cached and must be deleted
+ */
+static inline void ResourceFileRelease( LocFile *file, FBOOL freeFile )
+{
+	if( freeFile == TRUE )
+	{
+		LocFileDelete( file );
+	}
+	else
+	{
+		CacheManagerFileRelease( SLIB->cm, file );
+	}
+}
 
-#define PHP_READ_SIZE 262144
-	char buf[ PHP_READ_SIZE ]; memset( buf, '\0', PHP_READ_SIZE );
+/**
+ * Send static resource file. Response header is built once and stored in LocFile,
+ * header and file buffer are written to socket without copying.
+ * Compressed variant is sent when client accepts it, 304 is sent when client copy is still valid.
+ *
+ * @param sock pointer to Socket
+ * @param request http request, used for content encoding negotiation, can be NULL
+ * @param file pointer to LocFile
+ * @param mime file mime type
+ * @param cacheControl value of Cache-Control header
+ * @return number of bytes writen to socket
+ */
+static FQUAD ResourceFileWrite( Socket *sock, Http *request, LocFile *file, const char *mime, const char *cacheControl )
+{
+	static const char *encodings[ LOCFILE_VARIANT_MAX ] = { "gzip", "br" };
+	
+	int v = ResourceFileSelectVariant( request, file );
+	// identity header is built once, so it announces variants also when they are not ready yet
+	FBOOL hasVariants = ( file->lf_CompressState != LOCFILE_COMPRESS_NONE );
+	
+	char **headerPtr = v >= 0 ? &(file->lf_Variants[ v ].lfv_Header) : &(file->lf_Header);
+	FULONG *headerLengthPtr = v >= 0 ? &(file->lf_Variants[ v ].lfv_HeaderLength) : &(file->lf_HeaderLength);
+	char *content = v >= 0 ? file->lf_Variants[ v ].lfv_Buffer : file->lf_Buffer;
+	FULONG contentLength = v >= 0 ? file->lf_Variants[ v ].lfv_Size : file->lf_FileSize;
+	
+	// every encoding is different representation, so it gets own entity tag
+	char etag[ 80 ];
+	if( v >= 0 )
+	{
+		int len = strlen( file->lf_ETag );
+		snprintf( etag, sizeof( etag ), "%.*s-%s\"", len > 0 ? len - 1 : 0, file->lf_ETag, encodings[ v ] );
+	}
+	else
+	{
+		strcpy( etag, file->lf_ETag );
+	}
 	
-	while( !feof( pipe ) )
+	if( etag[ 0 ] != 0 && HttpIsNotModified( request, etag, file->lf_Info.st_mtime ) == TRUE )
 	{
-		// Make a new buffer and read
-		size = fread( buf, sizeof(char), PHP_READ_SIZE, pipe );
+		struct TagItem tags[] = {
+			{ HTTP_HEADER_ETAG, (FULONG)StringDuplicate( etag ) },
+			{ HTTP_HEADER_CACHE_CONTROL, (FULONG)StringDuplicate( cacheControl ) },
+			{ TAG_DONE, TAG_DONE }
+		};
+		
+		Http *tmp = HttpNewSimple( HTTP_304_NOT_MODIFIED, tags );
+		if( tmp == NULL )
+		{
+			return -1;
+		}
+		if( hasVariants == TRUE )
+		{
+			HttpAddHeader( tmp, HTTP_HEADER_VARY, StringDuplicate( "Accept-Encoding" ) );
+		}
+		
+		FULONG len = 0;
+		char *header = HttpBuildStaticHeader( tmp, &len );
+		HttpFree( tmp );
 		
-		if( size > 0 )
+		if( header == NULL )
 		{
-			ListStringAdd( data, buf, size );
+			return -1;
 		}
-		pthread_yield();
+		
+		FQUAD res = HttpWriteStatic( sock, header, len, NULL, 0 );
+		FFree( header );
+		return res;
 	}
-	ListStringJoin( data );		
 	
-	// Free buffer if it's there
-	pclose( pipe );
+	if( *headerPtr == NULL )
+	{
+		struct TagItem tags[] = {
+			{ HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( mime ) },
+			{ HTTP_HEADER_CACHE_CONTROL, (FULONG)StringDuplicate( cacheControl ) },
+			{ TAG_DONE, TAG_DONE }
+		};
+		
+		Http *tmp = HttpNewSimple( HTTP_200_OK, tags );
+		if( tmp == NULL )
+		{
+			return -1;
+		}
+		HttpSetContent( tmp, content, contentLength );
+		
+		if( etag[ 0 ] != 0 )
+		{
+			HttpAddHeader( tmp, HTTP_HEADER_ETAG, StringDuplicate( etag ) );
+		}
+		if( file->lf_Info.st_mtime > 0 )
+		{
+			char date[ 64 ];
+			HttpDateFormat( date, sizeof( date ), file->lf_Info.st_mtime );
+			HttpAddHeader( tmp, HTTP_HEADER_LAST_MODIFIED, StringDuplicate( date ) );
+		}
+		
+		// caches must keep encodings separated when file can be sent in different forms
+		if( hasVariants == TRUE )
+		{
+			HttpAddHeader( tmp, HTTP_HEADER_VARY, StringDuplicate( "Accept-Encoding" ) );
+		}
+		if( v >= 0 )
+		{
+			HttpAddHeader( tmp, HTTP_HEADER_CONTENT_ENCODING, StringDuplicate( encodings[ v ] ) );
+		}
+		
+		FULONG len = 0;
+		char *header = HttpBuildStaticHeader( tmp, &len );
+		
+		tmp->content = NULL;
+		tmp->sizeOfContent = 0;
+		HttpFree( tmp );
+		
+		if( header == NULL )
+		{
+			return -1;
+		}
+		
+		// file can be shared by many threads, first built header is stored
+		*headerLengthPtr = len;
+		if( __sync_bool_compare_and_swap( headerPtr, NULL, header ) == FALSE )
+		{
+			FFree( header );
+		}
+	}
 	
-	return data;
+	return HttpWriteStatic( sock, *headerPtr, *headerLengthPtr, content, contentLength );
 }
 
 /**
@@ -116,7 +509,7 @@ inline ListString *RunPHPScript( const char *command )
  * @param result pointer to place where http status will be stored
  * @return 0 when success, otherwise NULL
  */
-inline int ReadServerFile( Uri *uri, char *locpath, BufString *dstbs, int *result )
+static inline int ReadServerFile( Uri *uri, char *locpath, BufString *dstbs, int *result )
 {
 	Path *base = PathNew( "resources" );
 	if( base == NULL )
@@ -147,69 +540,12 @@ inline int ReadServerFile( Uri *uri, char *locpath, BufString *dstbs, int *resul
 	
 	FBOOL freeFile = FALSE;
 	
-	LocFile* file = NULL;
-	if( pthread_mutex_lock( &SLIB->sl_ResourceMutex ) == 0 )
+	char *decoded = UrlDecodeToMem( completePath->raw );
+	LocFile* file = ResourceFileGet( decoded, completePath->extension ? MimeFromExtension( completePath->extension ) : NULL, &freeFile );
+	FFree( decoded );
+	if( file == NULL )
 	{
-		if( SLIB->sl_CacheFiles == 1 )
-		{
-			file = CacheManagerFileGet( SLIB->cm, completePath->raw, FALSE );
-		
-			//pthread_mutex_unlock( &SLIB->sl_ResourceMutex );
-		
-			if( file == NULL )
-			{
-				char *decoded = UrlDecodeToMem( completePath->raw );
-				file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
-				FFree( decoded );
-				
-				if( file != NULL )
-				{
-					//if( pthread_mutex_lock( &SLIB->sl_ResourceMutex ) == 0 )
-					{
-						if( CacheManagerFilePut( SLIB->cm, file ) != 0 )
-						{
-							freeFile = TRUE;
-						}
-						//pthread_mutex_unlock( &SLIB->sl_ResourceMutex );
-					}
-				}
-				else
-				{
-					Log( FLOG_ERROR,"Cannot read file %s\n", completePath->raw );
-				}
-			}
-			else
-			{
-				struct stat attr;
-				stat( completePath->raw, &attr);
-			
-				// if file is new file, reload it
-			
-			
-				//DEBUG1("\n\n\n\n\n SIZE %lld  stat %lld\n\n\n\n",attr.st_mtime ,file->info.st_mtime );
-				if( attr.st_mtime != file->lf_Info.st_mtime )
-				{
-					LocFileReload( file, completePath->raw);
-				}
-			}
-		}
-		else
-		{
-			//pthread_mutex_unlock( &SLIB->sl_ResourceMutex );
-			
-			char *decoded = UrlDecodeToMem( completePath->raw );
-			file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
-			FFree( decoded );
-			if( file == NULL )
-			{
-				Log( FLOG_ERROR,"Cannot load file in developer mode %s\n", completePath->raw );
-			}
-			else
-			{
-				freeFile = TRUE;
-			}
-		}
-		pthread_mutex_unlock( &SLIB->sl_ResourceMutex );
+		Log( FLOG_ERROR,"Cannot read file %s\n", completePath->raw );
 	}
 
 	// Send reply
@@ -223,10 +559,7 @@ inline int ReadServerFile( Uri *uri, char *locpath, BufString *dstbs, int *resul
 		BufStringAddSize( dstbs, file->lf_Buffer, file->lf_FileSize );
 		BufStringAdd( dstbs, "\n");
 
-		if( freeFile == TRUE )
-		{
-			LocFileDelete( file );
-		}
+		ResourceFileRelease( file, freeFile );
 
 		*result = 200;
 	}
@@ -234,37 +567,28 @@ inline int ReadServerFile( Uri *uri, char *locpath, BufString *dstbs, int *resul
 	{
 		// Try to fall back on module
 		// TODO: Make this behaviour configurable
-		char *command;
-		
-		int loclen = strlen( locpath )+256;
-		if( ( command = FCalloc( loclen, sizeof( char ) ) ) != NULL )
+		DEBUG( "[ReadServerFile] Executing php/catch_all.php %s\n", locpath );
+		int phpRun = FALSE;
+		ListString *bs = RunPHPScript( "php/catch_all.php", locpath );
+		if( bs )
 		{
-			snprintf( command, loclen, "php \"php/catch_all.php\" \"%s\";", locpath ); 
-			DEBUG( "[ReadServerFile] Executing %s\n", command );
-			int phpRun = FALSE;
-			ListString *bs = RunPHPScript( command );
-			if( bs )
+			if( bs->ls_Size > 0 )
 			{
-				if( bs->ls_Size > 0 )
-				{
-					BufStringAddSize( dstbs, bs->ls_Data, bs->ls_Size );
-					BufStringAdd( dstbs, "\n");
-				}
-			
-				phpRun = TRUE;
-				*result = 200;
-
-				ListStringDelete( bs );
+				BufStringAddSize( dstbs, bs->ls_Data, bs->ls_Size );
+				BufStringAdd( dstbs, "\n");
 			}
 		
-			if( !phpRun )
-			{
-				INFO("[ReadServerFile] File do not exist %s\n", locpath );
+			phpRun = TRUE;
+			*result = 200;
 
-				*result = 404;
-			}
-			
-			FFree( command );
+			ListStringDelete( bs );
+		}
+	
+		if( !phpRun )
+		{
+			INFO("[ReadServerFile] File do not exist %s\n", locpath );
+
+			*result = 404;
 		}
 	}
 	PathFree( base );
@@ -500,15 +824,7 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 							{
 								if( tst->data != NULL )
 								{
-									session = SLIB->sl_USM->usm_Sessions;
-									while( session != NULL )
-									{
-										if(  strcmp( session->us_SessionID, (char *)tst->data ) == 0 )
-										{
-											break;
-										}
-										session = (UserSession *)session->node.mln_Succ;
-									}
+									session = USMGetSessionBySessionID( SLIB->sl_USM, (char *)tst->data );
 								}
 							}
 							UserLoggerStore( SLIB->sl_ULM, session, request->rawRequestPath, request->h_UserActionInfo );
@@ -555,40 +871,16 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 						if( strcmp( SLIB->sl_ActiveModuleName, "fcdb.authmod" ) != 0 )
 						//if( strcmp( SLIB->sl_ActiveAuthModule->am_Name, "fcdb.authmod" ) != 0 )
 						{
-							FULONG res = 0;
-
-							char command[ 1024 ];
-
-							// Make the commandline string with the safe, escaped arguments, and check for buffer overflows.
-							int cx = snprintf( command, sizeof(command), "php \"%s\" \"%s\" \"%s\" \"%s\";", "php/login.php", uri->path->raw, uri->queryRaw, request->content ); // SLIB->sl_ModuleNames
-							if( !( cx >= 0 ) )
+							const char *args[] = { uri->path->raw, uri->queryRaw ? uri->queryRaw : "", request->content ? request->content : "" };
+							
+							// script is served by php worker pool, arguments are not passed through shell
+							ListString *ls = PHPPoolRun( SLIB->sl_PHPPool, "php/login.php", args, 3 );
+							if( ls == NULL )
 							{
-								FERROR( "[ProtocolHttp] snprintf\n" );;
+								FERROR( "[ProtocolHttp] cannot run login script\n" );
 							}
 							else
 							{
-								FILE *pipe = popen( command, "r" );
-								ListString *ls = NULL;
-	
-								if( pipe != NULL )
-								{
-									ls = ListStringNew();
-									char buffer[ 1024 ];
-	
-									while( !feof( pipe ) )
-									{
-										int reads = fread( buffer, sizeof( char ), 1024, pipe );
-										if( reads > 0 )
-										{
-											ListStringAdd( ls, buffer, reads );
-											res += reads;
-										}
-									}
-									pclose( pipe );
-								}
-
-								ListStringJoin( ls );
-								
 								struct TagItem tags[] = {
 									{ HTTP_HEADER_CONTENT_TYPE, (FULONG) StringDuplicate("text/html") },
 									{ HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
@@ -600,7 +892,7 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 
 								if( ls->ls_Data != NULL )
 								{
-									HttpSetContent( response, ls->ls_Data, res );
+									HttpSetContent( response, ls->ls_Data, ls->ls_Size );
 								}
 								else
 								{
@@ -928,15 +1220,7 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 						{
 							if( tst->data != NULL )
 							{
-								session = SLIB->sl_USM->usm_Sessions;
-								while( session != NULL )
-								{
-									if(  strcmp( session->us_SessionID, (char *)tst->data ) == 0 )
-									{
-										break;
-									}
-									session = (UserSession *)session->node.mln_Succ;
-								}
+								session = USMGetSessionBySessionID( SLIB->sl_USM, (char *)tst->data );
 							}
 						}
 						UserLoggerStore( SLIB->sl_ULM, session, request->rawRequestPath, request->h_UserActionInfo );
@@ -1000,30 +1284,18 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 										extension[ ii ] = path->raw[ pos++ ];
 									}
 									
-									char *mime = StringDuplicate( MimeFromExtension( extension ) );
+									// response is written here, returned Http is only released
+									ResourceFileWrite( sock, request, file, MimeFromExtension( extension ), "max-age = 3600" );
+									result = 200;
 									
 									FFree( extension );
 									
-									struct TagItem tags[] = {
-										{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  mime },
-										{ HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
-										{ HTTP_HEADER_CACHE_CONTROL, (FULONG )StringDuplicate( "max-age = 3600" ) },
-										{ TAG_DONE, TAG_DONE }
-									};
+									if( ( response = HttpNew( ) ) != NULL )
+									{
+										response->h_WriteType = FREE_ONLY;
+									}
 									
-									response = HttpNewSimple( HTTP_200_OK, tags );
-								
-									HttpSetContent( response, file->lf_Buffer, file->lf_FileSize );
-								
-									// write here and set data to NULL!!!!!
-									// return response
-									HttpWrite( response, sock );
-									result = 200;
-
-									response->content = NULL;
-									response->sizeOfContent = 0;
-								
-									response->h_WriteType = FREE_ONLY;
+									CacheManagerFileRelease( SLIB->cm, file );
 								}
 								else // file not found in cache
 									
@@ -1116,10 +1388,19 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 												{
 													DEBUG("[ProtocolHttp] File created %s size %d\n", nlf->lf_Path, nlf->lf_FileSize );
 													
+													ResourceFileETag( nlf );
+													ResourceFileCompressPrepare( nlf, mime );
+													HttpAddHeader( response, HTTP_HEADER_ETAG, StringDuplicate( nlf->lf_ETag ) );
+													
 													if( CacheManagerFilePut( SLIB->cm, nlf ) != 0 )
 													{
 														LocFileDelete( nlf );
 													}
+													else
+													{
+														ResourceFileCompressStart( nlf );
+														CacheManagerFileRelease( SLIB->cm, nlf );
+													}
 												}
 
 												bs->bs_Buffer = NULL;
@@ -1162,106 +1443,32 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 							
 								if( completePath != NULL )
 								{
-									LocFile* file = NULL;
-									
-									if( pthread_mutex_lock( &SLIB->sl_ResourceMutex ) == 0 )
-									{	
-										char *decoded = UrlDecodeToMem( completePath->raw );
-										if( SLIB->sl_CacheFiles == 1 )
-										{
-											
-											Log( FLOG_DEBUG, "[ProtocolHttp] Read single file, first from cache %s\n", decoded );
-											file = CacheManagerFileGet( SLIB->cm, decoded, FALSE );
-
-											if( file == NULL )
-											{
-												// Don't allow directory traversal
-												if( !strstr( decoded, ".." ) )
-												{
-													file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
-												}
-												
-												if( file != NULL )
-												{
-													if( CacheManagerFilePut( SLIB->cm, file ) != 0 )
-													{
-														freeFile = TRUE;
-													}
-												}
-											}
-											else
-											{
-												struct stat attr;
-												stat( decoded, &attr);
-			
-												// if file is new file, reload it
-			
-												//DEBUG1("\n\n\n\n\n SIZE %lld  stat %lld   NAME %s\n\n\n\n",attr.st_mtime ,file->info.st_mtime,completePath->raw );
-												Log( FLOG_DEBUG, "[ProtocolHttp] File will be reloaded\n");
-												if( attr.st_mtime != file->lf_Info.st_mtime )
-												{
-													LocFileReload( file, decoded );
-												}
-											}
-										}
-										else
-										{
-											// Don't allow directory traversal
-											if( !strstr( decoded, ".." ) )
-											{
-												file = LocFileNew( decoded, FILE_READ_NOW | FILE_CACHEABLE );
-											}
-											freeFile = TRUE;
-										}
-										FFree( decoded );
-										pthread_mutex_unlock( &SLIB->sl_ResourceMutex );
-									}
+									char *decoded = UrlDecodeToMem( completePath->raw );
+									Log( FLOG_DEBUG, "[ProtocolHttp] Read single file %s\n", decoded );
+									const char *mime = completePath->extension ? MimeFromExtension( completePath->extension ) : "text/plain";
+									LocFile* file = ResourceFileGet( decoded, mime, &freeFile );
+									FFree( decoded );
 									Log( FLOG_DEBUG, "[ProtocolHttp] Return file content\n");
 
 									// Send reply
 									if( file != NULL )
 									{
-										char* mime = NULL;
-						
 										if(  file->lf_Buffer == NULL )
 										{
 											Log( FLOG_ERROR,"File is empty %s\n", completePath->raw );
 										}
-
-										if( completePath->extension )
-										{
-											mime = StringDuplicate( MimeFromExtension( completePath->extension ) );
-										}
-										else
-										{
-											mime = StringDuplicate( "text/plain" );
-										}
-						
-										struct TagItem tags[] = {
-											{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  mime },
-											{ HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
-											{ HTTP_HEADER_CACHE_CONTROL, (FULONG )StringDuplicate( "max-age = 3600" ) },
-											{ TAG_DONE, TAG_DONE }
-										};
-		
-										response = HttpNewSimple( HTTP_200_OK, tags );
 						
-										HttpSetContent( response, file->lf_Buffer, file->lf_FileSize );
-						
-										// write here and set data to NULL!!!!!
-										// return response
-										HttpWrite( response, sock );
+										// response is written here, returned Http is only released
+										ResourceFileWrite( sock, request, file, mime, "max-age = 3600" );
 										result = 200;
 						
 										//INFO("--------------------------------------------------------------%d\n", freeFile );
-										if( freeFile == TRUE )
+										ResourceFileRelease( file, freeFile );
+										
+										if( ( response = HttpNew( ) ) != NULL )
 										{
-											LocFileDelete( file );
+											response->h_WriteType = FREE_ONLY;
 										}
-										response->content = NULL;
-										response->sizeOfContent = 0;
-						
-										response->h_WriteType = FREE_ONLY;
 									
 										Log( FLOG_DEBUG, "[ProtocolHttp] File returned to caller\n");
 									}
@@ -1333,104 +1540,94 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 
 											// Try to fall back on module
 											// TODO: Make this behaviour configurable
-											char *command = NULL;
-
-											int clen = strlen( uri->path->raw ) + 256;
+											ListString *bs = RunPHPScript( "php/catch_all.php", uri->path->raw );
 
-											if( ( command = FCalloc( clen, sizeof(char) ) ) != NULL )
+											if( bs && bs->ls_Data != NULL && bs->ls_Size > 0 )
 											{
-												snprintf( command, clen, "php \"php/catch_all.php\" \"%s\";", uri->path->raw ); 
+												// Check header and remove from data
+												char *cntype = CheckEmbeddedHeaders( bs->ls_Data, bs->ls_Size, "Content-Type" );
+												char *code = CheckEmbeddedHeaders( bs->ls_Data, bs->ls_Size, "Status Code" );
 
-												ListString *bs = RunPHPScript( command );
-
-												if( bs && bs->ls_Data != NULL && bs->ls_Size > 0 )
+												if( cntype != NULL )
 												{
-													// Check header and remove from data
-													char *cntype = CheckEmbeddedHeaders( bs->ls_Data, bs->ls_Size, "Content-Type" );
-													char *code = CheckEmbeddedHeaders( bs->ls_Data, bs->ls_Size, "Status Code" );
+													bs->ls_Size = StripEmbeddedHeaders( &bs->ls_Data, bs->ls_Size );
+												}
+												
+												struct TagItem tags[] = {
+													{ HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( cntype ? cntype : "text/html" ) },
+													{ HTTP_HEADER_CONNECTION,   (FULONG)StringDuplicate( "close" ) },
+													{ TAG_DONE, TAG_DONE }
+												};
 
-													if( cntype != NULL )
+												if( code != NULL )
+												{
+													char *pEnd;
+													int errCode = -1;
+													
+													char *next;
+													errCode = strtol ( code, &next, 10);
+													if( ( next == code ) || ( *next != '\0' ) ) 
 													{
-														bs->ls_Size = StripEmbeddedHeaders( &bs->ls_Data, bs->ls_Size );
+														errCode = -1;
 													}
 													
-													struct TagItem tags[] = {
-														{ HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( cntype ? cntype : "text/html" ) },
-														{ HTTP_HEADER_CONNECTION,   (FULONG)StringDuplicate( "close" ) },
-														{ TAG_DONE, TAG_DONE }
-													};
-
-													if( code != NULL )
+													if( errCode == -1 )
 													{
-														char *pEnd;
-														int errCode = -1;
-														
-														char *next;
-														errCode = strtol ( code, &next, 10);
-														if( ( next == code ) || ( *next != '\0' ) ) 
-														{
-															errCode = -1;
-														}
-														
-														if( errCode == -1 )
-														{
-															response = HttpNewSimple( HTTP_200_OK, tags );
-														}
-														else
-														{
-															response = HttpNewSimple( errCode, tags );
-														}
+														response = HttpNewSimple( HTTP_200_OK, tags );
 													}
 													else
 													{
-														response = HttpNewSimple( HTTP_200_OK, tags );
+														response = HttpNewSimple( errCode, tags );
 													}
+												}
+												else
+												{
+													response = HttpNewSimple( HTTP_200_OK, tags );
+												}
+												
+												char *resp = bs->ls_Data;
+												if( resp != NULL )
+												{
+													const char *hsearche = "---http-headers-end---\n";
+													const int hsearchLene = 23;
 													
-													char *resp = bs->ls_Data;
-													if( resp != NULL )
+													char *tmp = NULL;
+													if( ( tmp = strstr( resp, hsearche ) ) != NULL )
 													{
-														const char *hsearche = "---http-headers-end---\n";
-														const int hsearchLene = 23;
-														
-														char *tmp = NULL;
-														if( ( tmp = strstr( resp, hsearche ) ) != NULL )
-														{
-															resp = tmp + 23;
-														}
+														resp = tmp + 23;
 													}
-													
-													HttpWrite( response, sock );
-													
-													response->content = NULL;
-													response->sizeOfContent = 0;
-													
-													response->h_WriteType = FREE_ONLY;
+												}
+												
+												HttpWrite( response, sock );
+												
+												response->content = NULL;
+												response->sizeOfContent = 0;
+												
+												response->h_WriteType = FREE_ONLY;
 
-													SocketWrite( sock, resp, (FQUAD)(bs->ls_Size - (resp - bs->ls_Data)) );
-													//HttpSetContent( response, bs->ls_Data, bs->ls_Size );
-													
-													if( cntype != NULL ) FFree( cntype );
-													if( code != NULL ) FFree( code );
+												SocketWrite( sock, resp, (FQUAD)(bs->ls_Size - (resp - bs->ls_Data)) );
+												//HttpSetContent( response, bs->ls_Data, bs->ls_Size );
+												
+												if( cntype != NULL ) FFree( cntype );
+												if( code != NULL ) FFree( code );
 
-													result = 200;
+												result = 200;
 
-													//bs->ls_Data = NULL; 
-													ListStringDelete( bs );
-												}
-												else 
-												{
-													Log( FLOG_ERROR,"File do not exist (PHPCall)\n");
+												//bs->ls_Data = NULL; 
+												ListStringDelete( bs );
+											}
+											else 
+											{
+												Log( FLOG_ERROR,"File do not exist (PHPCall)\n");
 
-													struct TagItem tags[] = {
-														{ HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
-														{ TAG_DONE, TAG_DONE }
-													};	
-		
-													response = HttpNewSimple( HTTP_404_NOT_FOUND,  tags );
+												struct TagItem tags[] = {
+													{ HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
+													{ TAG_DONE, TAG_DONE }
+												};	
 	
-													result = 404;
-												}
-												FFree( command );
+												response = HttpNewSimple( HTTP_404_NOT_FOUND,  tags );
+
+												result = 404;
 											}
 										}
 									}
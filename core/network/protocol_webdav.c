@@ -1051,8 +1051,9 @@ request.xml:1: parser error : Start tag expected, '<' not found
 									{
 										BufStringAdd( strResp, "</D:multistatus>\r\n" );
 										//HttpAddTextContent( resp, strResp->bs_Buffer );
-										HttpSetContent( resp, strResp->bs_Buffer, strResp->bs_Size );
-										strResp->bs_Buffer = NULL;
+										int contentSize = 0;
+										char *content = BufStringDetach( strResp, &contentSize );
+										HttpSetContent( resp, content, contentSize );
 								
 										BufStringDelete( dirresp );
 									}
@@ -1070,8 +1071,9 @@ request.xml:1: parser error : Start tag expected, '<' not found
 										{
 											BufStringAdd( strResp, "</D:multistatus>\r\n" );
 											//HttpAddTextContent( resp, strResp->bs_Buffer );
-											HttpSetContent( resp, strResp->bs_Buffer, strResp->bs_Size );
-											strResp->bs_Buffer = NULL;
+											int contentSize = 0;
+											char *content = BufStringDetach( strResp, &contentSize );
+											HttpSetContent( resp, content, contentSize );
 								
 											BufStringDelete( dirresp );
 										}
@@ -49,6 +49,7 @@
 #include "network/socket.h"
 #include <system/systembase.h>
 #include <pthread.h>
+#include <poll.h>
 
 static int ssl_session_ctx_id = 1;
 static int ssl_sockopt_on = 1;
@@ -2263,6 +2264,243 @@ BufString *SocketReadTillEnd( Socket* sock, unsigned int pass, int sec )
 	return NULL;
 }
 
+/**
+ * Read available data from socket, wait for it if nothing was received yet
+ *
+ * @param sock pointer to Socket on which read function will be called
+ * @param data pointer to char table where data will be stored
+ * @param length size of char table
+ * @param sec timeout value in seconds
+ * @return number of bytes readed, 0 when connection was closed, -1 on error or timeout
+ */
+
+static int SocketReadAvailable( Socket* sock, char* data, unsigned int length, int sec )
+{
+	struct pollfd pfd;
+	pfd.fd = sock->fd;
+	pfd.events = POLLIN;
+	
+	while( TRUE )
+	{
+		// SSL can hold decrypted data which is not visible on descriptor
+		if( sock->s_SSLEnabled == FALSE || SSL_pending( sock->s_Ssl ) <= 0 )
+		{
+			int err = poll( &pfd, 1, sec * 1000 );
+			if( err == 0 )
+			{
+				FERROR("[SocketReadAvailable] Timeout\n");
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			else if( err < 0 )
+			{
+				if( errno == EINTR )
+				{
+					continue;
+				}
+				return -1;
+			}
+		}
+		
+		if( sock->s_SSLEnabled == TRUE )
+		{
+			int res = SSL_read( sock->s_Ssl, data, length );
+			if( res > 0 )
+			{
+				return res;
+			}
+			int err = SSL_get_error( sock->s_Ssl, res );
+			if( err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE )
+			{
+				continue;
+			}
+			return err == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+		}
+		else
+		{
+			int res = recv( sock->fd, data, length, MSG_DONTWAIT );
+			if( res >= 0 )
+			{
+				return res;
+			}
+			if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+			{
+				continue;
+			}
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Read exactly one FriendCore message from socket. Message starts with ID_FCRE and full message size,
+ * so connection can be used for next messages. Streamed answers (size set to 0) are read till end of connection.
+ *
+ * @param sock pointer to Socket on which read function will be called
+ * @param sec timeout value in seconds (for every read)
+ * @param closed pointer to variable which is set to TRUE when other side closed connection before first byte of message was received, can be NULL
+ * @return BufString structure with message or NULL when error appear
+ */
+
+BufString *SocketReadDataForm( Socket* sock, int sec, FBOOL *closed )
+{
+	if( closed != NULL )
+	{
+		*closed = FALSE;
+	}
+	
+	if( sock == NULL )
+	{
+		FERROR("[SocketReadDataForm] Cannot read from socket, socket = NULL!\n");
+		return NULL;
+	}
+	
+	FULONG header[ 2 ];		// ID, size
+	unsigned int read = 0;
+	
+	while( read < sizeof( header ) )
+	{
+		errno = 0;
+		int res = SocketReadAvailable( sock, ((char *)header) + read, sizeof( header ) - read, sec );
+		if( res <= 0 )
+		{
+			// timeout is not reported as closed, request could be already processed by other side
+			if( closed != NULL && read == 0 && ( res == 0 || errno == ECONNRESET || errno == EPIPE ) )
+			{
+				*closed = TRUE;
+			}
+			return NULL;
+		}
+		read += res;
+	}
+	
+	if( header[ 0 ] != ID_FCRE || ( header[ 1 ] != 0 && header[ 1 ] < sizeof( header ) ) )
+	{
+		FERROR("[SocketReadDataForm] Message is not FriendCore message\n");
+		return NULL;
+	}
+	
+	// size comes from other side, it is checked before anything is allocated
+	FULONG size = header[ 1 ];
+	if( size > SOCKET_DATA_FORM_MAX_SIZE )
+	{
+		FERROR("[SocketReadDataForm] Message is too big, size %lu\n", size );
+		return NULL;
+	}
+	
+	// buffer grows with received data, not with declared size
+	BufString *bs = BufStringNewSize( ( size > 0 && size < 8192 ) ? (int)size : 8192 );
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	BufStringAddSize( bs, (char *)header, sizeof( header ) );
+	
+	if( size > 0 )
+	{
+		// message is read directly into buffer
+		while( (FULONG)bs->bs_Size < size )
+		{
+			int toread = (int)( size - bs->bs_Size );
+			if( toread > SOCKET_DATA_FORM_CHUNK )
+			{
+				toread = SOCKET_DATA_FORM_CHUNK;
+			}
+			if( BufStringReserve( bs, toread ) != 0 )
+			{
+				BufStringDelete( bs );
+				return NULL;
+			}
+			
+			int res = SocketReadAvailable( sock, bs->bs_Buffer + bs->bs_Size, toread, sec );
+			if( res <= 0 )
+			{
+				FERROR("[SocketReadDataForm] Message was not received, got %d/%lu\n", bs->bs_Size, size );
+				BufStringDelete( bs );
+				return NULL;
+			}
+			bs->bs_Size += res;
+		}
+		bs->bs_Buffer[ bs->bs_Size ] = 0;
+	}
+	else
+	{
+		char locbuffer[ 8192 ];
+		int res;
+		while( ( res = SocketReadAvailable( sock, locbuffer, sizeof( locbuffer ), sec ) ) > 0 )
+		{
+			if( bs->bs_Size + res > SOCKET_DATA_FORM_MAX_SIZE )
+			{
+				FERROR("[SocketReadDataForm] Streamed message is too big\n");
+				BufStringDelete( bs );
+				return NULL;
+			}
+			BufStringAddSize( bs, locbuffer, res );
+		}
+	}
+	
+	DEBUG("[SocketReadDataForm] Message received, size %d\n", bs->bs_Size );
+	
+	return bs;
+}
+
+/**
+ * Check if idle connection was not closed by other side. Connection which is not used should not have data to read.
+ *
+ * @param sock pointer to Socket
+ * @return TRUE when connection can be used, otherwise FALSE
+ */
+
+FBOOL SocketIsAlive( Socket* sock )
+{
+	if( sock == NULL )
+	{
+		return FALSE;
+	}
+	
+	struct pollfd pfd;
+	pfd.fd = sock->fd;
+	pfd.events = POLLIN;
+	
+	if( poll( &pfd, 1, 0 ) != 0 )
+	{
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Check if data can be read from socket without waiting. Used when next message could be already
+ * delivered together with previous one (edge triggered epoll will not report it again).
+ *
+ * @param sock pointer to Socket
+ * @return TRUE when data (or end of connection) is waiting, otherwise FALSE
+ */
+
+FBOOL SocketHasData( Socket* sock )
+{
+	if( sock == NULL )
+	{
+		return FALSE;
+	}
+	
+	if( sock->s_SSLEnabled == TRUE && SSL_pending( sock->s_Ssl ) > 0 )
+	{
+		return TRUE;
+	}
+	
+	struct pollfd pfd;
+	pfd.fd = sock->fd;
+	pfd.events = POLLIN;
+	
+	if( poll( &pfd, 1, 0 ) > 0 )
+	{
+		return TRUE;
+	}
+	return FALSE;
+}
+
 /**
  * Write data to socket
  *
@@ -2354,7 +2592,7 @@ int SocketWrite( Socket* sock, char* data, FQUAD length )
 		do
 		{
 			if( bufLength > length - written ) bufLength = length - written;
-			res = send( sock->fd, data + written, bufLength, MSG_DONTWAIT );
+			res = send( sock->fd, data + written, bufLength, MSG_DONTWAIT | MSG_NOSIGNAL );
 			
 			if( res > 0 ) 
 			{
@@ -2382,6 +2620,124 @@ int SocketWrite( Socket* sock, char* data, FQUAD length )
 }
 
 
+/**
+ * Write many buffers to socket, data is sent directly from provided buffers
+ * Write stops when peer does not take any data for SOCKET_WRITE_TIMEOUT
+ *
+ * @param sock pointer to Socket on which write function will be called
+ * @param iov table of buffers which will be send, table is modified during write
+ * @param iovcnt number of entries in iov table
+ * @return number of bytes writen to socket
+ */
+
+FQUAD SocketWriteV( Socket* sock, struct iovec *iov, int iovcnt )
+{
+	if( sock == NULL || iov == NULL )
+	{
+		FERROR("Socket or buffers are NULL\n");
+		return -1;
+	}
+	
+	FQUAD written = 0;
+	
+	if( sock->s_SSLEnabled == TRUE )
+	{
+		// SSL_write is called on every buffer, there is no need to join them
+		int i;
+		for( i = 0; i < iovcnt; i++ )
+		{
+			if( iov[ i ].iov_len > 0 )
+			{
+				int res = SocketWrite( sock, iov[ i ].iov_base, iov[ i ].iov_len );
+				if( res <= 0 )
+				{
+					break;
+				}
+				written += res;
+				if( (size_t)res < iov[ i ].iov_len )
+				{
+					break;
+				}
+			}
+		}
+		return written;
+	}
+	
+	int retries = 0;
+	struct msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	
+	while( iovcnt > 0 )
+	{
+		// skip buffers which were already sent
+		if( iov->iov_len == 0 )
+		{
+			iov++;
+			iovcnt--;
+			continue;
+		}
+		
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovcnt;
+		
+		ssize_t res = sendmsg( sock->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL );
+		if( res > 0 )
+		{
+			written += res;
+			retries = 0;
+			
+			while( res > 0 && iovcnt > 0 )
+			{
+				if( (size_t)res >= iov->iov_len )
+				{
+					res -= iov->iov_len;
+					iov->iov_len = 0;
+					iov++;
+					iovcnt--;
+				}
+				else
+				{
+					iov->iov_base = (char *)iov->iov_base + res;
+					iov->iov_len -= res;
+					res = 0;
+				}
+			}
+		}
+		else if( res < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			// Error, temporarily unavailable, wait until peer takes data but not forever
+			if( errno == EAGAIN || errno == EWOULDBLOCK )
+			{
+				struct pollfd pfd;
+				pfd.fd = sock->fd;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				
+				retries++;
+				int err = poll( &pfd, 1, SOCKET_WRITE_TIMEOUT );
+				if( err > 0 || ( err < 0 && errno == EINTR ) )
+				{
+					continue;
+				}
+				if( err == 0 )
+				{
+					FERROR( "[SocketWriteV] Timeout, peer did not take data for %d ms\n", SOCKET_WRITE_TIMEOUT );
+					break;
+				}
+			}
+			FERROR( "Failed to write: %d, %s\n", errno, strerror( errno ) );
+			break;
+		}
+	}
+	
+	DEBUG("end writev %lld (had %d retries)\n", written, retries );
+	return written;
+}
+
 /**
  * Abort write function
  *
@@ -37,6 +37,7 @@
 #include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #endif
 #include <libwebsockets.h>
 #ifdef USE_SELECT
@@ -61,6 +62,10 @@
 
 #define SOCKET_CLOSED_STATE -2
 
+#define SOCKET_DATA_FORM_MAX_SIZE	( 64 * 1024 * 1024 )	// biggest message accepted by SocketReadDataForm
+#define SOCKET_DATA_FORM_CHUNK		( 1024 * 1024 )			// message buffer grows with received data by this step
+#define SOCKET_WRITE_TIMEOUT		30000					// milliseconds SocketWriteV waits for peer to accept more data
+
 // For debug
 int _writes;
 int _reads;
@@ -145,6 +150,15 @@ typedef struct Socket
 	int                                           s_Timeoutu;
 	int                                           s_Users;        // How many use it right now?
 
+// HTTP keep-alive
+	FBOOL                                    s_KeepAliveAllowed;   // client request allows to reuse connection
+	FBOOL                                    s_KeepAlive;            // response was sent with keep-alive, connection can be reused
+	int                                           s_Requests;             // number of requests served on this connection
+	time_t                                      s_LastActivity;        // when connection went idle
+	FBOOL                                    s_Idle;                   // socket is waiting on idle list
+	struct Socket                            *s_IdlePrev;
+	struct Socket                            *s_IdleNext;
+
 	MinNode                                 node;
 } Socket;
 
@@ -208,12 +222,36 @@ int       SocketWaitRead( Socket* sock, char* data, unsigned int length, unsigne
 
 BufString *SocketReadTillEnd( Socket* sock, unsigned int pass, int sec );
 
+//
+// Read one FriendCore message (ID_FCRE + size header), stream without size is read till end
+//
+
+BufString *SocketReadDataForm( Socket* sock, int sec, FBOOL *closed );
+
+//
+// Check if idle connection was not closed by other side
+//
+
+FBOOL     SocketIsAlive( Socket* sock );
+
+//
+// Check if data is waiting on socket
+//
+
+FBOOL     SocketHasData( Socket* sock );
+
 //
 // Write to the socket, or queue data for writing if non-blocking socket
 //
 
 int       SocketWrite( Socket* s, char* data, FQUAD length );
 
+//
+// Write many buffers to the socket without joining them (iov table is modified)
+//
+
+FQUAD     SocketWriteV( Socket* s, struct iovec *iov, int iovcnt );
+
 //
 // Request the socket to be closed (Acceptable if the other end also has closed the socket)
 //
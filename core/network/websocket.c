@@ -68,13 +68,15 @@ static int callback_http( struct lws *wsi, enum lws_callback_reasons reason, voi
 /**
  * Write data to websockets, inline function
  * If message is bigger then WS buffer then message is encoded, splitted and send
+ * Clients which negotiated binary framing get big message as fragmented binary message without encoding
+ * Message is put into client send queue and sent by websocket thread when socket is writeable
  *
  * @param wsi pointer to websocket structure
  * @param msgptr pointer to message
  * @param msglen length of the messsage
  * @param type type of websocket message which will be send
  * @param mut pointer to pthread mutex
- * @return number of bytes sent
+ * @return number of bytes queued
  */
 inline int WebsocketWriteInline( void *wsi, unsigned char *msgptr, int msglen, int type )
 {
@@ -86,7 +88,54 @@ inline int WebsocketWriteInline( void *wsi, unsigned char *msgptr, int msglen, i
 	}
 	cl->wc_InUseCounter++;
 
-	if( msglen > WS_PROTOCOL_BUFFER_SIZE ) // message is too big, we must split data into chunks
+	if( msglen > WS_PROTOCOL_BUFFER_SIZE && cl->wc_Binary == TRUE ) // message is too big, sending fragments
+	{
+		int totalChunk = 1 + ( msglen + WS_PROTOCOL_BUFFER_SIZE - 1 ) / WS_PROTOCOL_BUFFER_SIZE;
+		unsigned char **frames = FCalloc( totalChunk, sizeof( unsigned char * ) );
+		int *sizes = FCalloc( totalChunk, sizeof( int ) );
+		
+		DEBUG("[WS] Sending big binary message , size %d\n", msglen );
+		
+		if( frames != NULL && sizes != NULL )
+		{
+			unsigned char header[ WS_BINARY_HEADER_SIZE ];
+			int actChunk;
+			
+			header[ 0 ] = 'F';
+			header[ 1 ] = 'C';
+			header[ 2 ] = WS_BINARY_VERSION;
+			header[ 3 ] = ( type == LWS_WRITE_TEXT ) ? WS_BINARY_FLAG_TEXT : 0;
+			header[ 4 ] = (unsigned char)( msglen >> 24 );
+			header[ 5 ] = (unsigned char)( msglen >> 16 );
+			header[ 6 ] = (unsigned char)( msglen >> 8 );
+			header[ 7 ] = (unsigned char)msglen;
+			
+			frames[ 0 ] = header;
+			sizes[ 0 ] = WS_BINARY_HEADER_SIZE;
+			
+			// fragments point directly to message, data is copied only once into send queue
+			for( actChunk = 1; actChunk < totalChunk ; actChunk++ )
+			{
+				int pos = ( actChunk - 1 ) * WS_PROTOCOL_BUFFER_SIZE;
+				
+				frames[ actChunk ] = msgptr + pos;
+				sizes[ actChunk ] = msglen - pos;
+				if( sizes[ actChunk ] > WS_PROTOCOL_BUFFER_SIZE )
+				{
+					sizes[ actChunk ] = WS_PROTOCOL_BUFFER_SIZE;
+				}
+			}
+			
+			result = WebsocketClientQueueAdd( cl, frames, sizes, totalChunk, LWS_WRITE_BINARY, TRUE );
+			if( result > 0 )
+			{
+				result -= WS_BINARY_HEADER_SIZE;
+			}
+		}
+		if( frames != NULL ) FFree( frames );
+		if( sizes != NULL ) FFree( sizes );
+	}
+	else if( msglen > WS_PROTOCOL_BUFFER_SIZE ) // message is too big, we must split data into chunks
 	{
 		char *encmsg = Base64Encode( (const unsigned char *)msgptr, msglen, &msglen );
 		if( encmsg != NULL )
@@ -94,21 +143,27 @@ inline int WebsocketWriteInline( void *wsi, unsigned char *msgptr, int msglen, i
 			char *locmsgptr = encmsg;
 			int totalChunk = (msglen / WS_PROTOCOL_BUFFER_SIZE)+1;
 			int actChunk = 0;
+			int chunkSize = WS_PROTOCOL_BUFFER_SIZE + 256;
 			
 			int END_CHAR_SIGNS = 4;
 			char *end = "\"}}}";
 			
 			DEBUG("[WS] Sending big message , size %d\n", msglen );
 		
-			unsigned char *sendMsg = FMalloc( LWS_SEND_BUFFER_PRE_PADDING + WS_PROTOCOL_BUFFER_SIZE + 256 );
-			if( sendMsg != NULL )
+			// all chunks are queued together, so queue policy cannot drop part of message
+			unsigned char *sendMsg = FMalloc( totalChunk * chunkSize );
+			unsigned char **frames = FCalloc( totalChunk, sizeof( unsigned char * ) );
+			int *sizes = FCalloc( totalChunk, sizeof( int ) );
+			if( sendMsg != NULL && frames != NULL && sizes != NULL )
 			{
 				// sending chunks
 				for( actChunk = 0; actChunk < totalChunk ; actChunk++ )
 				{
-					unsigned char *chunkptr = sendMsg + LWS_SEND_BUFFER_PRE_PADDING;
+					unsigned char *chunkptr = sendMsg + ( actChunk * chunkSize );
 					int sendLen = 0;
 					
+					frames[ actChunk ] = chunkptr;
+					
 					int txtmsgpos = sprintf( (char *)chunkptr, "{\"type\":\"con\",\"data\":{\"type\":\"chunk\",\"data\":{\"id\":\"%p\",\"total\":\"%d\",\"part\":\"%d\",\"data\":\"", sendMsg, totalChunk, actChunk );
 					int copysize = msglen;
 					if( copysize > WS_PROTOCOL_BUFFER_SIZE )
@@ -131,38 +186,21 @@ inline int WebsocketWriteInline( void *wsi, unsigned char *msgptr, int msglen, i
 					
 					locmsgptr += copysize;
 					msglen -= copysize;
-
-					pthread_mutex_lock( &(cl->wc_Mutex) );
-					if( cl->wc_Wsi != NULL )
-					{
-						result += lws_write( cl->wc_Wsi, sendMsg+LWS_SEND_BUFFER_PRE_PADDING , sendLen, type );
-						int val; int x=0;
-						while( 0 != (val = lws_send_pipe_choked( cl->wc_Wsi ) ) )
-						{
-							usleep( 2000 );
-						}
-					}
-					pthread_mutex_unlock( &(cl->wc_Mutex) );
+					
+					sizes[ actChunk ] = sendLen;
 				}
-				FFree( sendMsg );
+				
+				result = WebsocketClientQueueAdd( cl, frames, sizes, totalChunk, type, FALSE );
 			}
+			if( sendMsg != NULL ) FFree( sendMsg );
+			if( frames != NULL ) FFree( frames );
+			if( sizes != NULL ) FFree( sizes );
 			FFree( encmsg );
 		}
 	}
 	else
 	{
-		pthread_mutex_lock( &(cl->wc_Mutex) );
-		
-		if( cl->wc_Wsi != NULL )
-		{
-			result = lws_write( cl->wc_Wsi, msgptr, msglen, type );
-			int val; int x=0;
-			while( 0 != (val = lws_send_pipe_choked( cl->wc_Wsi ) ) )
-			{
-				usleep( 2000 );
-			}
-		}
-		pthread_mutex_unlock( &(cl->wc_Mutex) );
+		result = WebsocketClientQueueAdd( cl, &msgptr, &msglen, 1, type, FALSE );
 	}
 	cl->wc_InUseCounter--;
 	
@@ -178,7 +216,7 @@ inline int WebsocketWriteInline( void *wsi, unsigned char *msgptr, int msglen, i
  * @param msglen length of the messsage
  * @param type type of websocket message which will be send
  * @param mut pointer to pthread mutex
- * @return number of bytes sent
+ * @return number of bytes queued
  */
 int WebsocketWrite( void *wsi, unsigned char *msgptr, int msglen, int type )
 {
@@ -267,6 +305,31 @@ typedef struct WSThreadData
 	int requestLen;
 }WSThreadData;
 
+//
+// release request data which could not be passed to worker
+//
+
+static void WSThreadDataFree( WSThreadData *data )
+{
+	Http *http = data->http;
+	if( http != NULL )
+	{
+		UriFree( http->uri );
+		
+		if( http->rawRequestPath != NULL )
+		{
+			FFree( http->rawRequestPath );
+			http->rawRequestPath = NULL;
+		}
+		HttpFree( http );
+	}
+	
+	FFree( data->requestid );
+	FFree( data->path );
+	BufStringDelete( data->queryrawbs );
+	FFree( data );
+}
+
 /**
  * Websocket request thread
  *
@@ -675,6 +738,116 @@ void WSThreadPing( void *p )
 #endif
 
 
+/**
+ * Release message reassembly buffers
+ *
+ * @param fcd pointer to FCWSData
+ */
+static void FC_ReceiveBinaryReset( FCWSData *fcd )
+{
+	if( fcd->fcd_RecvBuffer != NULL )
+	{
+		FFree( fcd->fcd_RecvBuffer );
+		fcd->fcd_RecvBuffer = NULL;
+	}
+	if( fcd->fcd_RecvText != NULL )
+	{
+		BufStringDelete( fcd->fcd_RecvText );
+		fcd->fcd_RecvText = NULL;
+	}
+	fcd->fcd_RecvHeaderSize = 0;
+	fcd->fcd_RecvBufferSize = 0;
+	fcd->fcd_RecvSize = 0;
+	fcd->fcd_RecvPos = 0;
+}
+
+/**
+ * Put received part of binary message into reassembly buffer.
+ * Size from message header only limits the buffer, it grows with received data, so peer cannot
+ * make server reserve memory for data which is never sent.
+ *
+ * @param wsi pointer to main Websockets structure
+ * @param fcd pointer to FCWSData
+ * @param in received data
+ * @param len size of received data
+ * @return 1 when message is complete, 0 when more data is expected, -1 when message is not valid
+ */
+static int FC_ReceiveBinary( struct lws *wsi, FCWSData *fcd, unsigned char *in, size_t len )
+{
+	if( fcd->fcd_RecvHeaderSize < WS_BINARY_HEADER_SIZE )
+	{
+		size_t hlen = WS_BINARY_HEADER_SIZE - fcd->fcd_RecvHeaderSize;
+		if( hlen > len )
+		{
+			hlen = len;
+		}
+		memcpy( fcd->fcd_RecvHeader + fcd->fcd_RecvHeaderSize, in, hlen );
+		fcd->fcd_RecvHeaderSize += hlen;
+		in += hlen;
+		len -= hlen;
+		
+		if( fcd->fcd_RecvHeaderSize < WS_BINARY_HEADER_SIZE )
+		{
+			return lws_is_final_fragment( wsi ) && lws_remaining_packet_payload( wsi ) == 0 ? -1 : 0;
+		}
+		
+		unsigned char *h = fcd->fcd_RecvHeader;
+		FULONG size = ( (FULONG)h[ 4 ] << 24 ) | ( (FULONG)h[ 5 ] << 16 ) | ( (FULONG)h[ 6 ] << 8 ) | (FULONG)h[ 7 ];
+		
+		if( h[ 0 ] != 'F' || h[ 1 ] != 'C' || h[ 2 ] != WS_BINARY_VERSION || size == 0 || size > WS_BINARY_MESSAGE_MAX )
+		{
+			FERROR("[WS] Wrong binary message header, version %d size %lu\n", h[ 2 ], size );
+			return -1;
+		}
+		
+		fcd->fcd_RecvSize = (int)size;
+		fcd->fcd_RecvPos = 0;
+	}
+	
+	if( len > (size_t)( fcd->fcd_RecvSize - fcd->fcd_RecvPos ) )
+	{
+		FERROR("[WS] Binary message is longer then declared size %d\n", fcd->fcd_RecvSize );
+		return -1;
+	}
+	
+	if( fcd->fcd_RecvPos + (int)len > fcd->fcd_RecvBufferSize )
+	{
+		int bsize = fcd->fcd_RecvBufferSize > 0 ? fcd->fcd_RecvBufferSize * 2 : WS_PROTOCOL_BUFFER_SIZE;
+		if( bsize < fcd->fcd_RecvPos + (int)len )
+		{
+			bsize = fcd->fcd_RecvPos + (int)len;
+		}
+		if( bsize > fcd->fcd_RecvSize )
+		{
+			bsize = fcd->fcd_RecvSize;
+		}
+		
+		char *buf = realloc( fcd->fcd_RecvBuffer, bsize + 1 );
+		if( buf == NULL )
+		{
+			FERROR("[WS] Cannot allocate memory for binary message, size %d\n", bsize );
+			return -1;
+		}
+		fcd->fcd_RecvBuffer = buf;
+		fcd->fcd_RecvBufferSize = bsize;
+	}
+	
+	memcpy( fcd->fcd_RecvBuffer + fcd->fcd_RecvPos, in, len );
+	fcd->fcd_RecvPos += len;
+	
+	if( lws_is_final_fragment( wsi ) && lws_remaining_packet_payload( wsi ) == 0 )
+	{
+		if( fcd->fcd_RecvPos != fcd->fcd_RecvSize )
+		{
+			FERROR("[WS] Binary message is shorter then declared size %d, received %d\n", fcd->fcd_RecvSize, fcd->fcd_RecvPos );
+			return -1;
+		}
+		fcd->fcd_RecvBuffer[ fcd->fcd_RecvSize ] = 0;
+		return 1;
+	}
+	return 0;
+}
+
 /**
  * Main FriendCore websocket callback
  *
@@ -704,6 +877,18 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 			INFO("[WS] Callback estabilished %p %p\n", fcd->fcd_SystemBase, fcd->fcd_WSClient );
 			fcd->fcd_SystemBase = NULL;
 			fcd->fcd_WSClient = NULL;
+			fcd->fcd_Binary = ( lws_get_protocol( wsi )->id == WS_PROTOCOL_BINARY_ID );
+			fcd->fcd_RecvBuffer = NULL;
+			fcd->fcd_RecvText = NULL;
+			fcd->fcd_RecvDispatch = FALSE;
+			FC_ReceiveBinaryReset( fcd );
+		break;
+		
+		case LWS_CALLBACK_SERVER_WRITEABLE:
+			if( fcd->fcd_WSClient != NULL && WebsocketClientQueueFlush( fcd->fcd_WSClient ) != 0 )
+			{
+				returnError = -1;
+			}
 		break;
 		
 		case LWS_CALLBACK_CLOSED:
@@ -711,6 +896,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 			
             DeleteWebSocketConnection( SLIB, wsi, fcd );
 			fcd->fcd_WSClient = NULL;
+			FC_ReceiveBinaryReset( fcd );
 		break;
 
 		//
@@ -734,6 +920,59 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 
 		case LWS_CALLBACK_RECEIVE:
 			{
+				// binary message is reassembled and processed like text message when it is complete
+				if( fcd->fcd_Binary == TRUE && fcd->fcd_RecvDispatch == FALSE && lws_frame_is_binary( wsi ) )
+				{
+					int ret = FC_ReceiveBinary( wsi, fcd, (unsigned char *)in, len );
+					if( ret < 0 )
+					{
+						FC_ReceiveBinaryReset( fcd );
+						returnError = -1;
+					}
+					else if( ret > 0 )
+					{
+						if( fcd->fcd_RecvHeader[ 3 ] & WS_BINARY_FLAG_TEXT )
+						{
+							fcd->fcd_RecvDispatch = TRUE;
+							FC_Callback( wsi, reason, user, fcd->fcd_RecvBuffer, fcd->fcd_RecvSize );
+							fcd->fcd_RecvDispatch = FALSE;
+						}
+						else
+						{
+							FERROR("[WS] Binary payload without JSON message is not supported\n");
+						}
+						FC_ReceiveBinaryReset( fcd );
+					}
+					break;
+				}
+				
+				// text message which does not fit into one receive buffer is joined before it is parsed
+				if( fcd->fcd_RecvDispatch == FALSE && ( fcd->fcd_RecvText != NULL || !lws_is_final_fragment( wsi ) || lws_remaining_packet_payload( wsi ) > 0 ) )
+				{
+					if( fcd->fcd_RecvText == NULL && ( fcd->fcd_RecvText = BufStringNewSize( WS_PROTOCOL_BUFFER_SIZE ) ) == NULL )
+					{
+						FERROR("[WS] Cannot allocate memory for message\n");
+						returnError = -1;
+						break;
+					}
+					BufStringAddSize( fcd->fcd_RecvText, in, len );
+					
+					if( fcd->fcd_RecvText->bs_Size > WS_BINARY_MESSAGE_MAX )
+					{
+						FERROR("[WS] Message is too big, size %d\n", fcd->fcd_RecvText->bs_Size );
+						FC_ReceiveBinaryReset( fcd );
+						returnError = -1;
+					}
+					else if( lws_is_final_fragment( wsi ) && lws_remaining_packet_payload( wsi ) == 0 )
+					{
+						fcd->fcd_RecvDispatch = TRUE;
+						FC_Callback( wsi, reason, user, fcd->fcd_RecvText->bs_Buffer, fcd->fcd_RecvText->bs_Size );
+						fcd->fcd_RecvDispatch = FALSE;
+						FC_ReceiveBinaryReset( fcd );
+					}
+					break;
+				}
+				
 				// if we want to move full calls to WS threads
 				
 //				Socket *sock = SocketWSOpen( wsi );
@@ -943,7 +1182,11 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 #else
 #ifdef USE_WORKERS
 											//SystemBase *lsb = (SystemBase *)fcd->fcd_SystemBase;
-											WorkerManagerRun( SLIB->sl_WorkerManager,  WSThreadPing, wstdata, NULL );
+											if( WorkerManagerTryRun( SLIB->sl_WorkerManager,  WSThreadPing, wstdata, NULL ) != 0 )
+											{
+												FERROR("[WS] Cannot queue ping, server is busy\n");
+												WSThreadDataFree( wstdata );
+											}
 #else
 #endif
 #endif
@@ -1222,7 +1465,11 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 #else
 #ifdef USE_WORKERS
 													SystemBase *lsb = (SystemBase *)fcd->fcd_SystemBase;
-													WorkerManagerRun( SLIB->sl_WorkerManager,  WSThread, wstdata, http );
+													if( WorkerManagerTryRun( SLIB->sl_WorkerManager,  WSThread, wstdata, http ) != 0 )
+													{
+														FERROR("[WS] Cannot queue request, server is busy\n");
+														WSThreadDataFree( wstdata );
+													}
 #else
 #endif
 #endif
@@ -1693,6 +1940,108 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 	return returnError;
 }
 
+/**
+ * permessage-deflate extension callback. Calls libwebsockets extension and applies FriendCore settings,
+ * skips compression of small messages and counts compression ratio and time.
+ *
+ * @param context pointer to libwebsockets context
+ * @param ext pointer to extension structure
+ * @param wsi pointer to main Websockets structure
+ * @param reason extension callback reason
+ * @param user per connection extension data
+ * @param in extension callback data
+ * @param len extension callback length, write protocol when payload is sent
+ * @return 0 when success, otherwise error number
+ */
+static int FC_DeflateCallback( struct lws_context *context, const struct lws_extension *ext, struct lws *wsi, enum lws_extension_callback_reasons reason, void *user, void *in, size_t len )
+{
+	WebSocket *ws = (WebSocket *)lws_context_user( context );
+	struct lws_tokens *eff_buf = (struct lws_tokens *)in;
+	struct timespec start, end;
+	int inlen;
+	int ret;
+	
+	switch( reason )
+	{
+		case LWS_EXT_CB_PAYLOAD_TX:
+			// only unfragmented messages can be sent uncompressed, continuation must follow first fragment
+			if( ( ( len & 0x3f ) == LWS_WRITE_TEXT || ( len & 0x3f ) == LWS_WRITE_BINARY ) && !( len & LWS_WRITE_NO_FIN ) &&
+				eff_buf->token != NULL && eff_buf->token_len < SLIB->sl_WSDeflateThreshold )
+			{
+				ws->ws_DeflateSkipped++;
+				return 0;
+			}
+			
+			inlen = eff_buf->token != NULL ? eff_buf->token_len : 0;
+			clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+			ret = lws_extension_callback_pm_deflate( context, ext, wsi, reason, user, in, len );
+			clock_gettime( CLOCK_THREAD_CPUTIME_ID, &end );
+			
+			ws->ws_DeflateIn += inlen;
+			ws->ws_DeflateOut += eff_buf->token_len;
+			ws->ws_DeflateTime += ( end.tv_sec - start.tv_sec ) * 1000000 + ( end.tv_nsec - start.tv_nsec ) / 1000;
+		return ret;
+		
+		case LWS_EXT_CB_PAYLOAD_RX:
+			if( !( wsi->u.ws.rsv_first_msg & 0x40 ) )	// message was not compressed
+			{
+				break;
+			}
+			
+			inlen = eff_buf->token_len;
+			clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+			ret = lws_extension_callback_pm_deflate( context, ext, wsi, reason, user, in, len );
+			clock_gettime( CLOCK_THREAD_CPUTIME_ID, &end );
+			
+			ws->ws_InflateIn += inlen;
+			ws->ws_InflateOut += eff_buf->token_len;
+			ws->ws_InflateTime += ( end.tv_sec - start.tv_sec ) * 1000000 + ( end.tv_nsec - start.tv_nsec ) / 1000;
+		return ret;
+		
+		case LWS_EXT_CB_CONSTRUCT:
+			if( ( ret = lws_extension_callback_pm_deflate( context, ext, wsi, reason, user, in, len ) ) == 0 )
+			{
+				struct lws_ext_option_arg oa;
+				char val[ 16 ];
+				
+				// bundled libwebsockets compress server messages with window from client_max_window_bits slot
+				// smaller window on sender side is always readable by client, so it does not need negotiation
+				oa.option_name = "client_max_window_bits";
+				oa.option_index = 0;
+				oa.len = snprintf( val, sizeof(val), "%d", SLIB->sl_WSDeflateWindowBits );
+				oa.start = val;
+				lws_extension_callback_pm_deflate( context, ext, wsi, LWS_EXT_CB_NAMED_OPTION_SET, *(void **)user, &oa, 0 );
+				
+				oa.option_name = "mem_level";
+				oa.len = snprintf( val, sizeof(val), "%d", SLIB->sl_WSDeflateMemLevel );
+				lws_extension_callback_pm_deflate( context, ext, wsi, LWS_EXT_CB_NAMED_OPTION_SET, *(void **)user, &oa, 0 );
+				
+				// inflated messages are delivered in parts of this size (2^15, biggest which fits into protocol rx buffer)
+				oa.option_name = "rx_buf_size";
+				oa.len = snprintf( val, sizeof(val), "%d", 15 );
+				lws_extension_callback_pm_deflate( context, ext, wsi, LWS_EXT_CB_NAMED_OPTION_SET, *(void **)user, &oa, 0 );
+			}
+		return ret;
+		
+		default:
+		break;
+	}
+	return lws_extension_callback_pm_deflate( context, ext, wsi, reason, user, in, len );
+}
+
+// list of extensions offered to clients
+
+static const struct lws_extension extensions[] = {
+	{
+		"permessage-deflate",
+		FC_DeflateCallback,
+		"permessage-deflate"
+	},
+	{
+		NULL, NULL, NULL 		// End of list 
+	}
+};
+
 // list of supported protocols and callbacks 
 
 static struct lws_protocols protocols[] = {
@@ -1707,11 +2056,20 @@ static struct lws_protocols protocols[] = {
 		0
 	},
 	{
-		"FC-protocol",
+		WS_PROTOCOL_NAME,
+		FC_Callback,
+		sizeof( struct FCWSData ),
+		WS_PROTOCOL_BUFFER_SIZE,
+		WS_PROTOCOL_ID,
+		NULL,
+		0
+	},
+	{
+		WS_PROTOCOL_BINARY_NAME,	// same protocol, big messages are sent as binary fragments
 		FC_Callback,
 		sizeof( struct FCWSData ),
 		WS_PROTOCOL_BUFFER_SIZE,
-		2,
+		WS_PROTOCOL_BINARY_ID,
 		NULL,
 		0
 	},
@@ -1749,6 +2107,9 @@ int WebsocketThread( FThread *data )
 	{
 		int n = lws_service( ws->ws_Context, 500 );
 		
+		// other threads only put messages into queues, writeable callback can be requested only here
+		WebsocketClientsRequestWrite();
+		
 		if( ws->ws_Quit == TRUE && nothreads <= 0 )
 		{
 			break;
@@ -1838,8 +2199,20 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn )
 		}
 		
 		ws->ws_Info.user = ws;
-		//ws->ws_Info.extensions = lws_get_internal_extensions();
-//		ws->ws_Info.extensions->per_context_private_data = ws;
+		if( lsb->sl_WSCompression == TRUE )
+		{
+			// zlib accepts raw deflate window from 9 bits
+			if( lsb->sl_WSDeflateWindowBits < 9 || lsb->sl_WSDeflateWindowBits > 15 )
+			{
+				lsb->sl_WSDeflateWindowBits = WS_DEFLATE_WINDOW_BITS_DEFAULT;
+			}
+			if( lsb->sl_WSDeflateMemLevel < 1 || lsb->sl_WSDeflateMemLevel > 9 )
+			{
+				lsb->sl_WSDeflateMemLevel = WS_DEFLATE_MEM_LEVEL_DEFAULT;
+			}
+			INFO("[WS] permessage-deflate enabled, window bits %d memory level %d threshold %d\n", lsb->sl_WSDeflateWindowBits, lsb->sl_WSDeflateMemLevel, lsb->sl_WSDeflateThreshold );
+			ws->ws_Info.extensions = extensions;
+		}
 		ws->ws_Info.ssl_cipher_list = "ECDHE-ECDSA-AES256-GCM-SHA384:"
 			       "ECDHE-RSA-AES256-GCM-SHA384:"
 			       "DHE-RSA-AES256-GCM-SHA384:"
@@ -2138,6 +2511,7 @@ int AddWebSocketConnection( void *locsb, struct lws *wsi, const char *sessionid,
 		Log(FLOG_DEBUG, "WebsocketClient new %p pointer to new %p\n", nwsc, nwsc->node.mln_Succ );
 		DEBUG("[WS] AddWSCon new connection created\n");
 		nwsc->wc_Wsi = wsi;
+		nwsc->wc_Binary = data->fcd_Binary;
 		
 		User *actUser = actUserSess->us_User;
 		if( actUser != NULL )
@@ -2255,6 +2629,24 @@ int DeleteWebSocketConnection( void *locsb, struct lws *wsi, FCWSData *data )
     return 0;
 }
 
+/**
+ * Get permessage-deflate statistics as JSON object
+ *
+ * @param ws pointer to WebSocket
+ * @param buffer pointer to buffer where statistics will be stored
+ * @param size size of buffer
+ * @return number of characters written
+ */
+int WebSocketGetStatistics( WebSocket *ws, char *buffer, int size )
+{
+	FULONG in = ws->ws_DeflateIn;
+	FULONG out = ws->ws_DeflateOut;
+	
+	return snprintf( buffer, size, "{\"compression\":%d,\"deflatein\":%lu,\"deflateout\":%lu,\"ratio\":%.3f,\"deflatetime\":%lu,\"skipped\":%lu,\"inflatein\":%lu,\"inflateout\":%lu,\"inflatetime\":%lu}",
+		SLIB->sl_WSCompression, in, out, in > 0 ? (double)out / (double)in : 1.0, ws->ws_DeflateTime, ws->ws_DeflateSkipped,
+		ws->ws_InflateIn, ws->ws_InflateOut, ws->ws_InflateTime );
+}
+
 /*
  // original
 int DeleteWebSocketConnection( void *locsb, struct lws *wsi, void *wscl )
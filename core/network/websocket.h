@@ -43,11 +43,36 @@
 #include <core/thread.h>
 #include <time.h>
 #include <network/websocket_client.h>
+#include <util/buffered_string.h>
 
 #define MAX_MESSAGE_QUEUE 64
 
 #define MAX_POLL_ELEMENTS 256
 
+//
+// binary framing of big messages, negotiated by WS_PROTOCOL_BINARY_NAME subprotocol
+// message is sent as fragmented binary websocket message, first fragment is header:
+// 'F' 'C' version flags length(4 bytes, big endian), next fragments are raw payload
+//
+
+#define WS_PROTOCOL_NAME				"FC-protocol"
+#define WS_PROTOCOL_BINARY_NAME			"FC-protocol-binary"
+#define WS_PROTOCOL_ID					2
+#define WS_PROTOCOL_BINARY_ID			3
+
+#define WS_BINARY_HEADER_SIZE			8
+#define WS_BINARY_VERSION				1
+#define WS_BINARY_FLAG_TEXT				0x01		// payload is JSON/text message
+#define WS_BINARY_MESSAGE_MAX			( 64 * 1024 * 1024 )
+
+//
+// permessage-deflate defaults
+//
+
+#define WS_DEFLATE_WINDOW_BITS_DEFAULT	15
+#define WS_DEFLATE_MEM_LEVEL_DEFAULT	8
+#define WS_DEFLATE_THRESHOLD_DEFAULT	256		// messages smaller then this are sent uncompressed
+
 //
 // main WebSocket structure
 //
@@ -78,6 +103,15 @@ typedef struct WebSocket
 	
 	FBOOL                                           ws_Quit;
 	void                                            *ws_FCM;
+	
+	// permessage-deflate statistics, updated only by websocket service thread
+	FULONG                                          ws_DeflateIn;
+	FULONG                                          ws_DeflateOut;
+	FULONG                                          ws_DeflateTime;		// microseconds of CPU time
+	FULONG                                          ws_DeflateSkipped;	// messages below threshold
+	FULONG                                          ws_InflateIn;
+	FULONG                                          ws_InflateOut;
+	FULONG                                          ws_InflateTime;
 } WebSocket;
 
 
@@ -93,6 +127,16 @@ typedef struct FCWSData
 	void								*fcd_SystemBase;
 	
 	struct timeval				fcd_Timer;
+	
+	FBOOL								fcd_Binary;			// connection use binary framing
+	unsigned char						fcd_RecvHeader[ WS_BINARY_HEADER_SIZE ];
+	int									fcd_RecvHeaderSize;
+	char								*fcd_RecvBuffer;	// binary message reassembly, grows with received data up to header length
+	int									fcd_RecvBufferSize;
+	int									fcd_RecvSize;
+	int									fcd_RecvPos;
+	FBOOL								fcd_RecvDispatch;	// reassembled message is processed
+	BufString							*fcd_RecvText;		// text message delivered in many parts (inflated or bigger then rx buffer)
 }FCWSData;
 
 //
@@ -131,6 +175,12 @@ int AddWebSocketConnection( void *l, struct lws *wsi, const char *sessionid, con
 
 int DeleteWebSocketConnection( void *locsb, struct lws *wsi, FCWSData *data );
 
+//
+// Get compression statistics
+//
+
+int WebSocketGetStatistics( WebSocket *ws, char *buffer, int size );
+
 #endif // __NETWORK_WEBSOCKET_H__
 
 
@@ -31,9 +31,17 @@
 
 #include "websocket_client.h"
 #include <system/systembase.h>
+#include <private-libwebsockets.h>
 
 extern SystemBase *SLIB;
 
+//
+// clients which got new frames and wait for lws_callback_on_writable, it can be called only by service thread
+//
+
+static WebsocketClient *writePending = NULL;
+static pthread_mutex_t writePendingMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Create new WebsocketClient
  *
@@ -45,6 +53,20 @@ WebsocketClient *WebsocketClientNew()
 	if( cl != NULL )
 	{
 		pthread_mutex_init( &(cl->wc_Mutex), NULL );
+		
+		cl->wc_QueueBaseSize = WS_QUEUE_SIZE_DEFAULT;
+		cl->wc_QueuePolicy = WS_QUEUE_POLICY_DROP;
+		if( SLIB != NULL )
+		{
+			if( SLIB->sl_WSQueueSize > 0 )
+			{
+				cl->wc_QueueBaseSize = SLIB->sl_WSQueueSize;
+			}
+			cl->wc_QueuePolicy = SLIB->sl_WSQueuePolicy;
+		}
+		
+		// ring and frame buffers are allocated when first message is queued, idle connection does not hold them
+		cl->wc_QueueSize = 0;
 	}
 	return cl;
 }
@@ -87,7 +109,404 @@ void WebsocketClientDelete( WebsocketClient *cl )
 		//cl->wc_WebsocketsData = NULL;
 		pthread_mutex_unlock( &(cl->wc_Mutex) );
 		
+		pthread_mutex_lock( &writePendingMutex );
+		if( cl->wc_WritePending == TRUE )
+		{
+			WebsocketClient **prev = &writePending;
+			while( *prev != NULL )
+			{
+				if( *prev == cl )
+				{
+					*prev = cl->wc_WriteNext;
+					break;
+				}
+				prev = &((*prev)->wc_WriteNext);
+			}
+		}
+		pthread_mutex_unlock( &writePendingMutex );
+		
+		if( cl->wc_Queue != NULL )
+		{
+			int i;
+			for( i=0 ; i < cl->wc_QueueSize ; i++ )
+			{
+				if( cl->wc_Queue[ i ].wf_Buffer != NULL )
+				{
+					FFree( cl->wc_Queue[ i ].wf_Buffer );
+				}
+			}
+			FFree( cl->wc_Queue );
+		}
+		
 		pthread_mutex_destroy( &(cl->wc_Mutex) );
 		FFree( cl );
 	}
 }
+
+/**
+ * Remove oldest message from send queue, message can be stored in many frames
+ *
+ * @param cl pointer to WebsocketClient
+ */
+static void WebsocketClientQueueDropOldest( WebsocketClient *cl )
+{
+	do
+	{
+		cl->wc_QueueFirst = ( cl->wc_QueueFirst + 1 ) % cl->wc_QueueSize;
+		cl->wc_QueueCount--;
+	}
+	while( cl->wc_QueueCount > 0 && cl->wc_Queue[ cl->wc_QueueFirst ].wf_Continue == TRUE );
+}
+
+/**
+ * Extend send queue ring, waiting frames keep their order
+ *
+ * @param cl pointer to WebsocketClient
+ * @param size new number of frames in ring
+ * @return 0 when success, otherwise -1
+ */
+static int WebsocketClientQueueGrow( WebsocketClient *cl, int size )
+{
+	WebsocketFrame *queue = FCalloc( size, sizeof( WebsocketFrame ) );
+	if( queue == NULL )
+	{
+		FERROR("[WebsocketClientQueueGrow] Cannot allocate memory for send queue\n");
+		return -1;
+	}
+	
+	// waiting frames first, then free ones with their buffers, new frames get buffers when they are used
+	int i;
+	for( i=0 ; i < cl->wc_QueueSize ; i++ )
+	{
+		queue[ i ] = cl->wc_Queue[ ( cl->wc_QueueFirst + i ) % cl->wc_QueueSize ];
+	}
+	FFree( cl->wc_Queue );
+	
+	cl->wc_Queue = queue;
+	cl->wc_QueueSize = size;
+	cl->wc_QueueFirst = 0;
+	cl->wc_QueueGrown = TRUE;
+	
+	return 0;
+}
+
+/**
+ * Bring empty send queue back to configured size, big frame buffers are released
+ *
+ * @param cl pointer to WebsocketClient
+ */
+static void WebsocketClientQueueShrink( WebsocketClient *cl )
+{
+	int i;
+	for( i=0 ; i < cl->wc_QueueSize ; i++ )
+	{
+		WebsocketFrame *wf = &(cl->wc_Queue[ i ]);
+		if( i >= cl->wc_QueueBaseSize || wf->wf_BufferSize > WS_QUEUE_FRAME_SIZE )
+		{
+			// frame gets small buffer again when it is used next time
+			if( wf->wf_Buffer != NULL )
+			{
+				FFree( wf->wf_Buffer );
+				wf->wf_Buffer = NULL;
+			}
+			wf->wf_BufferSize = 0;
+		}
+	}
+	
+	if( cl->wc_QueueSize > cl->wc_QueueBaseSize )
+	{
+		if( cl->wc_QueueBaseSize == 0 )
+		{
+			FFree( cl->wc_Queue );
+			cl->wc_Queue = NULL;
+		}
+		else
+		{
+			// table only gets smaller, old one is still valid when realloc fails
+			WebsocketFrame *queue = realloc( cl->wc_Queue, cl->wc_QueueBaseSize * sizeof( WebsocketFrame ) );
+			if( queue != NULL )
+			{
+				cl->wc_Queue = queue;
+			}
+		}
+		cl->wc_QueueSize = cl->wc_QueueBaseSize;
+	}
+	cl->wc_QueueFirst = 0;
+	cl->wc_QueueGrown = FALSE;
+}
+
+/**
+ * Add message to send queue. Message is sent later by websocket service thread, so slow client
+ * does not block caller. When queue is full, queue policy decide what happens with message.
+ * Message which has more frames than whole queue gets bigger ring, but only one such message can wait at a time.
+ *
+ * @param cl pointer to WebsocketClient
+ * @param frames table of pointers to frames payload
+ * @param sizes table of frames sizes
+ * @param count number of frames
+ * @param type type of websocket message (LWS_WRITE_TEXT, LWS_WRITE_BINARY)
+ * @param fragmented when TRUE frames are sent as fragments of one websocket message, otherwise every frame is separate message
+ * @return number of queued bytes, 0 when message was dropped
+ */
+int WebsocketClientQueueAdd( WebsocketClient *cl, unsigned char **frames, int *sizes, int count, int type, FBOOL fragmented )
+{
+	int result = 0;
+	
+	if( cl == NULL || count <= 0 )
+	{
+		return 0;
+	}
+	
+	pthread_mutex_lock( &(cl->wc_Mutex) );
+	
+	if( cl->wc_Wsi == NULL || cl->wc_QueueOverflow == TRUE )
+	{
+		pthread_mutex_unlock( &(cl->wc_Mutex) );
+		return 0;
+	}
+	
+	if( cl->wc_Queue == NULL && cl->wc_QueueBaseSize > 0 )
+	{
+		if( ( cl->wc_Queue = FCalloc( cl->wc_QueueBaseSize, sizeof( WebsocketFrame ) ) ) != NULL )
+		{
+			cl->wc_QueueSize = cl->wc_QueueBaseSize;
+		}
+		else
+		{
+			FERROR("[WebsocketClientQueueAdd] Cannot allocate memory for send queue\n");
+		}
+	}
+	
+	// message would never fit into queue, ring is extended for it
+	if( count > cl->wc_QueueBaseSize && cl->wc_QueueSize <= cl->wc_QueueBaseSize )
+	{
+		WebsocketClientQueueGrow( cl, cl->wc_QueueCount + count );
+	}
+	
+	if( cl->wc_QueueCount + count > cl->wc_QueueSize )
+	{
+		if( cl->wc_QueuePolicy == WS_QUEUE_POLICY_COALESCE && count <= cl->wc_QueueSize )
+		{
+			// rest of message which is partially sent cannot be removed, websocket stream would be broken
+			while( cl->wc_QueueCount + count > cl->wc_QueueSize && cl->wc_Queue[ cl->wc_QueueFirst ].wf_Continue == FALSE )
+			{
+				WebsocketClientQueueDropOldest( cl );
+				cl->wc_QueueCoalesced++;
+			}
+		}
+		
+		if( cl->wc_QueueCount + count > cl->wc_QueueSize )
+		{
+			if( cl->wc_QueuePolicy == WS_QUEUE_POLICY_DISCONNECT )
+			{
+				FERROR("[WebsocketClientQueueAdd] Client %p does not read messages, disconnecting\n", cl );
+				cl->wc_QueueOverflow = TRUE;
+			}
+			cl->wc_QueueDropped++;
+			count = 0;
+		}
+	}
+	
+	int i;
+	for( i=0 ; i < count ; i++ )
+	{
+		WebsocketFrame *wf = &(cl->wc_Queue[ ( cl->wc_QueueFirst + cl->wc_QueueCount ) % cl->wc_QueueSize ]);
+		
+		if( wf->wf_Buffer == NULL || wf->wf_BufferSize < sizes[ i ] )
+		{
+			// small frames share default buffer size, so buffer can be reused by next messages
+			int bufsize = sizes[ i ] > WS_QUEUE_FRAME_SIZE ? sizes[ i ] : WS_QUEUE_FRAME_SIZE;
+			unsigned char *buf = FMalloc( LWS_PRE + bufsize );
+			if( buf == NULL )
+			{
+				FERROR("[WebsocketClientQueueAdd] Cannot allocate memory for frame\n");
+				// part of message cannot be sent, remove already queued frames
+				cl->wc_QueueCount -= i;
+				result = 0;
+				break;
+			}
+			if( wf->wf_Buffer != NULL )
+			{
+				FFree( wf->wf_Buffer );
+			}
+			wf->wf_Buffer = buf;
+			wf->wf_BufferSize = bufsize;
+			if( bufsize > WS_QUEUE_FRAME_SIZE )
+			{
+				cl->wc_QueueGrown = TRUE;
+			}
+		}
+		
+		memcpy( wf->wf_Buffer + LWS_PRE, frames[ i ], sizes[ i ] );
+		wf->wf_Size = sizes[ i ];
+		wf->wf_Type = type;
+		if( fragmented == TRUE )
+		{
+			// first fragment carry message type, next ones are continuations, only last one has FIN bit
+			if( i > 0 )
+			{
+				wf->wf_Type = LWS_WRITE_CONTINUATION;
+			}
+			if( i < count-1 )
+			{
+				wf->wf_Type |= LWS_WRITE_NO_FIN;
+			}
+		}
+		wf->wf_Continue = ( i > 0 );
+		cl->wc_QueueCount++;
+		result += sizes[ i ];
+	}
+	
+	if( cl->wc_QueueCount > cl->wc_QueueMax )
+	{
+		cl->wc_QueueMax = cl->wc_QueueCount;
+	}
+	
+	// service thread will ask for writeable callback, lws_callback_on_writable cannot be called from other threads
+	if( result > 0 || cl->wc_QueueOverflow == TRUE )
+	{
+		pthread_mutex_lock( &writePendingMutex );
+		if( cl->wc_WritePending == FALSE )
+		{
+			cl->wc_WritePending = TRUE;
+			cl->wc_WriteNext = writePending;
+			writePending = cl;
+		}
+		pthread_mutex_unlock( &writePendingMutex );
+		
+		lws_cancel_service_pt( cl->wc_Wsi );
+	}
+	
+	pthread_mutex_unlock( &(cl->wc_Mutex) );
+	
+	return result;
+}
+
+/**
+ * Send frames from queue while socket accepts data. Called on LWS_CALLBACK_SERVER_WRITEABLE.
+ *
+ * @param cl pointer to WebsocketClient
+ * @return 0 when success, -1 when connection should be closed
+ */
+int WebsocketClientQueueFlush( WebsocketClient *cl )
+{
+	int result = 0;
+	
+	if( cl == NULL )
+	{
+		return 0;
+	}
+	
+	pthread_mutex_lock( &(cl->wc_Mutex) );
+	
+	if( cl->wc_QueueOverflow == TRUE )
+	{
+		result = -1;
+	}
+	else if( cl->wc_Wsi != NULL )
+	{
+		while( cl->wc_QueueCount > 0 && lws_send_pipe_choked( cl->wc_Wsi ) == 0 )
+		{
+			WebsocketFrame *wf = &(cl->wc_Queue[ cl->wc_QueueFirst ]);
+			
+			if( lws_write( cl->wc_Wsi, wf->wf_Buffer + LWS_PRE, wf->wf_Size, wf->wf_Type ) < 0 )
+			{
+				FERROR("[WebsocketClientQueueFlush] Cannot write to websocket\n");
+				result = -1;
+				break;
+			}
+			
+			cl->wc_QueueFirst = ( cl->wc_QueueFirst + 1 ) % cl->wc_QueueSize;
+			cl->wc_QueueCount--;
+			cl->wc_QueueSent++;
+			
+			// compression extension has more output, next frame can be written when it is drained
+			if( cl->wc_Wsi->u.ws.tx_draining_ext )
+			{
+				break;
+			}
+		}
+		
+		if( result == 0 && cl->wc_QueueCount > 0 )
+		{
+			lws_callback_on_writable( cl->wc_Wsi );
+		}
+		else if( cl->wc_QueueCount == 0 && cl->wc_QueueGrown == TRUE )
+		{
+			// memory taken by big message is not kept for whole connection
+			WebsocketClientQueueShrink( cl );
+		}
+	}
+	
+	pthread_mutex_unlock( &(cl->wc_Mutex) );
+	
+	return result;
+}
+
+/**
+ * Ask for writeable callback for all clients which got new frames. Must be called by websocket service thread.
+ */
+void WebsocketClientsRequestWrite()
+{
+	pthread_mutex_lock( &writePendingMutex );
+	
+	WebsocketClient *cl = writePending;
+	writePending = NULL;
+	
+	while( cl != NULL )
+	{
+		WebsocketClient *next = cl->wc_WriteNext;
+		
+		cl->wc_WritePending = FALSE;
+		cl->wc_WriteNext = NULL;
+		
+		// client is removed only by service thread, so wsi is still valid here
+		if( cl->wc_Wsi != NULL )
+		{
+			lws_callback_on_writable( cl->wc_Wsi );
+		}
+		cl = next;
+	}
+	
+	pthread_mutex_unlock( &writePendingMutex );
+}
+
+/**
+ * Get send queue statistics in JSON format
+ *
+ * @param cl pointer to WebsocketClient
+ * @param buffer pointer to buffer where statistics will be stored
+ * @param size size of buffer
+ * @return number of characters stored in buffer
+ */
+int WebsocketClientGetStatistics( WebsocketClient *cl, char *buffer, int size )
+{
+	pthread_mutex_lock( &(cl->wc_Mutex) );
+	int len = snprintf( buffer, size, "{\"queued\":%d,\"queuesize\":%d,\"maxqueued\":%d,\"sent\":%lu,\"dropped\":%lu,\"coalesced\":%lu}",
+		cl->wc_QueueCount, cl->wc_QueueSize, cl->wc_QueueMax, cl->wc_QueueSent, cl->wc_QueueDropped, cl->wc_QueueCoalesced );
+	pthread_mutex_unlock( &(cl->wc_Mutex) );
+	
+	return len;
+}
+
+/**
+ * Convert send queue policy name (drop, coalesce, disconnect) to value
+ *
+ * @param name policy name
+ * @return queue policy
+ */
+int WebsocketQueuePolicyFromName( const char *name )
+{
+	if( name != NULL )
+	{
+		if( strcmp( name, "coalesce" ) == 0 )
+		{
+			return WS_QUEUE_POLICY_COALESCE;
+		}
+		else if( strcmp( name, "disconnect" ) == 0 )
+		{
+			return WS_QUEUE_POLICY_DISCONNECT;
+		}
+	}
+	return WS_QUEUE_POLICY_DROP;
+}
@@ -36,6 +36,33 @@
 #include <core/nodes.h>
 #include <libwebsockets.h>
 
+#define WS_QUEUE_SIZE_DEFAULT		128		// frames waiting for send per client
+#define WS_QUEUE_FRAME_SIZE			1024	// smallest payload size of frame buffer, buffers are allocated when frames are queued
+
+//
+// what happens when client does not read and its send queue is full
+//
+
+enum
+{
+	WS_QUEUE_POLICY_DROP = 0,		// new message is dropped
+	WS_QUEUE_POLICY_COALESCE,		// oldest waiting messages are replaced by new one
+	WS_QUEUE_POLICY_DISCONNECT		// client is disconnected
+};
+
+//
+// frame waiting for send, LWS_PRE bytes before payload are reserved for websocket header
+//
+
+typedef struct WebsocketFrame
+{
+	unsigned char					*wf_Buffer;
+	int								wf_BufferSize;	// payload size which fits into buffer
+	int								wf_Size;
+	int								wf_Type;
+	FBOOL							wf_Continue;	// frame is next chunk of previous message
+}WebsocketFrame;
+
 //
 //
 //
@@ -48,6 +75,23 @@ typedef struct WebsocketClient
 	void							*wc_UserSession;
 	void 							*wc_WebsocketsData;
 	pthread_mutex_t					wc_Mutex;
+	
+	WebsocketFrame					*wc_Queue;		// ring of frames waiting for LWS_CALLBACK_SERVER_WRITEABLE
+	int								wc_QueueSize;
+	int								wc_QueueBaseSize;	// configured size, ring is bigger only while message bigger than queue is sent
+	FBOOL							wc_QueueGrown;		// ring or frame buffers were extended, they are shrunk when queue is empty
+	int								wc_QueueFirst;
+	int								wc_QueueCount;
+	int								wc_QueuePolicy;
+	FBOOL							wc_QueueOverflow;	// client will be disconnected
+	FBOOL							wc_WritePending;	// client is on list of clients waiting for writeable callback
+	struct WebsocketClient			*wc_WriteNext;
+	FBOOL							wc_Binary;			// client negotiated binary framing of big messages
+	
+	int								wc_QueueMax;		// statistics
+	FULONG							wc_QueueSent;
+	FULONG							wc_QueueDropped;
+	FULONG							wc_QueueCoalesced;
 }WebsocketClient;
 
 //
@@ -62,4 +106,34 @@ WebsocketClient *WebsocketClientNew();
 
 void WebsocketClientDelete( WebsocketClient *cl );
 
+//
+// Add message to send queue, big messages are sent as many frames or as fragments of one websocket message
+//
+
+int WebsocketClientQueueAdd( WebsocketClient *cl, unsigned char **frames, int *sizes, int count, int type, FBOOL fragmented );
+
+//
+// Send queued frames, called on LWS_CALLBACK_SERVER_WRITEABLE
+//
+
+int WebsocketClientQueueFlush( WebsocketClient *cl );
+
+//
+// Ask for writeable callback for clients which got new messages, called by websocket service thread
+//
+
+void WebsocketClientsRequestWrite();
+
+//
+// Get send queue statistics
+//
+
+int WebsocketClientGetStatistics( WebsocketClient *cl, char *buffer, int size );
+
+//
+// Convert queue policy name to value
+//
+
+int WebsocketQueuePolicyFromName( const char *name );
+
 #endif // __NETWORK_WEBSOCKET_CLIENT__
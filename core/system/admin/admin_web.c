@@ -239,8 +239,9 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 			
 			BufStringAddSize( bs, "]", 1 );
 			
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 			
 			BufStringDelete( bs );
 			
@@ -354,8 +355,9 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 		
 		BufStringAddSize( bs, "]", 1 );
 		
-		HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-		bs->bs_Buffer = NULL;
+		int contentSize = 0;
+		char *content = BufStringDetach( bs, &contentSize );
+		HttpSetContent( response, content, contentSize );
 		*result = 200;
 		
 		BufStringDelete( bs );
@@ -521,8 +523,9 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 			
 			BufStringAdd( bs, "]}");
 			
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 			
 			BufStringDelete( bs );
 		}
@@ -249,8 +249,9 @@ Http* ApplicationWebRequest( SystemBase *l, char **urlpath, Http* request, UserS
 				
 				BufStringAdd( bs, "  ]}" );
 
-				HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-				bs->bs_Buffer = NULL;
+				int contentSize = 0;
+				char *content = BufStringDetach( bs, &contentSize );
+				HttpSetContent( response, content, contentSize );
 			}
 			else
 			{
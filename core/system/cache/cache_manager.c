@@ -30,6 +30,290 @@
 #include "cache_manager.h"
 #include <util/murmurhash3.h>
 #include <system/user/user.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+//
+// LRU list and bucket helpers, all of them must be called with cm_Lock locked for writing
+//
+
+static inline void CacheLRUUnlink( CacheManager *cm, LocFile *lf )
+{
+	if( lf->lf_LRUPrev != NULL )
+	{
+		lf->lf_LRUPrev->lf_LRUNext = lf->lf_LRUNext;
+	}
+	else
+	{
+		cm->cm_LRUHead = lf->lf_LRUNext;
+	}
+	
+	if( lf->lf_LRUNext != NULL )
+	{
+		lf->lf_LRUNext->lf_LRUPrev = lf->lf_LRUPrev;
+	}
+	else
+	{
+		cm->cm_LRUTail = lf->lf_LRUPrev;
+	}
+	lf->lf_LRUPrev = lf->lf_LRUNext = NULL;
+}
+
+static inline void CacheLRUPushHead( CacheManager *cm, LocFile *lf )
+{
+	lf->lf_LRUPrev = NULL;
+	lf->lf_LRUNext = cm->cm_LRUHead;
+	if( cm->cm_LRUHead != NULL )
+	{
+		cm->cm_LRUHead->lf_LRUPrev = lf;
+	}
+	cm->cm_LRUHead = lf;
+	if( cm->cm_LRUTail == NULL )
+	{
+		cm->cm_LRUTail = lf;
+	}
+}
+
+/**
+ * Remove file from cache structures (bucket and LRU list)
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile which will be removed
+ * @return TRUE when nobody use file and it can be deleted, otherwise FALSE
+ */
+static FBOOL CacheRemoveEntry( CacheManager *cm, LocFile *lf )
+{
+	unsigned char id = (unsigned char)((char *)lf->hash)[ 0 ];
+	CacheFileGroup *cg = &(cm->cm_CacheFileGroup[ id ]);
+	
+	if( cg->cg_File == lf )
+	{
+		cg->cg_File = (LocFile *)lf->node.mln_Succ;
+	}
+	else
+	{
+		LocFile *prev = cg->cg_File;
+		while( prev != NULL )
+		{
+			if( (LocFile *)prev->node.mln_Succ == lf )
+			{
+				prev->node.mln_Succ = lf->node.mln_Succ;
+				break;
+			}
+			prev = (LocFile *)prev->node.mln_Succ;
+		}
+	}
+	lf->node.mln_Succ = NULL;
+	
+	CacheLRUUnlink( cm, lf );
+	
+	cm->cm_CacheSize -= lf->lf_CacheSize;
+	cm->cm_FilesNumber--;
+	lf->lf_CacheSize = 0;
+	lf->lf_Cached = FALSE;
+	
+	// drop reference held by cache
+	return ( __sync_sub_and_fetch( &(lf->lf_References), 1 ) <= 0 );
+}
+
+/**
+ * Remove file from cache by path
+ *
+ * @param cm pointer to CacheManager
+ * @param path path to file
+ */
+static void CacheEvictPath( CacheManager *cm, char *path )
+{
+	uint64_t hash[ 2 ];
+	MURMURHASH3( path, strlen(path), hash );
+	unsigned char id = (unsigned char)((char *)hash)[ 0 ];
+	LocFile *del = NULL;
+	
+	pthread_rwlock_wrlock( &(cm->cm_Lock) );
+	LocFile *lf = cm->cm_CacheFileGroup[ id ].cg_File;
+	while( lf != NULL )
+	{
+		if( memcmp( hash, lf->hash, sizeof(hash) ) == 0 )
+		{
+			DEBUG("[CacheEvictPath] File changed, removed from cache: %s\n", path );
+			if( CacheRemoveEntry( cm, lf ) == TRUE )
+			{
+				del = lf;
+			}
+			break;
+		}
+		lf = (LocFile *)lf->node.mln_Succ;
+	}
+	pthread_rwlock_unlock( &(cm->cm_Lock) );
+	
+	if( del != NULL )
+	{
+		LocFileDelete( del );
+	}
+}
+
+/**
+ * Add inotify watch on directory where cached file is stored
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile
+ */
+static void CacheWatchAdd( CacheManager *cm, LocFile *lf )
+{
+	// only files loaded from disk can be watched
+	if( cm->cm_INotifyFD < 0 || lf->lf_Filename == NULL || lf->lf_Path == NULL )
+	{
+		return;
+	}
+	
+	char *dir;
+	char *slash = strrchr( lf->lf_Path, '/' );
+	if( slash != NULL )
+	{
+		dir = StringDuplicateN( lf->lf_Path, slash - lf->lf_Path );
+	}
+	else
+	{
+		dir = StringDuplicate( "." );
+	}
+	if( dir == NULL )
+	{
+		return;
+	}
+	
+	pthread_mutex_lock( &(cm->cm_WatchMutex) );
+	
+	// inotify returns same descriptor when directory is already watched
+	int wd = inotify_add_watch( cm->cm_INotifyFD, dir, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO );
+	if( wd >= 0 )
+	{
+		CacheWatch *cw = cm->cm_Watches;
+		while( cw != NULL )
+		{
+			if( cw->cw_WD == wd )
+			{
+				break;
+			}
+			cw = cw->cw_Next;
+		}
+		
+		if( cw == NULL && ( cw = FCalloc( 1, sizeof(CacheWatch) ) ) != NULL )
+		{
+			cw->cw_WD = wd;
+			cw->cw_Path = dir;
+			dir = NULL;
+			cw->cw_Next = cm->cm_Watches;
+			cm->cm_Watches = cw;
+		}
+	}
+	else
+	{
+		FERROR("[CacheWatchAdd] Cannot watch directory %s\n", dir );
+	}
+	
+	pthread_mutex_unlock( &(cm->cm_WatchMutex) );
+	
+	if( dir != NULL )
+	{
+		FFree( dir );
+	}
+}
+
+/**
+ * Thread which remove changed files from cache
+ *
+ * @param ft pointer to FThread
+ */
+static void CacheWatchThread( FThread *ft )
+{
+	CacheManager *cm = (CacheManager *)ft->t_Data;
+	char buffer[ 4096 ] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char path[ 1024 ];
+	
+	while( ft->t_Quit != TRUE )
+	{
+		struct pollfd pfd;
+		pfd.fd = cm->cm_INotifyFD;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		
+		if( poll( &pfd, 1, 1000 ) <= 0 )
+		{
+			continue;
+		}
+		
+		int len = read( cm->cm_INotifyFD, buffer, sizeof(buffer) );
+		if( len <= 0 )
+		{
+			continue;
+		}
+		
+		char *ptr = buffer;
+		while( ptr < buffer + len )
+		{
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			
+			if( event->mask & IN_Q_OVERFLOW )
+			{
+				// events were lost, we cannot trust any cached file
+				CacheManagerClearCache( cm );
+			}
+			else if( event->mask & IN_IGNORED )
+			{
+				pthread_mutex_lock( &(cm->cm_WatchMutex) );
+				CacheWatch *cw = cm->cm_Watches;
+				CacheWatch *prev = NULL;
+				while( cw != NULL )
+				{
+					if( cw->cw_WD == event->wd )
+					{
+						if( prev == NULL )
+						{
+							cm->cm_Watches = cw->cw_Next;
+						}
+						else
+						{
+							prev->cw_Next = cw->cw_Next;
+						}
+						FFree( cw->cw_Path );
+						FFree( cw );
+						break;
+					}
+					prev = cw;
+					cw = cw->cw_Next;
+				}
+				pthread_mutex_unlock( &(cm->cm_WatchMutex) );
+			}
+			else if( event->len > 0 )
+			{
+				path[ 0 ] = 0;
+				
+				pthread_mutex_lock( &(cm->cm_WatchMutex) );
+				CacheWatch *cw = cm->cm_Watches;
+				while( cw != NULL )
+				{
+					if( cw->cw_WD == event->wd )
+					{
+						snprintf( path, sizeof(path), "%s/%s", cw->cw_Path, event->name );
+						break;
+					}
+					cw = cw->cw_Next;
+				}
+				pthread_mutex_unlock( &(cm->cm_WatchMutex) );
+				
+				if( path[ 0 ] != 0 )
+				{
+					CacheEvictPath( cm, path );
+				}
+			}
+			
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	
+	ft->t_Launched = FALSE;
+}
 
 /**
  * create new CacheManager
@@ -55,6 +339,30 @@ CacheManager *CacheManagerNew( FULONG size )
 				cm->cm_CacheFileGroup[ i ].cg_File = NULL;
 			}
 		}
+		else
+		{
+			FERROR("Cannot allocate memory for CacheFileGroup\n");
+			FFree( cm );
+			return NULL;
+		}
+		
+		pthread_rwlock_init( &(cm->cm_Lock), NULL );
+		pthread_mutex_init( &(cm->cm_WatchMutex), NULL );
+		
+		if( ( cm->cm_INotifyFD = inotify_init() ) >= 0 )
+		{
+			cm->cm_WatchThread = ThreadNew( CacheWatchThread, cm, TRUE, NULL );
+			if( cm->cm_WatchThread == NULL )
+			{
+				close( cm->cm_INotifyFD );
+				cm->cm_INotifyFD = -1;
+			}
+		}
+		
+		if( cm->cm_INotifyFD < 0 )
+		{
+			FERROR("Cannot start inotify watcher, cached files will be checked on every request\n");
+		}
 	}
 	else
 	{
@@ -74,6 +382,27 @@ void CacheManagerDelete( CacheManager *cm )
 	{
 		int i = 0;
 		
+		INFO("[CacheManagerDelete] hits %llu misses %llu evictions %llu\n", (unsigned long long)cm->cm_Hits, (unsigned long long)cm->cm_Misses, (unsigned long long)cm->cm_Evictions );
+		
+		if( cm->cm_WatchThread != NULL )
+		{
+			ThreadDelete( cm->cm_WatchThread );
+			cm->cm_WatchThread = NULL;
+		}
+		if( cm->cm_INotifyFD >= 0 )
+		{
+			close( cm->cm_INotifyFD );
+		}
+		
+		CacheWatch *cw = cm->cm_Watches;
+		while( cw != NULL )
+		{
+			CacheWatch *rw = cw;
+			cw = cw->cw_Next;
+			FFree( rw->cw_Path );
+			FFree( rw );
+		}
+		
 		for( ; i < CACHE_GROUP_MAX; i++ )
 		{
 			LocFile *lf = cm->cm_CacheFileGroup[ i ].cg_File;
@@ -90,22 +419,15 @@ void CacheManagerDelete( CacheManager *cm )
 			FFree( cm->cm_CacheFileGroup );
 		}
 		
-		/*
-		LocFile *lf = cm->cm_LocFileCache;
-		while( lf != NULL )
-		{
-			LocFile *rf = lf;
-			lf = (LocFile *)lf->node.mln_Succ;
-			LocFileDelete( rf );
-		}
-		*/
+		pthread_rwlock_destroy( &(cm->cm_Lock) );
+		pthread_mutex_destroy( &(cm->cm_WatchMutex) );
 	}
 	
 	FFree( cm );
 }
 
 /**
- * Remove all data from cache
+ * Remove all data from cache. Files which are still in use will be deleted when last user release them
  *
  * @param cm pointer to CacheManager which will be flushed
  */
@@ -113,42 +435,29 @@ void CacheManagerClearCache( CacheManager *cm )
 {
 	if( cm != NULL )
 	{
-		int i = 0;
+		pthread_rwlock_wrlock( &(cm->cm_Lock) );
 		
-		for( ; i < CACHE_GROUP_MAX; i++ )
+		LocFile *lf = cm->cm_LRUHead;
+		while( lf != NULL )
 		{
-			LocFile *lf = cm->cm_CacheFileGroup[ i ].cg_File;
-			while( lf != NULL )
+			LocFile *rf = lf;
+			lf = lf->lf_LRUNext;
+			
+			if( CacheRemoveEntry( cm, rf ) == TRUE )
 			{
-				LocFile *rf = lf;
-				lf = (LocFile *)lf->node.mln_Succ;
-				
 				LocFileDelete( rf );
 			}
-			
-			cm->cm_CacheFileGroup[ i ].cg_File = NULL;
 		}
 		
-		/*
-		disabled for now
-		LocFile *lf = cm->cm_LocFileCache;
-		while( lf != NULL )
-		{
-			LocFile *rf = lf;
-			lf = (LocFile *)lf->node.mln_Succ;
-			
-			LocFileDelete( rf );
-		}
-		*/
-			
 		cm->cm_LocFileCache = NULL;
+		
+		pthread_rwlock_unlock( &(cm->cm_Lock) );
 	}
 }
 
-// we need task which will check if file was or not used too often
-
 /**
- * function store LocFile inside cache
+ * function store LocFile inside cache. Least recently used files are evicted when there is no space for new one.
+ * On success caller holds reference to file and must call CacheManagerFileRelease when file is not needed anymore.
  *
  * @param cm pointer to CacheManager which will store file
  * @param lf pointer to LocFile structure which will be stored in cache
@@ -158,52 +467,184 @@ int CacheManagerFilePut( CacheManager *cm, LocFile *lf )
 {
 	if( cm != NULL )
 	{
-		INFO(" cache size %lld file size %lld cache max %lld\n",  cm->cm_CacheSize ,(FQUAD)lf->lf_FileSize, (FQUAD)cm->cm_CacheMax );
-		if( (cm->cm_CacheSize + lf->lf_FileSize) > cm->cm_CacheMax )
+		if( lf == NULL )
+		{
+			FERROR("Cannot store file in cache without filename!\n");
+			return -1;
+		}
+		
+		// compressed variants are kept in memory together with file
+		FULONG size = lf->lf_FileSize;
+		for( int i = 0; i < LOCFILE_VARIANT_MAX ; i++ )
 		{
-			FERROR("Cannot add file to cache, cache is FULL\n");
+			size += lf->lf_Variants[ i ].lfv_Size;
+		}
+		
+		INFO(" cache size %lld file size %lld cache max %lld\n",  cm->cm_CacheSize ,(FQUAD)size, (FQUAD)cm->cm_CacheMax );
+		if( size > cm->cm_CacheMax )
+		{
+			FERROR("Cannot add file to cache, file is bigger then cache\n");
 			return 1;
 		}
-		else
+		
+		unsigned char id = (unsigned char)((char *)lf->hash)[0];		//we sort data by name
+		DEBUG("ID %d\n", id );
+		
+		CacheWatchAdd( cm, lf );
+		
+		pthread_rwlock_wrlock( &(cm->cm_Lock) );
+		
+		// file could be loaded by other thread in meantime, old entry is replaced
+		
+		LocFile *old = cm->cm_CacheFileGroup[ id ].cg_File;
+		while( old != NULL )
 		{
-			if( lf != NULL )
+			if( memcmp( old->hash, lf->hash, sizeof(lf->hash) ) == 0 )
 			{
-				char *hfirstChar = (char *)lf->hash;
-				unsigned char id = (unsigned char)hfirstChar[0];		//we sort data by name
-				/*
-				if( id < 0 && id > 255 )
-				{
-					id = 0;
-				}
-				*/
-				DEBUG("ID %d\n", id );
-				if( cm->cm_CacheFileGroup[ id ].cg_File == NULL )
-				{
-					cm->cm_CacheFileGroup[ id ].cg_File = lf;
-				}
-				else
+				if( CacheRemoveEntry( cm, old ) == TRUE )
 				{
-					lf->node.mln_Succ = (MinNode *)cm->cm_CacheFileGroup[ id ].cg_File;
-					cm->cm_CacheFileGroup[ id ].cg_File = lf;
+					LocFileDelete( old );
 				}
-				
-				//lf->node.mln_Succ = (MinNode *)cm->cm_LocFileCache;
-				//cm->cm_LocFileCache = lf;
-			
-				lf->lf_FileUsed++;
+				break;
+			}
+			old = (LocFile *)old->node.mln_Succ;
+		}
+		
+		// evict least recently used files until new one fit, files which were used since last check get second chance
+		
+		while( cm->cm_LRUTail != NULL && (cm->cm_CacheSize + size) > cm->cm_CacheMax )
+		{
+			LocFile *rf = cm->cm_LRUTail;
 			
-				cm->cm_CacheSize += lf->lf_FileSize;
+			if( rf->lf_Accessed == TRUE )
+			{
+				rf->lf_Accessed = FALSE;
+				CacheLRUUnlink( cm, rf );
+				CacheLRUPushHead( cm, rf );
+				continue;
 			}
-			else
+			
+			DEBUG("[CacheManagerFilePut] Evict file %s size %lu\n", rf->lf_Path, rf->lf_FileSize );
+			cm->cm_Evictions++;
+			if( CacheRemoveEntry( cm, rf ) == TRUE )
 			{
-				FERROR("Cannot store file in cache without filename!\n");
-				return -1;
+				LocFileDelete( rf );
 			}
 		}
+		
+		lf->node.mln_Succ = (MinNode *)cm->cm_CacheFileGroup[ id ].cg_File;
+		cm->cm_CacheFileGroup[ id ].cg_File = lf;
+		CacheLRUPushHead( cm, lf );
+		
+		lf->lf_Cached = TRUE;
+		lf->lf_Accessed = FALSE;
+		lf->lf_CacheSize = size;
+		lf->lf_References = 2;		// one for cache, one for caller
+		lf->lf_FileUsed++;
+		
+		cm->cm_CacheSize += size;
+		cm->cm_FilesNumber++;
+		
+		pthread_rwlock_unlock( &(cm->cm_Lock) );
 	}
 	return 0;
 }
 
+/**
+ * release file taken from cache by CacheManagerFileGet or stored by CacheManagerFilePut.
+ * File which was evicted in meantime is deleted when last reference is released.
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile
+ */
+void CacheManagerFileRelease( CacheManager *cm, LocFile *lf )
+{
+	if( cm == NULL || lf == NULL )
+	{
+		return;
+	}
+	
+	if( __sync_sub_and_fetch( &(lf->lf_References), 1 ) <= 0 )
+	{
+		LocFileDelete( lf );
+	}
+}
+
+/**
+ * account memory which was added to cached file after it was stored (compressed variants)
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile
+ * @param size number of bytes added
+ */
+void CacheManagerFileGrow( CacheManager *cm, LocFile *lf, FULONG size )
+{
+	if( cm == NULL || lf == NULL )
+	{
+		return;
+	}
+	
+	pthread_rwlock_wrlock( &(cm->cm_Lock) );
+	if( lf->lf_Cached == TRUE )
+	{
+		lf->lf_CacheSize += size;
+		cm->cm_CacheSize += size;
+	}
+	pthread_rwlock_unlock( &(cm->cm_Lock) );
+}
+
+/**
+ * remove file from cache. Caller must still release his reference.
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile
+ */
+void CacheManagerFileEvict( CacheManager *cm, LocFile *lf )
+{
+	if( cm == NULL || lf == NULL )
+	{
+		return;
+	}
+	
+	FBOOL del = FALSE;
+	
+	pthread_rwlock_wrlock( &(cm->cm_Lock) );
+	if( lf->lf_Cached == TRUE )
+	{
+		del = CacheRemoveEntry( cm, lf );
+	}
+	pthread_rwlock_unlock( &(cm->cm_Lock) );
+	
+	if( del == TRUE )
+	{
+		LocFileDelete( lf );
+	}
+}
+
+/**
+ * get cache statistics
+ *
+ * @param cm pointer to CacheManager
+ * @param buffer pointer to buffer where statistics in JSON format will be stored
+ * @param size size of buffer
+ * @return number of characters stored in buffer
+ */
+int CacheManagerGetStatistics( CacheManager *cm, char *buffer, int size )
+{
+	if( cm == NULL || buffer == NULL )
+	{
+		return 0;
+	}
+	
+	pthread_rwlock_rdlock( &(cm->cm_Lock) );
+	int len = snprintf( buffer, size, "{\"files\":%lu,\"size\":%llu,\"max\":%llu,\"hits\":%llu,\"misses\":%llu,\"evictions\":%llu}",
+		cm->cm_FilesNumber, (unsigned long long)cm->cm_CacheSize, (unsigned long long)cm->cm_CacheMax,
+		(unsigned long long)cm->cm_Hits, (unsigned long long)cm->cm_Misses, (unsigned long long)cm->cm_Evictions );
+	pthread_rwlock_unlock( &(cm->cm_Lock) );
+	
+	return len;
+}
+
 /**
  * function store LocFile inside cache (User cache)
  *
@@ -287,7 +728,7 @@ inline char *GetFileNamePtr( char *path, int len )
  * @param cm pointer to CacheManager
  * @param path path to file
  * @param checkByPath find file by compareing paths
- * @return pointer to LocFile when structure is stored in CacheManager, otherwise NULL
+ * @return pointer to LocFile when structure is stored in CacheManager (must be released by CacheManagerFileRelease), otherwise NULL
  */
 LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath )
 {
@@ -315,6 +756,8 @@ LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath )
 		
 		LocFile *lf = NULL;
 
+		pthread_rwlock_rdlock( &(cm->cm_Lock) );
+		
 		CacheFileGroup *cg = &(cm->cm_CacheFileGroup[ id ]);
 		lf = cg->cg_File;
 
@@ -322,13 +765,40 @@ LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath )
 		{
 			if( memcmp( hash, lf->hash, sizeof(hash) ) == 0 )
 			{
-				lf->lf_FileUsed++;
-				return lf;
+				__sync_add_and_fetch( &(lf->lf_References), 1 );
+				__sync_add_and_fetch( &(lf->lf_FileUsed), 1 );
+				lf->lf_Accessed = TRUE;
+				ret = lf;
+				break;
 			}
 			
 			lf = (LocFile *)lf->node.mln_Succ;
 		}
 		
+		pthread_rwlock_unlock( &(cm->cm_Lock) );
+		
+		// without inotify watcher we have to check if file was not changed
+		
+		if( ret != NULL && cm->cm_INotifyFD < 0 && ret->lf_Filename != NULL )
+		{
+			struct stat attr;
+			if( stat( path, &attr ) != 0 || attr.st_mtime != ret->lf_Info.st_mtime )
+			{
+				CacheManagerFileEvict( cm, ret );
+				CacheManagerFileRelease( cm, ret );
+				ret = NULL;
+			}
+		}
+		
+		if( ret == NULL )
+		{
+			__sync_add_and_fetch( &(cm->cm_Misses), 1 );
+		}
+		else
+		{
+			__sync_add_and_fetch( &(cm->cm_Hits), 1 );
+		}
+		
 		/*
 		LocFile *lf = cm->cm_LocFileCache;
 		while( lf != NULL )
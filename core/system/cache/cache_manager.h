@@ -35,6 +35,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <core/thread.h>
 #include "cache_user_files.h"
 
 #define CACHE_GROUP_MAX 256
@@ -50,7 +52,23 @@ typedef struct CacheFileGroup
 }CacheFileGroup;
 
 //
+// watched directory
 //
+
+typedef struct CacheWatch
+{
+	int					cw_WD;				// inotify watch descriptor
+	char				*cw_Path;			// directory path
+	struct CacheWatch	*cw_Next;
+}CacheWatch;
+
+//
+// Files are kept in CACHE_GROUP_MAX buckets (first byte of path hash) and on LRU list.
+// Cached LocFile is never changed, new version of file replace old one in cache.
+// Readers only take cm_Lock for reading and increase file reference counter. Every hit mark file
+// as accessed, when cache is full files from LRU tail are evicted unless they were accessed (second chance).
+// Evicted file is deleted when last reference is released.
+// Directories of cached files are watched by inotify and changed files are removed from cache by watcher thread.
 //
 
 typedef struct CacheManager
@@ -59,6 +77,20 @@ typedef struct CacheManager
 	LocFile			*cm_LocFileCache;
 	FUQUAD			cm_CacheSize;
 	FUQUAD 			cm_CacheMax;
+	
+	LocFile			*cm_LRUHead;		// most recently stored file
+	LocFile			*cm_LRUTail;		// first candidate for eviction
+	FULONG			cm_FilesNumber;
+	pthread_rwlock_t	cm_Lock;
+	
+	FUQUAD			cm_Hits;
+	FUQUAD			cm_Misses;
+	FUQUAD			cm_Evictions;
+	
+	int				cm_INotifyFD;		// -1 when inotify is not avaiable, files are checked by stat then
+	CacheWatch		*cm_Watches;
+	pthread_mutex_t	cm_WatchMutex;
+	FThread			*cm_WatchThread;
 }CacheManager;
 
 //
@@ -80,15 +112,39 @@ void CacheManagerDelete( CacheManager *cm );
 void CacheManagerClearCache( CacheManager *cm );
 
 //
-//
+// store file in cache, on success caller holds reference to file and must release it
 //
 
 int CacheManagerFilePut( CacheManager *cm, LocFile *lf );
 
 //
-//
+// get file from cache, returned file must be released by CacheManagerFileRelease
 //
 
 LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath );
 
+//
+// release file taken from cache
+//
+
+void CacheManagerFileRelease( CacheManager *cm, LocFile *lf );
+
+//
+// account memory added to cached file (compressed variants)
+//
+
+void CacheManagerFileGrow( CacheManager *cm, LocFile *lf, FULONG size );
+
+//
+// remove file from cache
+//
+
+void CacheManagerFileEvict( CacheManager *cm, LocFile *lf );
+
+//
+// get cache statistics in JSON format
+//
+
+int CacheManagerGetStatistics( CacheManager *cm, char *buffer, int size );
+
 #endif //__FILE_CACHE_MANAGER_H__
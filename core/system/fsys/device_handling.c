@@ -399,28 +399,27 @@ int MountFS( SystemBase *l, struct TagItem *tl, File **mfile, User *usr )
 		SQLLibrary *sqllib = l->LibrarySQLGet( l );
 		if( sqllib != NULL )
 		{
-			char temptext[ 512 ]; memset( temptext, 0, sizeof(temptext) );
-			
-			sqllib->SNPrintF( sqllib, temptext, sizeof( temptext ), 
-			//snprintf( temptext, sizeof( temptext ), 
-"SELECT \
+			// same statement is used for user and sentinel, it is prepared once per connection
+			const char *mountQuery = "SELECT \
 `Type`,`Server`,`Path`,`Port`,`Username`,`Password`,`Config`,f.`ID`,`Execute`,`StoredBytes`,fsa.`ID`,fsa.`StoredBytesLeft`,fsa.`ReadedBytesLeft`,fsa.`ToDate` \
 FROM `Filesystem` f left outer join `FilesystemActivity` fsa on f.ID = fsa.FilesystemID and CURDATE() <= fsa.ToDate \
 WHERE \
 (\
-f.UserID = '%ld' OR \
+f.UserID = ? OR \
 f.GroupID IN (\
 SELECT ug.UserGroupID FROM FUserToGroup ug, FUserGroup g \
 WHERE \
 g.ID = ug.UserGroupID AND g.Type = \'Workgroup\' AND \
-ug.UserID = '%ld' \
+ug.UserID = ? \
 ) \
 ) \
-AND f.Name = '%s'",
-				usr->u_ID , usr->u_ID, name
-			);
+AND f.Name = ?";
+			char userid[ 32 ];
+			
+			snprintf( userid, sizeof(userid), "%lu", usr->u_ID );
+			const char *params[] = { userid, userid, name };
 	
-			void *res = sqllib->Query( sqllib, temptext );
+			void *res = sqllib->QueryPrepared( sqllib, mountQuery, params, 3 );
 			if( res == NULL || sqllib->NumberOfRows( sqllib, res ) <= 0 )
 			{
 				FERROR("[MountFS] %s - GetUserDevice fail: database results = NULL\n", usr->u_Name );
@@ -429,26 +428,9 @@ AND f.Name = '%s'",
 					sqllib->FreeResult( sqllib, res );
 					
 					DEBUG( "[MountFS] Trying to mount device using sentinel!\n" );
-					memset( temptext, '\0', 512 );
-					sqllib->SNPrintF( sqllib, temptext, sizeof( temptext ), 
-					//snprintf( temptext, sizeof( temptext ), 
-"SELECT \
-`Type`,`Server`,`Path`,`Port`,`Username`,`Password`,`Config`,`ID`,`Execute`,`StoredBytes`,fsa.`ID`,fsa.`StoredBytesLeft`,fsa.`ReadedBytesLeft`,fsa.`ToDate` \
-FROM `Filesystem` f left outer join `FilesystemActivity` fsa on f.ID = fsa.FilesystemID and CURDATE() <= fsa.ToDate \
-WHERE \
-( \
-f.UserID = '%ld' OR \
-f.GroupID IN ( \
-SELECT ug.UserGroupID FROM FUserToGroup ug, FUserGroup g \
-WHERE \
-g.ID = ug.UserGroupID AND g.Type = \'Workgroup\' AND \
-ug.UserID = '%ld' \
-)\
-) \
-AND f.Name = '%s'",
-						sent->s_User->u_ID, sent->s_User->u_ID, name 
-					);
-					if( ( res = sqllib->Query( sqllib, temptext ) ) == NULL )
+					snprintf( userid, sizeof(userid), "%lu", sent->s_User->u_ID );
+					
+					if( ( res = sqllib->QueryPrepared( sqllib, mountQuery, params, 3 ) ) == NULL )
 					{
 						pthread_mutex_unlock( &l->sl_InternalMutex );
 						if( type != NULL ){ FFree( type );}
@@ -1516,14 +1498,15 @@ ug.UserID = '%ld' \
 File *GetUserDeviceByUserID( SystemBase *l, SQLLibrary *sqllib, FULONG uid, const char *devname )
 {
 	File *device = NULL;
-	char temptext[ 512 ];
+	char userid[ 32 ];
 	
-	sqllib->SNPrintF( sqllib, temptext, sizeof(temptext), "\
+	snprintf( userid, sizeof(userid), "%lu", uid );
+	const char *params[] = { userid, devname };
+
+	void *res = sqllib->QueryPrepared( sqllib, "\
 SELECT `Name`, `Type`, `Server`, `Port`, `Path`, `Mounted`, `UserID`, `ID` \
 FROM `Filesystem` \
-WHERE `UserID` = '%ld' AND `Name` = '%s'", uid, devname );
-
-	void *res = sqllib->Query( sqllib, temptext );
+WHERE `UserID` = ? AND `Name` = ?", params, 2 );
 	if( res == NULL )
 	{
 		FERROR("GetUserDevice fail: database results = NULL\n");
@@ -71,8 +71,9 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 		BufString *bs = BufStringNew();
 		if( RefreshUserDrives( l, loggedSession->us_User, bs ) == 0 )
 		{
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Bufsize );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 		}
 		else
 		{
@@ -285,8 +285,7 @@ DoorNotification *DoorNotificationGetNotificationsFromPath( SQLLibrary *sqllib,
 		// file is not in subfolder
 		if( lastSlashPosition == 0 )
 		{
-			sqllib->SNPrintF( sqllib, tmpQuery, querysize, "SELECT Distinct ID,OwnerID,Type FROM `FDoorNotification` \
-				WHERE Path = '' AND DeviceID = %lu ", device->f_ID );
+			sqllib->SNPrintF( sqllib, tmpQuery, querysize, "Path = '' AND DeviceID = %lu", device->f_ID );
 		}
 		else
 		{
@@ -295,55 +294,34 @@ DoorNotification *DoorNotificationGetNotificationsFromPath( SQLLibrary *sqllib,
 			{
 				parentPath[ lastSlashPosition ] = 0;
 				
-				sqllib->SNPrintF( sqllib, tmpQuery, querysize, "SELECT Distinct ID,OwnerID,Type FROM `FDoorNotification` \
-					WHERE (Path='%s' OR Path='%s' ) \
-					AND DeviceID = %lu", path, parentPath, device->f_ID );
+				sqllib->SNPrintF( sqllib, tmpQuery, querysize, "(Path='%s' OR Path='%s' ) AND DeviceID = %lu", path, parentPath, device->f_ID );
 				FFree( parentPath );
 			}
 		}
 
-		void *res = sqllib->Query( sqllib, tmpQuery );
-		
-		if( res != NULL )
+		// rows are streamed from server and converted one by one, result is not buffered by mysql
+		void *it = sqllib->LoadIteratorNew( sqllib, DoorNotificationDesc, tmpQuery );
+		if( it != NULL )
 		{
-			if( sqllib->NumberOfRows( sqllib, res ) > 0 )
+			DoorNotification *local;
+			
+			while( ( local = (DoorNotification *)sqllib->LoadIteratorNext( sqllib, it ) ) != NULL )
 			{
-				char **row = NULL;
-				// OwnerID , Type
+				local->node.mln_Succ = NULL;
 				
-				while( ( row = sqllib->FetchRow( sqllib, res ) ) ) 
+				if( rootLock == NULL )
 				{
-					char *next;
-					// ownerid, type
-					DoorNotification *local = DoorNotificationNew();
-					if( local != NULL )
-					{
-						char *next;
-						local->dn_ID = (FULONG)strtol( row[ 0 ], &next, 0);
-						local->dn_OwnerID = (FULONG)strtol( row[ 1 ], &next, 0);
-						local->dn_Type = (FULONG)strtol( row[ 2 ], &next, 0);
-						
-						if( rootLock == NULL )
-						{
-							rootLock = local;
-							lastLock = rootLock;
-						}
-						else
-						{
-							lastLock->node.mln_Succ = (MinNode *)local;
-							lastLock = local;
-						}
-					}
+					rootLock = local;
+					lastLock = rootLock;
+				}
+				else
+				{
+					lastLock->node.mln_Succ = (MinNode *)local;
+					lastLock = local;
 				}
-			}
-			// number of rows > 0
-			// checking default access
-			else
-			{
-
 			}
 			
-			sqllib->FreeResult( sqllib, res );
+			sqllib->LoadIteratorDelete( sqllib, it );
 		}
 		FFree( tmpQuery );
 	}
@@ -31,6 +31,8 @@
 #include <system/fsys/device_handling.h>
 #include <network/mime.h>
 #include <util/md5.h>
+#include <util/murmurhash3.h>
+#include <system/json/jsmn.h>
 
 #define DEFAULT_ACCESS "-RWED"
 
@@ -47,7 +49,26 @@ FSManager *FSManagerNew( void *sb )
 	FSManager *fm = NULL;
 	if( ( fm = FCalloc( 1, sizeof( FSManager ) ) ) != NULL )
 	{
+		SystemBase *lsb = (SystemBase *)sb;
 		fm->fm_SB = sb;
+		
+		fm->fm_PermCacheTTL = lsb->sl_PermCacheTTL;
+		if( fm->fm_PermCacheTTL > 0 && lsb->sl_PermCacheSize > 0 )
+		{
+			int i;
+			
+			fm->fm_PermBucketMax = lsb->sl_PermCacheSize / FSM_PERM_CACHE_BUCKETS;
+			if( fm->fm_PermBucketMax < 4 )
+			{
+				fm->fm_PermBucketMax = 4;
+			}
+			
+			for( i=0 ; i < FSM_PERM_CACHE_SHARDS ; i++ )
+			{
+				pthread_rwlock_init( &(fm->fm_PermLocks[ i ]), NULL );
+			}
+			fm->fm_PermCache = FCalloc( FSM_PERM_CACHE_BUCKETS, sizeof( FSMPermEntry *) );
+		}
 	}
 	
 	return fm;
@@ -62,10 +83,297 @@ void FSManagerDelete( FSManager *fm )
 {
 	if( fm != NULL )
 	{
+		if( fm->fm_PermCache != NULL )
+		{
+			int i;
+			for( i=0 ; i < FSM_PERM_CACHE_BUCKETS ; i++ )
+			{
+				FSMPermEntry *pe = fm->fm_PermCache[ i ];
+				while( pe != NULL )
+				{
+					FSMPermEntry *rem = pe;
+					pe = pe->pe_Next;
+					FFree( rem );
+				}
+			}
+			FFree( fm->fm_PermCache );
+			
+			for( i=0 ; i < FSM_PERM_CACHE_SHARDS ; i++ )
+			{
+				pthread_rwlock_destroy( &(fm->fm_PermLocks[ i ]) );
+			}
+		}
 		FFree( fm );
 	}
 }
 
+//
+// permission cache, entries are kept per user, device and path
+//
+
+#define FSM_PERM_SHARD( BUCKET ) ( (BUCKET) & ( FSM_PERM_CACHE_SHARDS - 1 ) )
+
+static inline uint32_t FSMPermHash( FULONG userid, FULONG devid, const char *path, int len )
+{
+	uint32_t hash;
+	MurmurHash3_x86_32( path, len, (uint32_t)( ( userid * 2654435761u ) ^ devid ), &hash );
+	return hash;
+}
+
+/**
+ * Find permissions of path in cache
+ *
+ * @param fm pointer to FSManager
+ * @param userid user id
+ * @param devid device id
+ * @param path path (does not have to be terminated by 0)
+ * @param len length of path
+ * @param rows pointer where number of permission entries will be stored
+ * @param mask pointer where access mask will be stored
+ * @return TRUE when entry was found, otherwise FALSE
+ */
+static FBOOL FSMPermCacheGet( FSManager *fm, FULONG userid, FULONG devid, const char *path, int len, int *rows, int *mask )
+{
+	uint32_t hash = FSMPermHash( userid, devid, path, len );
+	unsigned int bucket = hash & ( FSM_PERM_CACHE_BUCKETS - 1 );
+	time_t now = time( NULL );
+	FBOOL found = FALSE;
+	
+	pthread_rwlock_rdlock( &(fm->fm_PermLocks[ FSM_PERM_SHARD( bucket ) ]) );
+	FSMPermEntry *pe = fm->fm_PermCache[ bucket ];
+	while( pe != NULL )
+	{
+		if( pe->pe_Hash == hash && pe->pe_UserID == userid && pe->pe_DeviceID == devid && strncmp( pe->pe_Path, path, len ) == 0 && pe->pe_Path[ len ] == 0 )
+		{
+			if( ( now - pe->pe_Time ) < fm->fm_PermCacheTTL )
+			{
+				*rows = pe->pe_Rows;
+				*mask = pe->pe_Mask;
+				found = TRUE;
+			}
+			break;
+		}
+		pe = pe->pe_Next;
+	}
+	pthread_rwlock_unlock( &(fm->fm_PermLocks[ FSM_PERM_SHARD( bucket ) ]) );
+	
+	__atomic_add_fetch( found == TRUE ? &fm->fm_PermHits : &fm->fm_PermMisses, 1, __ATOMIC_RELAXED );
+	
+	return found;
+}
+
+/**
+ * Put permissions of path into cache. Entry is not stored when cache was invalidated after DB was read.
+ *
+ * @param fm pointer to FSManager
+ * @param generation value of fm_PermGeneration taken before DB was read
+ * @param userid user id
+ * @param devid device id
+ * @param path path (does not have to be terminated by 0)
+ * @param len length of path
+ * @param rows number of permission entries
+ * @param mask access mask
+ */
+static void FSMPermCachePut( FSManager *fm, FUQUAD generation, FULONG userid, FULONG devid, const char *path, int len, int rows, int mask )
+{
+	uint32_t hash = FSMPermHash( userid, devid, path, len );
+	unsigned int bucket = hash & ( FSM_PERM_CACHE_BUCKETS - 1 );
+	
+	FSMPermEntry *ne = FMalloc( sizeof( FSMPermEntry ) + len + 1 );
+	if( ne == NULL )
+	{
+		return;
+	}
+	ne->pe_UserID = userid;
+	ne->pe_DeviceID = devid;
+	ne->pe_Time = time( NULL );
+	ne->pe_Rows = rows;
+	ne->pe_Mask = mask;
+	ne->pe_Hash = hash;
+	memcpy( ne->pe_Path, path, len );
+	ne->pe_Path[ len ] = 0;
+	
+	pthread_rwlock_wrlock( &(fm->fm_PermLocks[ FSM_PERM_SHARD( bucket ) ]) );
+	
+	if( __atomic_load_n( &fm->fm_PermGeneration, __ATOMIC_ACQUIRE ) != generation )
+	{
+		pthread_rwlock_unlock( &(fm->fm_PermLocks[ FSM_PERM_SHARD( bucket ) ]) );
+		FFree( ne );
+		return;
+	}
+	
+	// new entry goes on top, old entry for same key and entries over bucket limit are removed
+	
+	ne->pe_Next = fm->fm_PermCache[ bucket ];
+	fm->fm_PermCache[ bucket ] = ne;
+	
+	int count = 1;
+	FSMPermEntry *prev = ne;
+	FSMPermEntry *pe = ne->pe_Next;
+	while( pe != NULL )
+	{
+		if( count >= fm->fm_PermBucketMax || ( pe->pe_Hash == hash && pe->pe_UserID == userid && pe->pe_DeviceID == devid && strcmp( pe->pe_Path, ne->pe_Path ) == 0 ) )
+		{
+			prev->pe_Next = pe->pe_Next;
+			FFree( pe );
+			pe = prev->pe_Next;
+			__atomic_sub_fetch( &fm->fm_PermEntries, 1, __ATOMIC_RELAXED );
+			continue;
+		}
+		count++;
+		prev = pe;
+		pe = pe->pe_Next;
+	}
+	__atomic_add_fetch( &fm->fm_PermEntries, 1, __ATOMIC_RELAXED );
+	
+	pthread_rwlock_unlock( &(fm->fm_PermLocks[ FSM_PERM_SHARD( bucket ) ]) );
+}
+
+/**
+ * Remove cache entries which match path and/or user
+ *
+ * @param fm pointer to FSManager
+ * @param path path which entries will be removed or NULL
+ * @param devid device id, used with path
+ * @param userid user id which entries will be removed, used when path is NULL
+ */
+static void FSMPermCacheRemove( FSManager *fm, const char *path, FULONG devid, FULONG userid )
+{
+	int shard;
+	
+	__atomic_add_fetch( &fm->fm_PermGeneration, 1, __ATOMIC_RELEASE );
+	__atomic_add_fetch( &fm->fm_PermInvalidations, 1, __ATOMIC_RELAXED );
+	
+	for( shard = 0 ; shard < FSM_PERM_CACHE_SHARDS ; shard++ )
+	{
+		unsigned int bucket;
+		
+		pthread_rwlock_wrlock( &(fm->fm_PermLocks[ shard ]) );
+		for( bucket = shard ; bucket < FSM_PERM_CACHE_BUCKETS ; bucket += FSM_PERM_CACHE_SHARDS )
+		{
+			FSMPermEntry **pe = &(fm->fm_PermCache[ bucket ]);
+			while( *pe != NULL )
+			{
+				FBOOL match;
+				if( path != NULL )
+				{
+					match = (*pe)->pe_DeviceID == devid && strcmp( (*pe)->pe_Path, path ) == 0;
+				}
+				else
+				{
+					match = (*pe)->pe_UserID == userid;
+				}
+				
+				if( match == TRUE )
+				{
+					FSMPermEntry *rem = *pe;
+					*pe = rem->pe_Next;
+					FFree( rem );
+					__atomic_sub_fetch( &fm->fm_PermEntries, 1, __ATOMIC_RELAXED );
+				}
+				else
+				{
+					pe = &((*pe)->pe_Next);
+				}
+			}
+		}
+		pthread_rwlock_unlock( &(fm->fm_PermLocks[ shard ]) );
+	}
+}
+
+/**
+ * Get permission entries which apply to user on path, from cache or DB
+ *
+ * @param fm pointer to FSManager
+ * @param sqlLib pointer to SQLLibrary pointer, library is taken when DB must be asked
+ * @param userid user id
+ * @param devid device id
+ * @param path path (does not have to be terminated by 0)
+ * @param len length of path
+ * @param rows pointer where number of permission entries will be stored
+ * @param mask pointer where access mask will be stored (bit number is position in ARWED string)
+ * @return 0 when success, otherwise error number
+ */
+static int FSMPermGet( FSManager *fm, SQLLibrary **sqlLib, FULONG userid, FULONG devid, const char *path, int len, int *rows, int *mask )
+{
+	SystemBase *sb = (SystemBase  *) fm->fm_SB;
+	FUQUAD generation = 0;
+	
+	if( fm->fm_PermCache != NULL )
+	{
+		if( FSMPermCacheGet( fm, userid, devid, path, len, rows, mask ) == TRUE )
+		{
+			return 0;
+		}
+		generation = __atomic_load_n( &fm->fm_PermGeneration, __ATOMIC_ACQUIRE );
+	}
+	
+	if( *sqlLib == NULL && ( *sqlLib = sb->LibrarySQLGet( sb ) ) == NULL )
+	{
+		return -1;
+	}
+	
+	char *lpath = StringDuplicateN( (char *)path, len );
+	if( lpath == NULL )
+	{
+		return -2;
+	}
+	
+	char devidc[ 32 ];
+	char userc[ 32 ];
+	snprintf( devidc, sizeof(devidc), "%lu", devid );
+	snprintf( userc, sizeof(userc), "%lu", userid );
+	
+	DEBUG("[FSManagerCheckAccess] Checking access via SQL, path '%s' device %lu\n", lpath, devid );
+	
+	// statement is prepared once per connection, values are sent as parameters
+	const char *params[] = { lpath, devidc, userc, userc };
+	void *res = (*sqlLib)->QueryPrepared( *sqlLib, "SELECT Access, ObjectID, Type, PermissionID FROM `FPermLink` WHERE \
+PermissionID IN( SELECT ID FROM `FFilePermission` WHERE Path = ? AND DeviceID = ? ) \
+AND ( ( ObjectID IN( SELECT UserGroupID FROM `FUserToGroup` WHERE UserID = ? ) AND Type = 1 ) OR ( ObjectID = ? AND Type = 0 ) OR ( Type = 2 ) )", params, 4 );
+	
+	FFree( lpath );
+	
+	if( res == NULL )
+	{
+		return -3;
+	}
+	
+	//  ROW````
+	// 0 - access string  -RWED
+	// 1  - objectid (group or userid)
+	// 2 - type of id  0 - user, 1- group,  2  - others
+	// 3 - permissionid
+	
+	char **row = NULL;
+	*rows = 0;
+	*mask = 0;
+	while( ( row = (*sqlLib)->FetchRow( *sqlLib, res ) ) ) 
+	{
+		(*rows)++;
+		if( row[ 0 ] != NULL )
+		{
+			int i;
+			int alen = strlen( row[ 0 ] );
+			for( i=1 ; i < 5 && i < alen ; i++ )
+			{
+				if( row[ 0 ][ i ] == DEFAULT_ACCESS[ i ] )
+				{
+					*mask |= ( 1 << i );
+				}
+			}
+		}
+	}
+	(*sqlLib)->FreeResult( *sqlLib, res );
+	
+	if( fm->fm_PermCache != NULL )
+	{
+		FSMPermCachePut( fm, generation, userid, devid, path, len, *rows, *mask );
+	}
+	
+	return 0;
+}
+
 /**
  * Static locking function.
  *
@@ -79,7 +387,6 @@ void FSManagerDelete( FSManager *fm )
 FBOOL FSManagerCheckAccess( FSManager *fm, const char *path, FULONG devid, User *usr, char *perm )
 {
 	FBOOL result = FALSE;
-	char *localPath = NULL;
 	
 	DEBUG("[FSManagerCheckAccess] Check access for %s\n", path );
 	if( path == NULL )
@@ -87,182 +394,88 @@ FBOOL FSManagerCheckAccess( FSManager *fm, const char *path, FULONG devid, User
 		return FALSE;
 	}
 	
-	char *newPath = NULL;
-	int plen = strlen( path );
-	if( plen == 0 )
-	{
-		newPath = FCalloc( 1, sizeof(char) );
-	}
-	else
+	int pathLen = strlen( path );
+	if( pathLen > 0 && path[ pathLen -1 ] == '/' )
 	{
-		if( path[ plen -1 ] == '/' )
-		{
-			newPath = StringDuplicateN( (char *)path, plen-1 );
-		}
-		else
-		{
-			newPath = StringDuplicateN( (char *)path, plen );
-		}
+		pathLen--;
 	}
 	
-	SystemBase *sb = (SystemBase  *) fm->fm_SB;
-	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
-	
-	if( fm != NULL && perm != NULL && newPath != NULL && sqlLib != NULL )
+	if( fm != NULL && perm != NULL && usr != NULL )
 	{
-		int querysize = 0;
-		querysize = 1024  + (2*strlen( newPath ));
-		
-		int i;
-		int slashes = 0;
-		int lastSlash = 0;
-		int pathLen = strlen(newPath);
+		SystemBase *sb = (SystemBase  *) fm->fm_SB;
+		SQLLibrary *sqlLib = NULL;
+		int rows = 0;
+		int mask = 0;
 		
-		char *tmpQuery;
+		DEBUG("[FSManagerCheckAccess] User ptr %p\n", usr );
 		
-		DEBUG("[FSManagerCheckAccess] User ptr %p alloc size %d\n", usr, querysize );
-		
-		if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
+		if( FSMPermGet( fm, &sqlLib, usr->u_ID, devid, path, pathLen, &rows, &mask ) == 0 )
 		{
+			FBOOL loaded = TRUE;
+			
 			if( perm[ 2 ] == 'W' )	// if we are checking write permission, we must check also parent folder permissions
 			{
-				char *parentPath = StringDuplicate( newPath );
 				int i;
+				int parentLen = pathLen;
+				
 				// getting parent directory path
-				for( i=pathLen ; i>=0 ; i-- )
+				for( i=pathLen-1 ; i>=0 ; i-- )
 				{
-					if( parentPath[ i ] == '/' )
+					if( path[ i ] == '/' )
 					{
-						parentPath[ i ] = 0;
+						parentLen = i;
 						break;
 					}
 				}
 				
-				sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-				PermissionID in( \
-					SELECT ID FROM `FFilePermission` WHERE \
-						( Path = '%s' OR Path = '%s' ) \
-						AND DeviceID = %lu \
-					)\
-				AND ( \
-						( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-					OR \
-						( ObjectID = %lu and Type = 0 ) \
-					OR \
-						( Type = 2 ) \
-						) \
-				", newPath, parentPath, devid, usr->u_ID, usr->u_ID );
-				
-				FFree( parentPath );
-			}
-			else
-			{
-				sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-				PermissionID in( \
-					SELECT ID FROM `FFilePermission` WHERE \
-						Path = '%s' \
-						AND DeviceID = %lu \
-				   )\
-				AND ( \
-						( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-					OR \
-						( ObjectID = %lu and Type = 0 ) \
-					OR \
-						( Type = 2 ) \
-					) \
-				", newPath, devid, usr->u_ID, usr->u_ID );
+				if( parentLen != pathLen )
+				{
+					int parentRows = 0;
+					int parentMask = 0;
+					
+					if( FSMPermGet( fm, &sqlLib, usr->u_ID, devid, path, parentLen, &parentRows, &parentMask ) == 0 )
+					{
+						rows += parentRows;
+						mask |= parentMask;
+					}
+					else
+					{
+						loaded = FALSE;
+					}
+				}
 			}
 			
-			DEBUG("[FSManagerCheckAccess] Checking access via SQL '%s'\n", tmpQuery );
-		
-			void *res = sqlLib->Query( sqlLib, tmpQuery );
-			FBOOL access = FALSE;
-			
-			char defaultAccessRights[] = "-RWED";
-
-			if( res != NULL )
+			if( loaded == TRUE )
 			{
-				// default access
-				// -RWED-     - ARWEDH
-				
-				//  ROW````
-				// 0 - access string
-				// 1  - objectid (group or userid)
-				// 2 - type of id  0 - user, 1- group,  2  - others
-				// 3 - permissionid
-				// 4 - ID - unused
-				int nrrows = sqlLib->NumberOfRows( sqlLib, res );
-
-				if( nrrows > 0 )
+				// no entries, default access
+				if( rows == 0 )
 				{
-					char **row = NULL;
+					result = TRUE;
+				}
+				else
+				{
+					int i;
 					
 					DEBUG("[FSManagerCheckAccess] Checking permissions %c  -   permission param %s\n", (char)perm[ 0 ], perm );
 					
-					while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
+					// access is given when any entry allows one of requested rights
+					for( i=1 ; i < 5 ; i++ )
 					{
-						DEBUG("[FSManagerCheckAccess] Found permission entry %s  permissions to check PERM %s OBJID %s TYPE %s\n", row[ 0 ], perm, row[1], row[2] );
-						
-						// others rights
-						//if( row[ 2 ][ 0 ] == '2' )
-						//{
-						//	strcpy( defaultAccessRights, row[ 0 ] );
-						//}
-						//else
+						if( perm[ i ] == DEFAULT_ACCESS[ i ] && ( mask & ( 1 << i ) ) )
 						{
-							// read
-							if( perm[ 1 ] == 'R' && ((char)row[ 0 ][ 1 ]) == perm[ 1 ] )
-							{
-								access = TRUE;
-								break;
-							}
-							// write
-							if( perm[ 2 ] == 'W' && ((char)row[ 0 ][ 2 ]) == perm[ 2 ] )
-							{
-								access = TRUE;
-								break;
-							}
-						
-							if( perm[ 3 ] == 'E' && ((char)row[ 0 ][ 3 ]) == perm[ 3 ] )
-							{
-								access = TRUE;
-								break;
-							}
-						
-							if( perm[ 4 ] == 'D' && ((char)row[ 0 ][ 4 ]) == perm[ 4 ] )
-							{
-								access = TRUE;
-								break;
-							}
+							result = TRUE;
+							break;
 						}
 					}
 				}
-				// number of rows > 0
-				// checking default access
-				else
-				{
-					access = TRUE;
-				}
-				
-				if( access == TRUE )
-				{
-					result = TRUE;
-				}
-				sqlLib->FreeResult( sqlLib, res );
 			}
-			FFree( tmpQuery );
 		}
-		else
+		
+		if( sqlLib != NULL )
 		{
-			FERROR("Cannot allocate memory for query!\n");
-			FFree( newPath );
 			sb->LibrarySQLDrop( sb, sqlLib );
-			return result;
 		}
-		
-		sb->LibrarySQLDrop( sb, sqlLib );
 	}
-	FFree( newPath );
 
 	return result;
 }
@@ -724,6 +937,9 @@ int FSManagerProtect3( FSManager *fm, User *usr, char *path, FULONG devid, char
 
 		sb->LibrarySQLDrop( sb, sqllib );
 	}
+	
+	FSManagerInvalidatePath( fm, path, devid );
+	
 	return 0;
 }
 
@@ -884,15 +1100,103 @@ int FSManagerProtect( FSManager *fm, const char *path, FULONG devid, char *accgr
 		}
 		sb->LibrarySQLDrop( sb, sqllib );
 	}
+	
+	FSManagerInvalidatePath( fm, path, devid );
+	
 	return 0;
 }
 
+//
+// directory entry which gets access rights
+//
+
+typedef struct FSMDirEntry
+{
+	char					*de_Path;				// path without '/' on the end
+	int						de_Start;				// position of Permissions value in Dir output
+	int						de_End;
+	char					de_Access[ 3 ][ 6 ];	// user, group, others
+}FSMDirEntry;
+
+#define FSM_DIR_PATHS_PER_QUERY		1000
+
+static int FSMDirEntryCompare( const void *a, const void *b )
+{
+	return strcmp( (*(FSMDirEntry **)a)->de_Path, (*(FSMDirEntry **)b)->de_Path );
+}
+
+//
+// return index of token which follows token i and all its children
+//
+
+static int FSMJsonSkip( jsmntok_t *t, int i, int count )
+{
+	if( i >= count )
+	{
+		return count;
+	}
+	
+	int j = i + 1;
+	int n;
+	
+	if( t[ i ].type == JSMN_OBJECT )
+	{
+		for( n = 0 ; n < t[ i ].size && j < count ; n++ )
+		{
+			j = FSMJsonSkip( t, FSMJsonSkip( t, j, count ), count );
+		}
+	}
+	else if( t[ i ].type == JSMN_ARRAY )
+	{
+		for( n = 0 ; n < t[ i ].size && j < count ; n++ )
+		{
+			j = FSMJsonSkip( t, j, count );
+		}
+	}
+	return j;
+}
+
+//
+// get copy of JSON string value, escaped characters are decoded and '/' on the end is removed
+//
+
+static char *FSMJsonPath( const char *js, jsmntok_t *t )
+{
+	int len = t->end - t->start;
+	char *path = FMalloc( len + 1 );
+	if( path == NULL )
+	{
+		return NULL;
+	}
+	
+	const char *src = js + t->start;
+	int i, pos = 0;
+	for( i = 0 ; i < len ; i++ )
+	{
+		if( src[ i ] == '\\' && i + 1 < len )
+		{
+			i++;
+		}
+		path[ pos++ ] = src[ i ];
+	}
+	if( pos > 0 && path[ pos - 1 ] == '/' )
+	{
+		pos--;
+	}
+	path[ pos ] = 0;
+	
+	return path;
+}
+
 /**
- * Add access rights to dir response command
+ * Add access rights to dir response command. Dir output is parsed once and permissions
+ * of all entries are taken from DB by one query (for every FSM_DIR_PATHS_PER_QUERY entries).
  *
  * @param fm pointer to FSManager structure
  * @param recv received Dir command output
-*  @return Dir output with permission strings when success, otherwise NULL
+ * @param devid device id
+ * @param usr pointer to user for which access is checked
+*  @return Dir output with permission strings, recv when there is nothing to add
  */
 BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG devid, User *usr )
 {
@@ -901,277 +1205,354 @@ BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG
 		return NULL;
 	}
 	
-	if( recv->bs_Buffer[ 0 ] == 'f' )
+	if( recv->bs_Buffer[ 0 ] == 'f' || fm == NULL || usr == NULL )
 	{
 		return recv;
 	}
 	
-	SystemBase *sb = (SystemBase  *) fm->fm_SB;
-	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
-	if( sqlLib == NULL )
+	// Dir output:  ok<!--separate-->[ { "Path":"...", "Permissions":"", ... }, ... ]
+	
+	char *js = strchr( recv->bs_Buffer, '[' );
+	if( js == NULL )
 	{
-		FERROR("Cannot get mysql.library slot!\n");
-		return NULL;
+		return recv;
+	}
+	int base = js - recv->bs_Buffer;
+	int jslen = recv->bs_Size - base;
+	
+	jsmn_parser parser;
+	jsmn_init( &parser );
+	int ntok = jsmn_parse( &parser, js, jslen, NULL, 0 );
+	if( ntok <= 0 )
+	{
+		return recv;
 	}
 	
-	//Permissions
-	//Path
+	jsmntok_t *t = FCalloc( ntok, sizeof( jsmntok_t ) );
+	if( t == NULL )
+	{
+		return recv;
+	}
 	
-	char *permPtr = recv->bs_Buffer;
-	char *permPtrLast = permPtr;
-	char *pathPtr = recv->bs_Buffer;
-	FBOOL parentDirectoryAccess = FALSE;
+	jsmn_init( &parser );
+	if( jsmn_parse( &parser, js, jslen, t, ntok ) < 1 || t[ 0 ].type != JSMN_ARRAY || t[ 0 ].size == 0 )
+	{
+		FFree( t );
+		return recv;
+	}
 	
-	BufString *bsres = BufStringNew();
+	FSMDirEntry *entries = FCalloc( t[ 0 ].size, sizeof( FSMDirEntry ) );
+	FSMDirEntry **sorted = FCalloc( t[ 0 ].size, sizeof( FSMDirEntry *) );
+	if( entries == NULL || sorted == NULL )
+	{
+		if( entries != NULL ) FFree( entries );
+		if( sorted != NULL ) FFree( sorted );
+		FFree( t );
+		return recv;
+	}
 	
-	// while parsing JSON Im trying to find files by Path
-	// next Im trying to localize Permissions and Im filling this field with file permissions
+	//
+	// collect Path and Permissions of every entry
+	//
 	
-	char parentAccess[ 3 ][ 5 ];
-	parentAccess[ 0 ][ 0 ] = parentAccess[ 1 ][ 0 ] = parentAccess[ 2 ][ 0 ] = 0;
-	char access[ 3 ][ 5 ];
-	access[ 0 ][ 0 ] = access[ 1 ][ 0 ] = access[ 2 ][ 0 ] = 0;
+	int nentries = 0;
+	int i = 1;
+	int e;
 	
-	while( ( pathPtr  = strstr( pathPtr, "\"Path\"" ) ) != NULL )
+	for( e = 0 ; e < t[ 0 ].size && i < ntok ; e++ )
 	{
-		char *path;
-		char *allocPath = NULL;
+		int obj = i;
+		i = FSMJsonSkip( t, i, ntok );
 		
-		pathPtr += 8;	// we move to the end of "Path":"
-		path = pathPtr;
-		int index = 0;
-		// we want to end string by putting 0 on the end
-		while( *pathPtr != 0 )
+		if( t[ obj ].type != JSMN_OBJECT )
 		{
-			char *oldChar = pathPtr;
+			continue;
+		}
+		
+		int pathTok = -1;
+		int permTok = -1;
+		int k = obj + 1;
+		int n;
+		
+		for( n = 0 ; n < t[ obj ].size && k + 1 < ntok ; n++ )
+		{
+			int val = k + 1;
+			int klen = t[ k ].end - t[ k ].start;
 			
-			pathPtr++;
-
-			if( *oldChar != '\\' && *pathPtr == '\"' )
+			if( t[ k ].type == JSMN_STRING && t[ val ].type == JSMN_STRING )
 			{
-				allocPath = StringDuplicateN( path, (oldChar+1)-path );
-				if( allocPath != NULL )
+				if( klen == 4 && strncmp( js + t[ k ].start, "Path", 4 ) == 0 )
 				{
-					int len = strlen( allocPath );
-					if( allocPath[ len-1 ] == '\\' )
-					{
-						allocPath[ len-1 ] = 0;
-					}
+					pathTok = val;
+				}
+				else if( klen == 11 && strncmp( js + t[ k ].start, "Permissions", 11 ) == 0 )
+				{
+					permTok = val;
 				}
-				break;
 			}
+			k = FSMJsonSkip( t, val, ntok );
 		}
 		
-		if( permPtr != NULL )
+		if( pathTok >= 0 && permTok >= 0 )
 		{
-			permPtr = strstr( permPtr, "\"Permissions\"" );
+			FSMDirEntry *de = &(entries[ nentries ]);
+			if( ( de->de_Path = FSMJsonPath( js, &t[ pathTok ] ) ) != NULL )
+			{
+				de->de_Start = base + t[ permTok ].start;
+				de->de_End = base + t[ permTok ].end;
+				sorted[ nentries ] = de;
+				nentries++;
+			}
 		}
-
-		if( permPtr != NULL )
+	}
+	
+	FFree( t );
+	
+	if( nentries == 0 )
+	{
+		FFree( entries );
+		FFree( sorted );
+		return recv;
+	}
+	
+	// access rights of parent directory are used when entry does not have own
+	
+	char parentAccess[ 3 ][ 6 ];
+	parentAccess[ 0 ][ 0 ] = parentAccess[ 1 ][ 0 ] = parentAccess[ 2 ][ 0 ] = 0;
+	
+	char *parentPath = StringDuplicate( entries[ 0 ].de_Path );
+	if( parentPath != NULL )
+	{
+		char *slash = strrchr( parentPath, '/' );
+		if( slash != NULL )
+		{
+			*slash = 0;
+		}
+	}
+	
+	qsort( sorted, nentries, sizeof( FSMDirEntry *), FSMDirEntryCompare );
+	
+	//
+	// fetch access rights of all entries
+	//
+	
+	SystemBase *sb = (SystemBase  *) fm->fm_SB;
+	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
+	if( sqlLib != NULL && parentPath != NULL )
+	{
+		int first;
+		
+		for( first = 0 ; first < nentries ; first += FSM_DIR_PATHS_PER_QUERY )
 		{
-			permPtr += 15;	// "Permissions":"  
-			FERROR("Permsize %d  - %.*s\n", (int)(permPtr-permPtrLast), (int)(permPtr-(permPtrLast+1)), permPtr );
-			BufStringAddSize( bsres, permPtrLast, permPtr-permPtrLast );
+			int last = first + FSM_DIR_PATHS_PER_QUERY;
+			if( last > nentries )
+			{
+				last = nentries;
+			}
 			
-			// fetch access rights to parent directory
+			BufString *bs = BufStringNewSize( 1024 + ( last - first ) * 128 );
+			if( bs == NULL )
+			{
+				break;
+			}
 			
-			// new path removes / on the end
-			char *newPath = NULL;
-			int plen = 0;
-			if( allocPath != NULL )
+			char tmp[ 512 ];
+			int len = snprintf( tmp, sizeof(tmp), "SELECT fp.Path, pl.Access, pl.Type FROM `FPermLink` pl INNER JOIN `FFilePermission` fp ON pl.PermissionID = fp.ID \
+WHERE fp.DeviceID = %lu AND ( ( pl.ObjectID IN( SELECT UserGroupID FROM `FUserToGroup` WHERE UserID = %lu ) AND pl.Type = 1 ) OR ( pl.ObjectID = %lu AND pl.Type = 0 ) OR ( pl.Type = 2 ) ) \
+AND fp.Path IN( ", devid, usr->u_ID, usr->u_ID );
+			BufStringAddSize( bs, tmp, len );
+			
+			// separator is put before every path, so path which cannot be escaped does not break the list
+			int added = 0;
+			
+			// parent directory is asked together with first entries
+			for( e = ( first == 0 ? first - 1 : first ) ; e < last ; e++ )
 			{
-				plen = strlen( allocPath );
-				if( allocPath[ plen -1 ] == '/' )
+				char *esc = sqlLib->MakeEscapedString( sqlLib, e < 0 ? parentPath : sorted[ e ]->de_Path );
+				if( esc != NULL )
 				{
-					newPath = StringDuplicateN( (char *)allocPath, plen-1 );
-				}
-				else
-				{
-					newPath = StringDuplicateN( (char *)allocPath, plen );
+					BufStringAddSize( bs, added > 0 ? ",'" : "'", added > 0 ? 2 : 1 );
+					BufStringAdd( bs, esc );
+					BufStringAddSize( bs, "'", 1 );
+					FFree( esc );
+					added++;
 				}
 			}
+			BufStringAddSize( bs, " )", 2 );
+			
+			if( added == 0 )
+			{
+				BufStringDelete( bs );
+				continue;
+			}
+			
+			void *res = sqlLib->Query( sqlLib, bs->bs_Buffer );
+			BufStringDelete( bs );
 			
-			if( fm != NULL && newPath != NULL )
+			if( res != NULL )
 			{
-				int querysize = 0;
-				querysize = 2048 + ( 2*strlen( newPath ) );
+				char **row = NULL;
 				
-				char *tmpQuery = NULL;
+				//  ROW
+				// 0 - path
+				// 1 - access string
+				// 2 - type of id  0 - user, 1- group,  2  - others
 				
-				if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
+				while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
 				{
-					if( parentDirectoryAccess == FALSE )
+					if( row[ 0 ] == NULL || row[ 1 ] == NULL || row[ 2 ] == NULL )
 					{
-						char *parentPath = StringDuplicate( newPath );
-						int i;
-						// getting parent directory path
-						if( plen > 0 )
-						{
-							for( i=plen-1 ; i>=0 ; i-- )
-							{
-								if( parentPath[ i ] == '/' )
-								{
-									parentPath[ i ] = 0;
-									break;
-								}
-							}
-						}
-						
-						sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-							PermissionID in( \
-							SELECT ID FROM `FFilePermission` WHERE \
-								( Path = '%s' ) \
-								AND DeviceID = %lu \
-							)\
-							AND ( \
-									( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-									OR \
-									( ObjectID = %lu and Type = 0 ) \
-									OR \
-									( Type = 2 ) \
-							) \
-						", parentPath, devid, usr->u_ID, usr->u_ID );
-						
-						void *res = sqlLib->Query( sqlLib, tmpQuery );
-						if( res != NULL )
-						{
-							char **row = NULL;
-							
-							while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
-							{
-								int type = atoi( row[ 2 ] );
-								switch( type )
-								{
-									case 0:
-									case 2:
-										strcpy( parentAccess[ type ], row[ 0 ] );
-										break;
-									case 1:
-										if( parentAccess[ 1 ][ 0 ] != 0 )
-										{
-											strcpy( parentAccess[ type ], row[ 0 ] );
-										}
-										break;
-								}
-							}
-							sqlLib->FreeResult( sqlLib, res );
-						}
-				
-						FFree( parentPath );
-				
-						parentDirectoryAccess = TRUE;
+						continue;
 					}
-			
-			
-					access[ 0 ][ 0 ] = access[ 1 ][ 0 ] = access[ 2 ][ 0 ] = 0;
-					// fetch access rights to file
-
-					sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-						PermissionID in( \
-						SELECT ID FROM `FFilePermission` WHERE \
-							( Path = '%s' ) \
-							AND DeviceID = %lu \
-						)\
-						AND ( \
-								( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-								OR \
-								( ObjectID = %lu and Type = 0 ) \
-								OR \
-								( Type = 2 ) \
-						) \
-					", newPath, devid, usr->u_ID, usr->u_ID );
-
-					void *res = sqlLib->Query( sqlLib, tmpQuery );
 					
-					if( res != NULL )
+					int type = atoi( row[ 2 ] );
+					if( type < 0 || type > 2 )
 					{
-						int pos = 0;
-						char **row = NULL;
-						
-						while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
-						{
-							int type = atoi( row[ 2 ] );
-							strcpy( access[ type ], row[ 0 ] );
-						}
-						
-						sqlLib->FreeResult( sqlLib, res );
+						continue;
 					}
 					
-					// copy access rights to string which will be returned
-					
-					if( access[ 0 ][ 0 ] != 0 )
+					if( strcmp( row[ 0 ], parentPath ) == 0 )
 					{
-						BufStringAddSize( bsres, access[ 0 ], 5 );
-					}
-					else if( parentAccess[ 0 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 0 ], 5 );
-					}
-					else
-					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
+						strncpy( parentAccess[ type ], row[ 1 ], 5 );
+						parentAccess[ type ][ 5 ] = 0;
 					}
 					
-					BufStringAddSize( bsres, ",", 1 );
+					FSMDirEntry key;
+					FSMDirEntry *keyPtr = &key;
+					key.de_Path = row[ 0 ];
 					
-					if( access[ 1 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, access[ 1 ], 5 );
-					}
-					else if( parentAccess[ 1 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 1 ], 5 );
-					}
-					else
+					FSMDirEntry **found = bsearch( &keyPtr, sorted, nentries, sizeof( FSMDirEntry *), FSMDirEntryCompare );
+					if( found != NULL )
 					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
+						strncpy( (*found)->de_Access[ type ], row[ 1 ], 5 );
+						(*found)->de_Access[ type ][ 5 ] = 0;
 					}
-					
+				}
+				sqlLib->FreeResult( sqlLib, res );
+			}
+		}
+	}
+	
+	if( sqlLib != NULL )
+	{
+		sb->LibrarySQLDrop( sb, sqlLib );
+	}
+	
+	//
+	// put access rights into Dir output
+	//
+	
+	BufString *bsres = BufStringNewSize( recv->bs_Size + ( nentries * 20 ) );
+	if( bsres != NULL )
+	{
+		int last = 0;
+		
+		for( e = 0 ; e < nentries ; e++ )
+		{
+			FSMDirEntry *de = &(entries[ e ]);
+			int type;
+			
+			BufStringAddSize( bsres, recv->bs_Buffer + last, de->de_Start - last );
+			
+			for( type = 0 ; type < 3 ; type++ )
+			{
+				if( type > 0 )
+				{
 					BufStringAddSize( bsres, ",", 1 );
-					
-					if( access[ 2 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, access[ 2 ], 5 );
-					}
-					else if( parentAccess[ 2 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 2 ], 5 );
-					}
-					else
-					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
-					}
-					
-					FFree( tmpQuery );
+				}
+				
+				if( de->de_Access[ type ][ 0 ] != 0 )
+				{
+					BufStringAdd( bsres, de->de_Access[ type ] );
+				}
+				else if( parentAccess[ type ][ 0 ] != 0 )
+				{
+					BufStringAdd( bsres, parentAccess[ type ] );
 				}
 				else
 				{
-					FERROR("Cannot allocate memory for query!\n");
-					//BufStringDelete( bs );
-					FFree( newPath );
-					sb->LibrarySQLDrop( sb, sqlLib );
-					return NULL;
+					BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
 				}
 			}
-			
-			FFree( newPath );
-			
-			// end fetch access rights to file
-			
-			permPtrLast = permPtr;
+			last = de->de_End;
 		}
+		BufStringAddSize( bsres, recv->bs_Buffer + last, recv->bs_Size - last );
 		
-		if( allocPath != NULL )
-		{
-			FFree( allocPath );
-		}
+		BufStringDelete( recv );
+		recv = bsres;
 	}
 	
-	BufStringAddSize( bsres, permPtrLast, ( &recv->bs_Buffer[ recv->bs_Size ] )-permPtrLast );
+	for( e = 0 ; e < nentries ; e++ )
+	{
+		FFree( entries[ e ].de_Path );
+	}
+	FFree( entries );
+	FFree( sorted );
+	if( parentPath != NULL )
+	{
+		FFree( parentPath );
+	}
 	
-	BufStringDelete( recv );
+	return recv;
+}
+
+/**
+ * Remove cached permissions of path. Entries of all users are removed.
+ *
+ * @param fm pointer to FSManager
+ * @param path path which permissions were changed
+ * @param devid device id
+ */
+void FSManagerInvalidatePath( FSManager *fm, const char *path, FULONG devid )
+{
+	if( fm == NULL || fm->fm_PermCache == NULL || path == NULL )
+	{
+		return;
+	}
+	
+	int len = strlen( path );
+	if( len > 0 && path[ len - 1 ] == '/' )
+	{
+		len--;
+	}
 	
-	sb->LibrarySQLDrop( sb, sqlLib );
+	char *lpath = StringDuplicateN( (char *)path, len );
+	if( lpath != NULL )
+	{
+		FSMPermCacheRemove( fm, lpath, devid, 0 );
+		FFree( lpath );
+	}
+}
+
+/**
+ * Remove cached permissions of user
+ *
+ * @param fm pointer to FSManager
+ * @param userid id of user which groups were changed
+ */
+void FSManagerInvalidateUser( FSManager *fm, FULONG userid )
+{
+	if( fm == NULL || fm->fm_PermCache == NULL )
+	{
+		return;
+	}
+	FSMPermCacheRemove( fm, NULL, 0, userid );
+}
+
+/**
+ * Get permission cache statistics in json format
+ *
+ * @param fm pointer to FSManager
+ * @param buffer pointer to buffer where statistics will be stored
+ * @param size size of buffer
+ * @return number of characters stored in buffer
+ */
+int FSManagerGetCacheStatistics( FSManager *fm, char *buffer, int size )
+{
+	FUQUAD hits = __atomic_load_n( &fm->fm_PermHits, __ATOMIC_RELAXED );
+	FUQUAD misses = __atomic_load_n( &fm->fm_PermMisses, __ATOMIC_RELAXED );
+	double rate = ( hits + misses ) > 0 ? (double)hits / (double)( hits + misses ) : 0.0;
 	
-	return bsres;
+	return snprintf( buffer, size, "{\"enabled\":%s,\"entries\":%llu,\"hits\":%llu,\"misses\":%llu,\"hitrate\":%.4f,\"invalidations\":%llu,\"ttl\":%d}",
+		fm->fm_PermCache != NULL ? "true" : "false", fm->fm_PermEntries, hits, misses, rate, fm->fm_PermInvalidations, fm->fm_PermCacheTTL );
 }
@@ -36,10 +36,44 @@
 #include "file_permissions.h"
 #include <system/user/user.h>
 #include <system/user/user_session.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define FSM_PERM_CACHE_BUCKETS			4096
+#define FSM_PERM_CACHE_SHARDS			32
+#define FSM_PERM_CACHE_TTL_DEFAULT		60		// seconds, 0 disables cache
+#define FSM_PERM_CACHE_SIZE_DEFAULT		65536	// maximum number of entries
+
+//
+// permission rows found for user on one path
+//
+
+typedef struct FSMPermEntry
+{
+	struct FSMPermEntry		*pe_Next;
+	FULONG					pe_UserID;
+	FULONG					pe_DeviceID;
+	time_t					pe_Time;
+	int						pe_Rows;		// number of permission entries which apply to user
+	int						pe_Mask;		// access given by any entry, bit number is position in ARWED string
+	uint32_t				pe_Hash;
+	char					pe_Path[];
+}FSMPermEntry;
 
 typedef struct FSManager
 {
 	void 					*fm_SB;
+	
+	FSMPermEntry			**fm_PermCache;		// NULL when cache is disabled
+	pthread_rwlock_t		fm_PermLocks[ FSM_PERM_CACHE_SHARDS ];
+	int						fm_PermCacheTTL;
+	int						fm_PermBucketMax;
+	volatile FUQUAD			fm_PermGeneration;	// changed on every invalidation
+	volatile FUQUAD			fm_PermEntries;
+	volatile FUQUAD			fm_PermHits;
+	volatile FUQUAD			fm_PermMisses;
+	volatile FUQUAD			fm_PermInvalidations;
 }FSManager;
 
 //
@@ -85,4 +119,22 @@ int FSManagerProtect( FSManager *fm, const char *path, FULONG devid, char *accgr
 
 BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG devid, User *usr  );
 
+//
+// remove cached permissions of path, must be called after permissions were changed in DB
+//
+
+void FSManagerInvalidatePath( FSManager *fm, const char *path, FULONG devid );
+
+//
+// remove cached permissions of user, must be called after user groups were changed
+//
+
+void FSManagerInvalidateUser( FSManager *fm, FULONG userid );
+
+//
+// get permission cache statistics in json format
+//
+
+int FSManagerGetCacheStatistics( FSManager *fm, char *buffer, int size );
+
 #endif // __SYSTEM_FSYS_FSMANAGER_H__
@@ -31,6 +31,7 @@
 #include <system/fsys/device_handling.h>
 #include <network/mime.h>
 #include <util/md5.h>
+#include <util/murmurhash3.h>
 #include <system/fsys/door_notification.h>
 #include <stdlib.h>
 #include <system/cache/cache_user_files.h>
@@ -397,9 +398,10 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 									resp = FSManagerAddPermissionsToDir( l->sl_FSM, resp, actDev->f_ID, loggedSession->us_User );
 								}
 
-								HttpSetContent( response, resp->bs_Buffer, resp->bs_Size );
-								//DEBUG("DIR set response to: %s\n", resp->bs_Buffer );
-								resp->bs_Buffer = NULL;
+								int contentSize = 0;
+								char *content = BufStringDetach( resp, &contentSize );
+								HttpSetContent( response, content, contentSize );
+								//DEBUG("DIR set response to: %s\n", content );
 							}
 							else
 							{
@@ -707,7 +709,35 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					FBOOL have = FSManagerCheckAccess( l->sl_FSM, path, actDev->f_ID, loggedSession->us_User, "-R----" );
 					if( have == TRUE )
 					{
-						if( mode != NULL && strcmp( mode, "rs" ) == 0 )		// read stream
+						// whole file can be validated by client, entity tag is built from modification time provided by filesystem
+						// time has only 1 second resolution and size is not known, so tag is weak
+						char etag[ 66 ];
+						etag[ 0 ] = 0;
+						
+						if( mode != NULL && mode[ 0 ] == 'r' && strcmp( mode, "rs" ) != 0 && offset == NULL && bytes == NULL && actFS->GetChangeTimestamp != NULL )
+						{
+							FQUAD tim = actFS->GetChangeTimestamp( actDev, origDecodedPath );
+							if( tim > 0 )
+							{
+								uint64_t hash[ 2 ];
+								MURMURHASH3( path, strlen( path ), hash );
+								etag[ 0 ] = 'W';
+								etag[ 1 ] = '/';
+								HttpETagBuild( etag + 2, sizeof( etag ) - 2, hash[ 0 ] ^ actDev->f_ID, tim, 0, mode );
+							}
+						}
+						
+						if( etag[ 0 ] != 0 && HttpIsNotModified( request, etag, 0 ) == TRUE )
+						{
+							HttpFree( response );
+							
+							response = HttpNewSimpleA( HTTP_304_NOT_MODIFIED, request,
+													   HTTP_HEADER_ETAG, (FULONG)StringDuplicate( etag ),
+													   HTTP_HEADER_CACHE_CONTROL, (FULONG)StringDuplicate( "no-cache" ),
+													   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),
+													   TAG_DONE, TAG_DONE );
+						}
+						else if( mode != NULL && strcmp( mode, "rs" ) == 0 )		// read stream
 						{ 
 							File *fp = (File *)actFS->FileOpen( actDev, path, mode );
 						
@@ -924,6 +954,13 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							INFO("READ RETURN BYTES %d  - %s\n", totalBytes, mime );
 							*/
 									HttpSetContent( response, outputBuf, totalBytes );
+									
+									// client must revalidate file, unchanged file is not sent again
+									if( etag[ 0 ] != 0 )
+									{
+										HttpAddHeader( response, HTTP_HEADER_ETAG, StringDuplicate( etag ) );
+										HttpAddHeader( response, HTTP_HEADER_CACHE_CONTROL, StringDuplicate( "no-cache" ) );
+									}
 								}
 								else
 								{
@@ -1063,6 +1100,76 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"No access to file\" }" );
 						}
 					}
+					// Data sent as multipart file, it is written in chunks
+					else if( mode != NULL && request->h_FileList != NULL )
+					{
+						HttpFile *file = request->h_FileList;
+						File *fp = NULL;
+						char *fbuffer = NULL;
+						
+						if( FSManagerCheckAccess( l->sl_FSM, path, actDev->f_ID, loggedSession->us_User, "--W---" ) != TRUE )
+						{
+							HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"No access to file\" }" );
+						}
+						else if( ( fbuffer = FMalloc( HTTP_BODY_STREAM_BUFFER_SIZE ) ) == NULL || ( fp = (File *)actFS->FileOpen( actDev, path, mode ) ) == NULL )
+						{
+							HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Cannot open file\" }" );
+						}
+						else
+						{
+							FQUAD stored = 0;
+							int dataread = 0;
+							const char *error = NULL;
+							
+							while( ( dataread = HttpFileRead( request, file, fbuffer, HTTP_BODY_STREAM_BUFFER_SIZE ) ) > 0 )
+							{
+								int size = FileSystemActivityCheckAndUpdate( l, &(actDev->f_Activity), dataread );
+								if( size > 0 )
+								{
+									int written = actFS->FileWrite( fp, fbuffer, size );
+									if( written > 0 )
+									{
+										actDev->f_BytesStored += written;
+										stored += written;
+									}
+									if( written < size )
+									{
+										error = "Cannot write file";
+										break;
+									}
+								}
+								// quota allowed only part of data
+								if( size < dataread )
+								{
+									error = "Quota exceeded";
+									break;
+								}
+							}
+							if( dataread < 0 && error == NULL )
+							{
+								error = "Cannot read file data";
+							}
+							actFS->FileClose( actDev, fp );
+							
+							char tmp[ 256 ];
+							if( error != NULL )
+							{
+								snprintf( tmp, sizeof(tmp), "fail<!--separate-->{ \"response\": \"%s\", \"FileDataStored\" : \"%lld\" } ", error, stored );
+							}
+							else
+							{
+								snprintf( tmp, sizeof(tmp), "ok<!--separate-->{ \"FileDataStored\" : \"%lld\" } ", stored );
+							}
+							HttpAddTextContent( response, tmp );
+							
+							DoorNotificationCommunicateChanges( l, loggedSession, actDev, path );
+						}
+						
+						if( fbuffer != NULL )
+						{
+							FFree( fbuffer );
+						}
+					}
 					else
 					{
 						HttpAddTextContent( response, "ok<!--separate-->{ \"response\": \"nmode parameter is missing\" }" );
@@ -1239,14 +1346,17 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 						FERROR( "PATH == NULL\n" );
 					}
 					
-					if( ( tmpPath = (char *) FCalloc( strlen(path) + 2048, sizeof(char) ) ) != NULL )
+					// Files are copied in chunks, streamed uploads are never stored whole in memory
+					char *fbuffer = FMalloc( HTTP_BODY_STREAM_BUFFER_SIZE );
+					
+					if( fbuffer != NULL && ( tmpPath = (char *) FCalloc( strlen(path) + 2048, sizeof(char) ) ) != NULL )
 					{
 						HttpFile *file = request->h_FileList;
 						
 						// Mind situations where hf_FileName is uploaded filename, where
 						// path has target filename built in..
 						FBOOL fileNameIsTmpPath = FALSE;
-						if( file->hf_FileName && strlen( file->hf_FileName ) > 5 )
+						if( file != NULL && file->hf_FileName && strlen( file->hf_FileName ) > 5 )
 						{
 							char *tmpF = FCalloc( 1, 6 );
 							sprintf( tmpF, "%.*s", 5, file->hf_FileName );
@@ -1288,11 +1398,21 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 								File *fp = (File *)actFS->FileOpen( actDev, tmpPath, "wb" );
 								if( fp != NULL )
 								{
-									int bytes = 0;
+									int bytes = 0, dataread = 0;
 									
-									int size = FileSystemActivityCheckAndUpdate( l, &(actDev->f_Activity), file->hf_FileSize );
-									bytes = actFS->FileWrite( fp, file->hf_Data, size );
-									actDev->f_BytesStored += bytes;
+									while( ( dataread = HttpFileRead( request, file, fbuffer, HTTP_BODY_STREAM_BUFFER_SIZE ) ) > 0 )
+									{
+										int size = FileSystemActivityCheckAndUpdate( l, &(actDev->f_Activity), dataread );
+										if( size <= 0 )
+										{
+											break;
+										}
+										bytes = actFS->FileWrite( fp, fbuffer, size );
+										if( bytes > 0 )
+										{
+											actDev->f_BytesStored += bytes;
+										}
+									}
 
 									actFS->FileClose( actDev, fp );
 								
@@ -1307,6 +1427,9 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							{
 								FERROR("No access to: %s\n", tmpPath );
 							}
+							
+							// Rest of file must be read before next file can be found in streamed body
+							HttpFileSkip( request, file );
 							file = (HttpFile *) file->node.mln_Succ;
 						} // while, goging through files
 						
@@ -1317,6 +1440,11 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 						FERROR("Cannot allocate memory for path buffer\n");
 					}
 					
+					if( fbuffer != NULL )
+					{
+						FFree( fbuffer );
+					}
+					
 					{
 						char tmp[ 1024 ];
 						
@@ -1562,8 +1690,9 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					BufString *bs = FSManagerGetAccess( l->sl_FSM, filepath, actDev->f_ID, loggedSession->us_User );
 					if( bs != NULL )
 					{
-						HttpSetContent( response,  bs->bs_Buffer, bs->bs_Size );
-						bs->bs_Buffer = NULL;
+						int contentSize = 0;
+						char *content = BufStringDetach( bs, &contentSize );
+						HttpSetContent( response, content, contentSize );
 						BufStringDelete( bs );
 					}
 					else
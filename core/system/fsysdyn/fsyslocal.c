@@ -20,6 +20,8 @@
 *                                                                              *
 *****************************************************************************©*/
 
+#define _GNU_SOURCE
+
 #include <core/library.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +38,11 @@
 #include <unistd.h>
 #include <system/datatypes/images/image.h>
 #include <system/datatypes/images/png.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/inotify.h>
 
 #define SUFFIX "fsys"
 #define PREFIX "local"
@@ -48,8 +55,13 @@ typedef struct SpecialData
 {
 	FILE                                        *fp;
 	SystemBase                                  *sb;
+	char                                        *path;		// file opened for writing, directory listing is dropped on close
 } SpecialData;
 
+static void DirCacheInit();
+static void DirCacheDeinit();
+static void DirCacheDrop( const char *path );
+
 
 const char *GetSuffix()
 {
@@ -112,6 +124,7 @@ char *GetFileName( const char *path )
 void init( struct FHandler *s )
 {
 	DEBUG("[FSYSLOCAL] init\n");
+	DirCacheInit();
 }
 
 //
@@ -121,6 +134,7 @@ void init( struct FHandler *s )
 void deinit( struct FHandler *s )
 {
 	DEBUG("[FSYSLOCAL] deinit\n");
+	DirCacheDeinit();
 }
 
 //
@@ -407,6 +421,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 					{
 						//DEBUG( "Didn't exist: creating dir: %s\n", directory );
 						mkdir( directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+						DirCacheDrop( directory );
 					}
 				
 					FFree( directory );
@@ -460,6 +475,13 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 					SpecialData *locsd = (SpecialData *)s->f_SpecialData;
 					sd->sb = locsd->sb;
 					sd->fp = f;
+					
+					// cached listing would show old size, it is dropped now and when file is closed
+					if( mode[ 0 ] != 'r' || strchr( mode, '+' ) != NULL )
+					{
+						DirCacheDrop( comm );
+						sd->path = StringDup( comm );
+					}
 				}
 				DEBUG("FileOpened, memory allocated for localfs\n");
 			
@@ -508,6 +530,11 @@ int FileClose( struct File *s, void *fp )
 		{
 			SpecialData *sd = ( SpecialData *)lfp->f_SpecialData;
 			close = fclose( ( FILE *)sd->fp );
+			if( sd->path != NULL )
+			{
+				DirCacheDrop( sd->path );
+				FFree( sd->path );
+			}
 			free( lfp->f_SpecialData );
 		}
 		
@@ -642,6 +669,7 @@ int MakeDir( struct File *s, const char *path )
 						if( stat( directory, &filest ) == -1 )
 						{
 							mkdir( directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+							DirCacheDrop( directory );
 							DEBUG( "Making directory %s\n", directory );
 						}
 						else
@@ -663,6 +691,7 @@ int MakeDir( struct File *s, const char *path )
 				
 			sprintf( directory, "%s%s", newPath, path );
 			mkdir( directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+			DirCacheDrop( directory );
 				
 			// Create if not exist!
 			if( stat( directory, &filest ) == -1 )
@@ -783,6 +812,7 @@ FQUAD Delete( struct File *s, const char *path )
 		DEBUG("[LocalfsDelete] file or directory %s!\n", comm );
 	
 		FQUAD ret = RemoveDirectory( comm );
+		DirCacheDrop( comm );
 
 		FFree( comm );
 		return ret;
@@ -853,6 +883,8 @@ int Rename( struct File *s, const char *path, const char *nname )
 	// 4. Execute!
 	DEBUG( "executing: rename %s %s\n", source, dest );
 	int res = rename( source, dest );
+	DirCacheDrop( source );
+	DirCacheDrop( dest );
 	
 	// 5. Free up
 	FFree( source );
@@ -923,6 +955,7 @@ int Copy( struct File *s, const char *dst, const char *src )
 					error = 1;
 				}
 				fclose( fdst );
+				DirCacheDrop( fnamedst );
 			}
 			else
 			{
@@ -1120,12 +1153,35 @@ void FillStatLocal( BufString *bs, struct stat *s, File *d, const char *path )
 
 FQUAD GetChangeTimestamp( struct File *s, const char *path )
 {
+	// path is relative to device root, device name is skipped
+	const char *relPath = strchr( path, ':' );
+	relPath = ( relPath != NULL ) ? relPath + 1 : path;
+	
+	int rspath = strlen( s->f_Path );
+	char *comm = FCalloc( rspath + strlen( relPath ) + 5, sizeof( char ) );
+	if( comm == NULL )
+	{
+		return 0;
+	}
+	
+	if( rspath > 0 && s->f_Path[ rspath-1 ] == '/' )
+	{
+		sprintf( comm, "%s%s", s->f_Path, relPath );
+	}
+	else
+	{
+		sprintf( comm, "%s/%s", s->f_Path, relPath );
+	}
+	
+	FQUAD tim = 0;
 	struct stat result;
-	if( stat( path, &result) == 0 )
+	if( stat( comm, &result ) == 0 )
 	{
-		return (FQUAD)result.st_mtimensec;
+		tim = (FQUAD)result.st_mtime;
 	}
-	return (FQUAD)-1;
+	FFree( comm );
+	
+	return tim;
 }
 
 //
@@ -1205,102 +1261,722 @@ BufString *Call( File *s, const char *path, char *args )
 	return bs;
 }
 
+//
+// directory listing engine
+//
+// Entries are stat'ed relative to directory descriptor (no path walk for every entry),
+// big directories are stat'ed by many threads. Listings are kept in cache until inotify
+// reports change in directory or this file system changes it. Paths in listing are relative
+// to device root, so listing is stored for directory and root of device.
+//
+
+#define DIR_CACHE_MAX_ENTRIES		128
+#define DIR_CACHE_MAX_SIZE			( 64 * 1024 * 1024 )
+#define DIR_CACHE_TTL				30		// seconds, changes inside subdirectories are not reported by inotify
+#define DIR_PARALLEL_MIN_ENTRIES	2048	// bigger directories are stat'ed by many threads
+#define DIR_PARALLEL_MAX_THREADS	8
+
+typedef struct DirCacheEntry
+{
+	struct DirCacheEntry		*dce_Next;
+	char						*dce_Path;			// absolute directory path
+	char						*dce_Root;			// root path of device (f_Path) which made listing
+	int							dce_WD;				// inotify watch descriptor
+	char						*dce_Data;			// Dir output, NULL when not stored
+	int							dce_Size;
+	unsigned int				dce_Generation;		// changed when directory was modified
+	time_t						dce_Time;
+	time_t						dce_LastUse;
+}DirCacheEntry;
+
+static pthread_mutex_t dirCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static DirCacheEntry *dirCache = NULL;
+static int dirCacheCount = 0;
+static FQUAD dirCacheSize = 0;
+static int dirCacheFD = -1;
+static int dirCacheUsers = 0;
+static pthread_t dirCacheThread;
+static volatile int dirCacheQuit = FALSE;
+
+typedef struct DirItem
+{
+	int							di_Name;			// offset of name in names buffer
+	int							di_OK;				// stat was successful
+	struct stat					di_Stat;
+}DirItem;
+
+typedef struct DirStatJob
+{
+	int							dsj_FD;
+	char						*dsj_Names;
+	DirItem						*dsj_Items;
+	int							dsj_Start;
+	int							dsj_End;
+}DirStatJob;
+
+//
+// release cache entry, must be called with dirCacheMutex locked
+//
+
+static void DirCacheEntryRemove( DirCacheEntry *rem )
+{
+	DirCacheEntry **de = &dirCache;
+	FBOOL watchUsed = FALSE;
+	
+	while( *de != NULL )
+	{
+		if( *de == rem )
+		{
+			*de = rem->dce_Next;
+			continue;
+		}
+		if( (*de)->dce_WD == rem->dce_WD )
+		{
+			watchUsed = TRUE;
+		}
+		de = &((*de)->dce_Next);
+	}
+	
+	// same directory can be reached by different paths
+	if( watchUsed == FALSE && rem->dce_WD >= 0 && dirCacheFD >= 0 )
+	{
+		inotify_rm_watch( dirCacheFD, rem->dce_WD );
+	}
+	
+	if( rem->dce_Data != NULL )
+	{
+		dirCacheSize -= rem->dce_Size;
+		FFree( rem->dce_Data );
+	}
+	FFree( rem->dce_Path );
+	FFree( rem->dce_Root );
+	FFree( rem );
+	dirCacheCount--;
+}
+
+//
+// inotify thread, removes listings of changed directories
+//
+
+static void *DirCacheThread( void *data )
+{
+	char buffer[ 16384 ] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	
+	while( dirCacheQuit == FALSE )
+	{
+		struct pollfd pfd;
+		pfd.fd = dirCacheFD;
+		pfd.events = POLLIN;
+		
+		if( poll( &pfd, 1, 500 ) <= 0 )
+		{
+			continue;
+		}
+		
+		int len = read( dirCacheFD, buffer, sizeof(buffer) );
+		if( len <= 0 )
+		{
+			continue;
+		}
+		
+		pthread_mutex_lock( &dirCacheMutex );
+		
+		char *ptr = buffer;
+		while( ptr < buffer + len )
+		{
+			struct inotify_event *ev = (struct inotify_event *)ptr;
+			DirCacheEntry *de = dirCache;
+			
+			while( de != NULL )
+			{
+				DirCacheEntry *next = de->dce_Next;
+				if( de->dce_WD == ev->wd )
+				{
+					de->dce_Generation++;
+					if( de->dce_Data != NULL )
+					{
+						dirCacheSize -= de->dce_Size;
+						FFree( de->dce_Data );
+						de->dce_Data = NULL;
+					}
+					// directory was removed, watch does not exist anymore
+					if( ev->mask & IN_IGNORED )
+					{
+						de->dce_WD = -1;
+						DirCacheEntryRemove( de );
+					}
+				}
+				de = next;
+			}
+			ptr += sizeof( struct inotify_event ) + ev->len;
+		}
+		
+		pthread_mutex_unlock( &dirCacheMutex );
+	}
+	return NULL;
+}
+
+//
+// start directory cache
+//
+
+static void DirCacheInit()
+{
+	pthread_mutex_lock( &dirCacheMutex );
+	if( dirCacheUsers++ == 0 )
+	{
+		dirCacheFD = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if( dirCacheFD >= 0 )
+		{
+			dirCacheQuit = FALSE;
+			if( pthread_create( &dirCacheThread, NULL, DirCacheThread, NULL ) != 0 )
+			{
+				close( dirCacheFD );
+				dirCacheFD = -1;
+			}
+		}
+		else
+		{
+			FERROR("[FSYSLOCAL] Cannot initialize inotify, directory listings will not be cached\n");
+		}
+	}
+	pthread_mutex_unlock( &dirCacheMutex );
+}
+
+//
+// stop directory cache and release all listings
+//
+
+static void DirCacheDeinit()
+{
+	pthread_mutex_lock( &dirCacheMutex );
+	if( --dirCacheUsers > 0 || dirCacheFD < 0 )
+	{
+		pthread_mutex_unlock( &dirCacheMutex );
+		return;
+	}
+	dirCacheQuit = TRUE;
+	pthread_mutex_unlock( &dirCacheMutex );
+	
+	pthread_join( dirCacheThread, NULL );
+	
+	pthread_mutex_lock( &dirCacheMutex );
+	while( dirCache != NULL )
+	{
+		DirCacheEntryRemove( dirCache );
+	}
+	close( dirCacheFD );
+	dirCacheFD = -1;
+	pthread_mutex_unlock( &dirCacheMutex );
+}
+
+//
+// get listing from cache. When listing is not available entry is prepared
+// (directory is watched) and generation which must be passed to DirCachePut is returned
+//
+
+static BufString *DirCacheGet( const char *root, const char *dpath, unsigned int *generation )
+{
+	BufString *bs = NULL;
+	time_t now = time( NULL );
+	
+	pthread_mutex_lock( &dirCacheMutex );
+	if( dirCacheFD < 0 )
+	{
+		pthread_mutex_unlock( &dirCacheMutex );
+		return NULL;
+	}
+	
+	DirCacheEntry *de = dirCache;
+	while( de != NULL )
+	{
+		if( strcmp( de->dce_Path, dpath ) == 0 && strcmp( de->dce_Root, root ) == 0 )
+		{
+			break;
+		}
+		de = de->dce_Next;
+	}
+	
+	if( de == NULL )
+	{
+		// oldest entry is removed when there is no space
+		if( dirCacheCount >= DIR_CACHE_MAX_ENTRIES )
+		{
+			DirCacheEntry *old = dirCache;
+			DirCacheEntry *it = dirCache;
+			while( it != NULL )
+			{
+				if( it->dce_LastUse < old->dce_LastUse )
+				{
+					old = it;
+				}
+				it = it->dce_Next;
+			}
+			DirCacheEntryRemove( old );
+		}
+		
+		int wd = inotify_add_watch( dirCacheFD, dpath, IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF );
+		if( wd >= 0 && ( de = FCalloc( 1, sizeof( DirCacheEntry ) ) ) != NULL )
+		{
+			de->dce_Path = StringDup( dpath );
+			de->dce_Root = StringDup( root );
+			if( de->dce_Path != NULL && de->dce_Root != NULL )
+			{
+				de->dce_WD = wd;
+				de->dce_LastUse = now;
+				de->dce_Next = dirCache;
+				dirCache = de;
+				dirCacheCount++;
+			}
+			else
+			{
+				if( de->dce_Path != NULL ) FFree( de->dce_Path );
+				if( de->dce_Root != NULL ) FFree( de->dce_Root );
+				FFree( de );
+				de = NULL;
+			}
+		}
+	}
+	
+	if( de != NULL )
+	{
+		if( de->dce_Data != NULL && ( now - de->dce_Time ) < DIR_CACHE_TTL )
+		{
+			if( ( bs = BufStringNewSize( de->dce_Size + 1 ) ) != NULL )
+			{
+				BufStringAddSize( bs, de->dce_Data, de->dce_Size );
+			}
+		}
+		de->dce_LastUse = now;
+		*generation = de->dce_Generation;
+	}
+	
+	pthread_mutex_unlock( &dirCacheMutex );
+	
+	return bs;
+}
+
+//
+// store listing in cache, listing is not stored when directory was changed while it was read
+//
+
+static void DirCachePut( const char *root, const char *dpath, unsigned int generation, BufString *bs )
+{
+	if( bs->bs_Size > DIR_CACHE_MAX_SIZE / 4 || strncmp( bs->bs_Buffer, "ok", 2 ) != 0 )
+	{
+		return;
+	}
+	
+	pthread_mutex_lock( &dirCacheMutex );
+	
+	DirCacheEntry *de = dirCache;
+	while( de != NULL )
+	{
+		if( strcmp( de->dce_Path, dpath ) == 0 && strcmp( de->dce_Root, root ) == 0 )
+		{
+			break;
+		}
+		de = de->dce_Next;
+	}
+	
+	if( de != NULL && de->dce_Generation == generation && de->dce_WD >= 0 )
+	{
+		char *data = FMalloc( bs->bs_Size );
+		if( data != NULL )
+		{
+			memcpy( data, bs->bs_Buffer, bs->bs_Size );
+			if( de->dce_Data != NULL )
+			{
+				dirCacheSize -= de->dce_Size;
+				FFree( de->dce_Data );
+			}
+			de->dce_Data = data;
+			de->dce_Size = bs->bs_Size;
+			de->dce_Time = time( NULL );
+			dirCacheSize += de->dce_Size;
+			
+			// release oldest listings when cache is too big
+			while( dirCacheSize > DIR_CACHE_MAX_SIZE )
+			{
+				DirCacheEntry *old = NULL;
+				DirCacheEntry *it = dirCache;
+				while( it != NULL )
+				{
+					if( it != de && it->dce_Data != NULL && ( old == NULL || it->dce_LastUse < old->dce_LastUse ) )
+					{
+						old = it;
+					}
+					it = it->dce_Next;
+				}
+				if( old == NULL )
+				{
+					break;
+				}
+				DirCacheEntryRemove( old );
+			}
+		}
+	}
+	
+	pthread_mutex_unlock( &dirCacheMutex );
+}
+
+//
+// compare directory path with cached one, repeated '/' are treated as one.
+// When prefix is TRUE cached path only has to start with path
+//
+
+static FBOOL DirCachePathMatch( const char *path, const char *cached, FBOOL prefix )
+{
+	while( *path != 0 && *cached != 0 )
+	{
+		if( *path != *cached )
+		{
+			return FALSE;
+		}
+		if( *path == '/' )
+		{
+			while( path[ 1 ] == '/' ) path++;
+			while( cached[ 1 ] == '/' ) cached++;
+		}
+		path++;
+		cached++;
+	}
+	return *path == 0 && ( prefix == TRUE || *cached == 0 );
+}
+
+//
+// drop listings which are changed by operation on path (file or directory): listing of parent
+// directory and listings of path and its subdirectories. inotify reports change later, so
+// listing is dropped now and listing which is read at the same time is not stored.
+//
+
+static void DirCacheDrop( const char *path )
+{
+	if( path == NULL )
+	{
+		return;
+	}
+	
+	int len = strlen( path );
+	while( len > 1 && path[ len - 1 ] == '/' )
+	{
+		len--;
+	}
+	
+	char *dir = FMalloc( len + 2 );
+	if( dir == NULL )
+	{
+		return;
+	}
+	memcpy( dir, path, len );
+	dir[ len ] = '/';
+	dir[ len + 1 ] = 0;
+	
+	// parent directory, with '/' on the end like cached paths
+	char *parent = StringDup( dir );
+	if( parent != NULL )
+	{
+		char *slash = NULL;
+		int i;
+		for( i = len - 1 ; i >= 0 ; i-- )
+		{
+			if( parent[ i ] == '/' )
+			{
+				slash = &(parent[ i ]);
+				break;
+			}
+		}
+		if( slash != NULL )
+		{
+			slash[ 1 ] = 0;
+		}
+	}
+	
+	pthread_mutex_lock( &dirCacheMutex );
+	
+	DirCacheEntry *de = dirCache;
+	while( de != NULL )
+	{
+		if( DirCachePathMatch( dir, de->dce_Path, TRUE ) || ( parent != NULL && DirCachePathMatch( parent, de->dce_Path, FALSE ) ) )
+		{
+			de->dce_Generation++;
+			if( de->dce_Data != NULL )
+			{
+				dirCacheSize -= de->dce_Size;
+				FFree( de->dce_Data );
+				de->dce_Data = NULL;
+			}
+		}
+		de = de->dce_Next;
+	}
+	
+	pthread_mutex_unlock( &dirCacheMutex );
+	
+	if( parent != NULL )
+	{
+		FFree( parent );
+	}
+	FFree( dir );
+}
+
+//
+// stat part of directory entries
+//
+
+static void *DirStatThread( void *data )
+{
+	DirStatJob *job = (DirStatJob *)data;
+	int i;
+	
+	for( i = job->dsj_Start ; i < job->dsj_End ; i++ )
+	{
+		DirItem *di = &(job->dsj_Items[ i ]);
+		di->di_OK = fstatat( job->dsj_FD, job->dsj_Names + di->di_Name, &(di->di_Stat), 0 ) == 0;
+	}
+	return NULL;
+}
+
+//
+// read directory content and put it into bs in Dir format
+//
+
+static void DirList( File *s, const char *dpath, BufString *bs )
+{
+	int dfd = open( dpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	DIR *d = NULL;
+	
+	if( dfd < 0 || ( d = fdopendir( dfd ) ) == NULL )
+	{
+		if( dfd >= 0 )
+		{
+			close( dfd );
+		}
+		BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
+		return;
+	}
+	
+	//
+	// read names
+	//
+	
+	DirItem *items = NULL;
+	char *names = NULL;
+	int count = 0, itemsSize = 0;
+	int namesLen = 0, namesSize = 0;
+	struct dirent *dir;
+	
+	while( ( dir = readdir( d ) ) != NULL )
+	{
+		if( strcmp( dir->d_name, "." ) == 0 || strcmp( dir->d_name, ".." ) == 0 )
+		{
+			continue;
+		}
+		
+		int len = strlen( dir->d_name ) + 1;
+		if( count >= itemsSize )
+		{
+			int nsize = itemsSize == 0 ? 256 : itemsSize * 2;
+			DirItem *nitems = realloc( items, nsize * sizeof( DirItem ) );
+			if( nitems == NULL )
+			{
+				break;
+			}
+			items = nitems;
+			itemsSize = nsize;
+		}
+		if( namesLen + len > namesSize )
+		{
+			int nsize = namesSize == 0 ? 8192 : namesSize * 2;
+			while( nsize < namesLen + len )
+			{
+				nsize *= 2;
+			}
+			char *nnames = realloc( names, nsize );
+			if( nnames == NULL )
+			{
+				break;
+			}
+			names = nnames;
+			namesSize = nsize;
+		}
+		memcpy( names + namesLen, dir->d_name, len );
+		items[ count ].di_Name = namesLen;
+		items[ count ].di_OK = FALSE;
+		namesLen += len;
+		count++;
+	}
+	
+	//
+	// stat entries, relative to directory descriptor
+	//
+	
+	DirStatJob jobs[ DIR_PARALLEL_MAX_THREADS ];
+	int nthreads = 1;
+	
+	if( count >= DIR_PARALLEL_MIN_ENTRIES )
+	{
+		long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+		nthreads = count / ( DIR_PARALLEL_MIN_ENTRIES / 2 );
+		if( nthreads > cpus ) nthreads = (int)cpus;
+		if( nthreads > DIR_PARALLEL_MAX_THREADS ) nthreads = DIR_PARALLEL_MAX_THREADS;
+		if( nthreads < 1 ) nthreads = 1;
+	}
+	
+	{
+		pthread_t threads[ DIR_PARALLEL_MAX_THREADS ];
+		FBOOL started[ DIR_PARALLEL_MAX_THREADS ];
+		int i;
+		
+		for( i = 0 ; i < nthreads ; i++ )
+		{
+			jobs[ i ].dsj_FD = dfd;
+			jobs[ i ].dsj_Names = names;
+			jobs[ i ].dsj_Items = items;
+			jobs[ i ].dsj_Start = ( count * i ) / nthreads;
+			jobs[ i ].dsj_End = ( count * ( i + 1 ) ) / nthreads;
+			started[ i ] = FALSE;
+			
+			// first part is done by calling thread
+			if( i > 0 && pthread_create( &threads[ i ], NULL, DirStatThread, &jobs[ i ] ) == 0 )
+			{
+				started[ i ] = TRUE;
+			}
+		}
+		
+		DirStatThread( &jobs[ 0 ] );
+		
+		for( i = 1 ; i < nthreads ; i++ )
+		{
+			if( started[ i ] == TRUE )
+			{
+				pthread_join( threads[ i ], NULL );
+			}
+			else
+			{
+				DirStatThread( &jobs[ i ] );
+			}
+		}
+	}
+	
+	//
+	// create response, format is same like in FillStatLocal
+	//
+	
+	const char *relPath = dpath + strlen( s->f_Path );
+	int relLen = strlen( relPath );
+	char *line = FMalloc( relLen + 1024 );
+	time_t lastTime = -1;
+	char timeStr[ 40 ];
+	int pos = 0;
+	int i;
+	
+	BufStringAdd( bs, "ok<!--separate-->[" );
+	
+	for( i = 0 ; i < count && line != NULL ; i++ )
+	{
+		DirItem *di = &(items[ i ]);
+		if( di->di_OK == FALSE )
+		{
+			continue;
+		}
+		
+		const char *name = names + di->di_Name;
+		FBOOL isDir = S_ISDIR( di->di_Stat.st_mode );
+		
+		if( di->di_Stat.st_mtime != lastTime )
+		{
+			struct tm tm;
+			localtime_r( &(di->di_Stat.st_mtime), &tm );
+			strftime( timeStr, 36, "%Y-%m-%d %H:%M:%S", &tm );
+			lastTime = di->di_Stat.st_mtime;
+		}
+		
+		int len = snprintf( line, relLen + 1024, "%s{ \"Filename\":\"", pos != 0 ? "," : "" );
+		BufStringAddSize( bs, line, len );
+		BufStringAdd( bs, name );
+		
+		len = snprintf( line, relLen + 1024, "\",\"Path\":\"%s", relPath );
+		BufStringAddSize( bs, line, len );
+		BufStringAdd( bs, name );
+		
+		len = snprintf( line, relLen + 1024, "%s\",\"Filesize\": %lld,\"DateModified\": \"%s\",%s",
+			isDir ? "/" : "", (long long)di->di_Stat.st_size, timeStr,
+			isDir ? "\"MetaType\":\"Directory\",\"Type\":\"Directory\" }" : "\"MetaType\":\"File\",\"Type\":\"File\" }" );
+		BufStringAddSize( bs, line, len );
+		pos++;
+	}
+	
+	BufStringAdd( bs, "]" );
+	
+	if( line != NULL )
+	{
+		FFree( line );
+	}
+	if( items != NULL )
+	{
+		free( items );
+	}
+	if( names != NULL )
+	{
+		free( names );
+	}
+	
+	closedir( d );
+}
+
 //
 // return content of directory
 //
 	
 BufString *Dir( File *s, const char *path )
 {
-	BufString *bs = BufStringNew();
+	BufString *bs = NULL;
 	
 	int rspath = strlen( s->f_Path );
 	
 	DEBUG("Dir!\n");
 	
-	// user is trying to get access to not his directory
-	
-	
-	int doub = strlen( s->f_Name );
-	
 	char *comm = NULL;
-	char *tempString = FCalloc( rspath +512, sizeof(char) );
 	
-	if( ( comm = FCalloc( rspath +512, sizeof(char) ) ) != NULL )
+	if( ( comm = FCalloc( rspath + ( path != NULL ? strlen( path ) : 0 ) + 4, sizeof(char) ) ) != NULL )
 	{
 		strcpy( comm, s->f_Path );
-		if( comm[ strlen( comm ) -1 ] != '/' && s->f_Path[ strlen(s->f_Path)-1 ] != '/' )
+		if( comm[ strlen( comm ) -1 ] != '/' )
 		{
-			DEBUG("Added '/\n");
 			strcat( comm, "/" );
 		}
 		
 		if( path != NULL )
 		{
-			strcat( comm, path ); //&(path[ doub+1 ]) );
+			strcat( comm, path );
 		}
 		
  		if( comm[ strlen( comm ) -1 ] != '/' )
 		{
-			DEBUG("end was not endeed /\n");
 			strcat( comm, "/" );
 		}
 	
-		DIR *d;
-		struct dirent *dir;
-		
-		DEBUG("DIR -> directory '%s' for path '%s' devname '%s' double %d devpath '%s'\n", comm, path, s->f_Name, doub, s->f_Path );
+		DEBUG("DIR -> directory '%s' for path '%s' devname '%s' devpath '%s'\n", comm, path, s->f_Name, s->f_Path );
 		
-		d = opendir( comm );
+		unsigned int generation = 0;
 		
-		if( d )
+		if( ( bs = DirCacheGet( s->f_Path, comm, &generation ) ) == NULL )
 		{
-			int pos = 0;
-			
-			BufStringAdd( bs, "ok<!--separate-->");
-			
-			//BufStringAdd( bs, "ok<!--separate-->[" );
-			BufStringAdd( bs, "[" );
-			while ((dir = readdir(d)) != NULL)
+			bs = BufStringNewSize( 4096 );
+			if( bs != NULL )
 			{
-				
-				if( dir->d_name[ 0 ] == '/' )
-				{
-					sprintf( tempString, "%s%s", comm, &(dir->d_name[1]) );
-				}
-				else
-				{
-					sprintf( tempString, "%s%s", comm, dir->d_name );
-				}
-				
-				struct stat ls;
-				
-				//DEBUG("---------------> %s\n", dir->d_name );
-		
-				if( stat( tempString, &ls ) == 0 )
-				{
-					if( !(strcmp( dir->d_name, "." ) == 0 || strcmp( dir->d_name, ".." ) == 0 ) )
-					{
-						if( pos != 0 )
-						{
-							BufStringAdd( bs, "," );
-						}
-						FillStatLocal( bs, &ls, s, tempString );
-						pos++;
-					}
-				}
+				DirList( s, comm, bs );
+				DirCachePut( s->f_Path, comm, generation, bs );
 			}
-			BufStringAdd( bs, "]" );
-			
-			closedir( d );
-		}
-		else
-		{
-			BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
 		}
 		
 		FFree( comm );
 	}
-	FFree( tempString );
+	
+	if( bs == NULL )
+	{
+		bs = BufStringNew();
+	}
 	DEBUG("Dir END\n");
 	
 	return bs;
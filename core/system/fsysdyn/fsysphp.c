@@ -50,6 +50,7 @@
 typedef struct SpecialData
 {
 	FILE *fp;
+	PHPPoolRequest *pr;		// stream served by php pool
 	char *type;
 	char *module;
 	//char *SessionID;
@@ -164,41 +165,18 @@ char *GetFileName( const char *path )
 // php call, send request, read answer
 //
 
-ListString *PHPCall( const char *command, int *length )
+ListString *PHPCall( SystemBase *sb, const char *command, int *length )
 {
-	DEBUG("[PHPFsys] run app: '%s'\n", command );
-	//Log( FLOG_INFO, "[PHPFsys] run app: '%s'\n", command );
+	DEBUG("[PHPFsys] run module: '%s'\n", command );
+	//Log( FLOG_INFO, "[PHPFsys] run module: '%s'\n", command );
 	
-	FILE *pipe = popen( command, "r" );
-	if( !pipe )
+	// script is served by persistent php worker (or popen when pool is disabled)
+	ListString *data = sb->sl_PHPPoolInterface.PHPPoolRun( sb->sl_PHPPool, "modules/system/module.php", &command, 1 );
+	if( data == NULL )
 	{
-		//free( command );
-		FERROR("[PHPFsys] cannot open pipe: %s\n", strerror(errno) );
+		FERROR("[PHPFsys] cannot run php module\n" );
 		return NULL;
 	}
-	
-	char *temp = NULL, *result = NULL, *gptr = NULL;
-	int size = 0, res = 0, sch = sizeof( char );
-
-#define PHP_READ_SIZE 262144
-	
-	//DEBUG("[PHPFsys] command launched\n");
-
-	char buf[ PHP_READ_SIZE ]; memset( buf, '\0', PHP_READ_SIZE );
-	ListString *data = ListStringNew();
-	
-	while( !feof( pipe ) )
-	{
-		// Make a new buffer and read
-		size = fread( buf, sch, PHP_READ_SIZE, pipe );
-		//DEBUG( "[PHPFsys] Adding %d of data\n", size );
-		ListStringAdd( data, buf, size );
-	}
-	
-	// Free pipe if it's there
-	pclose( pipe );
-	
-	ListStringJoin( data );		//we join all string into one buffer
 
 	// Set the length
 	if( length != NULL ) *length = data->ls_Size;
@@ -346,10 +324,8 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usr )
 				( usr->u_MainSessionID ? strlen( usr->u_MainSessionID ) : 0 ) + 1;
 			
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 			
 			if( command != NULL )
 			{
@@ -365,12 +341,12 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usr )
 						path ? path : "", 
 						module ? module : "files", 
 						usr->u_MainSessionID ? usr->u_MainSessionID : ""  );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 			
 					// Execute!
 					int answerLength = 0;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sb, command, &answerLength );
 					FFree( command );
 			
 					if( result && result->ls_Size >= 0 )
@@ -476,10 +452,8 @@ int UnMount( struct FHandler *s, void *f )
 				( lf->f_SessionID ? strlen( lf->f_SessionID ) : 0 )
 				+ 1;
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 			
 			if( command != NULL )
 			{
@@ -491,11 +465,11 @@ int UnMount( struct FHandler *s, void *f )
 				{
 					snprintf( commandCnt, cmdLength, "command=dosaction&action=unmount&devname=%s&module=%s&sessionid=%s",
 						lf->f_Name ? lf->f_Name : "", sd->module ? sd->module : "files", lf->f_SessionID ? lf->f_SessionID : "" );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 			
 					int answerLength = 0;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sd->sb, command, &answerLength );
 					
 					FFree( command );
 					
@@ -567,10 +541,8 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		( encodedcomm ? strlen( encodedcomm ) : 0 ) +
 		( mode ? strlen( mode ) : 0 ) + 1;
 	
-	// Whole command
-	char *command = FCalloc(
-		strlen( "php \"modules/system/module.php\" \"\";" ) +
-		cmdLength + 1, sizeof( char ) );
+	// Module arguments
+	char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 	
 	if( command != NULL )
 	{
@@ -582,7 +554,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		{
 			snprintf( commandCnt, cmdLength, "type=%s&module=files&args=false&command=read&authkey=false&sessionid=%s&path=%s&mode=%s",
 				sd->type ? sd->type : "", s->f_SessionID ? s->f_SessionID : "", encodedcomm ? encodedcomm : "", mode ? mode : "" );
-			sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+			strcpy( command, FilterPHPVar( commandCnt ) );
 			FFree( commandCnt );
 		}
 	}
@@ -599,12 +571,14 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 	
 	if( strcmp( mode, "rs" ) == 0 )
 	{
-		FILE *pipe = popen( command, "r" );
-		if( !pipe )
+		SystemBase *sb = (SystemBase *)sd->sb;
+		const char *args = command;
+		PHPPoolRequest *pr = sb->sl_PHPPoolInterface.PHPPoolOpen( sb->sl_PHPPool, "modules/system/module.php", &args, 1 );
+		if( !pr )
 		{
 			FFree( command );
 			FFree( encodedcomm );
-			FERROR("[PHPFsys] cannot open pipe\n");
+			FERROR("[PHPFsys] cannot start php module\n");
 			return NULL;
 		}
 	
@@ -615,10 +589,9 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 	
 			if( ( locfil->f_SpecialData = FCalloc( 1, sizeof( SpecialData ) ) ) != NULL )
 			{
-				sd->fp = pipe; 
 				SpecialData *locsd = (SpecialData *)locfil->f_SpecialData;
 				locsd->sb = sd->sb;
-				locsd->fp = pipe;
+				locsd->pr = pr;
 				locsd->mode = MODE_READ;
 				//locsd->fname = StringDup( tmpfilename );
 				locsd->path = StringDup( path );
@@ -637,6 +610,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		}
 		else
 		{
+			sb->sl_PHPPoolInterface.PHPPoolClose( pr );
 			FFree( command );
 			FFree( encodedcomm );
 			FERROR("[PHPFsys] cannot alloc memory\n");
@@ -686,7 +660,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		DEBUG( "[fsysphp] %s\n", command );
 
 		int answerLength = 0;			
-		ListString *result = PHPCall( command, &answerLength );
+		ListString *result = PHPCall( sd->sb, command, &answerLength );
 
 		// Open a file pointer
 		if( result )
@@ -842,16 +816,16 @@ int FileClose( struct File *s, void *fp )
 		{
 			SpecialData *sd = ( SpecialData *)lfp->f_SpecialData;
 			
+			if( sd->pr )
+			{
+				SystemBase *sb = (SystemBase *)sd->sb;
+				sb->sl_PHPPoolInterface.PHPPoolClose( sd->pr );
+				sd->pr = NULL;
+			}
+			
 			if( sd->fp )
 			{
-				if( lfp->f_Stream == TRUE )
-				{
-					closeerr = pclose( ( FILE *)sd->fp );
-				}
-				else
-				{
-					closeerr = fclose( ( FILE *)sd->fp );
-				}
+				closeerr = fclose( ( FILE *)sd->fp );
 				sd->fp = NULL;
 			}
 			
@@ -887,10 +861,8 @@ int FileClose( struct File *s, void *fp )
 					( encPath ? strlen( encPath ) : 0 ) + 
 					( sd->fname ? strlen( sd->fname ) : 0 ) + 1;
 				
-				// Whole command
-				char *command = FCalloc(
-					strlen( "php \"modules/system/module.php\" \"\";" ) +
-					cmdLength + 1, sizeof( char ) );
+				// Module arguments
+				char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 	
 				if( command != NULL )
 				{
@@ -902,7 +874,7 @@ int FileClose( struct File *s, void *fp )
 					{
 						snprintf( commandCnt, cmdLength, "module=files&command=write&sessionid=%s&path=%s&tmpfile=%s",
 							lfp->f_SessionID ? lfp->f_SessionID : "", encPath ? encPath : "", sd->fname ? sd->fname : "" );
-						sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+						strcpy( command, FilterPHPVar( commandCnt ) );
 						FFree( commandCnt );
 				
 						//INFO("Call write command %s\n", command );
@@ -910,7 +882,7 @@ int FileClose( struct File *s, void *fp )
 	
 						int answerLength = 0;
 		
-						ListString *result = PHPCall( command, &answerLength );
+						ListString *result = PHPCall( sd->sb, command, &answerLength );
 						if( result != NULL )
 						{
 							DEBUG( "[fsysphp] Closed file using PHP call.\n" );
@@ -971,21 +943,20 @@ int FileRead( struct File *f, char *buffer, int rsize )
 		if( f->f_Stream == TRUE )
 		{
 			SpecialData *sd = (SpecialData *)f->f_SpecialData;
+			SystemBase *sb = (SystemBase *)sd->sb;
 			
-			if( feof( sd->fp ) )
+			// Make a new buffer and read
+			result = sb->sl_PHPPoolInterface.PHPPoolRead( sd->pr, buffer, rsize );
+			if( result <= 0 )
 			{
 				DEBUG("[fsysphp] EOF\n");
 				return -1;
 			}
-
-			// Make a new buffer and read
-			result = fread( buffer, 1, rsize, sd->fp  );
 			//DEBUG( "[PHPFsys] Adding %ul of data\n", result );
 			
 			if( f->f_Socket )
 			{
 				char *ptr = strstr( buffer, "---http-headers-end---\n" );
-				SystemBase *sb = (SystemBase *)sd->sb;
 				
 				if( ptr != NULL && result > 23 )
 				{
@@ -1059,10 +1030,8 @@ char *InfoGet( struct File *f, const char *path, const char *key )
 			( lf->f_SessionID ? strlen( lf->f_SessionID ) : 0 ) +
 			( urlKey == NULL ? 1 : strlen( urlKey ) ) + 1;
 		
-		// Whole command
-		char *command = FCalloc(
-			strlen( "php \"modules/system/module.php\" \"\";" ) +
-			cmdLength + 1, sizeof( char ) );
+		// Module arguments
+		char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 		
 		if( command != NULL )
 		{	
@@ -1074,11 +1043,11 @@ char *InfoGet( struct File *f, const char *path, const char *key )
 			{
 				snprintf( commandCnt, cmdLength, "command=infoget&path=%s&module=files&sessionid=%s&key=%s",
 					urlPath ? urlPath : "", lf->f_SessionID ? lf->f_SessionID : "", urlKey == NULL ? "*" : urlKey );
-				sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+				strcpy( command, FilterPHPVar( commandCnt ) );
 				FFree( commandCnt );
 	
 				int answerLength = 0;
-				ListString *result = PHPCall( command, &answerLength );
+				ListString *result = PHPCall( sd->sb, command, &answerLength );
 				
 				FFree( command );
 				
@@ -1158,10 +1127,8 @@ int MakeDir( struct File *f, const char *path )
 			( f->f_SessionID ? strlen( f->f_SessionID ) : 0 ) +
 			( comm ? strlen( comm ) : 0 ) + 1;
 		
-		// Whole command
-		char *command = FCalloc(
-			strlen( "php \"modules/system/module.php\" \"\";" ) +
-			cmdLength + 1, sizeof( char ) );
+		// Module arguments
+		char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 		
 		if( command != NULL )
 		{	
@@ -1173,14 +1140,14 @@ int MakeDir( struct File *f, const char *path )
 			{
 				snprintf( commandCnt, cmdLength, "module=files&command=dosaction&action=makedir&sessionid=%s&path=%s",
 					f->f_SessionID ? f->f_SessionID : "", comm ? comm : "" );
-				sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+				strcpy( command, FilterPHPVar( commandCnt ) );
 				FFree( commandCnt );
 			
 				DEBUG("[fsysphp] MAKEDIR %s\n", command );
 	
 				int answerLength = 0;
 		
-				ListString *result = PHPCall( command, &answerLength );
+				ListString *result = PHPCall( sd->sb, command, &answerLength );
 		
 				if( result && result->ls_Size >= 0 )
 				{
@@ -1246,10 +1213,8 @@ FQUAD Delete( struct File *s, const char *path )
 			( s->f_SessionID ? strlen( s->f_SessionID ) : 0 ) +
 			( comm ? strlen( comm ) : 0 ) + 1;
 	
-		// Whole command
-		char *command = FCalloc(
-			strlen( "php \"modules/system/module.php\" \"\";" ) +
-			cmdLength + 1, sizeof( char ) );
+		// Module arguments
+		char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 
 		if( command != NULL )
 		{
@@ -1261,13 +1226,13 @@ FQUAD Delete( struct File *s, const char *path )
 			{					
 				snprintf( commandCnt, cmdLength, "module=files&command=dosaction&action=delete&sessionid=%s&path=%s",
 					s->f_SessionID ? s->f_SessionID : "", comm ? comm : "" );
-				sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+				strcpy( command, FilterPHPVar( commandCnt ) );
 				FFree( commandCnt );
 		
 				SpecialData *sd = (SpecialData *)s->f_SpecialData;
 		
 				int answerLength = 0;
-				ListString *result = PHPCall( command, &answerLength );
+				ListString *result = PHPCall( sd->sb, command, &answerLength );
 		
 				// TODO: we should parse result to get information about success
 				if( result )
@@ -1323,10 +1288,8 @@ int Rename( struct File *s, const char *path, const char *nname )
 				( encPath ? strlen( encPath ) : 0 ) + 
 				( newName ? strlen( newName ) : 0 ) + 1;
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 
 			if( command != NULL )
 			{
@@ -1340,11 +1303,11 @@ int Rename( struct File *s, const char *path, const char *nname )
 					
 					snprintf( commandCnt, cmdLength, "module=files&command=dosaction&action=rename&sessionid=%s&path=%s&newname=%s",
 						s->f_SessionID ? s->f_SessionID : "", encPath ? encPath : "", newName ? newName : "" );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 					
 					int answerLength = 0;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sd->sb, command, &answerLength );
 		
 					// TODO: we should parse result to get information about success
 					if( result )
@@ -1437,10 +1400,8 @@ BufString *Info( File *s, const char *path )
 				( s->f_SessionID ? strlen( s->f_SessionID ) : 0 ) + 
 				( encPath ? strlen( encPath ) : 0 ) + 1;
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 				
 			if( command != NULL )
 			{
@@ -1452,13 +1413,13 @@ BufString *Info( File *s, const char *path )
 				{
 					snprintf( commandCnt, cmdLength, "type=%s&module=files&args=false&command=info&authkey=false&sessionid=%s&path=%s&subPath=",
 						sd->type ? sd->type : "", s->f_SessionID ? s->f_SessionID : "", encPath ? encPath : "" );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 			
 					// Execute!
 					int answerLength = 0;
 					BufString *bs = NULL;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sd->sb, command, &answerLength );
 					if( result != NULL )
 					{
 						bs = BufStringNewSize( result->ls_Size );
@@ -1512,10 +1473,8 @@ BufString *Call( File *s, const char *path, char *args )
 				( encComm ? strlen( encComm ) : 0 ) +
 				( args ? strlen( args ) : 0 ) + 1;
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 			
 			if( command != NULL )
 			{
@@ -1527,12 +1486,12 @@ BufString *Call( File *s, const char *path, char *args )
 				{
 					snprintf( commandCnt, cmdLength, "type=%s&module=files&command=call&authkey=false&sessionid=%s&path=%s&args=%s",
 						sd->type ? sd->type : "", s->f_SessionID ? s->f_SessionID : "", encComm ? encComm : "", args ? args : "" );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 			
 					int answerLength = 0;
 					BufString *bs = NULL;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sd->sb, command, &answerLength );
 					if( result != NULL )
 					{
 						bs =BufStringNewSize( result->ls_Size );
@@ -1585,10 +1544,8 @@ BufString *Dir( File *s, const char *path )
 				( s->f_SessionID ? strlen( s->f_SessionID ) : 0 ) +
 				( encComm ? strlen( encComm ) : 0 ) + 1;
 			
-			// Whole command
-			char *command = FCalloc(
-				strlen( "php \"modules/system/module.php\" \"\";" ) +
-				cmdLength + 1, sizeof( char ) );
+			// Module arguments
+			char *command = FCalloc( cmdLength + 1, sizeof( char ) );
 			
 			if( command != NULL )
 			{
@@ -1600,12 +1557,12 @@ BufString *Dir( File *s, const char *path )
 				{
 					snprintf( commandCnt, cmdLength, "type=%s&module=files&args=false&command=directory&authkey=false&sessionid=%s&path=%s&subPath=",
 						sd->type ? sd->type : "", s->f_SessionID ? s->f_SessionID : "", encComm ? encComm : "" );
-					sprintf( command, "php \"modules/system/module.php\" \"%s\";", FilterPHPVar( commandCnt ) );
+					strcpy( command, FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 		
 					int answerLength;
 					BufString *bs  = NULL;
-					ListString *result = PHPCall( command, &answerLength );
+					ListString *result = PHPCall( sd->sb, command, &answerLength );
 					if( result != NULL )
 					{
 						bs =BufStringNewSize( result->ls_Size );
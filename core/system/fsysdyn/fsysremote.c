@@ -39,10 +39,19 @@
 #include <communication/comm_msg.h>
 #include <system/json/jsmn.h>
 #include <network/socket.h>
+#include <sys/time.h>
 
 #define SUFFIX "fsys"
 #define PREFIX "Remote"
 
+#define RFS_POOL_MAX_IDLE		8		// idle connections kept per remote host
+#define RFS_POOL_IDLE_TIMEOUT	60		// seconds after which idle connection is closed
+#define RFS_READ_TIMEOUT		15		// seconds to wait for response data
+#define RFS_WINDOW_MIN			2		// read/write requests kept in flight by file stream
+#define RFS_WINDOW_START		4
+#define RFS_WINDOW_MAX			16
+#define RFS_WRITE_CHUNK			262144	// written data is collected till it reach this size
+
 /** @file
  * 
  *  Remote file system
@@ -91,8 +100,65 @@ typedef struct SpecialData
 	char							*address;	// hold destination server address
 	int 							port;			// port
 	int								secured;		// is connection secured
+	
+	struct RemotePipe				*pipe;			// requests in flight for opened file
 }SpecialData;
 
+//
+// persistent connection to remote FriendCore
+//
+
+typedef struct RemoteConnection
+{
+	Socket							*rc_Socket;
+	time_t							rc_LastUsed;
+	MinNode							node;
+}RemoteConnection;
+
+//
+// connections pool for one remote FriendCore
+//
+
+typedef struct RemoteHost
+{
+	char							*rh_Address;
+	int								rh_Port;
+	int								rh_Secured;
+	RemoteConnection				*rh_Idle;		// connections ready to use, last used first
+	int								rh_IdleCount;
+	MinNode							node;
+}RemoteHost;
+
+//
+// file stream, next requests are sent before answers for previous ones arrive
+//
+
+typedef struct RemotePipe
+{
+	RemoteConnection				*rp_Connection;
+	DataForm						*rp_ReadMessage;	// read request, only request id is changed
+	FULONG							rp_ID[ RFS_WINDOW_MAX ];		// requests waiting for answer, oldest first
+	FQUAD							rp_Sent[ RFS_WINDOW_MAX ];		// time when request was sent (microseconds)
+	int								rp_Size[ RFS_WINDOW_MAX ];		// bytes sent by write request
+	int								rp_First;
+	int								rp_Count;
+	int								rp_Window;		// number of requests which should be in flight
+	FQUAD							rp_MinRTT;		// shortest round trip time
+	FQUAD							rp_Interval;	// smoothed time between answers
+	FQUAD							rp_LastAnswer;
+	DataForm						*rp_Answer;		// read answer which was not passed to caller completely
+	char							*rp_Data;
+	int								rp_DataSize;
+	int								rp_DataPos;
+	BufString						*rp_WriteBuffer;	// data collected before write request is sent
+	FBOOL							rp_End;			// end of file reached
+	FBOOL							rp_Error;
+}RemotePipe;
+
+static RemoteHost *remoteHosts = NULL;
+static pthread_mutex_t remoteHostsMutex = PTHREAD_MUTEX_INITIALIZER;
+static FULONG remoteRequestID = 0;
+
 //
 //
 //
@@ -133,85 +199,316 @@ void init( struct FHandler *s )
 void deinit( struct FHandler *s )
 {
 	DEBUG("[REMOTEFS] deinit\n");
+	
+	pthread_mutex_lock( &remoteHostsMutex );
+	RemoteHost *rh = remoteHosts;
+	while( rh != NULL )
+	{
+		RemoteHost *nexthost = (RemoteHost *)rh->node.mln_Succ;
+		RemoteConnection *rc = rh->rh_Idle;
+		while( rc != NULL )
+		{
+			RemoteConnection *next = (RemoteConnection *)rc->node.mln_Succ;
+			SocketClose( rc->rc_Socket );
+			FFree( rc );
+			rc = next;
+		}
+		FFree( rh->rh_Address );
+		FFree( rh );
+		rh = nexthost;
+	}
+	remoteHosts = NULL;
+	pthread_mutex_unlock( &remoteHostsMutex );
 }
 
-//
-// connect macro
-//
+/**
+ * Get connection to remote FriendCore from pool or create new one
+ *
+ * @param sd pointer to SpecialData of remote device
+ * @param reused pointer to variable where information if connection was taken from pool will be stored
+ * @return pointer to RemoteConnection or NULL when connection cannot be created
+ */
 
-DataForm *SendMessageRFS( SpecialData *sd, DataForm *df )
+static RemoteConnection *RemoteConnectionGet( SpecialData *sd, FBOOL *reused )
 {
-	MsgItem tags[] = {
-		{ ID_FCRE, (FULONG)0,  (FULONG)NULL },
-		{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
-		{ TAG_DONE, TAG_DONE, TAG_DONE }
-	};
+	RemoteConnection *rc = NULL;
+	time_t now = time( NULL );
+	
+	*reused = FALSE;
+	
+	pthread_mutex_lock( &remoteHostsMutex );
+	RemoteHost *rh = remoteHosts;
+	while( rh != NULL )
+	{
+		if( rh->rh_Port == sd->port && rh->rh_Secured == sd->secured && strcmp( rh->rh_Address, sd->address ) == 0 )
+		{
+			break;
+		}
+		rh = (RemoteHost *)rh->node.mln_Succ;
+	}
+	
+	// take most recently used connection, closed and expired ones are dropped
+	while( rh != NULL && rh->rh_Idle != NULL )
+	{
+		rc = rh->rh_Idle;
+		rh->rh_Idle = (RemoteConnection *)rc->node.mln_Succ;
+		rh->rh_IdleCount--;
+		rc->node.mln_Succ = NULL;
+		
+		if( ( now - rc->rc_LastUsed ) < RFS_POOL_IDLE_TIMEOUT && sd->sb->sl_SocketInterface.SocketIsAlive( rc->rc_Socket ) == TRUE )
+		{
+			*reused = TRUE;
+			break;
+		}
+		sd->sb->sl_SocketInterface.SocketClose( rc->rc_Socket );
+		FFree( rc );
+		rc = NULL;
+	}
+	pthread_mutex_unlock( &remoteHostsMutex );
+	
+	if( rc != NULL )
+	{
+		return rc;
+	}
+	
+	Socket *newsock = sd->sb->sl_SocketInterface.SocketConnectHost( sd->sb, sd->secured, sd->address, sd->port );
+	if( newsock == NULL )
+	{
+		return NULL;
+	}
+	
+	if( ( rc = FCalloc( 1, sizeof( RemoteConnection ) ) ) == NULL )
+	{
+		sd->sb->sl_SocketInterface.SocketClose( newsock );
+		return NULL;
+	}
+	rc->rc_Socket = newsock;
+	
+	DEBUG("[RemoteConnectionGet] New connection to %s:%d created\n", sd->address, sd->port );
+	
+	return rc;
+}
 
-	DEBUG("[SendMessageRFS] message to targetDirect\n");
+/**
+ * Return connection to pool or close it
+ *
+ * @param sd pointer to SpecialData of remote device
+ * @param rc pointer to RemoteConnection
+ * @param reuse set to TRUE if connection can be used again
+ */
+
+static void RemoteConnectionRelease( SpecialData *sd, RemoteConnection *rc, FBOOL reuse )
+{
+	if( reuse == TRUE )
+	{
+		pthread_mutex_lock( &remoteHostsMutex );
+		RemoteHost *rh = remoteHosts;
+		while( rh != NULL )
+		{
+			if( rh->rh_Port == sd->port && rh->rh_Secured == sd->secured && strcmp( rh->rh_Address, sd->address ) == 0 )
+			{
+				break;
+			}
+			rh = (RemoteHost *)rh->node.mln_Succ;
+		}
 		
-	DataForm *ldf = DataFormNew( tags );
+		if( rh == NULL && ( rh = FCalloc( 1, sizeof( RemoteHost ) ) ) != NULL )
+		{
+			rh->rh_Address = StringDuplicate( sd->address );
+			rh->rh_Port = sd->port;
+			rh->rh_Secured = sd->secured;
+			rh->node.mln_Succ = (MinNode *)remoteHosts;
+			remoteHosts = rh;
+		}
 		
-	BufString *bs = NULL;
-	FBYTE *lsdata = NULL;
-	FULONG sockReadSize = 0;
+		if( rh != NULL && rh->rh_IdleCount < RFS_POOL_MAX_IDLE )
+		{
+			rc->rc_LastUsed = time( NULL );
+			rc->node.mln_Succ = (MinNode *)rh->rh_Idle;
+			rh->rh_Idle = rc;
+			rh->rh_IdleCount++;
+			rc = NULL;
+		}
+		pthread_mutex_unlock( &remoteHostsMutex );
+	}
+	
+	if( rc != NULL )
+	{
+		sd->sb->sl_SocketInterface.SocketClose( rc->rc_Socket );
+		FFree( rc );
+	}
+}
 
-	Socket *newsock = sd->sb->sl_SocketInterface.SocketConnectHost( sd->sb, sd->secured, sd->address, sd->port );
-	if( newsock != NULL )
+/**
+ * Get unique id for request sent to remote FriendCore
+ *
+ * @return new request id
+ */
+
+static FULONG RemoteRequestIDNew()
+{
+	pthread_mutex_lock( &remoteHostsMutex );
+	FULONG reqid = ++remoteRequestID;
+	pthread_mutex_unlock( &remoteHostsMutex );
+	return reqid;
+}
+
+/**
+ * Send message to remote FriendCore and read response. Messages and responses are framed by size
+ * stored in header, so connection is kept in pool and used by next calls.
+ *
+ * @param sd pointer to SpecialData of remote device
+ * @param df message which will be send
+ * @param connected pointer to variable where information if connection was established will be stored
+ * @return response or NULL when error appear
+ */
+
+static BufString *RemoteConnectionSend( SpecialData *sd, DataForm *df, FBOOL *connected )
+{
+	*connected = FALSE;
+	
+	// request id is returned by server, it protects us against reading response which belongs to another call
+	FULONG reqid = 0;
+	if( df[ 1 ].df_ID == ID_FRID )
+	{
+		// server echoes whole id, so flag is part of id compared with response
+		reqid = RemoteRequestIDNew() | MSG_FRID_KEEP_ALIVE;
+		df[ 1 ].df_Size = reqid;
+	}
+	
+	int retry;
+	for( retry = 0 ; retry < 2 ; retry++ )
 	{
-		DEBUG("[SendMessageRFS] Connection created, message will be send: %d\n", df->df_Size );
-		int size = sd->sb->sl_SocketInterface.SocketWrite( newsock, (char *)df, (FQUAD)df->df_Size );
-		bs = sd->sb->sl_SocketInterface.SocketReadTillEnd( newsock, 0, 15 );
+		FBOOL reused = FALSE;
+		RemoteConnection *rc = RemoteConnectionGet( sd, &reused );
+		if( rc == NULL )
+		{
+			return NULL;
+		}
+		*connected = TRUE;
 		
-		if( bs != NULL )
+		BufString *bs = NULL;
+		FBOOL closed = TRUE;		// request was not sent or other side closed connection without answer
+		if( sd->sb->sl_SocketInterface.SocketWrite( rc->rc_Socket, (char *)df, (FQUAD)df->df_Size ) == (int)df->df_Size )
 		{
-			DEBUG2("[SendMessageRFS] Received from socket %d\n", bs->bs_Size );
-			lsdata = (FBYTE *)bs->bs_Buffer;
-			sockReadSize = bs->bs_Size;
+			bs = sd->sb->sl_SocketInterface.SocketReadDataForm( rc->rc_Socket, RFS_READ_TIMEOUT, &closed );
 		}
 		
-		if( lsdata != NULL )
+		if( bs != NULL )
 		{
-			//DEBUG2("[CommServClient]:Received bytes %ld CommunicationServiceClient Sending message size: %d server: %128s\n", sockReadSize, df->df_Size, con->cfcc_Name );
-			
-			DataFormAdd( &ldf, lsdata, sockReadSize );
-			
-			ldf->df_Size = sockReadSize;
-			DEBUG2("[SendMessageRFS] ---------------------Added new server to answer serverdfsize %ld sockreadsize %lu\n", ldf->df_Size, sockReadSize );
+			DataForm *rdf = (DataForm *)bs->bs_Buffer;
 			
-			DEBUG2("[SendMessageRFS] Message received '%.*s\n", (int)sockReadSize, lsdata );
+			// streamed response is ended by closing connection
+			FBOOL framed = ( rdf->df_Size > 0 );
 			
-			char *d = (char *)lsdata + (3*COMM_MSG_HEADER_SIZE);
-			if( d[ 0 ] == 'f' && d[ 1 ] == 'a' && d[ 2 ] == 'i' && d[ 3 ] ==  'l' )
+			if( reqid != 0 && bs->bs_Size >= (int)(2*COMM_MSG_HEADER_SIZE) && rdf[ 1 ].df_ID == ID_FRID && rdf[ 1 ].df_Size != reqid )
 			{
-				//char *tmp = "user session not found"; //22
-				char *tmp = "device not found      ";
-				
-				if( strcmp( d, "fail<!--separate-->{\"response\":\"user session not found\"}" ) == 0 )
-				{
-					d += 33;
-					memcpy( d, tmp, 22 );
-				}
+				FERROR("[RemoteConnectionSend] Response id %lu do not match request %lu\n", rdf[ 1 ].df_Size, reqid );
+				BufStringDelete( bs );
+				RemoteConnectionRelease( sd, rc, FALSE );
+				return NULL;
 			}
+			
+			RemoteConnectionRelease( sd, rc, framed );
+			return bs;
 		}
-		else
+		
+		RemoteConnectionRelease( sd, rc, FALSE );
+		
+		// pooled connection could be closed by server in meantime, try once with new one
+		// request is not sent again when server could process it (timeout, partial answer), write, delete etc. would run twice
+		if( reused == FALSE || closed == FALSE )
 		{
-			DataFormAdd( &ldf, (FBYTE *)"{\"rb\":\"-1\"}", 11 );
+			break;
 		}
+		DEBUG("[RemoteConnectionSend] Pooled connection failed, trying new one\n");
+	}
+	return NULL;
+}
+
+/**
+ * Put response received from remote FriendCore into DataForm
+ *
+ * @param bs response read from socket or NULL when nothing was received
+ * @return DataForm with response or NULL when error appear
+ */
+
+static DataForm *RemoteAnswerToDataForm( BufString *bs )
+{
+	MsgItem tags[] = {
+		{ ID_FCRE, (FULONG)0,  (FULONG)NULL },
+		{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
+		{ TAG_DONE, TAG_DONE, TAG_DONE }
+	};
+	
+	DataForm *ldf = DataFormNew( tags );
+	if( ldf == NULL )
+	{
+		return NULL;
+	}
+	
+	if( bs != NULL )
+	{
+		FBYTE *lsdata = (FBYTE *)bs->bs_Buffer;
+		FULONG sockReadSize = bs->bs_Size;
+		
+		DEBUG2("[SendMessageRFS] Received from socket %d\n", bs->bs_Size );
+		
+		DataFormAdd( &ldf, lsdata, sockReadSize );
+		
+		ldf->df_Size = sockReadSize;
+		DEBUG2("[SendMessageRFS] ---------------------Added new server to answer serverdfsize %ld sockreadsize %lu\n", ldf->df_Size, sockReadSize );
+		
+		DEBUG2("[SendMessageRFS] Message received '%.*s\n", (int)sockReadSize, lsdata );
+		
+		char *d = (char *)lsdata + (3*COMM_MSG_HEADER_SIZE);
+		if( d[ 0 ] == 'f' && d[ 1 ] == 'a' && d[ 2 ] == 'i' && d[ 3 ] ==  'l' )
+		{
+			//char *tmp = "user session not found"; //22
+			char *tmp = "device not found      ";
+			
+			if( strcmp( d, "fail<!--separate-->{\"response\":\"user session not found\"}" ) == 0 )
+			{
+				d += 33;
+				memcpy( d, tmp, 22 );
+			}
+		}
+	}
+	else
+	{
+		DataFormAdd( &ldf, (FBYTE *)"{\"rb\":\"-1\"}", 11 );
+	}
+	
+	return ldf;
+}
+
+//
+// connect macro
+//
+
+DataForm *SendMessageRFS( SpecialData *sd, DataForm *df )
+{
+	DEBUG("[SendMessageRFS] message to targetDirect\n");
+	
+	FBOOL connected = FALSE;
+
+	BufString *bs = RemoteConnectionSend( sd, df, &connected );
+	if( connected == TRUE )
+	{
+		DEBUG("[SendMessageRFS] Message sent: %lu\n", df->df_Size );
+		
+		DataForm *ldf = RemoteAnswerToDataForm( bs );
 		
 		if( bs != NULL )
 		{
 			BufStringDelete( bs );
 		}
 		
-		sd->sb->sl_SocketInterface.SocketClose( newsock );
-		
 		DEBUG("[SendMessageRFS] got reponse\n");
 		
 		return ldf;
 	}
 	
-	DataFormDelete( ldf );
-	
 	return NULL;
 }
 
@@ -950,6 +1247,360 @@ DataForm *SendMessageWithReconnection( SpecialData *sd, DataForm *df )
 	return recvdf;
 }
 
+/**
+ * Get current time in microseconds
+ *
+ * @return time in microseconds
+ */
+
+static FQUAD RemoteTime()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (FQUAD)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Create file stream on connection taken from pool
+ *
+ * @param rsd pointer to SpecialData of remote device
+ * @return new RemotePipe or NULL when connection cannot be created
+ */
+
+static RemotePipe *RemotePipeNew( SpecialData *rsd )
+{
+	RemotePipe *rp = NULL;
+	
+	if( ( rp = FCalloc( 1, sizeof( RemotePipe ) ) ) != NULL )
+	{
+		FBOOL reused = FALSE;
+		if( ( rp->rp_Connection = RemoteConnectionGet( rsd, &reused ) ) == NULL )
+		{
+			FERROR("[RemotePipeNew] Cannot connect to %s:%d\n", rsd->address, rsd->port );
+			FFree( rp );
+			return NULL;
+		}
+		rp->rp_Window = RFS_WINDOW_START;
+	}
+	return rp;
+}
+
+/**
+ * Delete file stream. Connection goes back to pool only when all answers were received.
+ *
+ * @param rsd pointer to SpecialData of remote device
+ * @param rp pointer to RemotePipe
+ */
+
+static void RemotePipeDelete( SpecialData *rsd, RemotePipe *rp )
+{
+	RemoteConnectionRelease( rsd, rp->rp_Connection, ( rp->rp_Count == 0 && rp->rp_Error == FALSE ) );
+	
+	if( rp->rp_ReadMessage != NULL )
+	{
+		DataFormDelete( rp->rp_ReadMessage );
+	}
+	if( rp->rp_Answer != NULL )
+	{
+		DataFormDelete( rp->rp_Answer );
+	}
+	if( rp->rp_WriteBuffer != NULL )
+	{
+		BufStringDelete( rp->rp_WriteBuffer );
+	}
+	FFree( rp );
+}
+
+/**
+ * Send request through file stream without waiting for answer
+ *
+ * @param rsd pointer to SpecialData of remote device
+ * @param rp pointer to RemotePipe
+ * @param df message which will be send, request id is set by this function
+ * @param size number of bytes stored by write request (0 for other requests)
+ * @return TRUE when request was sent, otherwise FALSE
+ */
+
+static FBOOL RemotePipeSend( SpecialData *rsd, RemotePipe *rp, DataForm *df, int size )
+{
+	if( rp->rp_Count >= RFS_WINDOW_MAX )
+	{
+		return FALSE;
+	}
+	
+	FULONG reqid = RemoteRequestIDNew() | MSG_FRID_KEEP_ALIVE;
+	df[ 1 ].df_Size = reqid;
+	
+	if( rsd->sb->sl_SocketInterface.SocketWrite( rp->rp_Connection->rc_Socket, (char *)df, (FQUAD)df->df_Size ) != (int)df->df_Size )
+	{
+		FERROR("[RemotePipeSend] Cannot send request %lu\n", reqid );
+		rp->rp_Error = TRUE;
+		return FALSE;
+	}
+	
+	int pos = ( rp->rp_First + rp->rp_Count ) % RFS_WINDOW_MAX;
+	rp->rp_ID[ pos ] = reqid;
+	rp->rp_Sent[ pos ] = RemoteTime();
+	rp->rp_Size[ pos ] = size;
+	rp->rp_Count++;
+	
+	return TRUE;
+}
+
+/**
+ * Receive answer for oldest request sent through file stream. Number of requests in flight
+ * follows bandwidth-delay product: shortest round trip time divided by time between answers.
+ *
+ * @param rsd pointer to SpecialData of remote device
+ * @param rp pointer to RemotePipe
+ * @param size pointer to variable where number of bytes sent by request will be stored
+ * @return DataForm with answer or NULL when error appear
+ */
+
+static DataForm *RemotePipeReceive( SpecialData *rsd, RemotePipe *rp, int *size )
+{
+	if( rp->rp_Count <= 0 )
+	{
+		return NULL;
+	}
+	
+	BufString *bs = rsd->sb->sl_SocketInterface.SocketReadDataForm( rp->rp_Connection->rc_Socket, RFS_READ_TIMEOUT, NULL );
+	
+	FULONG reqid = rp->rp_ID[ rp->rp_First ];
+	FQUAD sent = rp->rp_Sent[ rp->rp_First ];
+	*size = rp->rp_Size[ rp->rp_First ];
+	rp->rp_First = ( rp->rp_First + 1 ) % RFS_WINDOW_MAX;
+	rp->rp_Count--;
+	
+	if( bs == NULL )
+	{
+		FERROR("[RemotePipeReceive] Answer for request %lu not received\n", reqid );
+		rp->rp_Error = TRUE;
+		return NULL;
+	}
+	
+	// answers must come in order in which requests were sent, streamed answer closes connection
+	DataForm *rdf = (DataForm *)bs->bs_Buffer;
+	if( rdf->df_Size == 0 || bs->bs_Size < (int)(2*COMM_MSG_HEADER_SIZE) || rdf[ 1 ].df_ID != ID_FRID || rdf[ 1 ].df_Size != reqid )
+	{
+		FERROR("[RemotePipeReceive] Unexpected answer for request %lu\n", reqid );
+		rp->rp_Error = TRUE;
+		BufStringDelete( bs );
+		return NULL;
+	}
+	
+	FQUAD now = RemoteTime();
+	if( rp->rp_MinRTT == 0 || ( now - sent ) < rp->rp_MinRTT )
+	{
+		rp->rp_MinRTT = now - sent;
+	}
+	
+	// request was waiting behind previous one, time between answers is time needed to transfer one of them
+	if( rp->rp_LastAnswer != 0 && sent < rp->rp_LastAnswer )
+	{
+		FQUAD interval = now - rp->rp_LastAnswer;
+		rp->rp_Interval = rp->rp_Interval == 0 ? interval : ( rp->rp_Interval * 7 + interval ) / 8;
+		
+		int window = RFS_WINDOW_MAX;
+		if( rp->rp_Interval > 0 && ( rp->rp_MinRTT / rp->rp_Interval ) < RFS_WINDOW_MAX )
+		{
+			window = (int)( rp->rp_MinRTT / rp->rp_Interval ) + 2;
+		}
+		
+		if( window < RFS_WINDOW_MIN )
+		{
+			window = RFS_WINDOW_MIN;
+		}
+		else if( window > RFS_WINDOW_MAX )
+		{
+			window = RFS_WINDOW_MAX;
+		}
+		rp->rp_Window = window;
+	}
+	rp->rp_LastAnswer = now;
+	
+	DataForm *df = RemoteAnswerToDataForm( bs );
+	BufStringDelete( bs );
+	
+	return df;
+}
+
+/**
+ * Get data from ufile/read answer
+ *
+ * @param recvdf answer received from remote FriendCore
+ * @param data pointer where pointer to data will be stored
+ * @return number of bytes or -1 when end of file or error was reported
+ */
+
+static int RemoteReadAnswerData( DataForm *recvdf, char **data )
+{
+	if( recvdf == NULL || recvdf->df_ID != ID_FCRE || recvdf->df_Size <= HEADER_POSITION )
+	{
+		return -1;
+	}
+	
+	char *d = (char *)recvdf + HEADER_POSITION;
+	int size = (int)( recvdf->df_Size - HEADER_POSITION ) - 1;
+	
+	// end of file and errors are reported as {"rb":"<value>"}
+	if( size < 16 && strncmp( d, "{\"rb\":\"", 7 ) == 0 )
+	{
+		return -1;
+	}
+	
+	*data = d;
+	return size;
+}
+
+/**
+ * Get number of stored bytes from ufile/write answer
+ *
+ * @param recvdf answer received from remote FriendCore
+ * @return number of stored bytes or -1 when error appear
+ */
+
+static int RemoteWriteAnswerStored( DataForm *recvdf )
+{
+	int result = -1;
+	
+	if( recvdf == NULL || recvdf->df_Size <= HEADER_POSITION )
+	{
+		return -1;
+	}
+	
+	char *d = (char *)recvdf + HEADER_POSITION;
+	int size = (int)( recvdf->df_Size - HEADER_POSITION );
+	
+	DEBUG("[RemoteWrite] RECEIVED  %.10s\n", d );
+	
+	if( strcmp( d, "{\"rb\":\"-1\"}" ) == 0 )
+	{
+		return -1;
+	}
+	
+	int r;
+	jsmn_parser p;
+	jsmntok_t t[128]; // We expect no more than 128 tokens 
+
+	jsmn_init(&p);
+	r = jsmn_parse(&p, d, size, t, sizeof(t)/sizeof(t[0]));
+
+	// Assume the top-level element is an object 
+	if (r > 1 && t[0].type == JSMN_OBJECT) 
+	{
+		int i = 0, i1 = 0;
+		
+		for( i = 0; i < r-1 ;  i++ )
+		{
+			i1 = i + 1;
+			if (jsoneq( d, &t[i], "filestored") == 0) 
+			{
+				char sizec[ 256 ];
+				snprintf( sizec, sizeof( sizec ), "%.*s", t[ i1 ].end-t[ i1 ].start, d + t[ i1 ].start );
+				
+				result = atoi( sizec );
+			}
+		}
+	}
+	return result;
+}
+
+/**
+ * Send data collected by FileWrite and receive answers. Answers are received in batches,
+ * when window of requests in flight is full half of them are acknowledged.
+ *
+ * @param f pointer to opened File
+ * @param flush set to TRUE if all answers should be received
+ * @return 0 when success, otherwise -1
+ */
+
+static int RemotePipeWrite( File *f, FBOOL flush )
+{
+	SpecialData *sd = (SpecialData *)f->f_SpecialData;
+	SpecialData *rsd = (SpecialData *)f->f_RootDevice->f_SpecialData;
+	RemotePipe *rp = sd->pipe;
+	
+	if( rp->rp_WriteBuffer != NULL && rp->rp_WriteBuffer->bs_Size > 0 && rp->rp_Error == FALSE )
+	{
+		int wsize = rp->rp_WriteBuffer->bs_Size;
+		char *data;
+		
+		if( ( data = FCalloc( wsize+10, sizeof(char) ) ) == NULL  )
+		{
+			FERROR("[RemoteWrite] Cannot allocate memory for buffer\n");
+			rp->rp_Error = TRUE;
+			return -1;
+		}
+		
+		strcpy( data, "data=" );
+		memcpy( &data[ 5 ], rp->rp_WriteBuffer->bs_Buffer, wsize ); 
+		
+		char sizec[ 256 ];
+		int sizei = snprintf( sizec, 256, "size=%d", wsize )+1;
+		int hostsize = strlen( rsd->host )+1;
+		
+		MsgItem tags[] = {
+			{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
+				{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
+				{ ID_QUER, (FULONG)hostsize, (FULONG)rsd->host  },
+				{ ID_SLIB, (FULONG)0, (FULONG)NULL },
+				{ ID_HTTP, (FULONG)0, MSG_GROUP_START },
+					{ ID_PATH, (FULONG)27, (FULONG)"system.library/ufile/write" },
+					{ ID_PARM, (FULONG)0, MSG_GROUP_START },
+						{ ID_PRMT, (FULONG) wsize+6, (FULONG)data },
+						{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
+						{ ID_PRMT, (FULONG) sizei, (FULONG) sizec },
+						{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
+						{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
+						{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
+					{ MSG_GROUP_END, 0,  0 },
+				{ MSG_GROUP_END, 0,  0 },
+			{ MSG_GROUP_END, 0,  0 },
+			{ MSG_END, MSG_END, MSG_END }
+		};
+		
+		DEBUG("[RemoteWrite] bytes %d and message %.10s\n", wsize, data );
+		
+		DataForm *df = DataFormNew( tags );
+		
+		if( df == NULL || RemotePipeSend( rsd, rp, df, wsize ) == FALSE )
+		{
+			rp->rp_Error = TRUE;
+		}
+		
+		if( df != NULL )
+		{
+			DataFormDelete( df );
+		}
+		FFree( data );
+		
+		rp->rp_WriteBuffer->bs_Size = 0;
+	}
+	
+	int keep = ( flush == TRUE ) ? 0 : rp->rp_Window / 2;
+	if( flush == TRUE || rp->rp_Count >= rp->rp_Window )
+	{
+		while( rp->rp_Count > keep && rp->rp_Error == FALSE )
+		{
+			int size = 0;
+			DataForm *recvdf = RemotePipeReceive( rsd, rp, &size );
+			if( recvdf != NULL )
+			{
+				int stored = RemoteWriteAnswerStored( recvdf );
+				if( stored != size )
+				{
+					FERROR("[RemoteWrite] Remote side stored %d from %d bytes\n", stored, size );
+					rp->rp_Error = TRUE;
+				}
+				DataFormDelete( recvdf );
+			}
+		}
+	}
+	
+	return rp->rp_Error == TRUE ? -1 : 0;
+}
+
 //
 // Open file
 //
@@ -1137,6 +1788,18 @@ int FileClose( struct File *root, void *fp )
 	{
 		SpecialData *rsd = (SpecialData *)root->f_SpecialData;
 		int hostsize = strlen( rsd->host )+1;
+		FBOOL pipeError = FALSE;
+		
+		// written data must reach remote file before it is closed
+		if( sd->pipe != NULL )
+		{
+			if( sd->pipe->rp_WriteBuffer != NULL && RemotePipeWrite( f, TRUE ) != 0 )
+			{
+				pipeError = TRUE;
+			}
+			RemotePipeDelete( rsd, sd->pipe );
+			sd->pipe = NULL;
+		}
 		
 		MsgItem tags[] = {
 			{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
@@ -1182,6 +1845,11 @@ int FileClose( struct File *root, void *fp )
 		if( recvdf != NULL ) DataFormDelete( recvdf );
 		DataFormDelete( df );
 		
+		if( pipeError == TRUE )
+		{
+			result = -1;
+		}
+		
 		if( sd->host != NULL ) FFree( sd->host );
 		if( sd->id != NULL ) FFree( sd->id );
 		if( sd->login != NULL ) FFree( sd->login );
@@ -1217,69 +1885,109 @@ int FileRead( struct File *f, char *buffer, int rsize )
 	
 	if( sd != NULL )
 	{
-		char sizec[ 256 ];
-		int sizei = snprintf( sizec, 256, "size=%d", rsize )+1;
-		
 		File *root = f->f_RootDevice;
 		SpecialData *rsd = (SpecialData *)root->f_SpecialData;
-		int hostsize = strlen( rsd->host )+1;
 		
-		MsgItem tags[] = {
-			{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
-				{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
-				{ ID_QUER, (FULONG)hostsize, (FULONG)rsd->host  },
-				{ ID_SLIB, (FULONG)0, (FULONG)NULL },
-				{ ID_HTTP, (FULONG)0, MSG_GROUP_START },
-					{ ID_PATH, (FULONG)26, (FULONG)"system.library/ufile/read" },
-					{ ID_PARM, (FULONG)0, MSG_GROUP_START },
-						{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
-						{ ID_PRMT, (FULONG) sizei, (FULONG) sizec },
-						{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
-						{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
-						{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
+		// file is read sequentially, so next chunks are requested before caller ask for them
+		if( sd->pipe == NULL )
+		{
+			char sizec[ 256 ];
+			int sizei = snprintf( sizec, 256, "size=%d", rsize )+1;
+			int hostsize = strlen( rsd->host )+1;
+			
+			MsgItem tags[] = {
+				{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
+					{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
+					{ ID_QUER, (FULONG)hostsize, (FULONG)rsd->host  },
+					{ ID_SLIB, (FULONG)0, (FULONG)NULL },
+					{ ID_HTTP, (FULONG)0, MSG_GROUP_START },
+						{ ID_PATH, (FULONG)26, (FULONG)"system.library/ufile/read" },
+						{ ID_PARM, (FULONG)0, MSG_GROUP_START },
+							{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
+							{ ID_PRMT, (FULONG) sizei, (FULONG) sizec },
+							{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
+							{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
+							{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
+						{ MSG_GROUP_END, 0,  0 },
 					{ MSG_GROUP_END, 0,  0 },
 				{ MSG_GROUP_END, 0,  0 },
-			{ MSG_GROUP_END, 0,  0 },
-			{ MSG_END, MSG_END, MSG_END }
-		};
+				{ MSG_END, MSG_END, MSG_END }
+			};
 			
-		DataForm *df = DataFormNew( tags );
-
-		DataForm *recvdf = NULL;
+			if( ( sd->pipe = RemotePipeNew( rsd ) ) == NULL )
+			{
+				return -2;
+			}
+			
+			if( ( sd->pipe->rp_ReadMessage = DataFormNew( tags ) ) == NULL )
+			{
+				sd->pipe->rp_Error = TRUE;
+			}
+		}
 		
-		recvdf = SendMessageRFS( rsd, df );
-
-		DEBUG2("Response received %p\n", recvdf );
+		RemotePipe *rp = sd->pipe;
 		
-		if( recvdf != NULL && recvdf->df_ID == ID_FCRE &&  recvdf->df_Size > 0 )
+		while( rp->rp_DataPos >= rp->rp_DataSize )
 		{
-			char *d = (char *)recvdf + (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-			
-			result =  recvdf->df_Size  - (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-
-			// 1531 - 1483
+			if( rp->rp_Answer != NULL )
+			{
+				DataFormDelete( rp->rp_Answer );
+				rp->rp_Answer = NULL;
+			}
 			
-			if( strncmp( d, "{\"rb\":\"-1\"}", 11 ) == 0 )
+			if( rp->rp_End == TRUE || rp->rp_Error == TRUE )
 			{
-				DataFormDelete( recvdf );
-				DataFormDelete( df );
 				return -1;
 			}
 			
-			result = result-1;
-			
-			if( f->f_Stream == TRUE )
+			while( rp->rp_Count < rp->rp_Window )
 			{
-				sd->sb->sl_SocketInterface.SocketWrite( f->f_Socket, d, (FQUAD)result );
+				if( RemotePipeSend( rsd, rp, rp->rp_ReadMessage, 0 ) == FALSE )
+				{
+					return -1;
+				}
 			}
-			else
+			
+			int size = 0;
+			DataForm *recvdf = RemotePipeReceive( rsd, rp, &size );
+			
+			DEBUG2("Response received %p\n", recvdf );
+			
+			char *d = NULL;
+			int len = RemoteReadAnswerData( recvdf, &d );
+			if( len <= 0 )
 			{
-				memcpy( buffer, d, result );
+				if( recvdf != NULL )
+				{
+					DataFormDelete( recvdf );
+				}
+				rp->rp_End = TRUE;
+				return -1;
 			}
+			
+			rp->rp_Answer = recvdf;
+			rp->rp_Data = d;
+			rp->rp_DataSize = len;
+			rp->rp_DataPos = 0;
 		}
 		
-		if( recvdf != NULL ) DataFormDelete( recvdf );
-		DataFormDelete( df );
+		result = rp->rp_DataSize - rp->rp_DataPos;
+		if( result > rsize )
+		{
+			result = rsize;
+		}
+		
+		char *d = rp->rp_Data + rp->rp_DataPos;
+		rp->rp_DataPos += result;
+		
+		if( f->f_Stream == TRUE )
+		{
+			sd->sb->sl_SocketInterface.SocketWrite( f->f_Socket, d, (FQUAD)result );
+		}
+		else
+		{
+			memcpy( buffer, d, result );
+		}
 	} // sd != NULL
 	
 	return result;
@@ -1297,112 +2005,36 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 	
 	if( sd != NULL )
 	{
-		char *data;
-		
-		if( ( data = FCalloc( wsize+10, sizeof(char) ) ) != NULL  )
+		// data is collected and sent in bigger chunks, answers are checked in batches
+		if( sd->pipe == NULL )
 		{
-			strcpy( data, "data=" );
-			memcpy( &data[ 5 ], buffer, wsize ); 
-			
-			char sizec[ 256 ];
-			int sizei = snprintf( sizec, 256, "size=%d", wsize )+1;
-		
 			File *root = f->f_RootDevice;
-			SpecialData *rsd = (SpecialData *)root->f_SpecialData;
-			int hostsize = strlen( rsd->host )+1;
-		
-			MsgItem tags[] = {
-				{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
-					{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
-					{ ID_QUER, (FULONG)hostsize, (FULONG)rsd->host  },
-					{ ID_SLIB, (FULONG)0, (FULONG)NULL },
-					{ ID_HTTP, (FULONG)0, MSG_GROUP_START },
-						{ ID_PATH, (FULONG)27, (FULONG)"system.library/ufile/write" },
-						{ ID_PARM, (FULONG)0, MSG_GROUP_START },
-							{ ID_PRMT, (FULONG) wsize+6, (FULONG)data },
-							{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
-							{ ID_PRMT, (FULONG) sizei, (FULONG) sizec },
-							{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
-							{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
-							{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
-						{ MSG_GROUP_END, 0,  0 },
-					{ MSG_GROUP_END, 0,  0 },
-				{ MSG_GROUP_END, 0,  0 },
-				{ MSG_END, MSG_END, MSG_END }
-			};
-			
-			DEBUG("[RemoteWrite] bytes %d and message %.10s\n", wsize, data );
 			
-			DataForm *df = DataFormNew( tags );
-
-			DataForm *recvdf = NULL;
-			
-			recvdf = SendMessageRFS( rsd, df );
-
-			DEBUG("[RemoteWrite] Response received %p\n", recvdf );
-		
-			if( recvdf != NULL && recvdf->df_Size > 0 )
+			if( ( sd->pipe = RemotePipeNew( (SpecialData *)root->f_SpecialData ) ) == NULL )
 			{
-				//int i=0;
-
-				char *d = (char *)recvdf + (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-			
-				DEBUG("[RemoteWrite] RECEIVED  %.10s\n", d );
-				result =  recvdf->df_Size  - (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-				// 1531 - 1483
-			
-				if( strcmp( d, "{\"rb\":\"-1\"}" ) == 0 )
-				{
-					DataFormDelete( recvdf );
-					DataFormDelete( df );
-					return -1;
-				}
-				else
-				{
-					unsigned int i=0;
-					char *d = (char *)recvdf + (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-					int r;
-					jsmn_parser p;
-					jsmntok_t t[128]; // We expect no more than 128 tokens 
-
-					jsmn_init(&p);
-					r = jsmn_parse(&p, d, result, t, sizeof(t)/sizeof(t[0]));
-
-					DEBUG1("[RemoteWrite] commR %d\n", r );
-					// Assume the top-level element is an object 
-					if (r > 1 && t[0].type == JSMN_OBJECT) 
-					{
-						DEBUG1("[RemoteWrite] Found json object\n");
-						int i = 0, i1 = 0;
-				
-						for( i = 0; i < r ;  i++ )
-						{
-							i1 = i + 1;
-							if (jsoneq( d, &t[i], "filestored") == 0) 
-							{
-								int len = t[ i1 ].end-t[ i1 ].start;
-								char sizec[ 256 ];
-								
-								strncpy( sizec, d + t[ i1 ].start, len );
-								
-								result = atoi( sizec );
-							}
-						}
-					}
-				}
-			
-				DataFormDelete( recvdf );
+				return -2;
 			}
-			
-			DataFormDelete( df );
-			FFree( data );
 		}
-		else
+		
+		RemotePipe *rp = sd->pipe;
+		
+		if( rp->rp_WriteBuffer == NULL && ( rp->rp_WriteBuffer = BufStringNewSize( RFS_WRITE_CHUNK ) ) == NULL )
 		{
 			FERROR("[RemoteWrite] Cannot allocate memory for buffer\n");
 			return -2;
 		}
 		
+		if( rp->rp_Error == TRUE || BufStringAddSize( rp->rp_WriteBuffer, buffer, wsize ) != 0 )
+		{
+			return -1;
+		}
+		
+		if( rp->rp_WriteBuffer->bs_Size >= RFS_WRITE_CHUNK && RemotePipeWrite( f, FALSE ) != 0 )
+		{
+			return -1;
+		}
+		
+		result = wsize;
 	} // sd != NULL
 	
 	return result;
@@ -562,8 +562,9 @@ Http *INVARManagerWebRequest( void *m, char **urlpath, Http* request )
 	DEBUG( "INVARManager Command OK %s !\n", urlpath[ 0 ] );
 	BufStringAddSize( nbs, "}", 1 );
 	
-	HttpSetContent( response, nbs->bs_Buffer, nbs->bs_Size );
-	nbs->bs_Buffer = NULL;
+	int contentSize = 0;
+	char *content = BufStringDetach( nbs, &contentSize );
+	HttpSetContent( response, content, contentSize );
 	BufStringDelete( nbs );
 	//HttpWriteAndFree( response );
 	return response;
@@ -32,6 +32,7 @@
 #include <system/log/user_logger.h>
 #include <system/systembase.h>
 #include <time.h>
+#include <util/buffered_string.h>
 
 typedef struct SpecialData
 {
@@ -143,3 +144,55 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 	return 0;
 }
 
+//
+// store many entries with one write
+//
+
+int StoreEntries( struct UserLogger *s, UserLog **entries, int count )
+{
+	SpecialData *sd = s->ul_SD;
+	
+	if( sd == NULL || sd->sd_FP == NULL || count <= 0 )
+	{
+		return -1;
+	}
+	
+	BufString *bs = BufStringNewSize( count * 256 );
+	if( bs == NULL )
+	{
+		return -1;
+	}
+	
+	char datestring[ 64 ];
+	char line[ 1024 ];
+	time_t lastTime = -1;
+	int i;
+	
+	for( i = 0 ; i < count ; i++ )
+	{
+		UserLog *e = entries[ i ];
+		
+		// entries in batch usually have same time
+		if( e->ul_CreatedTime != lastTime )
+		{
+			struct tm tm;
+			localtime_r( &e->ul_CreatedTime, &tm );
+			strftime( datestring, sizeof(datestring), "%c", &tm );
+			lastTime = e->ul_CreatedTime;
+		}
+		
+		int len = snprintf( line, sizeof(line), "Date: %s, UserID: %llu, UserSessionID: %s, Action: ", datestring, e->ul_UserID, e->ul_UserSessionID );
+		BufStringAddSize( bs, line, len );
+		BufStringAdd( bs, e->ul_Action != NULL ? e->ul_Action : "(null)" );
+		BufStringAddSize( bs, ", Information: ", 15 );
+		BufStringAdd( bs, e->ul_Information != NULL ? e->ul_Information : "(null)" );
+		BufStringAddSize( bs, "\n", 1 );
+	}
+	
+	fwrite( bs->bs_Buffer, 1, bs->bs_Size, sd->sd_FP );
+	fflush( sd->sd_FP );
+	
+	BufStringDelete( bs );
+	
+	return 0;
+}
@@ -48,6 +48,7 @@ typedef struct UserLoggerFile
 	void                    (*deinit)( struct UserLogger *s );
 
 	int                     (*StoreInformation)( struct UserLogger *s, UserSession *session, char *actions, char *information );
+	int                     (*StoreEntries)( struct UserLogger *s, UserLog **entries, int count );
 	
 	void                   *ul_SD;  // special data
 	void                   *ul_SB; // system base
@@ -31,6 +31,7 @@
 #include "user_logger_sql.h"
 #include <system/log/user_logger.h>
 #include <system/systembase.h>
+#include <util/buffered_string.h>
 
 typedef struct SpecialData
 {
@@ -158,3 +159,110 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 	return 0;
 }
 
+//
+// add escaped string value to query, NULL pointer is stored as NULL
+//
+
+static inline void AddSQLString( BufString *bs, SQLLibrary *lib, char *str )
+{
+	if( str == NULL )
+	{
+		BufStringAddSize( bs, "NULL", 4 );
+		return;
+	}
+	
+	char *esc = lib->MakeEscapedString( lib, str );
+	BufStringAddSize( bs, "'", 1 );
+	if( esc != NULL )
+	{
+		BufStringAdd( bs, esc );
+		FFree( esc );
+	}
+	BufStringAddSize( bs, "'", 1 );
+}
+
+//
+// add values of one entry to query
+//
+
+static void AddEntryValues( BufString *bs, SQLLibrary *lib, UserLog *e )
+{
+	char tmp[ 64 ];
+	
+	BufStringAddSize( bs, "(", 1 );
+	AddSQLString( bs, lib, e->ul_UserSessionID );
+	int len = snprintf( tmp, sizeof(tmp), ",%llu,", (unsigned long long)e->ul_UserID );
+	BufStringAddSize( bs, tmp, len );
+	AddSQLString( bs, lib, e->ul_Action );
+	BufStringAddSize( bs, ",", 1 );
+	AddSQLString( bs, lib, e->ul_Information );
+	len = snprintf( tmp, sizeof(tmp), ",%lld)", (long long)e->ul_CreatedTime );
+	BufStringAddSize( bs, tmp, len );
+}
+
+#define USER_LOG_INSERT "INSERT INTO `FUserLog` (`UsersessiondID`,`UserID`,`Action`,`Information`,`CreatedTime`) VALUES "
+
+//
+// store many entries with one multi-row INSERT
+//
+
+int StoreEntries( struct UserLogger *s, UserLog **entries, int count )
+{
+	SpecialData *sd = s->ul_SD;
+	
+	if( sd == NULL || sd->sd_LibSQL == NULL || count <= 0 )
+	{
+		return -1;
+	}
+	
+	BufString *bs = BufStringNewSize( 256 + ( count * 256 ) );
+	if( bs == NULL )
+	{
+		return -1;
+	}
+	
+	BufStringAdd( bs, USER_LOG_INSERT );
+	
+	int i;
+	for( i = 0 ; i < count ; i++ )
+	{
+		if( i > 0 )
+		{
+			BufStringAddSize( bs, ",", 1 );
+		}
+		AddEntryValues( bs, sd->sd_LibSQL, entries[ i ] );
+	}
+	
+	int error = sd->sd_LibSQL->QueryWithoutResults( sd->sd_LibSQL, bs->bs_Buffer );
+	
+	// one bad row (e.g. value longer than column in strict mode) fails whole statement,
+	// entries are stored one by one then, so only bad ones are lost
+	if( error != 0 && count > 1 )
+	{
+		int failed = 0;
+		
+		FERROR("[UserLoggerSQL] Cannot store %d entries, error %d, storing them one by one\n", count, error );
+		
+		for( i = 0 ; i < count ; i++ )
+		{
+			bs->bs_Size = 0;
+			BufStringAdd( bs, USER_LOG_INSERT );
+			AddEntryValues( bs, sd->sd_LibSQL, entries[ i ] );
+			
+			if( sd->sd_LibSQL->QueryWithoutResults( sd->sd_LibSQL, bs->bs_Buffer ) != 0 )
+			{
+				failed++;
+			}
+		}
+		error = failed;
+	}
+	
+	if( error != 0 )
+	{
+		FERROR("[UserLoggerSQL] %d of %d entries were not stored\n", count > 1 ? error : 1, count );
+	}
+	
+	BufStringDelete( bs );
+	
+	return error;
+}
@@ -74,6 +74,7 @@ UserLogger *UserLoggerCreate( void *sb, const char *path, const char *name )
 			ulogger->deinit = dlsym( ulogger->handle, "deinit");
 			
 			ulogger->StoreInformation = dlsym( ulogger->handle, "StoreInformation");
+			ulogger->StoreEntries = dlsym( ulogger->handle, "StoreEntries");
 		}
 		else
 		{
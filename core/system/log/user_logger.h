@@ -78,6 +78,7 @@ typedef struct UserLogger
 	void                    (*deinit)( struct UserLogger *s );
 	
 	int                     (*StoreInformation)( struct UserLogger *s, UserSession *session, char *actions, char *information );
+	int                     (*StoreEntries)( struct UserLogger *s, UserLog **entries, int count );	// optional, store many entries at once
 	void                   *ul_SD;  // special data
 	void                   *ul_SB; // system base
 }UserLogger;
@@ -37,6 +37,11 @@
 #include <sys/stat.h>
 #include <util/buffered_string.h>
 #include <dirent.h>
+#include <time.h>
+#include <errno.h>
+
+static void *UserLoggerThread( void *data );
+static void UserLoggerQueueFlush( UserLoggerManager *ulm, UserLog **batch, int max );
 
 /**
  * Create new UserLoggerManager
@@ -59,6 +64,10 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 		struct PropertiesLibrary *plib = NULL;
 		char *actLogger = NULL;
 		Props *prop = NULL;
+		int queueSize = USER_LOGGER_QUEUE_SIZE_DEFAULT;
+		
+		ulm->ulm_FlushInterval = USER_LOGGER_FLUSH_INTERVAL_DEFAULT;
+		ulm->ulm_BatchRows = USER_LOGGER_BATCH_ROWS_DEFAULT;
 		
 		if( ( plib = (struct PropertiesLibrary *)LibraryOpen( sb, "properties.library", 0 ) ) != NULL )
 		{
@@ -71,6 +80,10 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 				DEBUG("reading actLogger\n");
 				actLogger = plib->ReadString( prop, "Logger:active", NULL );
 				DEBUG("actLogger %s\n", actLogger );
+				
+				queueSize = plib->ReadInt( prop, "Logger:queueSize", USER_LOGGER_QUEUE_SIZE_DEFAULT );
+				ulm->ulm_FlushInterval = plib->ReadInt( prop, "Logger:flushInterval", USER_LOGGER_FLUSH_INTERVAL_DEFAULT );
+				ulm->ulm_BatchRows = plib->ReadInt( prop, "Logger:batchRows", USER_LOGGER_BATCH_ROWS_DEFAULT );
 			}
 
 			// read directory and load loggers
@@ -125,6 +138,46 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 			
 			LibraryClose( plib );
 		}
+		
+		// entries are stored by logger thread
+		
+		if( ulm->ulm_ActiveLogger != NULL )
+		{
+			FUQUAD size = 64;
+			while( size < (FUQUAD)queueSize && size < ( 1 << 20 ) )
+			{
+				size <<= 1;
+			}
+			if( ulm->ulm_FlushInterval < 10 )
+			{
+				ulm->ulm_FlushInterval = 10;
+			}
+			if( ulm->ulm_BatchRows < 1 )
+			{
+				ulm->ulm_BatchRows = 1;
+			}
+			
+			if( ( ulm->ulm_Queue = FCalloc( size, sizeof( UserLoggerSlot ) ) ) != NULL )
+			{
+				FUQUAD i;
+				for( i = 0 ; i < size ; i++ )
+				{
+					ulm->ulm_Queue[ i ].uls_Seq = i;
+				}
+				ulm->ulm_QueueMask = size - 1;
+				
+				if( sem_init( &ulm->ulm_Wake, 0, 0 ) == 0 )
+				{
+					ulm->ulm_Running = TRUE;
+					if( pthread_create( &ulm->ulm_Thread, NULL, UserLoggerThread, ulm ) != 0 )
+					{
+						FERROR("Cannot start user logger thread\n");
+						ulm->ulm_Running = FALSE;
+						sem_destroy( &ulm->ulm_Wake );
+					}
+				}
+			}
+		}
 	}
 	
 	return ulm;
@@ -140,6 +193,25 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 	DEBUG("UserLoggerManagerDelete\n");
 	if( ulm != NULL )
 	{
+		// logger thread stores everything what is in queue before quit
+		if( ulm->ulm_Running == TRUE )
+		{
+			ulm->ulm_Quit = TRUE;
+			sem_post( &ulm->ulm_Wake );
+			pthread_join( ulm->ulm_Thread, NULL );
+			ulm->ulm_Running = FALSE;
+			sem_destroy( &ulm->ulm_Wake );
+		}
+		
+		if( ulm->ulm_Queue != NULL )
+		{
+			// entries added while thread was quitting
+			UserLog *entry[ 1 ];
+			UserLoggerQueueFlush( ulm, entry, 1 );
+			
+			FFree( ulm->ulm_Queue );
+		}
+		
 		UserLogger *ul = ulm->ulm_Loggers;
 		UserLogger *dl = ul;
 		
@@ -154,3 +226,241 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 		FFree( ulm );
 	}
 }
+
+/**
+ * Put user action into queue. Call does not block, entry is dropped when queue is full.
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param ses pointer to UserSession which called action
+ * @param path action path
+ * @param information additional information
+ */
+void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
+{
+	DEBUG("SESSION %p\n", ses );
+	if( ulm == NULL || ulm->ulm_ActiveLogger == NULL || ses == NULL )
+	{
+		return;
+	}
+	
+	// no logger thread, store directly
+	if( ulm->ulm_Running == FALSE || ulm->ulm_Quit == TRUE )
+	{
+		ulm->ulm_ActiveLogger->StoreInformation( ulm->ulm_ActiveLogger, ses, path, information );
+		return;
+	}
+	
+	// entry and its strings are allocated in one block
+	
+	int sesLen = ses->us_SessionID != NULL ? strlen( ses->us_SessionID ) + 1 : 0;
+	int pathLen = path != NULL ? strlen( path ) + 1 : 0;
+	int infoLen = information != NULL ? strlen( information ) + 1 : 0;
+	
+	UserLog *entry = FMalloc( sizeof( UserLog ) + sesLen + pathLen + infoLen );
+	if( entry == NULL )
+	{
+		__atomic_add_fetch( &ulm->ulm_Dropped, 1, __ATOMIC_RELAXED );
+		return;
+	}
+	
+	char *str = (char *)( entry + 1 );
+	entry->node.mln_Succ = NULL;
+	entry->ul_ID = 0;
+	entry->ul_UserID = ses->us_UserID;
+	entry->ul_CreatedTime = time( NULL );
+	entry->ul_UserSessionID = NULL;
+	entry->ul_Action = NULL;
+	entry->ul_Information = NULL;
+	if( sesLen > 0 )
+	{
+		entry->ul_UserSessionID = memcpy( str, ses->us_SessionID, sesLen );
+		str += sesLen;
+	}
+	if( pathLen > 0 )
+	{
+		entry->ul_Action = memcpy( str, path, pathLen );
+		str += pathLen;
+	}
+	if( infoLen > 0 )
+	{
+		entry->ul_Information = memcpy( str, information, infoLen );
+	}
+	
+	// reserve slot
+	
+	FUQUAD pos = __atomic_load_n( &ulm->ulm_QueueHead, __ATOMIC_RELAXED );
+	UserLoggerSlot *slot;
+	while( TRUE )
+	{
+		slot = &(ulm->ulm_Queue[ pos & ulm->ulm_QueueMask ]);
+		FQUAD diff = (FQUAD)( __atomic_load_n( &slot->uls_Seq, __ATOMIC_ACQUIRE ) - pos );
+		
+		if( diff == 0 )
+		{
+			if( __atomic_compare_exchange_n( &ulm->ulm_QueueHead, &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				break;
+			}
+		}
+		else if( diff < 0 )
+		{
+			// queue is full
+			FFree( entry );
+			__atomic_add_fetch( &ulm->ulm_Dropped, 1, __ATOMIC_RELAXED );
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n( &ulm->ulm_QueueHead, __ATOMIC_RELAXED );
+		}
+	}
+	
+	slot->uls_Entry = entry;
+	__atomic_store_n( &slot->uls_Seq, pos + 1, __ATOMIC_RELEASE );
+	
+	// do not wait for timeout when batch is ready
+	if( pos + 1 - __atomic_load_n( &ulm->ulm_QueueTail, __ATOMIC_RELAXED ) == (FUQUAD)ulm->ulm_BatchRows )
+	{
+		sem_post( &ulm->ulm_Wake );
+	}
+}
+
+/**
+ * Get number of entries dropped because queue was full
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @return number of dropped entries
+ */
+FUQUAD UserLoggerManagerGetDropped( UserLoggerManager *ulm )
+{
+	if( ulm == NULL )
+	{
+		return 0;
+	}
+	return __atomic_load_n( &ulm->ulm_Dropped, __ATOMIC_RELAXED );
+}
+
+/**
+ * Store entries taken from queue by active logger
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param entries table of entries
+ * @param count number of entries
+ */
+static void UserLoggerStoreBatch( UserLoggerManager *ulm, UserLog **entries, int count )
+{
+	UserLogger *ul = ulm->ulm_ActiveLogger;
+	int i;
+	
+	if( ul->StoreEntries != NULL )
+	{
+		ul->StoreEntries( ul, entries, count );
+	}
+	else
+	{
+		// logger can store only one entry from session
+		UserSession ses;
+		memset( &ses, 0, sizeof( UserSession ) );
+		
+		for( i = 0 ; i < count ; i++ )
+		{
+			ses.us_UserID = entries[ i ]->ul_UserID;
+			ses.us_SessionID = entries[ i ]->ul_UserSessionID;
+			ul->StoreInformation( ul, &ses, entries[ i ]->ul_Action, entries[ i ]->ul_Information );
+		}
+	}
+	
+	for( i = 0 ; i < count ; i++ )
+	{
+		FFree( entries[ i ] );
+	}
+}
+
+/**
+ * Take entries from queue and store them, at most max entries in one call
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param batch table where entries are collected
+ * @param max size of batch table
+ */
+static void UserLoggerQueueFlush( UserLoggerManager *ulm, UserLog **batch, int max )
+{
+	while( TRUE )
+	{
+		int count = 0;
+		FUQUAD tail = ulm->ulm_QueueTail;
+		
+		while( count < max )
+		{
+			UserLoggerSlot *slot = &(ulm->ulm_Queue[ tail & ulm->ulm_QueueMask ]);
+			if( __atomic_load_n( &slot->uls_Seq, __ATOMIC_ACQUIRE ) != tail + 1 )
+			{
+				break;
+			}
+			batch[ count++ ] = slot->uls_Entry;
+			__atomic_store_n( &slot->uls_Seq, tail + ulm->ulm_QueueMask + 1, __ATOMIC_RELEASE );
+			tail++;
+		}
+		__atomic_store_n( &ulm->ulm_QueueTail, tail, __ATOMIC_RELAXED );
+		
+		if( count == 0 )
+		{
+			break;
+		}
+		UserLoggerStoreBatch( ulm, batch, count );
+	}
+}
+
+/**
+ * User logger thread. Takes entries from queue and stores them in batches
+ * every flush interval or when batch is full.
+ *
+ * @param data pointer to UserLoggerManager
+ * @return NULL
+ */
+static void *UserLoggerThread( void *data )
+{
+	UserLoggerManager *ulm = (UserLoggerManager *)data;
+	UserLog **batch = FCalloc( ulm->ulm_BatchRows, sizeof( UserLog *) );
+	if( batch == NULL )
+	{
+		FERROR("Cannot allocate memory for user logger batch\n");
+		ulm->ulm_Quit = TRUE;
+		return NULL;
+	}
+	
+	while( TRUE )
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += ulm->ulm_FlushInterval / 1000;
+		ts.tv_nsec += ( ulm->ulm_FlushInterval % 1000 ) * 1000000;
+		if( ts.tv_nsec >= 1000000000 )
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		sem_timedwait( &ulm->ulm_Wake, &ts );
+		
+		int quit = ulm->ulm_Quit;
+		
+		// take everything what is in queue
+		UserLoggerQueueFlush( ulm, batch, ulm->ulm_BatchRows );
+		
+		FUQUAD dropped = __atomic_load_n( &ulm->ulm_Dropped, __ATOMIC_RELAXED );
+		if( dropped != ulm->ulm_DroppedReported )
+		{
+			Log( FLOG_WARN, "[UserLoggerThread] %llu user log entries dropped, queue is full\n", dropped - ulm->ulm_DroppedReported );
+			ulm->ulm_DroppedReported = dropped;
+		}
+		
+		if( quit == TRUE )
+		{
+			break;
+		}
+	}
+	
+	FFree( batch );
+	
+	return NULL;
+}
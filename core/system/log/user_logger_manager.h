@@ -35,6 +35,22 @@
 #include <stdlib.h>
 #include "user_logger.h"
 #include <util/log/log.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define USER_LOGGER_QUEUE_SIZE_DEFAULT		4096	// entries waiting for store, power of 2
+#define USER_LOGGER_FLUSH_INTERVAL_DEFAULT	1000	// milliseconds
+#define USER_LOGGER_BATCH_ROWS_DEFAULT		200		// entries stored in one call
+
+//
+// queue slot, sequence number tells if slot is free or filled (bounded MPSC queue)
+//
+
+typedef struct UserLoggerSlot
+{
+	volatile FUQUAD              uls_Seq;
+	UserLog                      *uls_Entry;
+}UserLoggerSlot;
 
 //
 // definition
@@ -45,6 +61,20 @@ typedef struct UserLoggerManager
 	void                         *ulm_SB; // pointer to SystemBase
 	UserLogger             *ulm_Loggers;
 	UserLogger             *ulm_ActiveLogger;
+	
+	UserLoggerSlot         *ulm_Queue;
+	FUQUAD                 ulm_QueueMask;
+	volatile FUQUAD        ulm_QueueHead;		// next slot for producers
+	volatile FUQUAD        ulm_QueueTail;		// next slot for flusher
+	volatile FUQUAD        ulm_Dropped;		// entries lost because queue was full
+	FUQUAD                 ulm_DroppedReported;
+	int                    ulm_FlushInterval;
+	int                    ulm_BatchRows;
+	
+	pthread_t              ulm_Thread;
+	sem_t                  ulm_Wake;
+	volatile int           ulm_Running;
+	volatile int           ulm_Quit;
 }UserLoggerManager;
 
 //
@@ -60,17 +90,16 @@ UserLoggerManager *UserLoggerManagerNew( void *sb );
 void UserLoggerManagerDelete( UserLoggerManager *ulm );
 
 //
+// Put user action into queue, entries are stored by logger thread
 //
+
+void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information );
+
+//
+// Get number of entries dropped because queue was full
 //
 
-inline void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
-{
-	DEBUG("SESSION %p\n", ses );
-	if( ulm->ulm_ActiveLogger != NULL && ses != NULL )
-	{
-		ulm->ulm_ActiveLogger->StoreInformation( ulm->ulm_ActiveLogger, ses, path, information );
-	}
-}
+FUQUAD UserLoggerManagerGetDropped( UserLoggerManager *ulm );
 
 
 #endif // __UTIL_USER_LOGGER_MANAGER_H__
@@ -113,101 +113,44 @@ char *FilterPHPVar( char *line )
 char *Run( struct EModule *mod, const char *path, const char *args, FULONG *length )
 {
 	DEBUG("[PHPmod] call run\n");
-
-	FULONG res = 0;
-
-	// Escape the input, so that remove code injection is not possible.
-	char *earg = StringShellEscape( args );
-	unsigned int eargLen = strlen( earg );
-	char *epath = StringShellEscape( path );
-	unsigned int epathLen = strlen( epath );
-	int escapedSize = eargLen + epathLen + 1024;
-
-	int siz = eargLen + epathLen + 128;
 	
-	char *command = NULL;
-	if( ( command = calloc( 1024 + strlen( path ) + ( args != NULL ? strlen( args ) : 0 ), sizeof( char ) ) ) == NULL )
+	SystemBase *sb = (SystemBase *)mod->em_SB;
+
+	// Arguments are passed to php worker directly, shell is not involved
+	char *farg = StringDuplicate( args != NULL ? args : "" );
+	if( farg == NULL )
 	{
 		FERROR("Cannot allocate memory for data\n");
-		free( epath ); free( earg );
 		return NULL;
 	}
 
 	DEBUG("[PHPmod] Run\n");
 	
-	//
-	// here there should be prepared command
-	//
-	
 	// Remove dangerous crap!
-	FilterPHPVar( earg );
-	FilterPHPVar( epath );
-
-	sprintf( command, "php \"%s\" \"%s\";", path, args != NULL ? args : "" );
+	FilterPHPVar( farg );
 	
-	// Make the commandline string with the safe, escaped arguments, and check for buffer overflows.
-	int cx = snprintf( command, escapedSize, "php \"%s\" \"%s\";", epath, earg );
-	if( !( cx >= 0 && cx < escapedSize ) )
-	{
-		FERROR( "[PHPmod] snprintf\n" );
-		free( command ); free( epath ); free( earg );
-		return NULL;
-	}
+	const char *fargs = farg;
+	ListString *ls = sb->sl_PHPPoolInterface.PHPPoolRun( sb->sl_PHPPool, path, &fargs, 1 );
+	FFree( farg );
 	
-	//DEBUG( "[PHPmod] run app: %s\n", command );
-	
-	FILE *pipe = popen( command, "r" );
-	if( !pipe )
+	if( ls == NULL )
 	{
-		FERROR("[PHPmod] cannot open pipe\n");
-		free( command ); free( epath ); free( earg );
+		FERROR("[PHPmod] cannot run script %s\n", path );
 		return NULL;
 	}
 	
-	//char *buffer = NULL;
-	char *temp = NULL;
-	char *result = NULL;
-	char *gptr = NULL;
-	
-	DEBUG("[PHPmod] command launched\n");
-	int errors = 0;
-	int lbufcall = LBUFFER_SIZE + 1;
-	
-	ListString *ls = ListStringNew();
-	char buffer[ LBUFFER_SIZE ];
-	
-	//printf("<=<=<=<=%s\n", command );
-	while( !feof( pipe ) )
-	{
-		int reads = fread( buffer, sizeof( char ), LBUFFER_SIZE, pipe );
-		if( reads > 0 )
-		{
-			ListStringAdd( ls, buffer, reads );
-			res += reads;
-		}
-	}
-	//printf("<=<=<=<=%s\n", command );
-	 
-	//DEBUG("[PHPmod] received bytes %d  : %100s\n", bs->bs_Size, bs->bs_Buffer );
-	
-	// Free buffer if it's there
-	pclose( pipe );
+	DEBUG("[PHPmod] script finished\n");
 	
 	// Set the length
 	if( length != NULL )
 	{
-		*length = ( unsigned long int )res;
+		*length = ( unsigned long int )ls->ls_Size;
 	}
 
-	ListStringJoin( ls );
 	char *final = ls->ls_Data;
 	ls->ls_Data = NULL;
 	ListStringDelete( ls );
 	
-	//DEBUG("Final string %s\n", final );
-	
-	//DEBUG( "[PHPmod] We are now complete.. %s\n", final );
-	free( command ); free( epath ); free( earg );
 	return final;
 }
 
@@ -0,0 +1,887 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  Pool of persistent PHP worker processes
+ *
+ *  Worker process is started once and serves many requests, so PHP interpreter
+ *  is not launched on every call. Workers are checked periodically and
+ *  replaced after configured number of requests or when they stop responding.
+ *  When pool is not available scripts are launched by popen.
+ *
+ *  @date created 2017
+ */
+
+#define _GNU_SOURCE
+
+#include "php_pool.h"
+#include <util/log/log.h>
+#include <util/string.h>
+#include <util/buffered_string.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+extern FILE *popen( const char *command, const char *modes );
+extern int pclose( FILE *stream );
+
+static void PHPPoolHealthThread( FThread *t );
+
+/**
+ * Write all data to socket
+ *
+ * @param fd socket descriptor
+ * @param data pointer to data
+ * @param length data length
+ * @return 0 when success, otherwise -1
+ */
+static int PHPWriteAll( int fd, const char *data, FULONG length )
+{
+	while( length > 0 )
+	{
+		ssize_t res = send( fd, data, length, MSG_NOSIGNAL );
+		if( res < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			return -1;
+		}
+		data += res;
+		length -= res;
+	}
+	return 0;
+}
+
+/**
+ * Read data from socket, wait until something arrive
+ *
+ * @param fd socket descriptor
+ * @param data pointer to buffer
+ * @param length maximum number of bytes
+ * @param timeout timeout in seconds, 0 - wait without limit
+ * @return number of bytes read, 0 when connection was closed, -1 on error or timeout
+ */
+static int PHPReadSome( int fd, char *data, FULONG length, int timeout )
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while( TRUE )
+	{
+		int res = poll( &pfd, 1, timeout > 0 ? timeout * 1000 : -1 );
+		if( res < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if( res <= 0 )
+		{
+			return -1;
+		}
+
+		ssize_t rd = recv( fd, data, length, 0 );
+		if( rd < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		return (int)rd;
+	}
+}
+
+/**
+ * Read exact number of bytes from socket
+ *
+ * @param fd socket descriptor
+ * @param data pointer to buffer
+ * @param length number of bytes
+ * @param timeout timeout in seconds
+ * @return 0 when success, otherwise -1
+ */
+static int PHPReadAll( int fd, char *data, FULONG length, int timeout )
+{
+	while( length > 0 )
+	{
+		int res = PHPReadSome( fd, data, length, timeout );
+		if( res <= 0 )
+		{
+			return -1;
+		}
+		data += res;
+		length -= res;
+	}
+	return 0;
+}
+
+/**
+ * Send frame to worker
+ *
+ * @param fd socket descriptor
+ * @param type frame type
+ * @param id request id
+ * @param payload frame data, can be NULL
+ * @param length data length
+ * @return 0 when success, otherwise -1
+ */
+static int PHPFrameWrite( int fd, int type, FULONG id, const char *payload, FULONG length )
+{
+	uint32_t header[ 3 ];
+	header[ 0 ] = htonl( (uint32_t)type );
+	header[ 1 ] = htonl( (uint32_t)id );
+	header[ 2 ] = htonl( (uint32_t)length );
+
+	if( PHPWriteAll( fd, (char *)header, PHP_FRAME_HEADER_SIZE ) != 0 )
+	{
+		return -1;
+	}
+	if( length > 0 )
+	{
+		return PHPWriteAll( fd, payload, length );
+	}
+	return 0;
+}
+
+/**
+ * Read frame header
+ *
+ * @param fd socket descriptor
+ * @param type pointer to place where frame type will be stored
+ * @param id pointer to place where request id will be stored
+ * @param length pointer to place where payload length will be stored
+ * @param timeout timeout in seconds
+ * @return 0 when success, otherwise -1
+ */
+static int PHPFrameReadHeader( int fd, int *type, FULONG *id, FULONG *length, int timeout )
+{
+	uint32_t header[ 3 ];
+
+	if( PHPReadAll( fd, (char *)header, PHP_FRAME_HEADER_SIZE, timeout ) != 0 )
+	{
+		return -1;
+	}
+	*type = (int)ntohl( header[ 0 ] );
+	*id = (FULONG)ntohl( header[ 1 ] );
+	*length = (FULONG)ntohl( header[ 2 ] );
+	return 0;
+}
+
+/**
+ * Skip frame payload
+ *
+ * @param fd socket descriptor
+ * @param length payload length
+ * @param timeout timeout in seconds
+ * @return 0 when success, otherwise -1
+ */
+static int PHPFrameSkip( int fd, FULONG length, int timeout )
+{
+	char buffer[ 1024 ];
+
+	while( length > 0 )
+	{
+		FULONG size = length > sizeof( buffer ) ? sizeof( buffer ) : length;
+		if( PHPReadAll( fd, buffer, size, timeout ) != 0 )
+		{
+			return -1;
+		}
+		length -= size;
+	}
+	return 0;
+}
+
+/**
+ * Start worker process
+ *
+ * @param pp pointer to PHPPool
+ * @param w pointer to PHPWorker
+ * @return 0 when success, otherwise error number
+ */
+static int PHPWorkerSpawn( PHPPool *pp, PHPWorker *w )
+{
+	int sv[ 2 ];
+
+	if( socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv ) != 0 )
+	{
+		FERROR("[PHPPool] Cannot create socket pair: %s\n", strerror( errno ) );
+		return -1;
+	}
+
+	// sysconf is not async-signal-safe, must be called before fork
+	long maxfd = sysconf( _SC_OPEN_MAX );
+	if( maxfd < 0 )
+	{
+		maxfd = 1024;
+	}
+
+	pid_t pid = fork();
+	if( pid < 0 )
+	{
+		FERROR("[PHPPool] Cannot fork: %s\n", strerror( errno ) );
+		close( sv[ 0 ] );
+		close( sv[ 1 ] );
+		return -2;
+	}
+
+	if( pid == 0 )
+	{
+		// FriendCore is multithreaded, only async-signal-safe calls are allowed here
+		// own process group, so processes forked by worker can be killed together with it
+		setpgid( 0, 0 );
+		
+		if( sv[ 1 ] == PHP_WORKER_FD )
+		{
+			fcntl( sv[ 1 ], F_SETFD, 0 );
+		}
+		else
+		{
+			dup2( sv[ 1 ], PHP_WORKER_FD );
+		}
+
+		// output which is not sent by frames is ignored
+		int nul = open( "/dev/null", O_WRONLY );
+		if( nul >= 0 )
+		{
+			dup2( nul, STDOUT_FILENO );
+		}
+		
+		// server descriptors are not CLOEXEC, worker would keep listening socket,
+		// client connections and database connections open for its whole life
+#ifdef SYS_close_range
+		if( syscall( SYS_close_range, PHP_WORKER_FD + 1, ~0U, 0 ) != 0 )
+#endif
+		{
+			int fd;
+			for( fd = PHP_WORKER_FD + 1 ; fd < maxfd ; fd++ )
+			{
+				close( fd );
+			}
+		}
+
+		execlp( "php", "php", PHP_WORKER_SCRIPT, (char *)NULL );
+		_exit( 127 );
+	}
+
+	close( sv[ 1 ] );
+	// set also here, kill() can be called before child runs setpgid
+	setpgid( pid, pid );
+
+	w->pw_PID = pid;
+	w->pw_Socket = sv[ 0 ];
+	w->pw_Requests = 0;
+	__sync_add_and_fetch( &(pp->pp_Spawned), 1 );
+
+	DEBUG("[PHPPool] Worker started, pid %d\n", pid );
+
+	return 0;
+}
+
+/**
+ * Stop worker process
+ *
+ * @param w pointer to PHPWorker
+ * @param force set to TRUE when process must be killed (it does not respond)
+ */
+static void PHPWorkerStop( PHPWorker *w, FBOOL force )
+{
+	if( w->pw_Socket >= 0 )
+	{
+		// worker quits when socket is closed
+		close( w->pw_Socket );
+		w->pw_Socket = -1;
+	}
+	if( w->pw_PID > 0 )
+	{
+		if( force == TRUE )
+		{
+			// whole group, script can run in process forked by worker
+			kill( -w->pw_PID, SIGKILL );
+		}
+		waitpid( w->pw_PID, NULL, 0 );
+		w->pw_PID = 0;
+	}
+}
+
+/**
+ * Send ping to idle worker and wait for answer
+ *
+ * @param pp pointer to PHPPool
+ * @param w pointer to PHPWorker
+ * @return TRUE when worker is alive, otherwise FALSE
+ */
+static FBOOL PHPWorkerPing( PHPPool *pp, PHPWorker *w )
+{
+	int type = 0;
+	FULONG id = 0, length = 0;
+
+	if( PHPFrameWrite( w->pw_Socket, PHP_FRAME_PING, 0, NULL, 0 ) != 0 )
+	{
+		return FALSE;
+	}
+	if( PHPFrameReadHeader( w->pw_Socket, &type, &id, &length, PHP_POOL_HEALTH_INTERVAL ) != 0 || type != PHP_FRAME_PONG )
+	{
+		return FALSE;
+	}
+	return PHPFrameSkip( w->pw_Socket, length, PHP_POOL_HEALTH_INTERVAL ) == 0 ? TRUE : FALSE;
+}
+
+/**
+ * Take free worker from pool, wait short time when all workers are busy
+ *
+ * PHP modules call FriendCore which can call PHP again, so caller does not wait for long,
+ * when no worker is available script is run without pool
+ *
+ * @param pp pointer to PHPPool
+ * @return pointer to running PHPWorker or NULL when no worker is available
+ */
+static PHPWorker *PHPPoolAcquire( PHPPool *pp )
+{
+	PHPWorker *w = NULL;
+	struct timespec ts;
+
+	clock_gettime( CLOCK_REALTIME, &ts );
+	ts.tv_nsec += PHP_POOL_ACQUIRE_WAIT * 1000000L;
+	if( ts.tv_nsec >= 1000000000L )
+	{
+		ts.tv_sec += ts.tv_nsec / 1000000000L;
+		ts.tv_nsec %= 1000000000L;
+	}
+
+	pthread_mutex_lock( &(pp->pp_Mutex) );
+	while( w == NULL )
+	{
+		int i;
+
+		// running workers are preferred, stopped one is started only when needed
+		for( i = 0; i < pp->pp_WorkersNumber; i++ )
+		{
+			if( pp->pp_Workers[ i ].pw_Busy == FALSE && pp->pp_Workers[ i ].pw_Socket >= 0 )
+			{
+				w = &(pp->pp_Workers[ i ]);
+				break;
+			}
+		}
+		if( w == NULL )
+		{
+			for( i = 0; i < pp->pp_WorkersNumber; i++ )
+			{
+				if( pp->pp_Workers[ i ].pw_Busy == FALSE )
+				{
+					w = &(pp->pp_Workers[ i ]);
+					break;
+				}
+			}
+		}
+
+		if( w == NULL && pthread_cond_timedwait( &(pp->pp_Cond), &(pp->pp_Mutex), &ts ) == ETIMEDOUT )
+		{
+			break;
+		}
+	}
+	if( w != NULL )
+	{
+		w->pw_Busy = TRUE;
+	}
+	pthread_mutex_unlock( &(pp->pp_Mutex) );
+
+	if( w != NULL && w->pw_Socket < 0 )
+	{
+		if( PHPWorkerSpawn( pp, w ) != 0 )
+		{
+			pthread_mutex_lock( &(pp->pp_Mutex) );
+			w->pw_Busy = FALSE;
+			pthread_cond_signal( &(pp->pp_Cond) );
+			pthread_mutex_unlock( &(pp->pp_Mutex) );
+			return NULL;
+		}
+	}
+	return w;
+}
+
+/**
+ * Return worker to pool. Broken and worn out workers are stopped, new process is started on next use.
+ *
+ * @param pp pointer to PHPPool
+ * @param w pointer to PHPWorker
+ * @param healthy set to FALSE when worker must be killed
+ */
+static void PHPPoolRelease( PHPPool *pp, PHPWorker *w, FBOOL healthy )
+{
+	if( healthy == FALSE )
+	{
+		__sync_add_and_fetch( &(pp->pp_Failures), 1 );
+		PHPWorkerStop( w, TRUE );
+	}
+	else if( pp->pp_MaxRequests > 0 && w->pw_Requests >= (FULONG)pp->pp_MaxRequests )
+	{
+		__sync_add_and_fetch( &(pp->pp_Recycled), 1 );
+		PHPWorkerStop( w, FALSE );
+	}
+
+	pthread_mutex_lock( &(pp->pp_Mutex) );
+	w->pw_Busy = FALSE;
+	w->pw_LastUsed = time( NULL );
+	pthread_cond_signal( &(pp->pp_Cond) );
+	pthread_mutex_unlock( &(pp->pp_Mutex) );
+}
+
+/**
+ * Create new PHP worker pool
+ *
+ * @param workers number of worker processes
+ * @param maxRequests number of requests after which worker is replaced (0 - never)
+ * @param timeout number of seconds request waits for worker answer (0 - no limit, worker is never killed because of slow script)
+ * @return pointer to new PHPPool or NULL when error appear
+ */
+PHPPool *PHPPoolNew( int workers, int maxRequests, int timeout )
+{
+	if( workers <= 0 )
+	{
+		return NULL;
+	}
+
+	PHPPool *pp = FCalloc( 1, sizeof( PHPPool ) );
+	if( pp == NULL )
+	{
+		FERROR("[PHPPool] Cannot allocate memory for pool\n");
+		return NULL;
+	}
+
+	pp->pp_Workers = FCalloc( workers, sizeof( PHPWorker ) );
+	if( pp->pp_Workers == NULL )
+	{
+		FERROR("[PHPPool] Cannot allocate memory for workers\n");
+		FFree( pp );
+		return NULL;
+	}
+
+	pp->pp_WorkersNumber = workers;
+	pp->pp_MaxRequests = maxRequests;
+	pp->pp_Timeout = timeout > 0 ? timeout : 0;
+
+	pthread_mutex_init( &(pp->pp_Mutex), NULL );
+	pthread_cond_init( &(pp->pp_Cond), NULL );
+
+	int i;
+	for( i = 0; i < workers; i++ )
+	{
+		pp->pp_Workers[ i ].pw_Socket = -1;
+		if( PHPWorkerSpawn( pp, &(pp->pp_Workers[ i ]) ) != 0 )
+		{
+			FERROR("[PHPPool] Cannot start worker %d, it will be started on first use\n", i );
+		}
+	}
+
+	pp->pp_HealthThread = ThreadNew( PHPPoolHealthThread, pp, TRUE, NULL );
+
+	INFO("[PHPPool] Pool created, workers %d\n", workers );
+
+	return pp;
+}
+
+/**
+ * Delete PHP worker pool and stop all workers
+ *
+ * @param pp pointer to PHPPool
+ */
+void PHPPoolDelete( PHPPool *pp )
+{
+	if( pp == NULL )
+	{
+		return;
+	}
+
+	if( pp->pp_HealthThread != NULL )
+	{
+		ThreadDelete( pp->pp_HealthThread );
+		pp->pp_HealthThread = NULL;
+	}
+
+	int i;
+	for( i = 0; i < pp->pp_WorkersNumber; i++ )
+	{
+		PHPWorkerStop( &(pp->pp_Workers[ i ]), pp->pp_Workers[ i ].pw_Busy );
+	}
+
+	pthread_cond_destroy( &(pp->pp_Cond) );
+	pthread_mutex_destroy( &(pp->pp_Mutex) );
+
+	FFree( pp->pp_Workers );
+	FFree( pp );
+}
+
+/**
+ * Launch php script by popen, used when pool is not available
+ *
+ * @param script path to script
+ * @param args script arguments
+ * @param argsNumber number of arguments
+ * @return pointer to FILE or NULL when error appear
+ */
+static FILE *PHPPoolPipeOpen( const char *script, const char **args, int argsNumber )
+{
+	BufString *bs = BufStringNewSize( 1024 );
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+
+	int i;
+	for( i = -1; i < argsNumber; i++ )
+	{
+		// Arguments are put in single quotes, so shell does not expand anything inside
+		const char *arg = i < 0 ? script : args[ i ];
+		BufStringAdd( bs, i < 0 ? "php '" : " '" );
+		while( arg != NULL && *arg != 0 )
+		{
+			const char *quote = strchr( arg, '\'' );
+			if( quote == NULL )
+			{
+				BufStringAdd( bs, arg );
+				break;
+			}
+			BufStringAddSize( bs, arg, quote - arg );
+			BufStringAdd( bs, "'\\''" );
+			arg = quote + 1;
+		}
+		BufStringAdd( bs, "'" );
+	}
+	BufStringAdd( bs, ";" );
+
+	FILE *pipe = popen( bs->bs_Buffer, "r" );
+	if( pipe == NULL )
+	{
+		FERROR("[PHPPool] Cannot open pipe: %s\n", strerror( errno ) );
+	}
+	BufStringDelete( bs );
+
+	return pipe;
+}
+
+/**
+ * Start php script. Script is sent to free worker, popen is used when pool is not available.
+ *
+ * @param pp pointer to PHPPool, can be NULL
+ * @param script path to script
+ * @param args script arguments ($argv[1]...)
+ * @param argsNumber number of arguments
+ * @return pointer to PHPPoolRequest or NULL when error appear
+ */
+PHPPoolRequest *PHPPoolOpen( PHPPool *pp, const char *script, const char **args, int argsNumber )
+{
+	if( script == NULL )
+	{
+		return NULL;
+	}
+
+	PHPPoolRequest *pr = FCalloc( 1, sizeof( PHPPoolRequest ) );
+	if( pr == NULL )
+	{
+		FERROR("[PHPPool] Cannot allocate memory for request\n");
+		return NULL;
+	}
+	pr->pr_Pool = pp;
+
+	if( pp != NULL )
+	{
+		// payload: script and arguments separated by 0
+		BufString *bs = BufStringNewSize( 1024 );
+		if( bs != NULL )
+		{
+			int i;
+			BufStringAddSize( bs, script, strlen( script ) + 1 );
+			for( i = 0; i < argsNumber; i++ )
+			{
+				const char *arg = args[ i ] != NULL ? args[ i ] : "";
+				BufStringAddSize( bs, arg, strlen( arg ) + 1 );
+			}
+
+			// second try is made when worker died while it was idle
+			int attempt;
+			for( attempt = 0; attempt < 2 && pr->pr_Worker == NULL; attempt++ )
+			{
+				PHPWorker *w = PHPPoolAcquire( pp );
+				if( w == NULL )
+				{
+					break;
+				}
+
+				pr->pr_ID = __sync_add_and_fetch( &(pp->pp_RequestID), 1 );
+				if( PHPFrameWrite( w->pw_Socket, PHP_FRAME_REQUEST, pr->pr_ID, bs->bs_Buffer, bs->bs_Size - 1 ) == 0 )
+				{
+					w->pw_Requests++;
+					pr->pr_Worker = w;
+					__sync_add_and_fetch( &(pp->pp_Requests), 1 );
+				}
+				else
+				{
+					PHPPoolRelease( pp, w, FALSE );
+				}
+			}
+			BufStringDelete( bs );
+		}
+
+		if( pr->pr_Worker != NULL )
+		{
+			return pr;
+		}
+		__sync_add_and_fetch( &(pp->pp_Fallbacks), 1 );
+	}
+
+	pr->pr_Pipe = PHPPoolPipeOpen( script, args, argsNumber );
+	if( pr->pr_Pipe == NULL )
+	{
+		FFree( pr );
+		return NULL;
+	}
+	return pr;
+}
+
+/**
+ * Read php script output
+ *
+ * @param pr pointer to PHPPoolRequest
+ * @param buffer pointer to buffer where data will be stored
+ * @param size buffer size
+ * @return number of bytes read, 0 when all data was read, -1 when error appear
+ */
+int PHPPoolRead( PHPPoolRequest *pr, char *buffer, int size )
+{
+	if( pr->pr_Pipe != NULL )
+	{
+		if( feof( pr->pr_Pipe ) )
+		{
+			return 0;
+		}
+		return (int)fread( buffer, sizeof( char ), size, pr->pr_Pipe );
+	}
+
+	PHPWorker *w = pr->pr_Worker;
+	int timeout = pr->pr_Pool->pp_Timeout;
+
+	while( pr->pr_Remaining == 0 )
+	{
+		int type = 0;
+		FULONG id = 0, length = 0;
+
+		if( pr->pr_Finished == TRUE )
+		{
+			return pr->pr_Failed == TRUE ? -1 : 0;
+		}
+
+		if( PHPFrameReadHeader( w->pw_Socket, &type, &id, &length, timeout ) != 0 )
+		{
+			FERROR("[PHPPool] Worker %d did not answer\n", w->pw_PID );
+			pr->pr_Failed = pr->pr_Finished = TRUE;
+			return -1;
+		}
+
+		if( type == PHP_FRAME_DATA && id == pr->pr_ID )
+		{
+			pr->pr_Remaining = length;
+		}
+		else if( type == PHP_FRAME_END && id == pr->pr_ID && length < 64 )
+		{
+			char code[ 64 ];
+			if( PHPReadAll( w->pw_Socket, code, length, timeout ) != 0 )
+			{
+				pr->pr_Failed = pr->pr_Finished = TRUE;
+				return -1;
+			}
+			code[ length ] = 0;
+			pr->pr_WorkerQuit = ( strstr( code, "quit" ) != NULL );
+			pr->pr_Finished = TRUE;
+		}
+		else if( PHPFrameSkip( w->pw_Socket, length, timeout ) != 0 )
+		{
+			pr->pr_Failed = pr->pr_Finished = TRUE;
+			return -1;
+		}
+	}
+
+	FULONG toRead = pr->pr_Remaining < (FULONG)size ? pr->pr_Remaining : (FULONG)size;
+	int res = PHPReadSome( w->pw_Socket, buffer, toRead, timeout );
+	if( res <= 0 )
+	{
+		pr->pr_Failed = pr->pr_Finished = TRUE;
+		return -1;
+	}
+	pr->pr_Remaining -= res;
+
+	return res;
+}
+
+/**
+ * Finish php request. Worker which did not finish request is killed.
+ *
+ * @param pr pointer to PHPPoolRequest
+ */
+void PHPPoolClose( PHPPoolRequest *pr )
+{
+	if( pr == NULL )
+	{
+		return;
+	}
+
+	if( pr->pr_Pipe != NULL )
+	{
+		pclose( pr->pr_Pipe );
+	}
+	else if( pr->pr_Worker != NULL )
+	{
+		FBOOL healthy = ( pr->pr_Finished == TRUE && pr->pr_Failed == FALSE && pr->pr_Remaining == 0 );
+		if( healthy == TRUE && pr->pr_WorkerQuit == TRUE )
+		{
+			PHPWorkerStop( pr->pr_Worker, FALSE );
+		}
+		PHPPoolRelease( pr->pr_Pool, pr->pr_Worker, healthy );
+	}
+
+	FFree( pr );
+}
+
+/**
+ * Run php script and return its output
+ *
+ * @param pp pointer to PHPPool, can be NULL
+ * @param script path to script
+ * @param args script arguments
+ * @param argsNumber number of arguments
+ * @return new ListString with joined output or NULL when error appear
+ */
+ListString *PHPPoolRun( PHPPool *pp, const char *script, const char **args, int argsNumber )
+{
+	PHPPoolRequest *pr = PHPPoolOpen( pp, script, args, argsNumber );
+	if( pr == NULL )
+	{
+		return NULL;
+	}
+
+	ListString *ls = ListStringNew();
+	if( ls != NULL )
+	{
+#define PHP_POOL_READ_SIZE 262144
+		char *buffer = FMalloc( PHP_POOL_READ_SIZE );
+		if( buffer != NULL )
+		{
+			int size;
+			while( ( size = PHPPoolRead( pr, buffer, PHP_POOL_READ_SIZE ) ) > 0 )
+			{
+				ListStringAdd( ls, buffer, size );
+			}
+			FFree( buffer );
+		}
+		ListStringJoin( ls );
+	}
+
+	PHPPoolClose( pr );
+
+	return ls;
+}
+
+/**
+ * Get pool statistics
+ *
+ * @param pp pointer to PHPPool
+ * @param buffer pointer to buffer where JSON will be stored
+ * @param size buffer size
+ * @return number of characters written
+ */
+int PHPPoolGetStatistics( PHPPool *pp, char *buffer, int size )
+{
+	if( pp == NULL || buffer == NULL )
+	{
+		return 0;
+	}
+
+	int i, running = 0, busy = 0;
+
+	pthread_mutex_lock( &(pp->pp_Mutex) );
+	for( i = 0; i < pp->pp_WorkersNumber; i++ )
+	{
+		if( pp->pp_Workers[ i ].pw_Socket >= 0 )
+		{
+			running++;
+		}
+		if( pp->pp_Workers[ i ].pw_Busy == TRUE )
+		{
+			busy++;
+		}
+	}
+	pthread_mutex_unlock( &(pp->pp_Mutex) );
+
+	return snprintf( buffer, size, "{\"workers\":%d,\"running\":%d,\"busy\":%d,\"requests\":%lu,\"spawned\":%lu,\"recycled\":%lu,\"failures\":%lu,\"fallbacks\":%lu}",
+		pp->pp_WorkersNumber, running, busy, pp->pp_Requests, pp->pp_Spawned, pp->pp_Recycled, pp->pp_Failures, pp->pp_Fallbacks );
+}
+
+/**
+ * Health check thread. Idle workers are pinged, workers which do not answer are replaced.
+ *
+ * @param t pointer to FThread
+ */
+static void PHPPoolHealthThread( FThread *t )
+{
+	PHPPool *pp = (PHPPool *)t->t_Data;
+	int counter = 0;
+
+	while( t->t_Quit != TRUE )
+	{
+		sleep( 1 );
+		if( ++counter < PHP_POOL_HEALTH_INTERVAL )
+		{
+			continue;
+		}
+		counter = 0;
+
+		int i;
+		for( i = 0; i < pp->pp_WorkersNumber && t->t_Quit != TRUE; i++ )
+		{
+			PHPWorker *w = &(pp->pp_Workers[ i ]);
+
+			pthread_mutex_lock( &(pp->pp_Mutex) );
+			if( w->pw_Busy == TRUE || w->pw_Socket < 0 )
+			{
+				pthread_mutex_unlock( &(pp->pp_Mutex) );
+				continue;
+			}
+			w->pw_Busy = TRUE;
+			pthread_mutex_unlock( &(pp->pp_Mutex) );
+
+			FBOOL healthy = PHPWorkerPing( pp, w );
+			if( healthy == FALSE )
+			{
+				Log( FLOG_ERROR, "[PHPPool] Worker %d does not respond, it will be replaced\n", w->pw_PID );
+			}
+			PHPPoolRelease( pp, w, healthy );
+		}
+	}
+	t->t_Launched = FALSE;
+}
@@ -0,0 +1,160 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  Pool of persistent PHP worker processes
+ *
+ *  Workers run php/phpworker.php and talk with FriendCore over unix socket.
+ *  Every frame starts with 12 bytes header: type, request id and payload length
+ *  (network byte order).
+ *
+ *  @date created 2017
+ */
+
+#ifndef __SYSTEM_PHP_PHP_POOL_H__
+#define __SYSTEM_PHP_PHP_POOL_H__
+
+#include <core/types.h>
+#include <core/thread.h>
+#include <util/list_string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define PHP_WORKER_SCRIPT "php/phpworker.php"
+#define PHP_WORKER_FD 3		// socket descriptor number in worker process
+
+#define PHP_POOL_WORKERS_DEFAULT 4
+#define PHP_POOL_MAX_REQUESTS_DEFAULT 500
+#define PHP_POOL_TIMEOUT_DEFAULT 0		// seconds script can run without sending output, 0 - no limit (scripts could always run as long as they need)
+#define PHP_POOL_HEALTH_INTERVAL 5		// seconds
+#define PHP_POOL_ACQUIRE_WAIT 50		// milliseconds, caller waits for free worker, then script is run by popen
+
+//
+// frame types
+//
+
+enum {
+	PHP_FRAME_REQUEST = 1,	// payload: script and arguments separated by 0
+	PHP_FRAME_DATA,			// payload: script output
+	PHP_FRAME_END,			// payload: exit code as text, "quit" is added when worker process ends
+	PHP_FRAME_PING,
+	PHP_FRAME_PONG
+};
+
+#define PHP_FRAME_HEADER_SIZE 12
+
+//
+// worker process
+//
+
+typedef struct PHPWorker
+{
+	pid_t					pw_PID;
+	int						pw_Socket;			// -1 when worker is not running
+	FBOOL					pw_Busy;
+	FULONG					pw_Requests;		// requests served by this process
+	time_t					pw_LastUsed;
+} PHPWorker;
+
+//
+// pool
+//
+
+typedef struct PHPPool
+{
+	PHPWorker				*pp_Workers;
+	int						pp_WorkersNumber;
+	int						pp_MaxRequests;		// worker is recycled after this number of requests
+	int						pp_Timeout;			// seconds
+	FULONG					pp_RequestID;
+
+	pthread_mutex_t			pp_Mutex;
+	pthread_cond_t			pp_Cond;
+	FThread					*pp_HealthThread;
+
+	FULONG					pp_Requests;		// statistics
+	FULONG					pp_Spawned;
+	FULONG					pp_Recycled;
+	FULONG					pp_Failures;
+	FULONG					pp_Fallbacks;
+} PHPPool;
+
+//
+// single request, output is read by PHPPoolRead
+//
+
+typedef struct PHPPoolRequest
+{
+	PHPPool					*pr_Pool;
+	PHPWorker				*pr_Worker;			// NULL when request is served by popen
+	FILE					*pr_Pipe;
+	FULONG					pr_ID;
+	FULONG					pr_Remaining;		// bytes left in current data frame
+	FBOOL					pr_Finished;
+	FBOOL					pr_Failed;
+	FBOOL					pr_WorkerQuit;		// worker ends after this request
+} PHPPoolRequest;
+
+//
+//
+//
+
+PHPPool *PHPPoolNew( int workers, int maxRequests, int timeout );
+
+//
+//
+//
+
+void PHPPoolDelete( PHPPool *pp );
+
+//
+// Start php script, pool can be NULL (popen is used then)
+//
+
+PHPPoolRequest *PHPPoolOpen( PHPPool *pp, const char *script, const char **args, int argsNumber );
+
+//
+// Read script output, returns 0 when all data was read, -1 on error
+//
+
+int PHPPoolRead( PHPPoolRequest *pr, char *buffer, int size );
+
+//
+// Finish request and return worker to pool
+//
+
+void PHPPoolClose( PHPPoolRequest *pr );
+
+//
+// Run php script and return whole output
+//
+
+ListString *PHPPoolRun( PHPPool *pp, const char *script, const char **args, int argsNumber );
+
+//
+// Get pool statistics as JSON
+//
+
+int PHPPoolGetStatistics( PHPPool *pp, char *buffer, int size );
+
+#endif // __SYSTEM_PHP_PHP_POOL_H__
@@ -45,6 +45,8 @@
 #include <dirent.h> 
 #include <stdio.h> 
 #include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
 #include <system/services/service_manager.h>
 #include <properties/propertieslibrary.h>
 #include <ctype.h>
@@ -154,7 +156,6 @@ SystemBase *SystemInit( void )
 	// init libraries
 	
 	l->UserLibCounter = 0;
-	l->MsqLlibCounter = 0;
 	l->AppLibCounter = 0;
 	l->PropLibCounter = 0;
 	l->ZLibCounter = 0;
@@ -162,6 +163,7 @@ SystemBase *SystemInit( void )
 	// Set mutex
 	pthread_mutex_init( &l->sl_InternalMutex, NULL );
 	pthread_mutex_init( &l->sl_ResourceMutex, NULL );
+	pthread_mutex_init( &l->sl_SQLMutex, NULL );
 	int 				msqllibc;
 	int				sl_Error;					// last error
 
@@ -213,6 +215,7 @@ SystemBase *SystemInit( void )
 	char *dbname = "FriendMaster";
 	int port = 3306;
 	l->sqlpoolConnections = DEFAULT_SQLLIB_POOL_NUMBER;
+	l->sl_SQLTimeout = DEFAULT_SQLLIB_POOL_TIMEOUT;
 	Props *prop = NULL;
 
 	// Get a copy of the properties.library
@@ -224,9 +227,27 @@ SystemBase *SystemInit( void )
 	}
 	l->sl_ActiveModuleName = StringDuplicate( "fcdb.authmod" );
 	l->sl_CacheFiles = TRUE;
+	l->sl_CompressFiles = TRUE;
+	l->sl_CompressMinSize = 1024;
+	l->sl_PHPWorkers = PHP_POOL_WORKERS_DEFAULT;
+	l->sl_PHPWorkerMaxRequests = PHP_POOL_MAX_REQUESTS_DEFAULT;
+	l->sl_PHPTimeout = PHP_POOL_TIMEOUT_DEFAULT;
 	l->sl_UnMountDevicesInDB =TRUE;
 	l->sl_SocketTimeout = 10000;
 	l->sl_WorkersNumber = WORKERS_MAX;
+	l->sl_WorkersQueueSize = WORKERS_QUEUE_SIZE_DEFAULT;
+	l->sl_WorkersPinned = FALSE;
+	l->sl_KeepAliveTimeout = HTTP_KEEPALIVE_TIMEOUT_DEFAULT;
+	l->sl_KeepAliveMaxRequests = HTTP_KEEPALIVE_MAX_REQUESTS_DEFAULT;
+	l->sl_MaxBufferedBody = HTTP_BODY_BUFFERED_MAX_DEFAULT;
+	l->sl_WSQueueSize = WS_QUEUE_SIZE_DEFAULT;
+	l->sl_WSQueuePolicy = WS_QUEUE_POLICY_DROP;
+	l->sl_WSCompression = TRUE;
+	l->sl_WSDeflateWindowBits = WS_DEFLATE_WINDOW_BITS_DEFAULT;
+	l->sl_WSDeflateMemLevel = WS_DEFLATE_MEM_LEVEL_DEFAULT;
+	l->sl_WSDeflateThreshold = WS_DEFLATE_THRESHOLD_DEFAULT;
+	l->sl_PermCacheTTL = FSM_PERM_CACHE_TTL_DEFAULT;
+	l->sl_PermCacheSize = FSM_PERM_CACHE_SIZE_DEFAULT;
 	l->sl_USFCacheMax = 102400000;
 	l->sl_DefaultDBLib = StringDuplicate("mysql.library");
 	
@@ -281,8 +302,11 @@ SystemBase *SystemInit( void )
 			DEBUG("[SystemBase] port read %d\n", port );
 			l->sqlpoolConnections = plib->ReadInt( prop, "DatabaseUser:connections", DEFAULT_SQLLIB_POOL_NUMBER );
 			DEBUG("[SystemBase] connections read %d\n", l->sqlpoolConnections );
+			l->sl_SQLTimeout = plib->ReadInt( prop, "DatabaseUser:waittimeout", DEFAULT_SQLLIB_POOL_TIMEOUT );
 			
 			l->sl_CacheFiles = plib->ReadInt( prop, "Options:CacheFiles", 1 );
+			l->sl_CompressFiles = plib->ReadInt( prop, "Options:CompressFiles", 1 );
+			l->sl_CompressMinSize = plib->ReadInt( prop, "Options:CompressMinSize", 1024 );
 			l->sl_UnMountDevicesInDB = plib->ReadInt( prop, "Options:UnmountInDB", 1 );
 			l->sl_SocketTimeout  = plib->ReadInt( prop, "Core:SSLSocketTimeout", 10000 );
 			l->sl_USFCacheMax = plib->ReadInt( prop, "Core:USFCachePerDevice", 102400000 );
@@ -311,6 +335,22 @@ SystemBase *SystemInit( void )
 			{
 				l->sl_WorkersNumber = WORKERS_MIN;
 			}
+			l->sl_WorkersQueueSize = plib->ReadInt( prop, "Core:WorkersQueue", WORKERS_QUEUE_SIZE_DEFAULT );
+			l->sl_WorkersPinned = plib->ReadInt( prop, "Core:WorkersPinned", 0 );
+			l->sl_KeepAliveTimeout = plib->ReadInt( prop, "Core:KeepAliveTimeout", HTTP_KEEPALIVE_TIMEOUT_DEFAULT );
+			l->sl_KeepAliveMaxRequests = plib->ReadInt( prop, "Core:KeepAliveMaxRequests", HTTP_KEEPALIVE_MAX_REQUESTS_DEFAULT );
+			l->sl_MaxBufferedBody = plib->ReadInt( prop, "Core:MaxBufferedBody", HTTP_BODY_BUFFERED_MAX_DEFAULT );
+			l->sl_PHPWorkers = plib->ReadInt( prop, "Core:PHPWorkers", PHP_POOL_WORKERS_DEFAULT );
+			l->sl_PHPWorkerMaxRequests = plib->ReadInt( prop, "Core:PHPWorkerMaxRequests", PHP_POOL_MAX_REQUESTS_DEFAULT );
+			l->sl_PHPTimeout = plib->ReadInt( prop, "Core:PHPTimeout", PHP_POOL_TIMEOUT_DEFAULT );
+			l->sl_WSQueueSize = plib->ReadInt( prop, "Core:WSQueueSize", WS_QUEUE_SIZE_DEFAULT );
+			l->sl_WSQueuePolicy = WebsocketQueuePolicyFromName( plib->ReadString( prop, "Core:WSQueuePolicy", "drop" ) );
+			l->sl_WSCompression = plib->ReadInt( prop, "Core:WSCompression", 1 );
+			l->sl_WSDeflateWindowBits = plib->ReadInt( prop, "Core:WSDeflateWindowBits", WS_DEFLATE_WINDOW_BITS_DEFAULT );
+			l->sl_WSDeflateMemLevel = plib->ReadInt( prop, "Core:WSDeflateMemLevel", WS_DEFLATE_MEM_LEVEL_DEFAULT );
+			l->sl_WSDeflateThreshold = plib->ReadInt( prop, "Core:WSDeflateThreshold", WS_DEFLATE_THRESHOLD_DEFAULT );
+			l->sl_PermCacheTTL = plib->ReadInt( prop, "Core:PermissionCacheTTL", FSM_PERM_CACHE_TTL_DEFAULT );
+			l->sl_PermCacheSize = plib->ReadInt( prop, "Core:PermissionCacheSize", FSM_PERM_CACHE_SIZE_DEFAULT );
 			
 			if( l->sl_ActiveModuleName != NULL )
 			{
@@ -343,6 +383,11 @@ SystemBase *SystemInit( void )
 				if( l->sqlpool[i ].sqllib != NULL )
 				{
 					l->sqlpool[i ].sqllib->Connect( l->sqlpool[i ].sqllib, host, dbname, login, pass, port );
+					l->sqlpool[i ].sqllib->l_PoolSlot = &(l->sqlpool[i ]);
+					
+					// put connection on free list
+					l->sqlpool[i ].next = l->sl_SQLFree;
+					l->sl_SQLFree = &(l->sqlpool[i ]);
 				}
 			}
 		}
@@ -364,7 +409,7 @@ SystemBase *SystemInit( void )
 		return NULL;
 	}
 	
-	l->sl_WorkerManager = WorkerManagerNew( l->sl_WorkersNumber );
+	l->sl_WorkerManager = WorkerManagerNew( l->sl_WorkersNumber, l->sl_WorkersQueueSize, l->sl_WorkersPinned );
 	l->fcm = FriendCoreManagerNew();
 	
 	Log( FLOG_INFO,  "[SystemBase] Systembase: Initialize interfaces\n" );
@@ -376,6 +421,7 @@ SystemBase *SystemInit( void )
 	UserManagerInterfaceInit( &(l->sl_UserManagerInterface) );
 	CommServiceInterfaceInit( &(l->sl_CommServiceInterface) );
 	CommServiceRemoteInterfaceInit( &(l->sl_CommServiceRemoteInterface) );
+	PHPPoolInterfaceInit( &(l->sl_PHPPoolInterface) );
 
 	l->alib = l->LibraryApplicationGet( l );
 	// dictionary
@@ -713,6 +759,16 @@ SystemBase *SystemInit( void )
 		Log( FLOG_ERROR, "Cannot initialize CacheManager\n");
 	}
 	
+	// when pool is not available scripts are started by popen
+	if( l->sl_PHPWorkers > 0 )
+	{
+		l->sl_PHPPool = PHPPoolNew( l->sl_PHPWorkers, l->sl_PHPWorkerMaxRequests, l->sl_PHPTimeout );
+		if( l->sl_PHPPool == NULL )
+		{
+			Log( FLOG_ERROR, "Cannot initialize PHPPool\n");
+		}
+	}
+	
 	// 
 	l->nm = INVARManagerNew();
 	if( l->nm == NULL )
@@ -829,6 +885,12 @@ void SystemClose( SystemBase *l )
 		CacheManagerDelete( l->cm );
 	}
 	
+	if( l->sl_PHPPool != NULL )
+	{
+		PHPPoolDelete( l->sl_PHPPool );
+		l->sl_PHPPool = NULL;
+	}
+	
 	//
 	// Delete dictionary
 	//
@@ -1015,6 +1077,7 @@ void SystemClose( SystemBase *l )
 	
 	// Destroy mutex
 	pthread_mutex_destroy( &l->sl_ResourceMutex );
+	pthread_mutex_destroy( &l->sl_SQLMutex );
 	pthread_mutex_destroy( &l->sl_InternalMutex );
 	
 	Autotask *at = l->sl_Autotasks;
@@ -1131,6 +1194,8 @@ int SystemInitExternal( SystemBase *l )
 		{
 			DEBUG("[SystemBase] Assigning sessions to users by ID %ld\n", usess->us_ID );
 			
+			USMSessionIndexAdd( l->sl_USM, usess );
+			
 			// checking if user exist, if not it is created
 			User *usr = l->sl_UM->um_Users;
 			while( usr != NULL )
@@ -1274,6 +1339,7 @@ int SystemInitExternal( SystemBase *l )
 					}
 					ses->node.mln_Succ = (MinNode *)l->sl_USM->usm_Sessions;
 					l->sl_USM->usm_Sessions = ses;
+					USMSessionIndexAdd( l->sl_USM, ses );
 					if( nextses != NULL )
 					{
 						nextses->node.mln_Pred = (MinNode *)ses;
@@ -1868,90 +1934,128 @@ void AuthModuleDrop( SystemBase *l, AuthMod *uclose )
 }
 
 /**
- * Get mysql.library from pool
+ * Get mysql.library from pool. When all connections are in use thread waits
+ * until connection is returned, waiting threads are served in FIFO order.
  *
  * @param l pointer to SystemBase
- * @return pointer to mysql.library
+ * @return pointer to mysql.library or NULL when no connection was available before timeout
  */
 
 SQLLibrary *LibrarySQLGet( SystemBase *l )
 {
-	SQLLibrary *retlib = NULL;
-	int i ;
-	int timer = 0;
-	int retries = 0;
-	int usingSleep = 0;
+	SQLConPool *con = NULL;
+	
+	pthread_mutex_lock( &l->sl_SQLMutex );
 	
-	while( TRUE )
+	// nobody is waiting, take connection directly
+	if( l->sl_SQLWaitFirst == NULL && l->sl_SQLFree != NULL )
 	{
-		if( pthread_mutex_lock( &l->sl_ResourceMutex ) == 0 )
+		con = l->sl_SQLFree;
+		l->sl_SQLFree = con->next;
+	}
+	else
+	{
+		SQLConWaiter waiter;
+		struct timeval start;
+		struct timespec deadline;
+		int err = 0;
+		
+		memset( &waiter, 0, sizeof( SQLConWaiter ) );
+		pthread_cond_init( &waiter.scw_Cond, NULL );
+		
+		if( l->sl_SQLWaitLast != NULL )
 		{
-			if( l->sqlpool[ l->MsqLlibCounter ].inUse == FALSE )
+			l->sl_SQLWaitLast->scw_Next = &waiter;
+		}
+		else
+		{
+			l->sl_SQLWaitFirst = &waiter;
+		}
+		l->sl_SQLWaitLast = &waiter;
+		l->sl_SQLWaits++;
+		
+		gettimeofday( &start, NULL );
+		if( l->sl_SQLTimeout > 0 )
+		{
+			FQUAD nsec = (FQUAD)start.tv_usec * 1000 + (FQUAD)( l->sl_SQLTimeout % 1000 ) * 1000000;
+			deadline.tv_sec = start.tv_sec + l->sl_SQLTimeout / 1000 + nsec / 1000000000;
+			deadline.tv_nsec = nsec % 1000000000;
+		}
+		
+		// connection is handed over by LibrarySQLDrop
+		while( waiter.scw_Connection == NULL && err != ETIMEDOUT )
+		{
+			if( l->sl_SQLTimeout > 0 )
 			{
-				pthread_mutex_unlock( &l->sl_ResourceMutex );
-			
-				pthread_mutex_lock( &l->sl_ResourceMutex );
-				retlib = l->sqlpool[l->MsqLlibCounter ].sqllib;
-				if( retlib == NULL || retlib->GetStatus( retlib ) != SQL_STATUS_READY ) //retlib->con.sql_Con->status != MYSQL_STATUS_READY )
-				{
-					FERROR( "[LibraryMYSQLGet] We found a NULL pointer on slot %d!\n", l->MsqLlibCounter );
-					// Increment and check
-					if( ++l->MsqLlibCounter >= l->sqlpoolConnections ) l->MsqLlibCounter = 0;
-					pthread_mutex_unlock( &l->sl_ResourceMutex );
-					continue;
-				}
-				l->sqlpool[ l->MsqLlibCounter ].inUse = TRUE;
-				if( l->sqlpool[ l->MsqLlibCounter ].sqllib->con.sql_Recconect == TRUE )
-				{
-					l->sqlpool[ l->MsqLlibCounter ].sqllib->Reconnect(  l->sqlpool[ l->MsqLlibCounter ].sqllib );
-					l->sqlpool[ l->MsqLlibCounter ].sqllib->con.sql_Recconect = FALSE;
-				}
-			
-				INFO( "[LibraryMYSQLGet] We found mysql library on slot %d.\n", l->MsqLlibCounter );
-			
-				// Increment and check
-				if( ++l->MsqLlibCounter >= l->sqlpoolConnections ) l->MsqLlibCounter = 0;
-				pthread_mutex_unlock( &l->sl_ResourceMutex );
-				break;
+				err = pthread_cond_timedwait( &waiter.scw_Cond, &l->sl_SQLMutex, &deadline );
 			}
 			else
 			{
-				pthread_mutex_unlock( &l->sl_ResourceMutex );
+				pthread_cond_wait( &waiter.scw_Cond, &l->sl_SQLMutex );
 			}
 		}
+		con = waiter.scw_Connection;
 		
-		timer++;
-		if( timer >= l->sqlpoolConnections )
+		// timeout, remove from waiting list
+		if( con == NULL )
 		{
-			timer = 0;
-			usleep( 20000 );
+			SQLConWaiter *prev = NULL, *w = l->sl_SQLWaitFirst;
+			while( w != NULL && w != &waiter )
+			{
+				prev = w;
+				w = w->scw_Next;
+			}
+			if( w != NULL )
+			{
+				if( prev != NULL ) prev->scw_Next = waiter.scw_Next;
+				else l->sl_SQLWaitFirst = waiter.scw_Next;
+				if( l->sl_SQLWaitLast == &waiter ) l->sl_SQLWaitLast = prev;
+			}
+			l->sl_SQLTimeouts++;
 		}
 		
-		l->MsqLlibCounter++;
-		if( l->MsqLlibCounter >= l->sqlpoolConnections )
+		struct timeval now;
+		gettimeofday( &now, NULL );
+		FULONG waited = (FULONG)( ( now.tv_sec - start.tv_sec ) * 1000 + ( now.tv_usec - start.tv_usec ) / 1000 );
+		l->sl_SQLWaitTime += waited;
+		if( waited > l->sl_SQLWaitTimeMax )
 		{
-			l->MsqLlibCounter = 0;
+			l->sl_SQLWaitTimeMax = waited;
 		}
 		
-		/*
-		retries++;
-		if( retries >= l->sqlpoolConnections )
-		{
-			if( usingSleep++ >= 32 )
-			{
-				DEBUG( "All SQL connections are busy!\n" );
-				break;
-			}
-			usleep( 5000 );
-		}
-		*/
+		pthread_cond_destroy( &waiter.scw_Cond );
+	}
+	
+	if( con == NULL )
+	{
+		pthread_mutex_unlock( &l->sl_SQLMutex );
+		FERROR( "[LibraryMYSQLGet] No database connection available after %d ms\n", l->sl_SQLTimeout );
+		return NULL;
+	}
+	
+	con->inUse = TRUE;
+	con->next = NULL;
+	l->sl_SQLAcquired++;
+	pthread_mutex_unlock( &l->sl_SQLMutex );
+	
+	// connection belongs to this thread now
+	SQLLibrary *retlib = con->sqllib;
+	if( retlib->GetStatus( retlib ) != SQL_STATUS_READY )
+	{
+		FERROR( "[LibraryMYSQLGet] Connection %p is not ready, reconnecting\n", retlib );
+		retlib->con.sql_Recconect = TRUE;
+	}
+	if( retlib->con.sql_Recconect == TRUE )
+	{
+		retlib->Reconnect( retlib );
+		retlib->con.sql_Recconect = FALSE;
 	}
 	
 	return retlib;
 }
 
 /**
- * Drop mysql.library to pool
+ * Drop mysql.library to pool. Connection is given to first waiting thread or put on free list.
  *
  * @param l pointer to SystemBase
  * @param mclose pointer to mysql.library which will be returned to pool
@@ -1959,29 +2063,69 @@ SQLLibrary *LibrarySQLGet( SystemBase *l )
 
 void LibrarySQLDrop( SystemBase *l, SQLLibrary *mclose )
 {
-	int i = 0;
-	int closed = -1;
+	if( mclose == NULL || mclose->l_PoolSlot == NULL )
+	{
+		return;
+	}
+	
+	SQLConPool *con = (SQLConPool *)mclose->l_PoolSlot;
+	
+	pthread_mutex_lock( &l->sl_SQLMutex );
 	
-	for( ; i < l->sqlpoolConnections ; i++ )
+	if( con->inUse == FALSE )
 	{
-		if( l->sqlpool[ i ].sqllib == mclose )
-		{
-			pthread_mutex_lock( &l->sl_ResourceMutex );
-			l->sqlpool[ i ].inUse = FALSE;
-			pthread_mutex_unlock( &l->sl_ResourceMutex );
-			closed = i;
-		}
-		
-		if( l->sqlpool[ i ].inUse != FALSE )
+		pthread_mutex_unlock( &l->sl_SQLMutex );
+		FERROR( "[SystemBase] Mysql connection %p returned twice\n", mclose );
+		return;
+	}
+	
+	SQLConWaiter *waiter = l->sl_SQLWaitFirst;
+	if( waiter != NULL )
+	{
+		l->sl_SQLWaitFirst = waiter->scw_Next;
+		if( l->sl_SQLWaitFirst == NULL )
 		{
-			DEBUG( "[SystemBase] Mysql slot %d is still in use\n", i );
+			l->sl_SQLWaitLast = NULL;
 		}
+		waiter->scw_Connection = con;		// connection stays in use
+		pthread_cond_signal( &waiter->scw_Cond );
 	}
+	else
+	{
+		con->inUse = FALSE;
+		con->next = l->sl_SQLFree;
+		l->sl_SQLFree = con;
+	}
+	
+	pthread_mutex_unlock( &l->sl_SQLMutex );
+}
+
+/**
+ * Get database connection pool statistics
+ *
+ * @param l pointer to SystemBase
+ * @param buffer pointer to buffer where statistics in JSON format will be stored
+ * @param size size of buffer
+ * @return number of characters written
+ */
+
+int LibrarySQLGetStatistics( SystemBase *l, char *buffer, int size )
+{
+	int i, busy = 0;
 	
-	if( closed != -1 )
+	pthread_mutex_lock( &l->sl_SQLMutex );
+	for( i = 0; i < l->sqlpoolConnections; i++ )
 	{
-		INFO( "[SystemBase] MYSQL slot %d was closed properly.\n", closed );
+		if( l->sqlpool[ i ].inUse == TRUE )
+		{
+			busy++;
+		}
 	}
+	int len = snprintf( buffer, size, "{\"connections\":%d,\"busy\":%d,\"acquired\":%lu,\"waits\":%lu,\"timeouts\":%lu,\"waittime\":%lu,\"waittimemax\":%lu}",
+		l->sqlpoolConnections, busy, l->sl_SQLAcquired, l->sl_SQLWaits, l->sl_SQLTimeouts, l->sl_SQLWaitTime, l->sl_SQLWaitTimeMax );
+	pthread_mutex_unlock( &l->sl_SQLMutex );
+	
+	return len;
 }
 
 /**
@@ -83,6 +83,7 @@
 #include <interface/user_manager_interface.h>
 #include <interface/comm_service_interface.h>
 #include <interface/comm_service_remote_interface.h>
+#include <interface/php_pool_interface.h>
 #include <core/event_manager.h>
 #include <system/cache/cache_uf_manager.h>
 #include <db/sqllib.h>
@@ -171,13 +172,26 @@ enum {
 };
 
 #define DEFAULT_SQLLIB_POOL_NUMBER 32
+#define DEFAULT_SQLLIB_POOL_TIMEOUT 30000	// ms
 
 typedef struct SQLConPool
 {
 	int inUse;
 	SQLLibrary *sqllib;
+	struct SQLConPool *next;	// next free connection
 }SQLConPool;
 
+//
+// thread waiting for database connection
+//
+
+typedef struct SQLConWaiter
+{
+	pthread_cond_t					scw_Cond;
+	SQLConPool						*scw_Connection;	// connection handed over by LibrarySQLDrop
+	struct SQLConWaiter				*scw_Next;
+}SQLConWaiter;
+
 // DONT FORGET TO USE THAT AS TEMPLATE
 
 typedef struct SystemBase
@@ -218,6 +232,16 @@ typedef struct SystemBase
 	//struct UserLibrary                  *ulib;					// user.library
 	struct SQLConPool				*sqlpool;			// mysql.library pool
 	int								sqlpoolConnections;	// number of database connections
+	SQLConPool						*sl_SQLFree;		// free connections
+	SQLConWaiter					*sl_SQLWaitFirst;	// threads waiting for connection, served in FIFO order
+	SQLConWaiter					*sl_SQLWaitLast;
+	pthread_mutex_t					sl_SQLMutex;		// protects free list and waiters
+	int								sl_SQLTimeout;		// ms, thread gives up waiting for connection after that time, 0 - wait forever
+	FULONG							sl_SQLAcquired;		// statistics
+	FULONG							sl_SQLWaits;
+	FULONG							sl_SQLTimeouts;
+	FULONG							sl_SQLWaitTime;		// ms
+	FULONG							sl_SQLWaitTimeMax;	// ms
 	struct ApplicationLibrary		*alib;				// application library
 	struct PropertiesLibrary		*plib;				// properties library
 	struct ZLibrary					*zlib;						// z.library
@@ -239,6 +263,7 @@ typedef struct SystemBase
 	UserManagerInterface			sl_UserManagerInterface;	// user manager interface
 	CommServiceInterface			sl_CommServiceInterface;	// communication interface
 	CommServiceRemoteInterface		sl_CommServiceRemoteInterface;	// communication remote interface
+	PHPPoolInterface				sl_PHPPoolInterface;	// php pool interface
 	
 	EModule							*sl_PHPModule;
 	
@@ -248,7 +273,6 @@ typedef struct SystemBase
 	#endif
 
 	int								UserLibCounter;						// counter of opened libraries
-	int								MsqLlibCounter;
 	int								AppLibCounter;
 	int 							PropLibCounter;
 	int 							ZLibCounter;
@@ -261,8 +285,27 @@ typedef struct SystemBase
 	// global settings
 	
 	int								sl_WorkersNumber;  // number of workers
+	int								sl_WorkersQueueSize;	// size of workers run queue
+	FBOOL							sl_WorkersPinned;	// pin workers to cpu cores
+	int								sl_KeepAliveTimeout;	// seconds idle http connection is kept open, 0 disables keep-alive
+	int								sl_KeepAliveMaxRequests;	// maximum number of requests served on one http connection
+	int								sl_MaxBufferedBody;	// bigger multipart request bodies are streamed to handlers
 	int								sl_SocketTimeout;
 	FBOOL 							sl_CacheFiles;
+	FBOOL							sl_CompressFiles;	// keep gzip/brotli variants of cached text resources
+	int								sl_CompressMinSize;	// smaller resources are not compressed
+	PHPPool							*sl_PHPPool;	// persistent php workers, NULL when popen is used
+	int								sl_PHPWorkers;	// number of php workers, 0 disables pool
+	int								sl_PHPWorkerMaxRequests;	// php worker is restarted after this number of requests
+	int								sl_PHPTimeout;	// seconds php script can run without sending output
+	int								sl_WSQueueSize;	// number of frames waiting for send per websocket client
+	int								sl_WSQueuePolicy;	// what to do when websocket send queue is full
+	FBOOL							sl_WSCompression;	// permessage-deflate is offered to clients
+	int								sl_WSDeflateWindowBits;
+	int								sl_WSDeflateMemLevel;
+	int								sl_WSDeflateThreshold;	// smaller messages are sent uncompressed
+	int								sl_PermCacheTTL;	// seconds file permissions are kept in FSManager cache, 0 disables cache
+	int								sl_PermCacheSize;	// maximum number of entries in permission cache
 	FBOOL							sl_UnMountDevicesInDB;
 	FQUAD							sl_USFCacheMax; // User Shared File Manager cache max (per device)
 	Sentinel 						*sl_Sentinel;
@@ -409,6 +452,12 @@ void LibrarySQLDrop( struct SystemBase *l, SQLLibrary *mclose );
 //
 //
 
+int LibrarySQLGetStatistics( struct SystemBase *l, char *buffer, int size );
+
+//
+//
+//
+
 struct AuthMod *AuthModuleGet( struct SystemBase *l );
 
 //
@@ -1593,6 +1593,200 @@ Webreq func: %s\n \
 		CacheManagerClearCache( l->cm );
 	}
 	
+	//
+	// cache statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "cachestats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			char stats[ 512 ];
+			char buffer[ 600 ];
+			
+			CacheManagerGetStatistics( l->cm, stats, sizeof(stats) );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->%s", stats );
+			HttpAddTextContent( response, buffer );
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'cachestats' function\" }" );
+		}
+	}
+	
+	//
+	// database connection pool statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "sqlstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			char stats[ 512 ];
+			char buffer[ 600 ];
+			
+			LibrarySQLGetStatistics( l, stats, sizeof(stats) );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->%s", stats );
+			HttpAddTextContent( response, buffer );
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'sqlstats' function\" }" );
+		}
+	}
+	
+	//
+	// FriendCore to FriendCore requests statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "commstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			if( l->fcm != NULL && l->fcm->fcm_CommService != NULL )
+			{
+				char stats[ 512 ];
+				char buffer[ 600 ];
+				
+				CommServiceGetStatistics( l->fcm->fcm_CommService, stats, sizeof(stats) );
+				snprintf( buffer, sizeof(buffer), "ok<!--separate-->%s", stats );
+				HttpAddTextContent( response, buffer );
+			}
+			else
+			{
+				HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Communication service is not running\" }" );
+			}
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'commstats' function\" }" );
+		}
+	}
+	
+	//
+	// php worker pool statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "phpstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			if( l->sl_PHPPool != NULL )
+			{
+				char stats[ 512 ];
+				char buffer[ 600 ];
+				
+				PHPPoolGetStatistics( l->sl_PHPPool, stats, sizeof(stats) );
+				snprintf( buffer, sizeof(buffer), "ok<!--separate-->%s", stats );
+				HttpAddTextContent( response, buffer );
+			}
+			else
+			{
+				HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"PHP worker pool is disabled\" }" );
+			}
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'phpstats' function\" }" );
+		}
+	}
+	
+	//
+	// websocket send queues statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "wsstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			BufString *bs = BufStringNew();
+			if( bs != NULL )
+			{
+				char stats[ 512 ];
+				int pos = 0;
+				
+				BufStringAdd( bs, "ok<!--separate-->{\"deflate\":" );
+				if( l->fcm != NULL && l->fcm->fcm_WebSocket != NULL )
+				{
+					WebSocketGetStatistics( l->fcm->fcm_WebSocket, stats, sizeof(stats) );
+					BufStringAdd( bs, stats );
+				}
+				else
+				{
+					BufStringAdd( bs, "null" );
+				}
+				BufStringAdd( bs, ",\"clients\":[" );
+				
+				pthread_mutex_lock( &(l->sl_USM->usm_Mutex) );
+				UserSession *us = l->sl_USM->usm_Sessions;
+				while( us != NULL )
+				{
+					pthread_mutex_lock( &(us->us_Mutex) );
+					WebsocketClient *wsc = us->us_WSClients;
+					while( wsc != NULL )
+					{
+						int len = snprintf( stats, sizeof(stats), "%s{\"sessionid\":\"%s\",\"queue\":", pos++ == 0 ? "" : ",", us->us_SessionID != NULL ? us->us_SessionID : "" );
+						WebsocketClientGetStatistics( wsc, stats + len, sizeof(stats) - len - 2 );
+						strcat( stats, "}" );
+						BufStringAdd( bs, stats );
+						
+						wsc = (WebsocketClient *)wsc->node.mln_Succ;
+					}
+					pthread_mutex_unlock( &(us->us_Mutex) );
+					us = (UserSession *)us->node.mln_Succ;
+				}
+				pthread_mutex_unlock( &(l->sl_USM->usm_Mutex) );
+				
+				BufStringAdd( bs, "]}" );
+				HttpAddTextContent( response, bs->bs_Buffer );
+				BufStringDelete( bs );
+			}
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'wsstats' function\" }" );
+		}
+	}
+	
+	//
+	// file permission cache statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "permstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE && l->sl_FSM != NULL )
+		{
+			char stats[ 512 ];
+			char buffer[ 600 ];
+			
+			FSManagerGetCacheStatistics( l->sl_FSM, stats, sizeof(stats) );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->%s", stats );
+			HttpAddTextContent( response, buffer );
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"You dont have access to 'permstats' function\" }" );
+		}
+	}
+	
 	//
 	// USB
 	//
@@ -200,6 +200,9 @@ int UMAssignGroupToUser( UserManager *smgr, User *usr )
 			usr->u_Groups = NULL;
 			usr->u_GroupsNr = 0;
 		}
+		
+		// groups are reloaded, file permissions cached for user can be outdated
+		FSManagerInvalidateUser( sb->sl_FSM, usr->u_ID );
 	
 		int rows = sqlLib->NumberOfRows( sqlLib, result );
 		if( rows > 0 )
@@ -393,6 +396,8 @@ int UMAssignGroupToUserByStringDB( UserManager *um, User *usr, char *groups )
 		}
 		usr->u_Groups = usrGroups;
 		
+		FSManagerInvalidateUser( sb->sl_FSM, usr->u_ID );
+		
 		if( bs != NULL )
 		{
 			BufStringDelete( bs );
@@ -714,7 +719,7 @@ FBOOL UMUserIsAdmin( UserManager *smgr, Http *r, User *usr )
 	sqlLib->SNPrintF( sqlLib, tmpQuery, 2048, "select u.ID from FUser u, FUserToGroup utg, FUserGroup g where u.ID = utg.UserID AND g.ID = utg.UserGroupID AND g.Name = 'Admin' AND u.Name = '%s'", usr->u_Name );
 	//sprintf( tmpQuery, "select count(*) from FUser u, FUserToGroup utg, FUserGroup g where u.ID = utg.UserID AND g.ID = utg.UserGroupID AND g.Name = 'Admin' AND u.Name = '%s'", usr->u_Name );
 	
-	MYSQL_RES *res = sqlLib->Query( sqlLib, tmpQuery );
+	void *res = sqlLib->Query( sqlLib, tmpQuery );
 
 	if( res != NULL )
 	{
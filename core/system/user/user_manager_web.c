@@ -976,8 +976,9 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 			
 			BufStringAdd( bs, "]}");
 			
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 			
 			BufStringDelete( bs );
 		}
@@ -1080,8 +1081,9 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 			
 			BufStringAdd( bs, "]}");
 			
-			HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-			bs->bs_Buffer = NULL;
+			int contentSize = 0;
+			char *content = BufStringDetach( bs, &contentSize );
+			HttpSetContent( response, content, contentSize );
 			
 			BufStringDelete( bs );
 		}
@@ -87,6 +87,9 @@ typedef struct UserSession
 	char                   us_UserActionInfo[ 512 ];
 	int                    us_InUseCounter;
 	WebsocketReqManager    *us_WSReqManager;
+	
+	struct UserSession     *us_HashNext;		// next session in UserSessionManager sessionid bucket
+	struct UserSession     *us_UserHashNext;	// next session in UserSessionManager userid bucket
 }UserSession;
 
 //
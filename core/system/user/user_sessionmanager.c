@@ -35,6 +35,244 @@
 #include <system/systembase.h>
 #include <system/user/user_manager.h>
 #include <system/fsys/door_notification.h>
+#include <util/murmurhash3.h>
+
+//
+// session index helpers
+//
+// Sessions are kept on usm_Sessions list and additionally in two hash tables:
+// by sessionid and by userid. Every change is done under usm_Mutex, readers
+// only take read lock on the shard which covers bucket they are walking.
+//
+
+#define USM_SHARD( HASH ) ( (HASH) & ( USM_SESSION_HASH_SHARDS - 1 ) )
+
+// table size is never smaller than number of shards, so shard of entry does not change when table grows
+#define USM_BUCKET( USM, HASH ) ( (HASH) & ( (USM)->usm_HashSize - 1 ) )
+
+/**
+ * Calculate sessionid hash
+ *
+ * @param sessionid sessionid as string
+ * @return hash value
+ */
+
+static inline unsigned int USMHashSessionID( const char *sessionid )
+{
+	uint32_t hash;
+	MurmurHash3_x86_32( sessionid, strlen( sessionid ), 0, &hash );
+	return hash;
+}
+
+/**
+ * Calculate userid hash
+ *
+ * @param id user id
+ * @return hash value
+ */
+
+static inline unsigned int USMHashUserID( FULONG id )
+{
+	return (unsigned int)( ( id * 2654435761u ) >> 7 );
+}
+
+/**
+ * Lock or unlock all shards of both tables for writing
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param lock TRUE to lock, FALSE to unlock
+ */
+
+static void USMIndexLockAll( UserSessionManager *smgr, FBOOL lock )
+{
+	int i;
+	for( i=0 ; i < USM_SESSION_HASH_SHARDS ; i++ )
+	{
+		if( lock == TRUE )
+		{
+			pthread_rwlock_wrlock( &(smgr->usm_SessionHashLock[ i ]) );
+			pthread_rwlock_wrlock( &(smgr->usm_UserHashLock[ i ]) );
+		}
+		else
+		{
+			pthread_rwlock_unlock( &(smgr->usm_UserHashLock[ i ]) );
+			pthread_rwlock_unlock( &(smgr->usm_SessionHashLock[ i ]) );
+		}
+	}
+}
+
+/**
+ * Double size of lookup tables and move sessions to new buckets. Caller must hold usm_Mutex
+ *
+ * @param smgr pointer to UserSessionManager
+ */
+
+static void USMIndexGrow( UserSessionManager *smgr )
+{
+	unsigned int size = smgr->usm_HashSize * 2;
+	UserSession **sessionHash = FCalloc( size, sizeof( UserSession *) );
+	UserSession **userHash = FCalloc( size, sizeof( UserSession *) );
+	
+	if( sessionHash == NULL || userHash == NULL )
+	{
+		FERROR("[USMIndexGrow] Cannot allocate memory for %u buckets\n", size );
+		FFree( sessionHash );
+		FFree( userHash );
+		return;
+	}
+	
+	USMIndexLockAll( smgr, TRUE );
+	
+	unsigned int i;
+	for( i=0 ; i < smgr->usm_HashSize ; i++ )
+	{
+		UserSession *s = smgr->usm_SessionHash[ i ];
+		while( s != NULL )
+		{
+			UserSession *next = s->us_HashNext;
+			unsigned int b = USMHashSessionID( s->us_SessionID ) & ( size - 1 );
+			s->us_HashNext = sessionHash[ b ];
+			sessionHash[ b ] = s;
+			s = next;
+		}
+		
+		s = smgr->usm_UserHash[ i ];
+		while( s != NULL )
+		{
+			UserSession *next = s->us_UserHashNext;
+			unsigned int b = USMHashUserID( s->us_UserID ) & ( size - 1 );
+			s->us_UserHashNext = userHash[ b ];
+			userHash[ b ] = s;
+			s = next;
+		}
+	}
+	
+	FFree( smgr->usm_SessionHash );
+	FFree( smgr->usm_UserHash );
+	smgr->usm_SessionHash = sessionHash;
+	smgr->usm_UserHash = userHash;
+	smgr->usm_HashSize = size;
+	
+	USMIndexLockAll( smgr, FALSE );
+	
+	DEBUG("[USMIndexGrow] Session index has %u buckets now, sessions %u\n", size, smgr->usm_HashCount );
+}
+
+/**
+ * Put session into lookup index. Caller must hold usm_Mutex
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param s pointer to UserSession
+ */
+
+static void USMIndexInsert( UserSessionManager *smgr, UserSession *s )
+{
+	unsigned int h, b;
+	
+	if( s->us_SessionID != NULL )
+	{
+		h = USMHashSessionID( s->us_SessionID );
+		pthread_rwlock_wrlock( &(smgr->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+		b = USM_BUCKET( smgr, h );
+		s->us_HashNext = smgr->usm_SessionHash[ b ];
+		smgr->usm_SessionHash[ b ] = s;
+		pthread_rwlock_unlock( &(smgr->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+	}
+	
+	h = USMHashUserID( s->us_UserID );
+	pthread_rwlock_wrlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	b = USM_BUCKET( smgr, h );
+	s->us_UserHashNext = smgr->usm_UserHash[ b ];
+	smgr->usm_UserHash[ b ] = s;
+	pthread_rwlock_unlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	
+	// keep chains short, grow when there is more sessions than buckets
+	if( ++(smgr->usm_HashCount) > smgr->usm_HashSize )
+	{
+		USMIndexGrow( smgr );
+	}
+}
+
+/**
+ * Remove session from lookup index. Caller must hold usm_Mutex
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param s pointer to UserSession
+ */
+
+static void USMIndexRemove( UserSessionManager *smgr, UserSession *s )
+{
+	unsigned int h;
+	UserSession **it;
+	
+	if( s->us_SessionID != NULL )
+	{
+		h = USMHashSessionID( s->us_SessionID );
+		pthread_rwlock_wrlock( &(smgr->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+		for( it = &(smgr->usm_SessionHash[ USM_BUCKET( smgr, h ) ]) ; *it != NULL ; it = &((*it)->us_HashNext) )
+		{
+			if( *it == s )
+			{
+				*it = s->us_HashNext;
+				break;
+			}
+		}
+		s->us_HashNext = NULL;
+		pthread_rwlock_unlock( &(smgr->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+	}
+	
+	h = USMHashUserID( s->us_UserID );
+	pthread_rwlock_wrlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	for( it = &(smgr->usm_UserHash[ USM_BUCKET( smgr, h ) ]) ; *it != NULL ; it = &((*it)->us_UserHashNext) )
+	{
+		if( *it == s )
+		{
+			*it = s->us_UserHashNext;
+			smgr->usm_HashCount--;
+			break;
+		}
+	}
+	s->us_UserHashNext = NULL;
+	pthread_rwlock_unlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+}
+
+/**
+ * Find session in index by user id and device id
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param devid device id as string (can be NULL)
+ * @param uid user id
+ * @return UserSession when found, otherwise NULL
+ */
+
+static UserSession *USMIndexFindDevice( UserSessionManager *smgr, const char *devid, FULONG uid )
+{
+	unsigned int h = USMHashUserID( uid );
+	
+	pthread_rwlock_rdlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	UserSession *us = smgr->usm_UserHash[ USM_BUCKET( smgr, h ) ];
+	while( us != NULL )
+	{
+		if( us->us_UserID == uid )
+		{
+			if( us->us_DeviceIdentity == NULL || devid == NULL )
+			{
+				if( us->us_DeviceIdentity == devid )
+				{
+					break;
+				}
+			}
+			else if( strcmp( devid, us->us_DeviceIdentity ) == 0 )
+			{
+				break;
+			}
+		}
+		us = us->us_UserHashNext;
+	}
+	pthread_rwlock_unlock( &(smgr->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	
+	return us;
+}
 
 /**
  * Create new User Session Manager
@@ -49,9 +287,27 @@ UserSessionManager *USMNew( void *sb )
 	
 	if( ( sm = FCalloc( 1, sizeof( UserSessionManager ) ) ) != NULL )
 	{
+		int i;
+		
 		sm->usm_SB = sb;
 		
+		sm->usm_HashSize = USM_SESSION_HASH_SIZE;
+		sm->usm_SessionHash = FCalloc( sm->usm_HashSize, sizeof( UserSession *) );
+		sm->usm_UserHash = FCalloc( sm->usm_HashSize, sizeof( UserSession *) );
+		if( sm->usm_SessionHash == NULL || sm->usm_UserHash == NULL )
+		{
+			FFree( sm->usm_SessionHash );
+			FFree( sm->usm_UserHash );
+			FFree( sm );
+			return NULL;
+		}
+		
 		pthread_mutex_init( &(sm->usm_Mutex), NULL );
+		for( i=0 ; i < USM_SESSION_HASH_SHARDS ; i++ )
+		{
+			pthread_rwlock_init( &(sm->usm_SessionHashLock[ i ]), NULL );
+			pthread_rwlock_init( &(sm->usm_UserHashLock[ i ]), NULL );
+		}
 
 		return sm;
 	}
@@ -81,8 +337,16 @@ void USMDelete( UserSessionManager *smgr )
 		}
 		smgr->usm_Sessions = NULL;
 		
+		int i;
+		for( i=0 ; i < USM_SESSION_HASH_SHARDS ; i++ )
+		{
+			pthread_rwlock_destroy( &(smgr->usm_SessionHashLock[ i ]) );
+			pthread_rwlock_destroy( &(smgr->usm_UserHashLock[ i ]) );
+		}
 		pthread_mutex_destroy( &(smgr->usm_Mutex) );
 		
+		FFree( smgr->usm_SessionHash );
+		FFree( smgr->usm_UserHash );
 		FFree( smgr );
 	}
 }
@@ -97,18 +361,11 @@ void USMDelete( UserSessionManager *smgr )
 
 User *USMGetUserBySessionID( UserSessionManager *usm, char *sessionid )
 {
-	pthread_mutex_lock( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
-	while( us != NULL )
+	UserSession *us = USMGetSessionBySessionID( usm, sessionid );
+	if( us != NULL )
 	{
-		if( strcmp( sessionid, us->us_SessionID ) == 0 )
-		{
-			pthread_mutex_unlock( &(usm->usm_Mutex) );
-			return us->us_User;
-		}
-		us = (UserSession *) us->node.mln_Succ;
+		return us->us_User;
 	}
-	pthread_mutex_unlock( &(usm->usm_Mutex) );
 	return NULL;
 }
 
@@ -128,19 +385,20 @@ UserSession *USMGetSessionBySessionID( UserSessionManager *usm, char *sessionid
         FERROR("Sessionid is NULL!\n");
         return NULL;
     }
-	pthread_mutex_lock( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
+	unsigned int h = USMHashSessionID( sessionid );
+	
+	pthread_rwlock_rdlock( &(usm->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+	UserSession *us = usm->usm_SessionHash[ USM_BUCKET( usm, h ) ];
 	while( us != NULL )
 	{
 		if( strcmp( sessionid, us->us_SessionID ) == 0 )
 		{
-			pthread_mutex_unlock( &(usm->usm_Mutex) );
-			return us;
+			break;
 		}
-		us = (UserSession *) us->node.mln_Succ;
+		us = us->us_HashNext;
 	}
-	pthread_mutex_unlock( &(usm->usm_Mutex) );
-	return NULL;
+	pthread_rwlock_unlock( &(usm->usm_SessionHashLock[ USM_SHARD( h ) ]) );
+	return us;
 }
 
 /**
@@ -190,19 +448,7 @@ UserSession *USMGetSessionBySessionIDFromDB( UserSessionManager *smgr, char *id
 
 UserSession *USMGetSessionByDeviceIDandUser( UserSessionManager *usm, char *devid, FULONG uid )
 {
-	pthread_mutex_lock( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
-	while( us != NULL )
-	{
-		if( us->us_UserID == uid && strcmp( devid, us->us_SessionID ) == 0 )
-		{
-			pthread_mutex_unlock( &(usm->usm_Mutex) );
-			return us;
-		}
-		us = (UserSession *) us->node.mln_Succ;
-	}
-	pthread_mutex_unlock( &(usm->usm_Mutex) );
-	return NULL;
+	return USMIndexFindDevice( usm, devid, uid );
 }
 
 /**
@@ -253,19 +499,24 @@ UserSession *USMGetSessionByDeviceIDandUserDB( UserSessionManager *smgr, char *d
 UserSession *USMGetSessionByUserID( UserSessionManager *usm, FULONG id )
 {
 	//  we  will take only first session of that user
-	pthread_mutex_lock( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
+	unsigned int h = USMHashUserID( id );
+	
+	pthread_rwlock_rdlock( &(usm->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	UserSession *us = usm->usm_UserHash[ USM_BUCKET( usm, h ) ];
 	while( us != NULL )
 	{
 		if( us->us_User  != NULL  && us->us_User->u_ID == id )
 		{
-			pthread_mutex_unlock( &(usm->usm_Mutex) );
-			return us->us_User->u_SessionsList->us;
+			if( us->us_User->u_SessionsList != NULL )
+			{
+				us = us->us_User->u_SessionsList->us;
+			}
+			break;
 		}
-		us = (UserSession *) us->node.mln_Succ;
+		us = us->us_UserHashNext;
 	}
-	pthread_mutex_unlock( &(usm->usm_Mutex) );
-	return NULL;
+	pthread_rwlock_unlock( &(usm->usm_UserHashLock[ USM_SHARD( h ) ]) );
+	return us;
 }
 
 /**
@@ -456,27 +707,10 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 	FBOOL duplicateMasterSession = FALSE;
 	
 	pthread_mutex_lock( &(smgr->usm_Mutex) );
-	UserSession  *ses =  smgr->usm_Sessions;
-	while( ses != NULL )
+	UserSession  *ses = USMIndexFindDevice( smgr, s->us_DeviceIdentity, s->us_UserID );
+	if( ses != NULL )
 	{
-		if( ses->us_DeviceIdentity != NULL )
-		{
-			if( s->us_UserID == ses->us_UserID && strcmp( s->us_DeviceIdentity, ses->us_DeviceIdentity ) ==  0 )
-			{
-				DEBUG("[USMUserSessionAdd] Session found, no need to create new  one %lu devid %s\n", ses->us_UserID, ses->us_DeviceIdentity );
-				break;
-			}
-		}
-		else
-		{
-			if( ses->us_DeviceIdentity == s->us_DeviceIdentity )
-			{
-				DEBUG("[USMUserSessionAdd] Found session with empty deviceid\n");
-				break;
-			}
-		}
-		
-		ses =  (UserSession *)ses->node.mln_Succ;
+		DEBUG("[USMUserSessionAdd] Session found, no need to create new  one %lu devid %s\n", ses->us_UserID, ses->us_DeviceIdentity );
 	}
 
 	// if session doesnt exist in memory we must add it to the list
@@ -489,6 +723,7 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 		//loggedUser->node.mln_Pred = (struct MinNode *)lastuser;
 		s->node.mln_Succ = (MinNode *)smgr->usm_Sessions;
 		smgr->usm_Sessions = s;
+		USMIndexInsert( smgr, s );
 	}
 	else
 	{
@@ -620,6 +855,10 @@ int USMUserSessionRemove( UserSessionManager *smgr, UserSession *remsess )
 			}
 		}
 	}
+	if( sessionRemoved == TRUE )
+	{
+		USMIndexRemove( smgr, remsess );
+	}
 	pthread_mutex_unlock( &(smgr->usm_Mutex) );
 	
 	if( sessionRemoved == TRUE )
@@ -630,6 +869,24 @@ int USMUserSessionRemove( UserSessionManager *smgr, UserSession *remsess )
 	return 0;
 }
 
+/**
+ * Add session which was put on usm_Sessions list directly (sessions loaded from DB on startup) to lookup index
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param s pointer to UserSession
+ */
+
+void USMSessionIndexAdd( UserSessionManager *smgr, UserSession *s )
+{
+	if( smgr == NULL || s == NULL )
+	{
+		return;
+	}
+	pthread_mutex_lock( &(smgr->usm_Mutex) );
+	USMIndexInsert( smgr, s );
+	pthread_mutex_unlock( &(smgr->usm_Mutex) );
+}
+
 /**
  * Get first active user sessionid
  *
@@ -690,11 +947,12 @@ int USMSessionSaveDB( UserSessionManager *smgr, UserSession *ses )
 		//
 		
 		int error = 0;
-		char temptext[ 512 ];
+		char userid[ 32 ];
 		
-		sqllib->SNPrintF( sqllib, temptext, sizeof(temptext), "SELECT ID FROM `FUserSession` WHERE `DeviceIdentity` = '%s' AND `UserID`=%lu", ses->us_DeviceIdentity,  ses->us_UserID );
+		snprintf( userid, sizeof(userid), "%lu", ses->us_UserID );
+		const char *params[] = { ses->us_DeviceIdentity ? ses->us_DeviceIdentity : "", userid };
 
-		void *res = sqllib->Query( sqllib, temptext );
+		void *res = sqllib->QueryPrepared( sqllib, "SELECT ID FROM `FUserSession` WHERE `DeviceIdentity` = ? AND `UserID` = ?", params, 2 );
 		char **row;
 		int numberEntries = 0;
 	
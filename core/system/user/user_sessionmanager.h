@@ -35,6 +35,14 @@
 #include "user_group.h"
 #include "user.h"
 
+//
+// initial session index size (must be power of 2, not smaller than number of shards) and number of lock shards
+// index is doubled when there is more sessions than buckets
+//
+
+#define USM_SESSION_HASH_SIZE		1024
+#define USM_SESSION_HASH_SHARDS		32
+
 //
 // User Session Manager structure
 //
@@ -45,7 +53,14 @@ typedef struct UserSessionManager
 	UserSession							*usm_Sessions;							// user sessions
 	void 										*usm_UM;
 	
-	pthread_mutex_t					usm_Mutex;		// mutex
+	pthread_mutex_t					usm_Mutex;		// mutex, serialize changes of usm_Sessions
+	
+	UserSession							**usm_SessionHash;		// sessions by sessionid
+	UserSession							**usm_UserHash;		// sessions by userid
+	unsigned int						usm_HashSize;			// number of buckets in both tables
+	unsigned int						usm_HashCount;			// number of sessions in index
+	pthread_rwlock_t				usm_SessionHashLock[ USM_SESSION_HASH_SHARDS ];
+	pthread_rwlock_t				usm_UserHashLock[ USM_SESSION_HASH_SHARDS ];
 } UserSessionManager;
 
 
@@ -139,6 +154,12 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s );
 
 int USMUserSessionRemove( UserSessionManager *smgr, UserSession *s );
 
+//
+// add session which was put on usm_Sessions list directly to lookup index
+//
+
+void USMSessionIndexAdd( UserSessionManager *smgr, UserSession *s );
+
 //
 //
 //
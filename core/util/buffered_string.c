@@ -30,6 +30,7 @@
  */
 
 #include "buffered_string.h"
+#include <limits.h>
 #include <util/log/log.h>
 
 //
@@ -62,6 +63,11 @@ BufString *BufStringNew()
 BufString *BufStringNewSize( int bufsize )
 {
 	BufString *str = NULL;
+	
+	if( bufsize < 0 )
+	{
+		bufsize = 0;
+	}
 		
 	if( ( str = FCalloc( sizeof( BufString ), 1 ) ) != NULL )
 	{
@@ -70,7 +76,6 @@ BufString *BufStringNewSize( int bufsize )
 		str->bs_MAX_SIZE = bufsize;
 		
 		if( ( str->bs_Buffer = FMalloc( str->bs_Bufsize + 1 ) ) != NULL )
-		//if( ( str->bs_Buffer = FCalloc( str->bs_Bufsize + 1, sizeof( char ) ) ) != NULL )
 		{
 			str->bs_Buffer[ 0 ] = 0;
 			return str;
@@ -99,92 +104,92 @@ void BufStringDelete( BufString *bs )
 }
 
 //
-// add text to buffer
+// make sure there is space for at least size more bytes (plus terminator)
+// buffer grows geometrically, so appends are O(1) amortised
 //
 
-int BufStringAdd( BufString *bs, const char *ntext )
+int BufStringReserve( BufString *bs, int size )
 {
-	if( ntext == NULL )
+	if( bs == NULL || size < 0 )
 	{
-		return 1;
+		return -1;
 	}
 	
-	int addsize = strlen( ntext );//+1;
-	if( bs->bs_Size == 0 )
+	// buffer could be taken over by caller (bs_Buffer = NULL)
+	if( bs->bs_Buffer == NULL )
+	{
+		bs->bs_Size = 0;
+		bs->bs_Bufsize = 0;
+	}
+	
+	if( size > INT_MAX - 1 - bs->bs_Size )
+	{
+		FERROR("BufString cannot grow above %d bytes\n", INT_MAX );
+		return -1;
+	}
+	
+	int needed = bs->bs_Size + size;
+	if( needed <= bs->bs_Bufsize && bs->bs_Buffer != NULL )
 	{
-		// buffer is too small to handle data, we must extend it
-		
-		if( addsize > bs->bs_MAX_SIZE )
-		{
-			int allsize = ( (addsize / bs->bs_MAX_SIZE) + 1) * bs->bs_MAX_SIZE;
-			char *tmp;
-			
-			if( ( tmp = FMalloc( allsize + 1 ) ) != NULL )
-			//if( ( tmp = FCalloc( allsize + 1, sizeof(char) ) ) != NULL )
-			{
-				strcpy( tmp, ntext );
-				bs->bs_Bufsize = allsize;
-				bs->bs_Size = addsize;
-			}
-			else
-			{
-				FERROR("Cannot allocate memory for BUFString\n");
-				return -1;
-			}
-		}
-		else	// buffer is enough to hold data, just copy it
-		{
-			strcpy( bs->bs_Buffer, ntext );
-			bs->bs_Size = strlen( ntext );
-		}
-		bs->bs_Buffer[ bs->bs_Size ] = 0;
-		
 		return 0;
 	}
 	
-	//int modsize = (bs->bs_Size / bs->bs_MAX_SIZE) * bs->bs_MAX_SIZE;
-	int newsize = (bs->bs_Size + addsize);
+	int allsize = bs->bs_Bufsize;
+	if( allsize < bs->bs_MAX_SIZE )
+	{
+		allsize = bs->bs_MAX_SIZE;
+	}
+	if( allsize < 64 )
+	{
+		allsize = 64;
+	}
+	while( allsize < needed )
+	{
+		allsize = ( allsize > ( INT_MAX - 1 ) / 2 ) ? ( INT_MAX - 1 ) : allsize * 2;
+	}
 	
-	if( newsize > bs->bs_Bufsize )
+	char *tmp = realloc( bs->bs_Buffer, (size_t)allsize + 1 );
+	if( tmp == NULL )
 	{
-		char *tmp;
-		int allsize = ( (newsize / bs->bs_MAX_SIZE) + 1) * bs->bs_MAX_SIZE;
-		
-		if( ( tmp = FMalloc( allsize + 1 ) ) != NULL )
-		//if( ( tmp = FCalloc( allsize+1, sizeof(char) ) ) != NULL )
-		{
-			bs->bs_Bufsize = allsize;
-			bs->bs_Size = newsize;
-			
-			strcpy( tmp, bs->bs_Buffer );
-			strcat( tmp, ntext );
-			
-			FFree( bs->bs_Buffer );
-			bs->bs_Buffer = tmp;
-		}
-		else
-		{
-			FERROR("Cannot allocate memory for buffer!\n");
-			return -1;
-		}
-		// there is no space in the buffer, we must extend it
+		FERROR("Cannot allocate memory for buffer!\n");
+		return -1;
 	}
-	else
+	
+	if( bs->bs_Buffer == NULL )
 	{
-		// there is some space in buffer, we can put information there
-		strcat( bs->bs_Buffer, ntext );
-		bs->bs_Size = newsize;
+		tmp[ 0 ] = 0;
 	}
-	bs->bs_Buffer[ bs->bs_Size ] = 0;
+	bs->bs_Buffer = tmp;
+	bs->bs_Bufsize = allsize;
 	
 	return 0;
 }
 
-
 //
 // add text to buffer
 //
 
+int BufStringAdd( BufString *bs, const char *ntext )
+{
+	if( ntext == NULL )
+	{
+		return 1;
+	}
+	
+	size_t len = strlen( ntext );
+	if( len > INT_MAX )
+	{
+		FERROR("Cannot add text larger than %d bytes\n", INT_MAX );
+		return -1;
+	}
+	
+	return BufStringAddSize( bs, ntext, (int)len );
+}
+
+//
+// add data to buffer
+//
+
 int BufStringAddSize( BufString *bs, const char *ntext, int len )
 {
 	if( ntext == NULL )
@@ -193,75 +198,89 @@ int BufStringAddSize( BufString *bs, const char *ntext, int len )
 		return 1;
 	}
 	
-	if( bs->bs_Size == 0 )
+	if( BufStringReserve( bs, len ) != 0 )
 	{
-		// buffer is too small to handle data, we must extend it
-		
-		if( len > bs->bs_MAX_SIZE )
-		{
-			int allsize = ( (len / bs->bs_MAX_SIZE) + 1) * bs->bs_MAX_SIZE;
-			char *tmp;
-			
-			if( ( tmp = FCalloc( allsize + 10, sizeof(char) ) ) != NULL )
-			{
-				memcpy( tmp, ntext, len );
-				bs->bs_Bufsize = allsize;
-				bs->bs_Size = len;
-				
-				FFree( bs->bs_Buffer );
-				bs->bs_Buffer = tmp;
-			}
-			else
-			{
-				FERROR("Cannot allocate memory for BUFString\n");
-				return -1;
-			}
-		}
-		else	// buffer is enough to hold data, just copy it
-		{
-			memcpy( bs->bs_Buffer, ntext, len );
-			bs->bs_Size = len;
-		}
-		bs->bs_Buffer[ bs->bs_Size ] = 0;
-		
-		return 0;
+		return -1;
 	}
 	
-	int addsize = len;
-//	int modsize = (bs->bs_Size / bs->bs_MAX_SIZE) * bs->bs_MAX_SIZE;
-	int newsize = (bs->bs_Size + addsize);
+	memcpy( bs->bs_Buffer + bs->bs_Size, ntext, len );
+	bs->bs_Size += len;
+	bs->bs_Buffer[ bs->bs_Size ] = 0;
+	
+	return 0;
+}
 
-	if( newsize > bs->bs_Bufsize )
+//
+// add formatted text to buffer
+//
+
+int BufStringAddFormat( BufString *bs, const char *format, ... )
+{
+	va_list args;
+	va_list copy;
+	
+	if( format == NULL )
 	{
-		char *tmp;
-		int allsize = ( (newsize / bs->bs_MAX_SIZE) + 4) * bs->bs_MAX_SIZE;
-		
-		if( ( tmp = FCalloc( allsize + 10, sizeof(char) ) ) != NULL )
-		{
-			memcpy( tmp, bs->bs_Buffer, bs->bs_Size );
-			memcpy( &(tmp[ bs->bs_Size ]), ntext, len );
-			
-			bs->bs_Bufsize = allsize;
-			bs->bs_Size = newsize;
-			
-			FFree( bs->bs_Buffer );
-			bs->bs_Buffer = tmp;
-		}
-		else
+		return 1;
+	}
+	
+	// print straight into free space, grow and print again only when it does not fit
+	if( BufStringReserve( bs, 0 ) != 0 )
+	{
+		return -1;
+	}
+	
+	va_start( args, format );
+	va_copy( copy, args );
+	
+	int avail = bs->bs_Bufsize - bs->bs_Size;
+	int len = vsnprintf( bs->bs_Buffer + bs->bs_Size, (size_t)avail + 1, format, args );
+	va_end( args );
+	
+	if( len < 0 )
+	{
+		va_end( copy );
+		bs->bs_Buffer[ bs->bs_Size ] = 0;
+		return -1;
+	}
+	
+	if( len > avail )
+	{
+		if( BufStringReserve( bs, len ) != 0 )
 		{
-			FERROR("Cannot allocate memory for buffer!\n");
+			va_end( copy );
+			bs->bs_Buffer[ bs->bs_Size ] = 0;
 			return -1;
 		}
-		// there is no space in the buffer, we must extend it
-	}
-	else
-	{
-		// there is some space in buffer, we can put information there
-		memcpy( &(bs->bs_Buffer[ bs->bs_Size ] ), ntext, len );
-		bs->bs_Size = newsize;
+		vsnprintf( bs->bs_Buffer + bs->bs_Size, (size_t)len + 1, format, copy );
 	}
-	bs->bs_Buffer[ bs->bs_Size ] = 0;
+	va_end( copy );
+	
+	bs->bs_Size += len;
 	
 	return 0;
 }
 
+//
+// take over buffer, BufString is left empty and can still be used or deleted
+//
+
+char *BufStringDetach( BufString *bs, int *size )
+{
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	
+	char *buffer = bs->bs_Buffer;
+	if( size != NULL )
+	{
+		*size = ( buffer != NULL ) ? bs->bs_Size : 0;
+	}
+	
+	bs->bs_Buffer = NULL;
+	bs->bs_Size = 0;
+	bs->bs_Bufsize = 0;
+	
+	return buffer;
+}
@@ -28,6 +28,7 @@
 #define __BUFFERED_STRING_H__
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <core/types.h>
@@ -41,8 +42,8 @@
 typedef struct BufString
 {
 	int             bs_Size;        // current data size
-	int             bs_Bufsize;     // buffer size
-	int             bs_MAX_SIZE;    // maximum size
+	int             bs_Bufsize;     // buffer size (without terminator)
+	int             bs_MAX_SIZE;    // minimum buffer size when growing
 	char           *bs_Buffer;      // pointer to buffer
 } BufString;
 
@@ -72,5 +73,23 @@ int BufStringAdd( BufString *bs, const char *add );
 
 int BufStringAddSize( BufString *bs, const char *add, int size );
 
+//
+// Add formatted text to Buffer
+//
+
+int BufStringAddFormat( BufString *bs, const char *format, ... );
+
+//
+// Reserve space for additional data
+//
+
+int BufStringReserve( BufString *bs, int size );
+
+//
+// Take over Buffer memory, caller must release it
+//
+
+char *BufStringDetach( BufString *bs, int *size );
+
 
 #endif //__BUFFERED_STRING_H__
@@ -0,0 +1,133 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  BufferedString append benchmark
+ *
+ *  Appends Dir-like JSON entries with BufStringAdd and with the previous
+ *  algorithm (fixed growth step, strcpy/strcat of whole string) and prints
+ *  times of both. Build with "make bench-bufstring" and run
+ *  bin/BufStringBench [entries...]
+ *
+ *  @date created 10/2026
+ */
+
+#include <util/buffered_string.h>
+#include <sys/time.h>
+
+static const char *benchEntry = "{ \"Filename\":\"f3914\",\"Path\":\"f3914\",\"Filesize\": 5,\"DateModified\": \"2026-10-17 05:45:13\",\"MetaType\":\"File\",\"Type\":\"File\" },";
+
+//
+// previous BufStringAdd: buffer grows by bs_MAX_SIZE and whole string is copied on every append
+//
+
+static int StrcatAdd( BufString *bs, const char *ntext )
+{
+	int addsize = strlen( ntext );
+	int newsize = bs->bs_Size + addsize;
+
+	if( newsize > bs->bs_Bufsize )
+	{
+		int allsize = ( (newsize / bs->bs_MAX_SIZE) + 1) * bs->bs_MAX_SIZE;
+		char *tmp;
+
+		if( ( tmp = FMalloc( allsize + 1 ) ) == NULL )
+		{
+			return -1;
+		}
+		strcpy( tmp, bs->bs_Buffer );
+		strcat( tmp, ntext );
+		FFree( bs->bs_Buffer );
+		bs->bs_Buffer = tmp;
+		bs->bs_Bufsize = allsize;
+	}
+	else
+	{
+		strcat( bs->bs_Buffer, ntext );
+	}
+	bs->bs_Size = newsize;
+
+	return 0;
+}
+
+//
+//
+//
+
+static double TimeNow()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+//
+//
+//
+
+int main( int argc, char **argv )
+{
+	int defaults[] = { 1000, 10000, 50000 };
+	int tests = argc > 1 ? argc - 1 : (int)(sizeof(defaults)/sizeof(int));
+	int t;
+
+	for( t = 0 ; t < tests ; t++ )
+	{
+		int entries = argc > 1 ? atoi( argv[ t + 1 ] ) : defaults[ t ];
+		int i;
+
+		BufString *old = BufStringNew();
+		BufString *cur = BufStringNew();
+		if( old == NULL || cur == NULL )
+		{
+			printf("Cannot allocate memory\n");
+			return 1;
+		}
+
+		double start = TimeNow();
+		for( i = 0 ; i < entries ; i++ )
+		{
+			StrcatAdd( old, benchEntry );
+		}
+		double oldTime = TimeNow() - start;
+
+		start = TimeNow();
+		for( i = 0 ; i < entries ; i++ )
+		{
+			BufStringAdd( cur, benchEntry );
+		}
+		double curTime = TimeNow() - start;
+
+		if( old->bs_Size != cur->bs_Size || memcmp( old->bs_Buffer, cur->bs_Buffer, cur->bs_Size + 1 ) != 0 )
+		{
+			printf("Results are different for %d entries!\n", entries );
+			return 1;
+		}
+
+		printf("%8d entries (%10d bytes): strcat %9.4fs  BufStringAdd %9.4fs\n", entries, cur->bs_Size, oldTime, curTime );
+
+		BufStringDelete( old );
+		BufStringDelete( cur );
+	}
+
+	return 0;
+}
@@ -42,7 +42,46 @@
 // Max size of string 
 #define MAXMSG 8196
 
-FlogFlags slg;
+#define LOG_BUFFER_SIZE_DEFAULT		65536		// size of per thread ring buffer
+#define LOG_FLUSH_INTERVAL			100			// milliseconds between flushes
+#define LOG_BATCH_SIZE				262144		// data collected before write
+
+#define LOG_RECORD_FILE				0x01
+#define LOG_RECORD_CONSOLE			0x02
+
+//
+// header of message stored in ring buffer, message text follows header
+//
+
+typedef struct LogRecord
+{
+	unsigned int			lr_Size;
+	unsigned int			lr_Flags;
+	time_t					lr_Time;
+	long					lr_Thread;		// buffer can be taken over by other thread before it is flushed
+}LogRecord;
+
+//
+// ring buffer with one producer (owner thread) and one consumer (flusher thread)
+//
+
+typedef struct LogBuffer
+{
+	struct LogBuffer		*lb_Next;
+	char					*lb_Data;
+	FUQUAD					lb_Mask;
+	volatile FUQUAD			lb_Head;		// moved only by owner thread
+	volatile FUQUAD			lb_Tail;		// moved only by flusher
+	volatile int			lb_Used;		// buffer belongs to running thread
+}LogBuffer;
+
+FlogFlags slg = { .logMutex = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread LogBuffer *threadBuffer = NULL;
+static pthread_key_t threadBufferKey;
+
+static void *LogFlushThread( void *d );
+static void LogBufferRelease( void *data );
 
 /**
  * Init logging
@@ -58,6 +97,7 @@ FlogFlags slg;
 int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl, int maxSize )
 {
 	int status = 0;
+	int async = 1;
 
 	slg.ff_Level = lvl;
 	slg.ff_FileLevel = flvl;
@@ -72,6 +112,7 @@ int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl,
 	slg.ff_Size = 0;
 	slg.ff_MaxSize = 0;
 	slg.ff_ArchiveFiles = 0;
+	slg.ff_BufferSize = LOG_BUFFER_SIZE_DEFAULT;
 	
 	if( maxSize >= 100000 )
 	{
@@ -100,6 +141,9 @@ int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl,
 			slg.ff_FileLevel  = plib->ReadInt( prop, "Log:fileLevel", 1 );
 			slg.ff_Fname = plib->ReadString( prop, "Log:fileName", (char *)fname );
 			
+			async = plib->ReadInt( prop, "Log:async", 1 );
+			slg.ff_BufferSize = plib->ReadInt( prop, "Log:bufferSize", LOG_BUFFER_SIZE_DEFAULT );
+			
 			plib->Close( prop );
 		}
 	
@@ -134,7 +178,39 @@ int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl,
 		}
 	}
 	
-	return 0;
+	// ring buffer size must be power of 2
+	int bufferSize = 4096;
+	while( bufferSize < slg.ff_BufferSize && bufferSize < ( 64 << 20 ) )
+	{
+		bufferSize <<= 1;
+	}
+	slg.ff_BufferSize = bufferSize;
+	
+	if( async == 1 )
+	{
+		slg.ff_FileBatch = FMalloc( LOG_BATCH_SIZE );
+		slg.ff_ConsoleBatch = FMalloc( LOG_BATCH_SIZE );
+		slg.ff_FileBatchSize = 0;
+		slg.ff_ConsoleBatchSize = 0;
+		slg.ff_Now = time( NULL );
+		slg.ff_Quit = FALSE;
+		
+		if( slg.ff_FileBatch != NULL && slg.ff_ConsoleBatch != NULL && sem_init( &slg.ff_Wake, 0, 0 ) == 0 )
+		{
+			pthread_key_create( &threadBufferKey, LogBufferRelease );
+			slg.ff_Running = TRUE;
+			
+			if( pthread_create( &slg.ff_Flusher, NULL, LogFlushThread, NULL ) != 0 )
+			{
+				printf("<%s:%d> %s: [ERROR] Cannot start log thread, messages will be written directly\n",  __FILE__, __LINE__, __FUNCTION__ );
+				slg.ff_Running = FALSE;
+				pthread_key_delete( threadBufferKey );
+				sem_destroy( &slg.ff_Wake );
+			}
+		}
+	}
+	
+	return status;
 }
 
 /**
@@ -143,6 +219,31 @@ int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl,
 
 void LogDelete( )
 {
+	if( slg.ff_Running == TRUE )
+	{
+		// new messages are written directly, flusher writes what is left in buffers
+		slg.ff_Running = FALSE;
+		slg.ff_Quit = TRUE;
+		sem_post( &slg.ff_Wake );
+		pthread_join( slg.ff_Flusher, NULL );
+		
+		// other threads can still be inside Log() with their ring buffer, so buffers, thread key
+		// and wake semaphore are not released, buffers stay on ff_Buffers list until process exit
+	}
+	
+	pthread_mutex_lock( &slg.logMutex );
+	if( slg.ff_FileBatch != NULL )
+	{
+		FFree( slg.ff_FileBatch );
+		slg.ff_FileBatch = NULL;
+	}
+	if( slg.ff_ConsoleBatch != NULL )
+	{
+		FFree( slg.ff_ConsoleBatch );
+		slg.ff_ConsoleBatch = NULL;
+	}
+	pthread_mutex_unlock( &slg.logMutex );
+	
 	if( slg.ff_FileNames != NULL )
 	{
 		int i = 0;
@@ -152,36 +253,106 @@ void LogDelete( )
 			{
 				FFree( slg.ff_FileNames[ i ] );
 			}
-			FFree( slg.ff_FileNames );
 		}
+		FFree( slg.ff_FileNames );
+		slg.ff_FileNames = NULL;
 	}
 	
+	// messages logged later are written directly, so file is closed under lock and mutex is not destroyed
+	pthread_mutex_lock( &slg.logMutex );
 	if( slg.ff_FP != NULL )
 	{
 		fclose( slg.ff_FP );
 		slg.ff_FP = NULL;
 	}
+	pthread_mutex_unlock( &slg.logMutex );
+}
+
+/**
+ * Get number of messages which were dropped because log buffers were full
+ *
+ * @return number of dropped messages
+ */
+
+FUQUAD LogGetDropped( )
+{
+	return __atomic_load_n( &slg.ff_Dropped, __ATOMIC_RELAXED );
+}
+
+/**
+ * Write collected file and console data. Must be called with logMutex locked.
+ */
+
+static void LogWriteBatch( )
+{
+	if( slg.ff_FileBatchSize > 0 )
+	{
+		if( slg.ff_FP != NULL )
+		{
+			fwrite( slg.ff_FileBatch, 1, slg.ff_FileBatchSize, slg.ff_FP );
+		}
+		slg.ff_FileBatchSize = 0;
+	}
+	if( slg.ff_FP != NULL )
+	{
+		fflush( slg.ff_FP );
+	}
 	
-	pthread_mutex_destroy( &slg.logMutex );
+	if( slg.ff_ConsoleBatchSize > 0 )
+	{
+		fwrite( slg.ff_ConsoleBatch, 1, slg.ff_ConsoleBatchSize, stdout );
+		slg.ff_ConsoleBatchSize = 0;
+	}
+	fflush( stdout );
 }
 
 /**
- * Move information to log. Use LOG() macro to store name of file + line number
+ * Add data to file or console batch, data is written directly when there is no batch buffer.
+ * Must be called with logMutex locked.
  *
- * @param lev level of logged message
- * @param fmt format of message (same like in printf)
- * @param ... other parameters
+ * @param toFile TRUE when data should go to log file, FALSE for console
+ * @param data pointer to data
+ * @param len length of data
  */
 
-void Log( int lev, char* fmt, ...) 
+static void LogAppend( FBOOL toFile, const char *data, int len )
 {
-	if( slg.ff_ToFile == TRUE )
+	char *batch = toFile == TRUE ? slg.ff_FileBatch : slg.ff_ConsoleBatch;
+	int *size = toFile == TRUE ? &slg.ff_FileBatchSize : &slg.ff_ConsoleBatchSize;
+	
+	if( batch != NULL && *size + len > LOG_BATCH_SIZE )
 	{
-		time_t rawtime;
-		struct tm timeinfo;
-		rawtime = time(NULL);
-		localtime_r(&rawtime, &timeinfo);
+		LogWriteBatch();
+	}
+	
+	if( batch != NULL && len <= LOG_BATCH_SIZE )
+	{
+		memcpy( batch + *size, data, len );
+		*size += len;
+	}
+	else if( toFile == FALSE )
+	{
+		fwrite( data, 1, len, stdout );
+	}
+	else if( slg.ff_FP != NULL )
+	{
+		fwrite( data, 1, len, slg.ff_FP );
+	}
+}
 
+/**
+ * Open new log file when day changed or file is too big. Must be called with logMutex locked.
+ *
+ * @param t time of message which will be stored
+ */
+
+static void LogRotate( time_t t )
+{
+	if( t != slg.ff_BatchTime )
+	{
+		struct tm timeinfo;
+		localtime_r( &t, &timeinfo );
+		
 		// Get System Date 
 		slg.ff_FD.fd_Year = timeinfo.tm_year+1900;
 		slg.ff_FD.fd_Mon = timeinfo.tm_mon+1;
@@ -189,99 +360,409 @@ void Log( int lev, char* fmt, ...)
 		slg.ff_FD.fd_Hour = timeinfo.tm_hour;
 		slg.ff_FD.fd_Min = timeinfo.tm_min;
 		slg.ff_FD.fd_Sec = timeinfo.tm_sec;
+		slg.ff_BatchTime = t;
+	}
+	
+	FBOOL changeFileName = FALSE;
+	
+	if( slg.ff_MaxSize != 0 )
+	{
+		if( slg.ff_FD.fd_Day != slg.ff_Time || slg.ff_Size >= slg.ff_MaxSize )
+		{
+			slg.ff_Size = 0;
+			slg.ff_LogNumber++;
+			changeFileName = TRUE;
+		}
+	}
+	else
+	{
+		if( slg.ff_FD.fd_Day != slg.ff_Time )
+		{
+			changeFileName = TRUE;
+		}
+	}
+
+	if( changeFileName == TRUE )
+	{
+		char fname[ 512 ];
 		
-		FBOOL changeFileName = FALSE;
+		// data collected for old file
+		LogWriteBatch();
 		
 		if( slg.ff_MaxSize != 0 )
 		{
-			if( slg.ff_FD.fd_Day != slg.ff_Time || slg.ff_Size >= slg.ff_MaxSize )
-			{
-				slg.ff_Size = 0;
-				slg.ff_LogNumber++;
-				changeFileName = TRUE;
-			}
+			snprintf( fname, sizeof(fname), "%s-%d-%02d-%02d-%02d.log",slg.ff_Fname, slg.ff_LogNumber, slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon, slg.ff_FD.fd_Day );
 		}
 		else
 		{
-			if( slg.ff_FD.fd_Day != slg.ff_Time )
-			{
-				changeFileName = TRUE;
-			}
+			snprintf( fname, sizeof(fname), "%s-%02d-%02d-%02d.log",slg.ff_Fname, slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon, slg.ff_FD.fd_Day );
+		}
+		
+		if( slg.ff_FP != NULL )
+		{
+			fclose( slg.ff_FP );
+			slg.ff_FP = NULL;
+		}
+		slg.ff_FP = fopen( fname, "a");
+		if( slg.ff_FP == NULL )
+		{
+			return;
 		}
 	
-		if( changeFileName == TRUE )
+		slg.ff_Time = slg.ff_FD.fd_Day;
+		
+		if( slg.ff_ArchiveFiles > 0 && slg.ff_FileNames != NULL )
 		{
-			char fname[ 512 ];
-			
-			if( slg.ff_MaxSize != 0 )
+			// list have reverse order, on the top we have oldest entries
+			if( remove( slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ] )  == 0 )
 			{
-				snprintf( fname, sizeof(fname), "%s-%d-%02d-%02d-%02d.log",slg.ff_Fname, slg.ff_LogNumber, slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon, slg.ff_FD.fd_Day );
-			}
-			else
-			{
-				snprintf( fname, sizeof(fname), "%s-%02d-%02d-%02d.log",slg.ff_Fname, slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon, slg.ff_FD.fd_Day );
+				fprintf( slg.ff_FP, "Old file removed: %s\n", slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ] );
 			}
 			
-			if( slg.ff_FP != NULL )
-			{
-				fclose( slg.ff_FP );
-				slg.ff_FP = NULL;
-			}
-			slg.ff_FP = fopen( fname, "a");
-			if( slg.ff_FP == NULL )
+			int i=0;
+			for( i = 0 ; i < slg.ff_ArchiveFiles-1 ; i++ )
 			{
-				return;
+				strcpy( slg.ff_FileNames[ i ], slg.ff_FileNames[ i+1 ] );
 			}
+			strcpy( slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ], fname );
+		}
+	}
+}
+
+/**
+ * Put message into log file and/or console batch. Must be called with logMutex locked.
+ *
+ * @param thread id of thread which logged message
+ * @param t time when message was logged
+ * @param flags LOG_RECORD_FILE and/or LOG_RECORD_CONSOLE
+ * @param msg message text
+ * @param len message length
+ */
+
+static void LogOutput( long thread, time_t t, unsigned int flags, const char *msg, int len )
+{
+	char prefix[ 128 ];
+	int plen;
+	
+	if( flags & LOG_RECORD_FILE )
+	{
+		LogRotate( t );
 		
-			slg.ff_Time = slg.ff_FD.fd_Day;
+		if( slg.ff_FP != NULL )
+		{
+			plen = snprintf( prefix, sizeof(prefix), "%ld: %02d.%02d.%02d-%02d:%02d:%02d: ", thread,
+				slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon , slg.ff_FD.fd_Day , 
+				slg.ff_FD.fd_Hour , slg.ff_FD.fd_Min , slg.ff_FD.fd_Sec );
 			
-			if( slg.ff_ArchiveFiles > 0 )
-			{
-				// list have reverse order, on the top we have oldest entries
-				if( remove( slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ] )  == 0 )
-				{
-					Log( FLOG_DEBUG, "Old file removed: %s\n", slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ] );
-				}
-				
-				int i=0;
-				for( i = 0 ; i < slg.ff_ArchiveFiles-1 ; i++ )
-				{
-					strcpy( slg.ff_FileNames[ i ], slg.ff_FileNames[ i+1 ] );
-				}
-				strcpy( slg.ff_FileNames[ slg.ff_ArchiveFiles-1 ], fname );
-			}
+			LogAppend( TRUE, prefix, plen );
+			LogAppend( TRUE, msg, len );
+			slg.ff_Size += plen + len;
 		}
+	}
 	
-		if (lev >= slg.ff_FileLevel)
+	// console output will be used for debug
+	if( flags & LOG_RECORD_CONSOLE )
+	{
+		plen = snprintf( prefix, sizeof(prefix), "%ld: ", thread );
+		LogAppend( FALSE, prefix, plen );
+		LogAppend( FALSE, msg, len );
+	}
+}
+
+/**
+ * Called when thread which used ring buffer finish. Buffer is given back and next new thread takes it,
+ * messages which are still in buffer are written by flusher as usual.
+ *
+ * @param data pointer to LogBuffer
+ */
+
+static void LogBufferRelease( void *data )
+{
+	LogBuffer *b = (LogBuffer *)data;
+	
+	threadBuffer = NULL;
+	__atomic_store_n( &b->lb_Used, FALSE, __ATOMIC_RELEASE );
+}
+
+/**
+ * Get ring buffer of current thread. Buffer of finished thread is reused, new one is allocated when there is no free buffer.
+ *
+ * @return pointer to LogBuffer or NULL when memory cannot be allocated
+ */
+
+static LogBuffer *LogBufferGet( )
+{
+	if( threadBuffer != NULL )
+	{
+		return threadBuffer;
+	}
+	
+	LogBuffer *b = __atomic_load_n( &slg.ff_Buffers, __ATOMIC_ACQUIRE );
+	while( b != NULL )
+	{
+		// buffer does not have to be empty, new owner continues writing after messages of finished thread
+		int unused = FALSE;
+		if( __atomic_compare_exchange_n( &b->lb_Used, &unused, TRUE, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
 		{
-			if (pthread_mutex_lock(&slg.logMutex) == 0)
-			{
-				char date[ 256 ];
-				
-				slg.ff_Size  += fprintf( slg.ff_FP, "%ld: %02d.%02d.%02d-%02d:%02d:%02d: ", pthread_self(),
-					slg.ff_FD.fd_Year, slg.ff_FD.fd_Mon , slg.ff_FD.fd_Day , 
-					slg.ff_FD.fd_Hour , slg.ff_FD.fd_Min , slg.ff_FD.fd_Sec );
-				
-				//fprintf( slg.ff_FP, "%s", out);
-				va_list args;
-				va_start(args, fmt);
-				//fprintf( slg.ff_FP, fmt, args);
-				vfprintf( slg.ff_FP, fmt, args);
-				va_end(args);
-				pthread_mutex_unlock(&slg.logMutex);
-			}
+			break;
 		}
+		b = b->lb_Next;
 	}
 	
-	// console output will be used for debug
-	if (lev >= slg.ff_Level)
-	{
-		printf("%ld: ", pthread_self() );
-		va_list args;
-		va_start(args, fmt);
-		//printf(fmt, args);
-		vprintf( fmt, args);
-		va_end(args);
+	if( b == NULL )
+	{
+		if( ( b = FCalloc( 1, sizeof( LogBuffer ) ) ) == NULL )
+		{
+			return NULL;
+		}
+		if( ( b->lb_Data = FMalloc( slg.ff_BufferSize ) ) == NULL )
+		{
+			FFree( b );
+			return NULL;
+		}
+		b->lb_Mask = slg.ff_BufferSize - 1;
+		b->lb_Used = TRUE;
+		
+		b->lb_Next = __atomic_load_n( &slg.ff_Buffers, __ATOMIC_RELAXED );
+		while( !__atomic_compare_exchange_n( &slg.ff_Buffers, &b->lb_Next, b, FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) ){}
+	}
+	
+	threadBuffer = b;
+	pthread_setspecific( threadBufferKey, b );
+	
+	return b;
+}
+
+/**
+ * Copy data into ring buffer, data can wrap around end of buffer
+ *
+ * @param b pointer to LogBuffer
+ * @param pos position in ring
+ * @param data pointer to data
+ * @param len length of data
+ */
+
+static inline void LogRingWrite( LogBuffer *b, FUQUAD pos, const void *data, unsigned int len )
+{
+	FUQUAD off = pos & b->lb_Mask;
+	FUQUAD first = b->lb_Mask + 1 - off;
+	
+	if( first >= len )
+	{
+		memcpy( b->lb_Data + off, data, len );
+	}
+	else
+	{
+		memcpy( b->lb_Data + off, data, first );
+		memcpy( b->lb_Data, (const char *)data + first, len - first );
+	}
+}
+
+/**
+ * Copy data from ring buffer, data can wrap around end of buffer
+ *
+ * @param b pointer to LogBuffer
+ * @param pos position in ring
+ * @param data pointer to destination
+ * @param len length of data
+ */
+
+static inline void LogRingRead( LogBuffer *b, FUQUAD pos, void *data, unsigned int len )
+{
+	FUQUAD off = pos & b->lb_Mask;
+	FUQUAD first = b->lb_Mask + 1 - off;
+	
+	if( first >= len )
+	{
+		memcpy( data, b->lb_Data + off, len );
+	}
+	else
+	{
+		memcpy( data, b->lb_Data + off, first );
+		memcpy( (char *)data + first, b->lb_Data, len - first );
+	}
+}
+
+/**
+ * Write messages from all thread buffers. Called by flusher thread.
+ */
+
+static void LogFlush( )
+{
+	char msg[ MAXMSG ];
+	
+	pthread_mutex_lock( &slg.logMutex );
+	
+	LogBuffer *b = __atomic_load_n( &slg.ff_Buffers, __ATOMIC_ACQUIRE );
+	while( b != NULL )
+	{
+		FUQUAD tail = b->lb_Tail;
+		FUQUAD head = __atomic_load_n( &b->lb_Head, __ATOMIC_ACQUIRE );
+		
+		while( tail < head )
+		{
+			LogRecord rec;
+			LogRingRead( b, tail, &rec, sizeof( rec ) );
+			LogRingRead( b, tail + sizeof( rec ), msg, rec.lr_Size );
+			LogOutput( rec.lr_Thread, rec.lr_Time, rec.lr_Flags, msg, rec.lr_Size );
+			tail += sizeof( rec ) + rec.lr_Size;
+		}
+		__atomic_store_n( &b->lb_Tail, tail, __ATOMIC_RELEASE );
+		
+		b = b->lb_Next;
+	}
+	
+	FUQUAD dropped = __atomic_load_n( &slg.ff_Dropped, __ATOMIC_RELAXED );
+	if( dropped != slg.ff_DroppedReported )
+	{
+		int len = snprintf( msg, sizeof(msg), "[Log] %llu messages were dropped, log buffers are full\n", dropped - slg.ff_DroppedReported );
+		LogOutput( (long)pthread_self(), slg.ff_Now, ( slg.ff_ToFile == TRUE ? LOG_RECORD_FILE : 0 ) | LOG_RECORD_CONSOLE, msg, len );
+		slg.ff_DroppedReported = dropped;
+	}
+	
+	LogWriteBatch();
+	
+	pthread_mutex_unlock( &slg.logMutex );
+}
+
+/**
+ * Log flusher thread. Updates cached time and writes messages collected by threads every tick
+ * or earlier when some buffer is half full.
+ *
+ * @param d not used
+ * @return NULL
+ */
+
+static void *LogFlushThread( void *d )
+{
+	while( TRUE )
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_nsec += LOG_FLUSH_INTERVAL * 1000000;
+		if( ts.tv_nsec >= 1000000000 )
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		sem_timedwait( &slg.ff_Wake, &ts );
+		
+		slg.ff_Now = time( NULL );
+		
+		int quit = slg.ff_Quit;
+		
+		LogFlush();
+		
+		if( quit == TRUE )
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Move information to log. Use LOG() macro to store name of file + line number
+ * Message is put into ring buffer of calling thread and written later by flusher thread,
+ * message bigger than MAXMSG is written directly.
+ *
+ * @param lev level of logged message
+ * @param fmt format of message (same like in printf)
+ * @param ... other parameters
+ */
+
+void Log( int lev, char* fmt, ...) 
+{
+	unsigned int flags = 0;
+	
+	if( slg.ff_ToFile == TRUE && lev >= slg.ff_FileLevel )
+	{
+		flags |= LOG_RECORD_FILE;
+	}
+	if( lev >= slg.ff_Level )
+	{
+		flags |= LOG_RECORD_CONSOLE;
+	}
+	if( flags == 0 )
+	{
+		return;
+	}
+	
+	char msg[ MAXMSG ];
+	char *text = msg;
+	va_list args, argsCopy;
+	va_start(args, fmt);
+	va_copy( argsCopy, args );
+	int len = vsnprintf( msg, sizeof(msg), fmt, args );
+	va_end(args);
+	
+	if( len >= (int)sizeof(msg) )
+	{
+		// message does not fit into ring record, it is written directly
+		if( ( text = FMalloc( len + 1 ) ) != NULL )
+		{
+			vsnprintf( text, len + 1, fmt, argsCopy );
+		}
+		else
+		{
+			text = msg;
+			len = sizeof(msg) - 1;
+		}
+	}
+	va_end( argsCopy );
+	
+	if( len < 0 )
+	{
+		return;
+	}
+	
+	LogBuffer *b;
+	if( text == msg && slg.ff_Running == TRUE && ( b = LogBufferGet() ) != NULL )
+	{
+		FUQUAD head = b->lb_Head;
+		FUQUAD used = head - __atomic_load_n( &b->lb_Tail, __ATOMIC_ACQUIRE );
+		FUQUAD size = b->lb_Mask + 1;
+		FUQUAD need = sizeof( LogRecord ) + len;
+		
+		if( used + need > size )
+		{
+			__atomic_add_fetch( &slg.ff_Dropped, 1, __ATOMIC_RELAXED );
+			return;
+		}
+		
+		LogRecord rec;
+		rec.lr_Size = len;
+		rec.lr_Flags = flags;
+		rec.lr_Time = slg.ff_Now;
+		rec.lr_Thread = (long)pthread_self();
+		
+		LogRingWrite( b, head, &rec, sizeof( rec ) );
+		LogRingWrite( b, head + sizeof( rec ), msg, len );
+		__atomic_store_n( &b->lb_Head, head + need, __ATOMIC_RELEASE );
+		
+		// do not wait for tick when buffer is getting full
+		if( used < size / 2 && used + need >= size / 2 )
+		{
+			sem_post( &slg.ff_Wake );
+		}
+		return;
+	}
+	
+	// messages which thread put into buffer before must be written first
+	if( text != msg && slg.ff_Running == TRUE )
+	{
+		LogFlush();
+	}
+	
+	// logging thread is not working or message is too big for buffer, message is written now
+	pthread_mutex_lock( &slg.logMutex );
+	LogOutput( (long)pthread_self(), time( NULL ), flags, text, len );
+	LogWriteBatch();
+	pthread_mutex_unlock( &slg.logMutex );
+	
+	if( text != msg )
+	{
+		FFree( text );
 	}
 }
 
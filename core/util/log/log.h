@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <pthread.h>
+#include <semaphore.h>
 
 #define LOG_ALL		0
 #define LOG_WARN	1
@@ -95,6 +96,22 @@ typedef struct FlogFlags{
 	pthread_mutex_t logMutex;
 	int ff_ArchiveFiles;
 	char **ff_FileNames;
+	
+	// asynchronous logging, every thread puts messages into own ring buffer, flusher thread writes them
+	struct LogBuffer		*ff_Buffers;		// list of per thread buffers, entries are never removed
+	int						ff_BufferSize;		// size of one ring buffer (power of 2)
+	volatile time_t			ff_Now;				// time cached by flusher thread
+	pthread_t				ff_Flusher;
+	sem_t					ff_Wake;			// wake up flusher before tick
+	volatile int			ff_Running;			// flusher thread is working
+	volatile int			ff_Quit;
+	volatile FUQUAD			ff_Dropped;			// messages which did not fit into buffers
+	FUQUAD					ff_DroppedReported;
+	time_t					ff_BatchTime;		// time for which ff_FD was computed by flusher
+	char					*ff_FileBatch;		// data collected by flusher before write
+	int						ff_FileBatchSize;
+	char					*ff_ConsoleBatch;
+	int						ff_ConsoleBatchSize;
 } FlogFlags;
 
 
@@ -102,6 +119,12 @@ int LogNew( const char* fname, const char* conf, int toFile, int lvl, int flvl,
 
 void LogDelete( );
 
+//
+// number of messages dropped because buffers were full
+//
+
+FUQUAD LogGetDropped( );
+
 int LogParseConfig(const char *cfg_name);
 
 void Log( int lev, char* fmt, ...) ;
@@ -45,6 +45,79 @@
 #define LIB_VERSION 1
 #define LIB_REVISION 0
 
+#define STATEMENT_CACHE_SIZE 32			// prepared statements kept per connection
+#define STATEMENT_COLUMN_MIN_SIZE 64	// text buffer for numbers and dates
+#define DESCRIPTOR_CACHE_SIZE 64		// compiled table descriptions kept per connection
+
+//
+// prepared statement kept by connection
+//
+
+typedef struct MYSQLStatement
+{
+	char					*ms_Query;
+	MYSQL_STMT				*ms_Stmt;
+	FULONG					ms_LastUsed;		// cache tick, oldest entry is replaced
+	FBOOL					ms_Busy;			// result was not released yet
+}MYSQLStatement;
+
+//
+// table description compiled to column list
+//
+
+typedef struct MYSQLDescriptor
+{
+	const FULONG			*md_Descr;
+	char					*md_Select;			// SELECT `column`,... FROM table
+	int						md_SelectLength;
+}MYSQLDescriptor;
+
+//
+// statement cache, stored in SQLConnection->sql_SpecialData
+//
+
+typedef struct MYSQLStatementCache
+{
+	MYSQLStatement			msc_Entries[ STATEMENT_CACHE_SIZE ];
+	MYSQLDescriptor			msc_Descriptors[ DESCRIPTOR_CACHE_SIZE ];
+	FULONG					msc_Tick;
+	FULONG					msc_Hits;
+	FULONG					msc_Misses;
+}MYSQLStatementCache;
+
+//
+// result returned by Query and QueryPrepared
+//
+
+typedef struct MYSQLResult
+{
+	MYSQL_RES				*mr_Result;			// text protocol result
+	MYSQLStatement			*mr_Statement;		// cached statement or NULL
+	MYSQL_STMT				*mr_Stmt;			// prepared statement which delivers rows
+	MYSQL_RES				*mr_Meta;
+	MYSQL_BIND				*mr_Bind;
+	char					**mr_Row;
+	unsigned long			*mr_Lengths;
+	my_bool					*mr_Nulls;
+	unsigned int			mr_Columns;
+}MYSQLResult;
+
+//
+// rows streamed by LoadIterator functions
+//
+
+typedef struct MYSQLIterator
+{
+	const FULONG			*mi_Descr;
+	MYSQLResult				*mi_Result;
+}MYSQLIterator;
+
+MYSQL_ROW FetchRow( struct SQLLibrary *l, MYSQLResult *res );
+void FreeResult( struct SQLLibrary *l, MYSQLResult *res );
+char* StringDuplicate( const char* str );
+static MYSQLStatementCache *StatementCacheStructure( struct SQLLibrary *l );
+static MYSQLResult *StatementQuery( struct SQLLibrary *l, const char *query, const char **params, int paramsNumber, FBOOL store );
+
 /**
  * return version of library
  *
@@ -66,21 +139,14 @@ long GetRevision(void)
 }
 
 /**
- * Load data from database
+ * Get table description compiled to column list. Description is compiled once per connection.
  *
  * @param l pointer to mysql.library structure
- * @param desc pointer to taglist which represent DB to C structure conversion
- * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
- * @param entries pointer to interger where number of loaded entries will be returned
- * @return pointer to new structure or list of structures.
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @return pointer to MYSQLDescriptor or NULL when error appear
  */
-void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
+static MYSQLDescriptor *DescriptorGet( struct SQLLibrary *l, const FULONG *descr )
 {
-	//char tmpQuery[ 1024 ];
-	BufString *tmpQuerybs = BufStringNew();
-	void *firstObject = NULL;
-	DEBUG("[MYSQLLibrary] Load\n");
-	
 	// Check if there was a description structure for the table
 	if( descr == NULL  )
 	{
@@ -94,231 +160,382 @@ void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
 		FERROR("SQLT_TABNAME was not provided!\n");
 		return NULL;
 	}
-
+	
+	MYSQLStatementCache *cache = StatementCacheStructure( l );
+	if( cache == NULL )
+	{
+		return NULL;
+	}
+	
+	// descriptions are static tables, address is the key
+	MYSQLDescriptor *desc = &(cache->msc_Descriptors[ ( ((size_t)descr) >> 3 ) % DESCRIPTOR_CACHE_SIZE ]);
+	if( desc->md_Descr == descr )
+	{
+		return desc;
+	}
+	
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	
 	char tmpvar[ 512 ];
 	int pos = 0;
 	int size = 0;
-	BufStringAdd( tmpQuerybs, "SELECT " );
-	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ]; 
+	BufStringAdd( bs, "SELECT " );
+	const FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
 	
 	while( dptr[0] != SQLT_END )
 	{
 		if( dptr[0] != SQLT_NODE && dptr[0] != SQLT_INIT_FUNCTION )
 		{
-			if( pos == 0 )
-			{
-				size = snprintf( tmpvar, sizeof(tmpvar),"`%s`", (char *)dptr[ 1 ] );
-			}
-			else
-			{
-				size = snprintf( tmpvar, sizeof(tmpvar),",`%s`", (char *)dptr[ 1 ] );
-			}
+			size = snprintf( tmpvar, sizeof(tmpvar), pos == 0 ? "`%s`" : ",`%s`", (char *)dptr[ 1 ] );
 			pos++;
 			
-			BufStringAddSize( tmpQuerybs, tmpvar, size );
+			BufStringAddSize( bs, tmpvar, size );
 		}
 		dptr += 3;
 	}
 	
-	// Check that there is a where query
+	size = snprintf( tmpvar, sizeof(tmpvar), " FROM %s", (char *)descr[ 1 ] );
+	BufStringAddSize( bs, tmpvar, size );
+	
+	if( desc->md_Select != NULL )
+	{
+		FFree( desc->md_Select );
+	}
+	desc->md_Descr = descr;
+	desc->md_Select = bs->bs_Buffer;
+	desc->md_SelectLength = bs->bs_Size;
+	bs->bs_Buffer = NULL;
+	BufStringDelete( bs );
+	
+	DEBUG("[MYSQLLibrary] Description compiled '%s'\n", desc->md_Select );
+	
+	return desc;
+}
 
-	if( where != NULL )
+/**
+ * Run SELECT query for table description. Rows are not stored on client side and must be read by FetchRow.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
+ * @return pointer to MYSQLResult or NULL when error appear
+ */
+static MYSQLResult *DescriptorQuery( struct SQLLibrary *l, const FULONG *descr, const char *where )
+{
+	MYSQLDescriptor *desc = DescriptorGet( l, descr );
+	if( desc == NULL )
 	{
-		size = snprintf( tmpvar, sizeof(tmpvar), " FROM %s WHERE %s", (char *)descr[ 1 ], where );
+		return NULL;
 	}
-	// Just select all
-	else
+	
+	// whole table is taken by statement prepared once per connection
+	if( where == NULL )
 	{
-		size = snprintf( tmpvar, sizeof(tmpvar), " FROM %s", (char *)descr[ 1 ] );
+		return StatementQuery( l, desc->md_Select, NULL, 0, FALSE );
+	}
+	
+	int querysize = desc->md_SelectLength + strlen( where ) + 8;
+	char *query = FCalloc( querysize, sizeof( char ) );
+	if( query == NULL )
+	{
+		return NULL;
 	}
+	querysize = snprintf( query, querysize, "%s WHERE %s", desc->md_Select, where );
 	
-	BufStringAddSize( tmpQuerybs, tmpvar, size );
+	DEBUG("[MYSQLLibrary] SQL SELECT QUERY '%s\n", query );
 	
-	if( mysql_query( l->con.sql_Con, tmpQuerybs->bs_Buffer ) )
+	if( mysql_real_query( l->con.sql_Con, query, querysize ) )
 	{
-		FERROR("Cannot run query: '%s'\n", tmpQuerybs->bs_Buffer );
-		BufStringDelete( tmpQuerybs );
+		FERROR("Cannot run query: '%s'\n", query );
 		FERROR( "[MYSQLLibrary]  %s\n", mysql_error( l->con.sql_Con ) );
+		FFree( query );
 		return NULL;
 	}
+	FFree( query );
 	
-	DEBUG("[MYSQLLibrary] SQL SELECT QUERY '%s\n", tmpQuerybs->bs_Buffer );
-	BufStringDelete( tmpQuerybs );
-
-	MYSQL_RES *result = mysql_store_result( l->con.sql_Con );
-  
+	MYSQL_RES *result = mysql_use_result( l->con.sql_Con );
 	if( result == NULL )
 	{
 		return NULL;
- 	}
-
-	MYSQL_ROW row;
+	}
 	
-	// This is where the data starts!
-	MinNode *node = NULL;
+	MYSQLResult *res = FCalloc( 1, sizeof( MYSQLResult ) );
+	if( res == NULL )
+	{
+		mysql_free_result( result );
+		return NULL;
+	}
+	res->mr_Result = result;
 	
-	int j = 0;
-	*entries = 0;
+	return res;
+}
 
-	//
-	// Receiving data as linked list of objects
-	//
+/**
+ * Get lengths of columns in last fetched row
+ *
+ * @param res pointer to MYSQLResult
+ * @return table of lengths
+ */
+static inline unsigned long *ResultLengths( MYSQLResult *res )
+{
+	if( res->mr_Stmt != NULL )
+	{
+		return res->mr_Lengths;
+	}
+	return mysql_fetch_lengths( res->mr_Result );
+}
 
-	while( ( row = mysql_fetch_row( result ) ) != NULL )
+/**
+ * Convert row to new structure described by table description
+ *
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param row row returned by FetchRow
+ * @param lengths lengths of columns in row
+ * @param node pointer where MinNode of new structure is returned, NULL is returned when description do not contain SQLT_NODE
+ * @return pointer to new structure or NULL when memory cannot be allocated
+ */
+static void *DescriptorRowToObject( const FULONG *descr, MYSQL_ROW row, unsigned long *lengths, MinNode **node )
+{
+	*node = NULL;
+	
+	void *data = FCalloc( 1, descr[ SQL_DATA_STRUCTURE_SIZE ] );
+	if( data == NULL )
 	{
-		unsigned long *lengths = mysql_fetch_lengths(result);
-		(*entries)++;
-		
-		void *data = FCalloc( 1, descr[ SQL_DATA_STRUCTURE_SIZE ] );
-		int dataUsed = 0; // Tell if we need to free data..
-		
-		// Link the first object (which holds the start of the data)
-		if( firstObject == NULL ) firstObject = data;
-		
-		FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure to which will will insert data
-		
-		// first 2 entries inform about table and size, rest information provided is about columns
-		dptr = &descr[ SQL_DATA_STRUCT_START ]; 
-		
-		int i = 0;
-			
-		// While the column is not the last
-		while( dptr[0] != SQLT_END )
+		FERROR("Cannot allocate memory for object\n");
+		return NULL;
+	}
+	
+	FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure to which will will insert data
+	
+	// first 2 entries inform about table and size, rest information provided is about columns
+	const FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
+	
+	int i = 0;
+	
+	// While the column is not the last
+	while( dptr[0] != SQLT_END )
+	{
+		switch( dptr[ 0 ] )
 		{
-			switch( dptr[ 0 ] )
-			{
-				case SQLT_NODE:
+			case SQLT_NODE:
+				*node = (MinNode *)( strptr + dptr[ 2 ] );
+				// node and init function are not columns
+				dptr += 3;
+				continue;
+				
+			case SQLT_INIT_FUNCTION:
+				DEBUG("[MYSQLLibrary] Init function found, calling it\n");
+				if( ((void *)dptr[2]) != NULL )
+				{
+					void (*funcptr)( void * ) = (void *)(void *)dptr[2];
+					funcptr( (void *)data );
+				}
+				dptr += 3;
+				continue;
+				
+			case SQLT_IDINT:	// primary key
+			case SQLT_INT:
+				{
+					int tmp = 0;
+					if( row[ i ] != NULL )
 					{
-						dataUsed = 1;
-						MinNode *locnode = (MinNode *)strptr + dptr[ 2 ];
-						if( node != NULL )
-						{
-							node->mln_Succ = (MinNode *)data;
-							node = locnode;
-						}
-						else node = locnode;
+						tmp = (int)atol( row[ i ] );
 					}
-					break;
-					case SQLT_IDINT:	// primary key
-					case SQLT_INT:
-						{
-							int tmp = 0;
-							if( row[ i ] != NULL )
-							{
-								tmp = (int)atol( row[ i ] );
-							}
-							memcpy( strptr + dptr[ 2 ], &tmp, sizeof( int ) );
-							//
-							
-						}
-						break;
-					case SQLT_STR:
-						{
-							if( row[i] != NULL )
-							{
-								int len = strlen( row[i] );
-								char *tmpval = calloc( len + 1, sizeof( char ) );
-								if( tmpval )
-								{
-									// Copy mysql data
-									memcpy( tmpval, row[i], len );
-									// Add tmpval to string pointer list..
-									memcpy( strptr + dptr[2], &tmpval, sizeof( char * ) );
-								}
-							}
-							else
-							{
-
-							}
-						}
-						break;
-						
-					case SQLT_DATETIME:
-						{
-							//struct tm ltm;
-							//ltm.tm_year += 1900;
-							//ltm.tm_mon ++;
-							struct tm *ltm = (struct tm *)strptr + dptr[ 2 ];
-							if( sscanf( (char *)row[i], "%d-%d-%d %d:%d:%d", &(ltm->tm_year), &(ltm->tm_mon), &(ltm->tm_mday), &(ltm->tm_hour), &(ltm->tm_min), &(ltm->tm_sec) ) != EOF )
-							{
-							}
-							
-							//memcpy( strptr + dptr[ 2 ], &lotime, sizeof( time_t ) );
-							DEBUG("[MYSQLLibrary] TIMESTAMP load %s\n", row[ i ] );
-						}
-						break;
-						
-					case SQLT_DATE:
-						{
-							struct tm *ltm = (struct tm *)strptr + dptr[ 2 ];
-							if( sscanf( (char *)row[i], "%d-%d-%d", &(ltm->tm_year), &(ltm->tm_mon), &(ltm->tm_mday) ) != EOF )
-							{
-								ltm->tm_hour = ltm->tm_min = ltm->tm_sec = 0;
-							}
-							DEBUG("[MYSQLLibrary] DATE load %s\n", row[ i ] );
-							
-							DEBUG("[MYSQLLibrary] Year %d  month %d  day %d\n", ltm->tm_year, ltm->tm_mon, ltm->tm_mday );
-						}
-						break;
-
-					case SQLT_QUAD:
-						{
-							
-						}
-					break;
-					
-					case SQLT_BLOB:
-						{
-							DEBUG("[MYSQLLibrary] Read BLOB\n");
-							ListString *ls = ListStringNew();
-							if( ls != NULL )
-							{
-								ListStringAdd( ls, row[i], lengths[i] );
-								
-								ListStringJoin( ls );
-							}
-							else
-							{
-								FERROR("Cannot allocate memory for BLOB\n");
-							}
-							
-							// copy pointer to this list
-							memcpy( strptr + dptr[2], &ls, sizeof( ListString * ) );
-							//ListStringDelete( ls );
-						}
-					break;
-					
-						case SQLT_INIT_FUNCTION:
-						{
-							DEBUG("[MYSQLLibrary] Init function found, calling it\n");
-							if( ((void *)dptr[2]) != NULL && data != NULL )
-							{
-								void (*funcptr)( void * ) = (void *)(void *)dptr[2];
-								funcptr( (void *)data );
-							}
-						}
-					break;
+					memcpy( strptr + dptr[ 2 ], &tmp, sizeof( int ) );
 				}
+				break;
 				
-				i++;
-				dptr += 3;
+			case SQLT_STR:
+				if( row[i] != NULL )
+				{
+					char *tmpval = FCalloc( lengths[i] + 1, sizeof( char ) );
+					if( tmpval )
+					{
+						// Copy mysql data
+						memcpy( tmpval, row[i], lengths[i] );
+						// Add tmpval to string pointer list..
+						memcpy( strptr + dptr[2], &tmpval, sizeof( char * ) );
+					}
+				}
+				break;
+				
+			case SQLT_DATETIME:
+				if( row[i] != NULL )
+				{
+					struct tm *ltm = (struct tm *)( strptr + dptr[ 2 ] );
+					sscanf( (char *)row[i], "%d-%d-%d %d:%d:%d", &(ltm->tm_year), &(ltm->tm_mon), &(ltm->tm_mday), &(ltm->tm_hour), &(ltm->tm_min), &(ltm->tm_sec) );
+					DEBUG("[MYSQLLibrary] TIMESTAMP load %s\n", row[ i ] );
+				}
+				break;
+				
+			case SQLT_DATE:
+				if( row[i] != NULL )
+				{
+					struct tm *ltm = (struct tm *)( strptr + dptr[ 2 ] );
+					if( sscanf( (char *)row[i], "%d-%d-%d", &(ltm->tm_year), &(ltm->tm_mon), &(ltm->tm_mday) ) != EOF )
+					{
+						ltm->tm_hour = ltm->tm_min = ltm->tm_sec = 0;
+					}
+					DEBUG("[MYSQLLibrary] DATE load %s\n", row[ i ] );
+				}
+				break;
+				
+			case SQLT_BLOB:
+				{
+					DEBUG("[MYSQLLibrary] Read BLOB\n");
+					ListString *ls = ListStringNew();
+					if( ls != NULL )
+					{
+						ListStringAdd( ls, row[i], lengths[i] );
+						ListStringJoin( ls );
+					}
+					else
+					{
+						FERROR("Cannot allocate memory for BLOB\n");
+					}
+					// copy pointer to this list
+					memcpy( strptr + dptr[2], &ls, sizeof( ListString * ) );
+				}
+				break;
+		}
+		
+		i++;
+		dptr += 3;
+	}
+	return data;
+}
+
+/**
+ * Load data from database
+ *
+ * @param l pointer to mysql.library structure
+ * @param desc pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
+{
+	void *firstObject = NULL;
+	MinNode *lastNode = NULL;
+	DEBUG("[MYSQLLibrary] Load\n");
+	
+	*entries = 0;
+	
+	// rows are converted to objects while they arrive, result is not stored by client
+	MYSQLResult *res = DescriptorQuery( l, descr, where );
+	if( res == NULL )
+	{
+		return NULL;
+	}
+	
+	//
+	// Receiving data as linked list of objects
+	//
+	
+	MYSQL_ROW row;
+	while( ( row = FetchRow( l, res ) ) != NULL )
+	{
+		MinNode *node = NULL;
+		void *data = DescriptorRowToObject( descr, row, ResultLengths( res ), &node );
+		if( data == NULL )
+		{
+			continue;
 		}
-		j++;
+		(*entries)++;
+		
 		// We allocated memory without using it..
-		if( dataUsed == 0 ) 
+		if( node == NULL )
 		{
-			if( data == firstObject )
-			{
-				firstObject = NULL;
-			}
 			FFree( data );
+			continue;
+		}
+		
+		if( lastNode != NULL )
+		{
+			lastNode->mln_Succ = (MinNode *)data;
+		}
+		else
+		{
+			firstObject = data;
 		}
+		lastNode = node;
+	}
+	
+	FreeResult( l, res );
+	DEBUG("[MYSQLLibrary] Load END\n");
+	
+	return firstObject;
+}
+
+/**
+ * Start streaming data from database. Rows are read from server one by one by LoadIteratorNext,
+ * connection cannot run other queries until LoadIteratorDelete is called.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
+ * @return pointer to iterator or NULL when error appear
+ */
+void *LoadIteratorNew( struct SQLLibrary *l, FULONG *descr, char *where )
+{
+	MYSQLIterator *it = FCalloc( 1, sizeof( MYSQLIterator ) );
+	if( it == NULL )
+	{
+		return NULL;
+	}
+	
+	it->mi_Descr = descr;
+	if( ( it->mi_Result = DescriptorQuery( l, descr, where ) ) == NULL )
+	{
+		FFree( it );
+		return NULL;
 	}
+	return it;
+}
 
-	mysql_free_result( result );
-	DEBUG("[MYSQLLibrary] Load END\n");
+/**
+ * Get next object from iterator
+ *
+ * @param l pointer to mysql.library structure
+ * @param it pointer to iterator
+ * @return pointer to new structure (released by caller) or NULL when there are no more rows
+ */
+void *LoadIteratorNext( struct SQLLibrary *l, MYSQLIterator *it )
+{
+	if( it == NULL )
+	{
+		return NULL;
+	}
 	
-	return firstObject;
+	MYSQL_ROW row = FetchRow( l, it->mi_Result );
+	if( row == NULL )
+	{
+		return NULL;
+	}
+	
+	MinNode *node;
+	return DescriptorRowToObject( it->mi_Descr, row, ResultLengths( it->mi_Result ), &node );
+}
+
+/**
+ * Delete iterator, rows which were not read are skipped
+ *
+ * @param l pointer to mysql.library structure
+ * @param it pointer to iterator
+ */
+void LoadIteratorDelete( struct SQLLibrary *l, MYSQLIterator *it )
+{
+	if( it == NULL )
+	{
+		return;
+	}
+	FreeResult( l, it->mi_Result );
+	FFree( it );
 }
 
 /**
@@ -1036,9 +1253,9 @@ int NumberOfRecordsCustomQuery( struct SQLLibrary *l, const char *query )
  * @param sel pointer to custom query
  * @return pointer to MYSQL_RES structure
  */
-MYSQL_RES *Query( struct SQLLibrary *l, const char *sel )
+MYSQLResult *Query( struct SQLLibrary *l, const char *sel )
 {
-	MYSQL_RES *result = NULL;
+	MYSQLResult *result = NULL;
 	
 	if( mysql_query( l->con.sql_Con, sel ) )
 	{
@@ -1056,7 +1273,18 @@ MYSQL_RES *Query( struct SQLLibrary *l, const char *sel )
 	
 	DEBUG("[MYSQLLibrary] SELECT QUERY %s\n", sel );
 
-	result = mysql_store_result( l->con.sql_Con );
+	MYSQL_RES *res = mysql_store_result( l->con.sql_Con );
+	if( res == NULL )
+	{
+		return NULL;
+	}
+	
+	if( ( result = FCalloc( 1, sizeof( MYSQLResult ) ) ) == NULL )
+	{
+		mysql_free_result( res );
+		return NULL;
+	}
+	result->mr_Result = res;
 
 	return result;
 }
@@ -1120,32 +1348,476 @@ int QueryWithoutResults( struct SQLLibrary *l, const char *sel )
  * @param res pointer to SQL response
  * @return 0 number of rows
  */
-int NumberOfRows( struct MYSQLLibrary *l, MYSQL_RES *res )
+int NumberOfRows( struct SQLLibrary *l, MYSQLResult *res )
 {
-	return (int)mysql_num_rows( res );
+	if( res == NULL )
+	{
+		return 0;
+	}
+	if( res->mr_Stmt != NULL )
+	{
+		return (int)mysql_stmt_num_rows( res->mr_Stmt );
+	}
+	return (int)mysql_num_rows( res->mr_Result );
 }
 
 /**
  * Fetch MYSQL_ROW from result
  *
  * @param l pointer to mysql.library structure
- * @param res pointer to MYSQL_RES
+ * @param res pointer to MYSQLResult
  * @return MYSQL_ROW when success, otherwise NULL
  */
-MYSQL_ROW FetchRow( struct MYSQLLibrary *l, MYSQL_RES *res )
+MYSQL_ROW FetchRow( struct SQLLibrary *l, MYSQLResult *res )
+{
+	if( res == NULL )
+	{
+		return NULL;
+	}
+	if( res->mr_Stmt == NULL )
+	{
+		return mysql_fetch_row( res->mr_Result );
+	}
+	
+	int err = mysql_stmt_fetch( res->mr_Stmt );
+	if( err != 0 && err != MYSQL_DATA_TRUNCATED )
+	{
+		if( err != MYSQL_NO_DATA )
+		{
+			FERROR("[MYSQLLibrary] Cannot fetch row: %s\n", mysql_stmt_error( res->mr_Stmt ) );
+		}
+		return NULL;
+	}
+	
+	FBOOL rebind = FALSE;
+	unsigned int i;
+	for( i = 0; i < res->mr_Columns; i++ )
+	{
+		MYSQL_BIND *bind = &(res->mr_Bind[ i ]);
+		
+		if( res->mr_Nulls[ i ] )
+		{
+			res->mr_Row[ i ] = NULL;
+			continue;
+		}
+		
+		// value is bigger than buffer, fetch it again
+		if( res->mr_Lengths[ i ] >= bind->buffer_length )
+		{
+			char *nbuf = realloc( bind->buffer, res->mr_Lengths[ i ] + 1 );
+			if( nbuf == NULL )
+			{
+				return NULL;
+			}
+			bind->buffer = nbuf;
+			bind->buffer_length = res->mr_Lengths[ i ] + 1;
+			mysql_stmt_fetch_column( res->mr_Stmt, bind, i, 0 );
+			rebind = TRUE;
+		}
+		
+		res->mr_Row[ i ] = (char *)bind->buffer;
+		res->mr_Row[ i ][ res->mr_Lengths[ i ] ] = 0;
+	}
+	
+	// statement keeps its own copy of bindings, new buffers must be passed to it
+	if( rebind == TRUE )
+	{
+		mysql_stmt_bind_result( res->mr_Stmt, res->mr_Bind );
+	}
+	return res->mr_Row;
+}
+
+/**
+ * Free sql result (MYSQLResult)
+ *
+ * @param l pointer to mysql.library structure
+ * @param res pointer to MYSQLResult
+ */
+void FreeResult( struct SQLLibrary *l, MYSQLResult *res )
+{
+	if( res == NULL )
+	{
+		return;
+	}
+	
+	if( res->mr_Result != NULL )
+	{
+		mysql_free_result( res->mr_Result );
+	}
+	if( res->mr_Meta != NULL )
+	{
+		mysql_free_result( res->mr_Meta );
+	}
+	if( res->mr_Bind != NULL )
+	{
+		unsigned int i;
+		for( i = 0; i < res->mr_Columns; i++ )
+		{
+			FFree( res->mr_Bind[ i ].buffer );
+		}
+		FFree( res->mr_Bind );
+	}
+	if( res->mr_Row != NULL ) FFree( res->mr_Row );
+	if( res->mr_Lengths != NULL ) FFree( res->mr_Lengths );
+	if( res->mr_Nulls != NULL ) FFree( res->mr_Nulls );
+	
+	if( res->mr_Stmt != NULL )
+	{
+		// cached statement stay prepared, temporary one is closed
+		if( res->mr_Statement != NULL )
+		{
+			mysql_stmt_free_result( res->mr_Stmt );
+			res->mr_Statement->ms_Busy = FALSE;
+		}
+		else
+		{
+			mysql_stmt_close( res->mr_Stmt );
+		}
+	}
+	FFree( res );
+}
+
+/**
+ * Release all prepared statements which belong to connection
+ *
+ * @param l pointer to mysql.library structure
+ * @param deleteCache set to TRUE if cache structure should be released too
+ */
+static void StatementCacheFlush( struct SQLLibrary *l, FBOOL deleteCache )
+{
+	MYSQLStatementCache *cache = (MYSQLStatementCache *)l->con.sql_SpecialData;
+	if( cache == NULL )
+	{
+		return;
+	}
+	
+	int i;
+	for( i = 0; i < STATEMENT_CACHE_SIZE; i++ )
+	{
+		MYSQLStatement *st = &(cache->msc_Entries[ i ]);
+		if( st->ms_Stmt != NULL )
+		{
+			mysql_stmt_close( st->ms_Stmt );
+		}
+		if( st->ms_Query != NULL )
+		{
+			FFree( st->ms_Query );
+		}
+		memset( st, 0, sizeof( MYSQLStatement ) );
+	}
+	
+	if( deleteCache == TRUE )
+	{
+		// compiled descriptions do not depend on connection, they are released only with cache
+		for( i = 0; i < DESCRIPTOR_CACHE_SIZE; i++ )
+		{
+			if( cache->msc_Descriptors[ i ].md_Select != NULL )
+			{
+				FFree( cache->msc_Descriptors[ i ].md_Select );
+			}
+		}
+		DEBUG("[MYSQLLibrary] Statement cache hits %lu misses %lu\n", cache->msc_Hits, cache->msc_Misses );
+		FFree( cache );
+		l->con.sql_SpecialData = NULL;
+	}
+}
+
+/**
+ * Prepare new statement
+ *
+ * @param l pointer to mysql.library structure
+ * @param query SQL query with ? placeholders
+ * @return pointer to MYSQL_STMT or NULL when error appear
+ */
+static MYSQL_STMT *StatementPrepare( struct SQLLibrary *l, const char *query )
+{
+	MYSQL_STMT *stmt = mysql_stmt_init( l->con.sql_Con );
+	if( stmt == NULL )
+	{
+		FERROR("[MYSQLLibrary] Cannot create statement\n");
+		return NULL;
+	}
+	
+	if( mysql_stmt_prepare( stmt, query, strlen( query ) ) != 0 )
+	{
+		const char *err = mysql_stmt_error( stmt );
+		FERROR("[MYSQLLibrary] Cannot prepare statement '%s' error: %s\n", query, err );
+		if( strstr( err, "Lost connection to MySQL server" ) != NULL || strstr( err, "MySQL server has gone away" ) != NULL )
+		{
+			l->con.sql_Recconect = TRUE;
+		}
+		mysql_stmt_close( stmt );
+		return NULL;
+	}
+	
+	// max_length of columns is needed to allocate row buffers
+	my_bool updateMaxLength = 1;
+	mysql_stmt_attr_set( stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &updateMaxLength );
+	
+	return stmt;
+}
+
+/**
+ * Get statement cache of connection, cache is created when it do not exist
+ *
+ * @param l pointer to mysql.library structure
+ * @return pointer to MYSQLStatementCache or NULL when memory cannot be allocated
+ */
+static MYSQLStatementCache *StatementCacheStructure( struct SQLLibrary *l )
+{
+	if( l->con.sql_SpecialData == NULL )
+	{
+		l->con.sql_SpecialData = FCalloc( 1, sizeof( MYSQLStatementCache ) );
+	}
+	return (MYSQLStatementCache *)l->con.sql_SpecialData;
+}
+
+/**
+ * Get prepared statement from connection cache or prepare new one
+ *
+ * @param l pointer to mysql.library structure
+ * @param query SQL query with ? placeholders
+ * @return pointer to MYSQLStatement or NULL when statement cannot be cached (still in use or error)
+ */
+static MYSQLStatement *StatementCacheGet( struct SQLLibrary *l, const char *query )
+{
+	MYSQLStatementCache *cache = StatementCacheStructure( l );
+	if( cache == NULL )
+	{
+		return NULL;
+	}
+	
+	cache->msc_Tick++;
+	
+	MYSQLStatement *oldest = NULL;
+	int i;
+	for( i = 0; i < STATEMENT_CACHE_SIZE; i++ )
+	{
+		MYSQLStatement *st = &(cache->msc_Entries[ i ]);
+		if( st->ms_Query != NULL && strcmp( st->ms_Query, query ) == 0 )
+		{
+			if( st->ms_Busy == TRUE )
+			{
+				return NULL;
+			}
+			st->ms_LastUsed = cache->msc_Tick;
+			cache->msc_Hits++;
+			return st;
+		}
+		if( st->ms_Busy == FALSE && ( oldest == NULL || st->ms_LastUsed < oldest->ms_LastUsed ) )
+		{
+			oldest = st;
+		}
+	}
+	
+	cache->msc_Misses++;
+	if( oldest == NULL )
+	{
+		return NULL;
+	}
+	
+	MYSQL_STMT *stmt = StatementPrepare( l, query );
+	if( stmt == NULL )
+	{
+		return NULL;
+	}
+	
+	if( oldest->ms_Stmt != NULL )
+	{
+		mysql_stmt_close( oldest->ms_Stmt );
+	}
+	if( oldest->ms_Query != NULL )
+	{
+		FFree( oldest->ms_Query );
+	}
+	oldest->ms_Stmt = stmt;
+	oldest->ms_Query = StringDuplicate( query );
+	oldest->ms_LastUsed = cache->msc_Tick;
+	
+	return oldest;
+}
+
+/**
+ * Bind parameters and execute statement
+ *
+ * @param stmt pointer to MYSQL_STMT
+ * @param params table of parameters, NULL entry is sent as SQL NULL
+ * @param paramsNumber number of parameters
+ * @return 0 when success, otherwise error number
+ */
+static int StatementExecute( MYSQL_STMT *stmt, const char **params, int paramsNumber )
+{
+	if( (int)mysql_stmt_param_count( stmt ) != paramsNumber )
+	{
+		FERROR("[MYSQLLibrary] Statement expects %lu parameters, received %d\n", mysql_stmt_param_count( stmt ), paramsNumber );
+		return -1;
+	}
+	
+	int size = paramsNumber > 0 ? paramsNumber : 1;
+	MYSQL_BIND bind[ size ];
+	unsigned long lengths[ size ];
+	my_bool nulls[ size ];
+	memset( bind, 0, sizeof( bind ) );
+	
+	int i;
+	for( i = 0; i < paramsNumber; i++ )
+	{
+		nulls[ i ] = ( params[ i ] == NULL );
+		lengths[ i ] = params[ i ] != NULL ? strlen( params[ i ] ) : 0;
+		bind[ i ].buffer_type = MYSQL_TYPE_STRING;
+		bind[ i ].buffer = (void *)params[ i ];
+		bind[ i ].buffer_length = lengths[ i ];
+		bind[ i ].length = &(lengths[ i ]);
+		bind[ i ].is_null = &(nulls[ i ]);
+	}
+	
+	if( paramsNumber > 0 && mysql_stmt_bind_param( stmt, bind ) != 0 )
+	{
+		return -1;
+	}
+	// parameters are copied to network buffer by execute
+	return mysql_stmt_execute( stmt );
+}
+
+/**
+ * Execute cached prepared statement and bind its result
+ *
+ * @param l pointer to mysql.library structure
+ * @param query SQL query with ? placeholders
+ * @param params table of parameters (strings)
+ * @param paramsNumber number of parameters
+ * @param store set to TRUE if rows should be stored on client side, otherwise they are read from server by FetchRow
+ * @return pointer to MYSQLResult or NULL when error appear
+ */
+static MYSQLResult *StatementQuery( struct SQLLibrary *l, const char *query, const char **params, int paramsNumber, FBOOL store )
 {
-	return mysql_fetch_row( res );
+	if( l == NULL || l->con.sql_Con == NULL || query == NULL )
+	{
+		return NULL;
+	}
+	
+	MYSQLResult *res = FCalloc( 1, sizeof( MYSQLResult ) );
+	if( res == NULL )
+	{
+		return NULL;
+	}
+	
+	// statement is already used by not released result, temporary one is used
+	res->mr_Statement = StatementCacheGet( l, query );
+	if( res->mr_Statement != NULL )
+	{
+		res->mr_Stmt = res->mr_Statement->ms_Stmt;
+		res->mr_Statement->ms_Busy = TRUE;
+	}
+	else if( ( res->mr_Stmt = StatementPrepare( l, query ) ) == NULL )
+	{
+		FFree( res );
+		return NULL;
+	}
+	
+	int err = StatementExecute( res->mr_Stmt, params, paramsNumber );
+	
+	// statement could be invalidated by server (reconnect, schema change), prepare it again
+	if( err != 0 && res->mr_Statement != NULL )
+	{
+		DEBUG("[MYSQLLibrary] Preparing statement again: %s\n", mysql_stmt_error( res->mr_Stmt ) );
+		mysql_stmt_close( res->mr_Statement->ms_Stmt );
+		res->mr_Statement->ms_Stmt = res->mr_Stmt = StatementPrepare( l, query );
+		if( res->mr_Stmt == NULL )
+		{
+			FFree( res->mr_Statement->ms_Query );
+			res->mr_Statement->ms_Query = NULL;
+			res->mr_Statement->ms_Busy = FALSE;
+			FFree( res );
+			return NULL;
+		}
+		err = StatementExecute( res->mr_Stmt, params, paramsNumber );
+	}
+	
+	if( err != 0 )
+	{
+		const char *errstr = mysql_stmt_error( res->mr_Stmt );
+		FERROR("[MYSQLLibrary] Cannot execute statement '%s' error: %s\n", query, errstr );
+		if( strstr( errstr, "Lost connection to MySQL server" ) != NULL || strstr( errstr, "MySQL server has gone away" ) != NULL )
+		{
+			l->con.sql_Recconect = TRUE;
+		}
+		FreeResult( l, res );
+		return NULL;
+	}
+	
+	res->mr_Meta = mysql_stmt_result_metadata( res->mr_Stmt );
+	if( res->mr_Meta == NULL )	// statement do not return rows
+	{
+		FreeResult( l, res );
+		return NULL;
+	}
+	
+	// without stored result max_length is not known, buffers are resized by FetchRow
+	if( store == TRUE && mysql_stmt_store_result( res->mr_Stmt ) != 0 )
+	{
+		FERROR("[MYSQLLibrary] Cannot store statement result: %s\n", mysql_stmt_error( res->mr_Stmt ) );
+		FreeResult( l, res );
+		return NULL;
+	}
+	
+	res->mr_Columns = mysql_num_fields( res->mr_Meta );
+	MYSQL_FIELD *fields = mysql_fetch_fields( res->mr_Meta );
+	
+	res->mr_Bind = FCalloc( res->mr_Columns, sizeof( MYSQL_BIND ) );
+	res->mr_Row = FCalloc( res->mr_Columns + 1, sizeof( char * ) );
+	res->mr_Lengths = FCalloc( res->mr_Columns, sizeof( unsigned long ) );
+	res->mr_Nulls = FCalloc( res->mr_Columns, sizeof( my_bool ) );
+	if( res->mr_Bind == NULL || res->mr_Row == NULL || res->mr_Lengths == NULL || res->mr_Nulls == NULL )
+	{
+		FreeResult( l, res );
+		return NULL;
+	}
+	
+	// all columns are delivered as strings, same as in text protocol
+	unsigned int i;
+	for( i = 0; i < res->mr_Columns; i++ )
+	{
+		unsigned long size = fields[ i ].max_length;
+		if( size < STATEMENT_COLUMN_MIN_SIZE )
+		{
+			size = STATEMENT_COLUMN_MIN_SIZE;
+		}
+		res->mr_Bind[ i ].buffer_type = MYSQL_TYPE_STRING;
+		res->mr_Bind[ i ].buffer = FCalloc( size + 1, sizeof( char ) );
+		res->mr_Bind[ i ].buffer_length = size + 1;
+		res->mr_Bind[ i ].length = &(res->mr_Lengths[ i ]);
+		res->mr_Bind[ i ].is_null = &(res->mr_Nulls[ i ]);
+		if( res->mr_Bind[ i ].buffer == NULL )
+		{
+			FreeResult( l, res );
+			return NULL;
+		}
+	}
+	
+	if( mysql_stmt_bind_result( res->mr_Stmt, res->mr_Bind ) != 0 )
+	{
+		FERROR("[MYSQLLibrary] Cannot bind statement result: %s\n", mysql_stmt_error( res->mr_Stmt ) );
+		FreeResult( l, res );
+		return NULL;
+	}
+	
+	return res;
 }
 
 /**
- * Free sql result (MYSQL_RES)
+ * Run query as prepared statement. Statements are prepared once per connection and kept in cache.
+ * Result is handled by NumberOfRows, FetchRow and FreeResult, same as Query result.
  *
  * @param l pointer to mysql.library structure
- * @param res pointer to MYSQL_RES
+ * @param query SQL query with ? placeholders
+ * @param params table of parameters (strings)
+ * @param paramsNumber number of parameters
+ * @return pointer to MYSQLResult or NULL when error appear
  */
-void FreeResult( struct MYSQLLibrary *l, MYSQL_RES *res )
+MYSQLResult *QueryPrepared( struct SQLLibrary *l, const char *query, const char **params, int paramsNumber )
 {
-	mysql_free_result( res );
+	return StatementQuery( l, query, params, paramsNumber, TRUE );
 }
 
 //
@@ -1802,7 +2474,10 @@ char* StringDuplicate( const char* str )
  */
 int Reconnect( struct SQLLibrary *l )
 {
-	void *connection = mysql_real_connect( l->con.sql_Con, l->con.sql_Host, l->con.sql_DBName, l->con.sql_User, l->con.sql_Pass, l->con.sql_Port, NULL, 0 );
+	// statements do not survive new session
+	StatementCacheFlush( l, FALSE );
+	
+	void *connection = mysql_real_connect( l->con.sql_Con, l->con.sql_Host, l->con.sql_User, l->con.sql_Pass, l->con.sql_DBName, l->con.sql_Port, NULL, 0 );
 	if( connection == NULL )
 	{
 		FERROR( "[MYSQLLibrary] Failed to connect to database: '%s'.\n", mysql_error(l->con.sql_Con) );
@@ -1873,6 +2548,7 @@ int Disconnect( struct SQLLibrary *l )
 	if( l->con.sql_User != NULL ){ FFree( l->con.sql_User );  l->con.sql_User = NULL; }
 	if( l->con.sql_Pass != NULL ){ FFree( l->con.sql_Pass );  l->con.sql_Pass = NULL; }
 	
+	StatementCacheFlush( l, TRUE );
 	mysql_close( l->con.sql_Con );
 	return 0;
 }
@@ -1930,6 +2606,10 @@ void *libInit( void *sb )
 	l->Update = dlsym ( l->l_Handle, "Update");
 	l->Delete = dlsym ( l->l_Handle, "Delete");
 	l->Query = dlsym ( l->l_Handle, "Query");
+	l->QueryPrepared = dlsym ( l->l_Handle, "QueryPrepared");
+	l->LoadIteratorNew = dlsym ( l->l_Handle, "LoadIteratorNew");
+	l->LoadIteratorNext = dlsym ( l->l_Handle, "LoadIteratorNext");
+	l->LoadIteratorDelete = dlsym ( l->l_Handle, "LoadIteratorDelete");
 	l->NumberOfRecords = dlsym( l->l_Handle, "NumberOfRecords");
 	l->NumberOfRecordsCustomQuery = dlsym( l->l_Handle, "NumberOfRecordsCustomQuery");
 	l->NumberOfRows = dlsym( l->l_Handle, "NumberOfRows");
@@ -1962,6 +2642,7 @@ void libClose( struct SQLLibrary *l )
 		if( l->con.sql_User != NULL ){ FFree( l->con.sql_User ); l->con.sql_User = NULL; }
 		if( l->con.sql_Pass != NULL ){ FFree( l->con.sql_Pass );  l->con.sql_Pass = NULL; }
 		
+		StatementCacheFlush( l, TRUE );
 		mysql_close( l->con.sql_Con );
 		l->con.sql_Con = NULL;
 	}
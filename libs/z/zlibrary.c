@@ -38,6 +38,10 @@
 #include <util/buffered_string.h>
 #include <system/json/json_converter.h>
 #include <system/user/user_session.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
 
 #define LIB_NAME "z.library"
 #define LIB_VERSION			1
@@ -98,6 +102,102 @@ int Pack( struct ZLibrary *l, const char *name, const char *dir, int cutfilename
 	return PackZip( name, dir, cutfilename, pass, request, numberOfFiles );
 }
 
+/**
+ * Compress memory buffer
+ *
+ * @param l pointer to ZLibrary
+ * @param type compression type ZLIB_COMPRESS_GZIP or ZLIB_COMPRESS_BROTLI
+ * @param level compression level (gzip 1-9, brotli quality 0-11), 0 or less selects best compression
+ * @param src pointer to data which will be compressed
+ * @param srcLen size of source data
+ * @param dst pointer to place where pointer to compressed data will be stored (must be released by FFree)
+ * @param dstLen pointer to place where size of compressed data will be stored
+ * @return 0 when success, otherwise error number
+ */
+
+int Compress( struct ZLibrary *l, int type, int level, const char *src, FULONG srcLen, char **dst, FULONG *dstLen )
+{
+	if( src == NULL || dst == NULL || dstLen == NULL )
+	{
+		return -1;
+	}
+	
+	*dst = NULL;
+	*dstLen = 0;
+	
+	if( type == ZLIB_COMPRESS_GZIP )
+	{
+		z_stream strm;
+		memset( &strm, 0, sizeof( z_stream ) );
+		
+		// 15 + 16 - max window with gzip header and trailer
+		if( deflateInit2( &strm, level > 0 && level < Z_BEST_COMPRESSION ? level : Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY ) != Z_OK )
+		{
+			FERROR("Cannot initialize deflate\n");
+			return -2;
+		}
+		
+		// gzip header and trailer are not included in deflateBound
+		FULONG size = deflateBound( &strm, srcLen ) + 32;
+		char *buf = FMalloc( size );
+		if( buf == NULL )
+		{
+			deflateEnd( &strm );
+			return -3;
+		}
+		
+		strm.next_in = (Bytef *)src;
+		strm.avail_in = srcLen;
+		strm.next_out = (Bytef *)buf;
+		strm.avail_out = size;
+		
+		if( deflate( &strm, Z_FINISH ) != Z_STREAM_END )
+		{
+			FERROR("Cannot compress buffer\n");
+			deflateEnd( &strm );
+			FFree( buf );
+			return -4;
+		}
+		
+		*dstLen = strm.total_out;
+		*dst = buf;
+		deflateEnd( &strm );
+		
+		return 0;
+	}
+#ifdef HAVE_BROTLI
+	else if( type == ZLIB_COMPRESS_BROTLI )
+	{
+		size_t size = BrotliEncoderMaxCompressedSize( srcLen );
+		if( size == 0 )
+		{
+			return -2;
+		}
+		
+		char *buf = FMalloc( size );
+		if( buf == NULL )
+		{
+			return -3;
+		}
+		
+		if( BrotliEncoderCompress( level > 0 && level < BROTLI_MAX_QUALITY ? level : BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, srcLen, (const uint8_t *)src, &size, (uint8_t *)buf ) == BROTLI_FALSE )
+		{
+			FERROR("Cannot compress buffer\n");
+			FFree( buf );
+			return -4;
+		}
+		
+		*dstLen = size;
+		*dst = buf;
+		
+		return 0;
+	}
+#endif
+	
+	// compression type not supported
+	return 1;
+}
+
 //
 // init library
 //
@@ -121,6 +221,7 @@ void *libInit( void *sb )
 
 	l->Unpack = Unpack; //dlsym ( l->l_Handle, "UnpackZIP");
 	l->Pack = Pack;//dlsym ( l->l_Handle, "PackToZIP");
+	l->Compress = Compress;
 
 	//l->ZWebRequest = dlsym( l->l_Handle, "ZWebRequest" );
 	
@@ -34,6 +34,13 @@
 #include <network/http.h>
 #include <system/user/user_session.h>
 
+//
+// compression types used by Compress
+//
+
+#define ZLIB_COMPRESS_GZIP		1
+#define ZLIB_COMPRESS_BROTLI	2
+
 //
 //	library
 //
@@ -52,6 +59,8 @@ typedef struct ZLibrary
 	int                (*Pack)( struct ZLibrary *l, const char *name, const char *dir, int cutfilename, const char *pass, Http *request, int numberOfFiles );
 	int                (*Unpack)( struct ZLibrary *l, const char *name, const char *dir, const char *pass, Http *request );
 	
+	int                (*Compress)( struct ZLibrary *l, int type, int level, const char *src, FULONG srcLen, char **dst, FULONG *dstLen );
+	
 	Http              *(*ZWebRequest)( struct ZLibrary *l, char* func, Http* request );
 } ZLibrary;
 
@@ -0,0 +1,120 @@
+<?php
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+// Persistent worker started by FriendCore PHP pool (core/system/php/php_pool.c)
+//
+// FriendCore sends requests on descriptor 3. Every frame has 12 bytes header
+// (type, request id, payload length - network byte order) followed by payload.
+// Request payload contains script path and arguments separated by \0.
+// Script is run in forked process, so die(), globals and include_once work
+// the same way as with "php script args" call. Without pcntl the script is run
+// in this process and worker quits after request, FriendCore starts new one.
+
+define( 'FRAME_REQUEST', 1 );
+define( 'FRAME_DATA',    2 );
+define( 'FRAME_END',     3 );
+define( 'FRAME_PING',    4 );
+define( 'FRAME_PONG',    5 );
+
+$workerSocket = fopen( 'php://fd/3', 'r+' );
+if( !$workerSocket ) exit( 1 );
+
+function WorkerRead( $sock, $length )
+{
+	$data = '';
+	while( strlen( $data ) < $length )
+	{
+		$r = fread( $sock, $length - strlen( $data ) );
+		if( $r === false || ( $r === '' && feof( $sock ) ) )
+			return false;
+		$data .= $r;
+	}
+	return $data;
+}
+
+function WorkerFrame( $sock, $type, $id, $data )
+{
+	$frame = pack( 'NNN', $type, $id, strlen( $data ) ) . $data;
+	for( $written = 0; $written < strlen( $frame ); $written += $r )
+	{
+		$r = fwrite( $sock, substr( $frame, $written ) );
+		if( !$r ) return false;
+	}
+	return true;
+}
+
+while( ( $workerHeader = WorkerRead( $workerSocket, 12 ) ) !== false )
+{
+	$workerFrame = unpack( 'Ntype/Nid/Nlength', $workerHeader );
+	$workerPayload = $workerFrame[ 'length' ] > 0 ? WorkerRead( $workerSocket, $workerFrame[ 'length' ] ) : '';
+	if( $workerPayload === false ) break;
+
+	if( $workerFrame[ 'type' ] == FRAME_PING )
+	{
+		WorkerFrame( $workerSocket, FRAME_PONG, $workerFrame[ 'id' ], '' );
+		continue;
+	}
+	if( $workerFrame[ 'type' ] != FRAME_REQUEST )
+		continue;
+
+	$workerPid = function_exists( 'pcntl_fork' ) ? pcntl_fork() : -1;
+
+	// Parent waits for script and reports its end
+	if( $workerPid > 0 )
+	{
+		pcntl_waitpid( $workerPid, $workerStatus );
+		$workerCode = pcntl_wifexited( $workerStatus ) ? pcntl_wexitstatus( $workerStatus ) : 255;
+		if( !WorkerFrame( $workerSocket, FRAME_END, $workerFrame[ 'id' ], (string)$workerCode ) )
+			break;
+		continue;
+	}
+
+	// Script is run with the same arguments as from command line
+	$argv = explode( "\0", $workerPayload );
+	$argc = count( $argv );
+	$_SERVER[ 'argv' ] = $argv;
+	$_SERVER[ 'argc' ] = $argc;
+	$workerRequest = $workerFrame[ 'id' ];
+	unset( $workerHeader, $workerFrame, $workerPayload );
+
+	ob_start( function( $buffer ) use ( $workerSocket, $workerRequest )
+	{
+		if( strlen( $buffer ) ) WorkerFrame( $workerSocket, FRAME_DATA, $workerRequest, $buffer );
+		return '';
+	}, 65536 );
+
+	if( $workerPid < 0 )
+	{
+		register_shutdown_function( function() use ( $workerSocket, $workerRequest )
+		{
+			while( ob_get_level() ) ob_end_flush();
+			// FriendCore will start new worker
+			WorkerFrame( $workerSocket, FRAME_END, $workerRequest, '0 quit' );
+		} );
+	}
+
+	include( $argv[ 0 ] );
+	exit( 0 );
+}
+
+?>